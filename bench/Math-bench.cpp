@@ -0,0 +1,227 @@
+// Micro-benchmark for the tuple and matrix math on the ray transform path.
+// Compares the heap-allocated Matrix against Matrix4 and the Simd.h kernels, which
+// are compiled for whatever instruction set simd_name() reports.
+//
+// Usage: jray_bench [iterations]
+
+#include "Tuple.h"
+#include "Vector.h"
+#include "Point.h"
+#include "Matrix.h"
+#include "Matrix4.h"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+
+// Results are summed into this so the compiler can't throw the loops away.
+static volatile double sink;
+
+template <typename F>
+static double time_ns(long iters, F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f(iters);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / iters;
+}
+
+// Scalar versions of the Simd.h kernels, as Tuple and Matrix4 had them before.
+static inline void scalar_add4(const double *a, const double *b, double *out)
+{
+    out[0] = a[0] + b[0]; out[1] = a[1] + b[1]; out[2] = a[2] + b[2]; out[3] = a[3] + b[3];
+}
+static inline void scalar_mul4(const double *a, const double *b, double *out)
+{
+    out[0] = a[0] * b[0]; out[1] = a[1] * b[1]; out[2] = a[2] * b[2]; out[3] = a[3] * b[3];
+}
+static inline void scalar_cross3(const double *a, const double *b, double *out)
+{
+    double x = a[1]*b[2] - a[2]*b[1];
+    double y = a[2]*b[0] - a[0]*b[2];
+    double z = a[0]*b[1] - a[1]*b[0];
+    out[0] = x; out[1] = y; out[2] = z; out[3] = 0;
+}
+static inline double scalar_dot4(const double *a, const double *b)
+{
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
+}
+static inline void scalar_mat4_mul_tuple(const double *m, const double *t, double *out)
+{
+    double r[4];
+    for (int i = 0; i < 4; i++) {
+        r[i] = m[i]*t[0] + m[4+i]*t[1] + m[8+i]*t[2] + m[12+i]*t[3];
+    }
+    out[0] = r[0]; out[1] = r[1]; out[2] = r[2]; out[3] = r[3];
+}
+
+// Loops that run a kernel over an array of independent tuples, the way a batch of rays
+// or shading points would. The arrays are small enough to stay in L1.
+typedef void (*Kernel)(const double *, const double *, double *);
+typedef double (*DotKernel)(const double *, const double *);
+
+static const int batch = 256;
+static double bench_a[batch * 4], bench_b[batch * 4], bench_out[batch * 4];
+
+// Column-major: a rotation about y followed by a translation
+static const double bench_m[16] = {0.8, 0, -0.6, 0,  0, 1, 0, 0,  0.6, 0, 0.8, 0,  1, 2, 3, 1};
+
+static void fill_batch()
+{
+    for (int i = 0; i < batch * 4; i++) {
+        bench_a[i] = (i % 4 == 3) ? 0 : 1 + i * 0.01;
+        bench_b[i] = (i % 4 == 3) ? 0 : 2 - i * 0.003;
+    }
+}
+
+template <Kernel kernel>
+static void run(long n)
+{
+    for (long i = 0; i < n; i += batch) {
+        for (int j = 0; j < batch; j++) {
+            kernel(bench_a + 4*j, bench_b + 4*j, bench_out + 4*j);
+        }
+        // An opaque use of the results, so the compiler can't drop repeated passes
+        asm volatile("" : : "r"(bench_out) : "memory");
+    }
+    sink = bench_out[0];
+}
+
+template <DotKernel kernel>
+static void run_dot(long n)
+{
+    for (long i = 0; i < n; i += batch) {
+        for (int j = 0; j < batch; j++) {
+            bench_out[j] = kernel(bench_a + 4*j, bench_b + 4*j);
+        }
+        asm volatile("" : : "r"(bench_out) : "memory");
+    }
+    sink = bench_out[0];
+}
+
+template <Kernel kernel>
+static void run_mat(long n)
+{
+    for (long i = 0; i < n; i += batch) {
+        for (int j = 0; j < batch; j++) {
+            kernel(bench_m, bench_a + 4*j, bench_out + 4*j);
+        }
+        asm volatile("" : : "r"(bench_out) : "memory");
+    }
+    sink = bench_out[0];
+}
+
+static inline void scalar_mat4_mul_point(const double *m, const double *t, double *out)
+{
+    double r[3];
+    for (int i = 0; i < 3; i++) {
+        r[i] = m[i]*t[0] + m[4+i]*t[1] + m[8+i]*t[2] + m[12+i];
+    }
+    out[0] = r[0]; out[1] = r[1]; out[2] = r[2];
+}
+static inline void simd_mat4_mul_point(const double *m, const double *t, double *out)
+{
+    simd_mat4_mul_xyz(m, t, true, out);
+}
+
+static void report(const std::string &name, double baseline_ns, double simd_ns)
+{
+    std::cout << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << baseline_ns << " ns"
+              << std::setw(10) << simd_ns << " ns"
+              << std::setw(9) << baseline_ns / simd_ns << "x" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    long iters = argc > 1 ? std::atol(argv[1]) : 10000000;
+
+    Matrix M = Matrix::translation(1, 2, 3) * Matrix::rotation_y(0.5) * Matrix::scaling(2, 3, 4);
+    Matrix N = Matrix::rotation_x(0.25) * Matrix::shearing(1, 0, 0, 1, 0, 0);
+    Matrix4 M4 = M;
+    Matrix4 N4 = N;
+
+    std::cout << "SIMD: " << simd_name() << ", " << iters << " iterations" << std::endl;
+    std::cout << std::left << std::setw(22) << "" << std::right
+              << std::setw(13) << "Matrix" << std::setw(13) << "Matrix4" << std::setw(10) << "speedup" << std::endl;
+
+    // Each iteration feeds its result back in, so successive multiplies can't overlap
+    // and we measure latency, which is what a ray transform sees.
+    double mt = time_ns(iters, [&](long n) {
+        Tuple t(1, 2, 3, 1);
+        for (long i = 0; i < n; i++) {
+            t = M * t;
+            t[3] = 1;
+            t /= 16;
+        }
+        sink = t.x();
+    });
+    double m4t = time_ns(iters, [&](long n) {
+        Tuple t(1, 2, 3, 1);
+        for (long i = 0; i < n; i++) {
+            t = M4 * t;
+            t[3] = 1;
+            t /= 16;
+        }
+        sink = t.x();
+    });
+    report("matrix * tuple", mt, m4t);
+
+    double mp = time_ns(iters, [&](long n) {
+        Point p(1, 2, 3);
+        for (long i = 0; i < n; i++) {
+            p = M * p;
+            p = Point(p.x() / 16, p.y() / 16, p.z() / 16);
+        }
+        sink = p.x();
+    });
+    double m4p = time_ns(iters, [&](long n) {
+        Point p(1, 2, 3);
+        for (long i = 0; i < n; i++) {
+            p = M4 * p;
+            p = Point(p.x() / 16, p.y() / 16, p.z() / 16);
+        }
+        sink = p.x();
+    });
+    report("matrix * point", mp, m4p);
+
+    // Matrix * Matrix allocates, so give it a tenth of the iterations. Each product is
+    // multiplied by a rotation again in the next iteration, so the compiler can't hoist
+    // it out of the loop, and the rotation keeps the entries from growing.
+    long mm_iters = iters / 10 > 0 ? iters / 10 : 1;
+    Matrix R = Matrix::rotation_y(0.5) * Matrix::rotation_x(0.25);
+    Matrix4 R4 = R;
+    double mm = time_ns(mm_iters, [&](long n) {
+        Matrix C = M;
+        for (long i = 0; i < n; i++) {
+            C = C * R;
+        }
+        sink = C(0,0);
+    });
+    double m4m = time_ns(mm_iters, [&](long n) {
+        Matrix4 C = M4;
+        for (long i = 0; i < n; i++) {
+            C = C * R4;
+        }
+        sink = C(0,0);
+    });
+    report("matrix * matrix", mm, m4m);
+
+    // The Simd.h kernels against the scalar code they replaced, on bare arrays so the
+    // Tuple validity checks don't dilute the difference. Times are per tuple.
+    std::cout << std::endl << std::left << std::setw(22) << "" << std::right
+              << std::setw(13) << "scalar" << std::setw(13) << simd_name() << std::setw(10) << "speedup" << std::endl;
+
+    fill_batch();
+    report("add", time_ns(iters, run<scalar_add4>), time_ns(iters, run<simd_add4>));
+    report("mul", time_ns(iters, run<scalar_mul4>), time_ns(iters, run<simd_mul4>));
+    report("cross", time_ns(iters, run<scalar_cross3>), time_ns(iters, run<simd_cross3>));
+    report("dot", time_ns(iters, run_dot<scalar_dot4>), time_ns(iters, run_dot<simd_dot4>));
+    report("mat4 * tuple", time_ns(iters, run_mat<scalar_mat4_mul_tuple>),
+                           time_ns(iters, run_mat<simd_mat4_mul_tuple>));
+    report("mat4 * point", time_ns(iters, run_mat<scalar_mat4_mul_point>),
+                           time_ns(iters, run_mat<simd_mat4_mul_point>));
+
+    return 0;
+}
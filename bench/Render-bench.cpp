@@ -0,0 +1,159 @@
+// Thread-scaling benchmark for the trace and shade path.
+// Renders a scene once per thread count with the same TileScheduler the Renderer uses,
+// one ray per pixel with no supersampling or focal blur, and reports primary rays per
+// second and the speedup over one thread. The best of several runs is kept. With
+// "packets", the rays of each tile row are traced PACKET_SIZE at a time as RayPackets.
+// The BVH nodes visited and boxes tested per pixel show how much of the time goes to
+// traversal; set bvh-width in the scene to compare node layouts.
+//
+// Usage: jray_render_bench <scene.yaml> [max_threads] [runs] [packets]
+
+#include "SceneConfig.h"
+#include "TileScheduler.h"
+#include "World.h"
+#include "Camera.h"
+#include "Sampler.h"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+
+// Results are summed into this so the compiler can't throw the renders away.
+static volatile double sink;
+
+static void render_tiles(const World &world, const Camera &camera, TileScheduler &scheduler,
+                         size_t threadnum, bool packets, double &sum_out, BVHCounters &bvh_out)
+{
+    BVHCounters &counters = BVHCounters::current();
+    BVHCounters start = counters;
+    Iset iset;
+    Tile tile;
+    double sum = 0;
+    Sampler &sampler = Sampler::current();
+    sampler.setSeed(camera.getSeed());
+    RayPacket packet;
+    PacketHits hits;
+    while ( scheduler.next(threadnum, tile) ) {
+        for (size_t y = tile.y0; y < tile.y1; y++) {
+            if ( packets ) {
+                for (size_t x = tile.x0; x < tile.x1; x += PACKET_SIZE) {
+                    size_t n = std::min<size_t>(PACKET_SIZE, tile.x1 - x);
+                    for (size_t i = 0; i < n; i++) {
+                        packet.set(i, camera.ray_for_pixel(x + i, y));
+                    }
+                    world.intersectPacket(packet, packetLanes(n), hits);
+                    for (size_t i = 0; i < n; i++) {
+                        sampler.startSample(x + i, y, 0);
+                        Color c = world.colorAtHit(packet.ray(i), hits.hit[i], iset);
+                        iset.clear();
+                        sum += c.x() + c.y() + c.z();
+                    }
+                }
+                continue;
+            }
+            for (size_t x = tile.x0; x < tile.x1; x++) {
+                sampler.startSample(x, y, 0);
+                Color c = world.colorAt(camera.ray_for_pixel(x, y), iset);
+                iset.clear();
+                sum += c.x() + c.y() + c.z();
+            }
+        }
+    }
+    sum_out = sum;
+    bvh_out.add(counters.nodes - start.nodes, counters.boxes - start.boxes);
+}
+
+static double render_seconds(const World &world, const Camera &camera, size_t threads, bool packets,
+                             BVHCounters &bvh)
+{
+    TileScheduler scheduler(camera.hsize, camera.vsize, DEFAULT_TILE_SIZE, threads);
+    std::vector<double> sums(threads, 0);
+    std::vector<BVHCounters> counters(threads);
+    std::vector<std::thread> pool;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < threads; i++) {
+        pool.push_back(std::thread(render_tiles, std::cref(world), std::cref(camera),
+                                   std::ref(scheduler), i, packets, std::ref(sums[i]), std::ref(counters[i])));
+    }
+    for (auto &th : pool) {
+        th.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    for (double s : sums) {
+        sink += s;
+    }
+    bvh = BVHCounters();
+    for (const auto &c : counters) {
+        bvh.add(c.nodes, c.boxes);
+    }
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    if ( argc < 2 ) {
+        std::cerr << "Usage: " << argv[0] << " <scene.yaml> [max_threads] [runs] [packets]" << std::endl;
+        return 1;
+    }
+    size_t max_threads = std::thread::hardware_concurrency();
+    if ( argc > 2 ) {
+        max_threads = std::strtoul(argv[2], nullptr, 10);
+    }
+    if ( max_threads == 0 ) {
+        max_threads = 1;
+    }
+    int runs = ( argc > 3 ) ? std::atoi(argv[3]) : 3;
+    if ( runs < 1 ) {
+        runs = 1;
+    }
+    bool packets = ( argc > 4 && std::string(argv[4]) == "packets" );
+
+    SceneConfig config(argv[1]);
+    World world = config.getWorld();
+    Camera camera = config.getCamera();
+    double rays = (double)camera.hsize * camera.vsize;
+
+    std::vector<size_t> counts;
+    for (size_t n = 1; n < max_threads; n *= 2) {
+        counts.push_back(n);
+    }
+    counts.push_back(max_threads);
+
+    std::cout << camera.hsize << "x" << camera.vsize << ", " << std::thread::hardware_concurrency()
+              << " hardware threads, best of " << runs;
+    if ( packets ) {
+        std::cout << ", packets of " << PACKET_SIZE;
+    }
+    std::cout << std::endl;
+    std::cout << "threads   time (s)   Krays/s   speedup   efficiency" << std::endl;
+    std::cout << std::fixed;
+    double base = 0;
+    BVHCounters bvh;
+    for (size_t n : counts) {
+        double best = 0;
+        for (int i = 0; i < runs; i++) {
+            double s = render_seconds(world, camera, n, packets, bvh);
+            if ( i == 0 || s < best ) {
+                best = s;
+            }
+        }
+        if ( n == 1 ) {
+            base = best;
+        }
+        double speedup = base / best;
+        std::cout << std::setw(7) << n
+                  << std::setprecision(3) << std::setw(11) << best
+                  << std::setprecision(1) << std::setw(10) << rays / best / 1e3
+                  << std::setprecision(2) << std::setw(10) << speedup
+                  << std::setprecision(2) << std::setw(13) << speedup / n << std::endl;
+    }
+    std::cout << std::setprecision(1) << "BVH per pixel: " << bvh.nodes / rays << " nodes visited, "
+              << bvh.boxes / rays << " boxes tested" << std::endl;
+    return 0;
+}
@@ -27,8 +27,13 @@ void BoundingBox::add(const Point &pt)
         max[2] = pt.z();
 }
 
+// An empty box adds nothing. Its corners are at +inf and -inf, so adding them as points
+// would stretch this box out to infinity.
 void BoundingBox::add(const BoundingBox &bb)
 {
+    if ( bb.isEmpty() ) {
+        return;
+    }
     add(bb.min);
     add(bb.max);
 }
@@ -45,8 +50,33 @@ bool BoundingBox::contains(const BoundingBox &bb) const
     return ( contains(bb.min) && contains(bb.max) );
 }
 
-BoundingBox BoundingBox::transform(const Matrix &M)
+bool BoundingBox::isFinite() const
+{
+    return ( std::isfinite(min.x()) && std::isfinite(min.y()) && std::isfinite(min.z()) &&
+             std::isfinite(max.x()) && std::isfinite(max.y()) && std::isfinite(max.z()) );
+}
+
+double BoundingBox::surfaceArea() const
+{
+    if ( isEmpty() ) {
+        return 0;
+    }
+    double dx = max.x() - min.x();
+    double dy = max.y() - min.y();
+    double dz = max.z() - min.z();
+    return 2 * (dx*dy + dy*dz + dz*dx);
+}
+
+BoundingBox BoundingBox::transform(const Matrix4 &M)
 {
+    // Infinite corners would come out NaN (inf * 0), so an unbounded box stays unbounded
+    // in every direction, and an empty one empty
+    if ( isEmpty() ) {
+        return BoundingBox();
+    }
+    if ( !isFinite() ) {
+        return BoundingBox(minusInfinityPoint, infinityPoint);
+    }
     Point p1, p2, p3, p4, p5, p6, p7, p8;
     p1 = min;
     p2 = Point(min.x(), min.y(), max.z());
@@ -125,6 +155,19 @@ bool BoundingBox::intersects(const Ray &ray) const
     return true;
 }
 
+bool BoundingBox::intersects(const Ray &ray, double max_t) const
+{
+    std::pair<double,double> xt, yt, zt;
+    xt = check_axis(ray.origin.x(), ray.dir.x(), min.x(), max.x() );
+    yt = check_axis(ray.origin.y(), ray.dir.y(), min.y(), max.y() );
+    zt = check_axis(ray.origin.z(), ray.dir.z(), min.z(), max.z() );
+
+    double tmin = std::max({xt.first, yt.first, zt.first});
+    double tmax = std::min({xt.second, yt.second, zt.second});
+
+    return ( tmin <= tmax && tmax > 0 && tmin < max_t );
+}
+
 inline std::pair<double,double> BoundingBox::check_axis(double origin, double direction, double min, double max) const
 {
     double tmin_numerator = (min - origin);
@@ -24,9 +24,17 @@ public:
     bool contains(const Point &pt) const;
     bool contains(const BoundingBox &bb) const;
 
-    BoundingBox transform(const Matrix &M);
+    BoundingBox transform(const Matrix4 &M);
     std::pair<BoundingBox,BoundingBox> splitBounds() const;
+    // An empty box has min > max. A box around a plane has infinite extent.
+    bool isEmpty() const { return min.x() > max.x() || min.y() > max.y() || min.z() > max.z(); }
+    bool isFinite() const;
+    double surfaceArea() const;
+    Point centroid() const { return Point((min.x() + max.x()) / 2, (min.y() + max.y()) / 2, (min.z() + max.z()) / 2); }
     bool intersects(const Ray &ray) const;
+    // Like intersects(ray), but also misses if the box lies entirely behind
+    // the ray origin or begins beyond max_t
+    bool intersects(const Ray &ray, double max_t) const;
     Point min, max;
 
 private:
@@ -2,16 +2,13 @@
 
 bool CSG::localIntersect(const Ray &ray, Iset &iset_out) 
 {
-    Iset leftxs;
-    Iset rightxs;
-    left->intersect(ray, leftxs);
-    right->intersect(ray, rightxs);
-
-    Iset xs;
-    std::merge(leftxs.begin(), leftxs.end(),
-               rightxs.begin(), rightxs.end(),
-               std::inserter(xs, xs.begin()));
-    return filter_intersections(xs, iset_out);
+    // Append the children's intersections to the end of iset_out, sort just that
+    // part of the list, then filter it in place. This way we never need temporary lists.
+    size_t first = iset_out.size();
+    left->intersect(ray, iset_out);
+    right->intersect(ray, iset_out);
+    iset_out.sort_from(first);
+    return filter_intersections(iset_out, first);
 }
 
 Vector CSG::localNormalAt(const Point &obj_p, const Intersection *const ip) const
@@ -19,16 +16,23 @@ Vector CSG::localNormalAt(const Point &obj_p, const Intersection *const ip) cons
     throw std::logic_error("Cannot call localNormalAt on CSG");
 }
 
-bool CSG::filter_intersections(const Iset &in, Iset &out)
+// Filters the (sorted) intersections starting at index first, keeping only those allowed
+// by our CSG operation. Kept intersections are compacted and the rest of the list is dropped.
+bool CSG::filter_intersections(Iset &xs, size_t first)
 {
     bool inl = false;
     bool inr = false;
     bool ret = false;
+    size_t kept = first;
 
-    for (auto i: in) {
+    for (size_t n = first; n < xs.size(); n++) {
+        const Intersection &i = xs[n];
         bool lhit = left->includes(i.obj);
         if ( intersection_allowed(lhit, inl, inr) ) {
-            out.insert(i);
+            if (kept != n) {
+                xs[kept] = i;
+            }
+            kept++;
             ret = true;
         }
         if (lhit) {
@@ -37,6 +41,7 @@ bool CSG::filter_intersections(const Iset &in, Iset &out)
             inr = !inr;
         }
     }
+    xs.truncate(kept);
     return ret;
 }
 
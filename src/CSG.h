@@ -23,7 +23,7 @@ public:
         ret->addChildren(left, right);
         return ret;
     }
-    static std::shared_ptr<CSG> make(unsigned short op, std::shared_ptr<Shape> left, std::shared_ptr<Shape> right, const Matrix &M)
+    static std::shared_ptr<CSG> make(unsigned short op, std::shared_ptr<Shape> left, std::shared_ptr<Shape> right, const Matrix4 &M)
     {
         std::shared_ptr<CSG> ret(new CSG(op, M));
         ret->addChildren(left, right);
@@ -41,7 +41,7 @@ public:
         return box;
     }
 
-    bool includes(const std::shared_ptr<Shape> &shape) {
+    bool includes(const Shape *shape) const override {
         if ( left->includes(shape) )
             return true;
         else if ( right->includes(shape) )
@@ -54,13 +54,17 @@ public:
             c->divide(threshold);
         }
     }
+    void divideSAH(size_t max_leaf_size) override {
+        for (auto c : { left, right } ) {
+            c->divideSAH(max_leaf_size);
+        }
+    }
 
     void addChildren(const std::shared_ptr<Shape> &l, const std::shared_ptr<Shape> &r) {
         left = l;
         right = r;
-        auto selfptr = shared_from_this();
-        left->setParent(selfptr);
-        right->setParent(selfptr);
+        left->setParent(this);
+        right->setParent(this);
         bbox.add(left->parentBounds());
         bbox.add(right->parentBounds());
 
@@ -76,8 +80,7 @@ public:
         } else {
             throw std::logic_error("Attempted to add third child shape to CSG");
         }
-        auto selfptr = shared_from_this();
-        s->setParent(selfptr);
+        s->setParent(this);
         bbox.add(s->parentBounds());
         
         update_parent_chain_bbox();
@@ -89,17 +92,16 @@ public:
 
 private:
     // save initialization of left, right for the public shared_ptr make() constructors,
-    // because we first need a shared_ptr to this object in order to set their parent
+    // which add them with addChildren() once this object is constructed
     CSG(unsigned short op) : Shape(), op(op) { }
-    CSG(unsigned short op, const Matrix &M) : Shape(M), op(op) { }
-    bool filter_intersections(const Iset &in, Iset &out);
+    CSG(unsigned short op, const Matrix4 &M) : Shape(M), op(op) { }
+    bool filter_intersections(Iset &xs, size_t first);
     bool intersection_allowed(bool lhit, bool inl, bool inr);
 
     // updates bbox on each parent in the chain
     void update_parent_chain_bbox() {
-        auto selfptr = shared_from_this();
-        auto p = selfptr;
-        auto c = selfptr;
+        Shape *p = this;
+        Shape *c = this;
         BoundingBox pbounds;
         while ( (p = p->getParent()) != nullptr) {
             pbounds = pbounds.transform(c->getTransform()); // get bounding box in next parent space
@@ -1,30 +1,30 @@
-#include <random>
 #include "Camera.h"
+#include "Sampler.h"
 #include "math.h"
 
 
-Matrix Camera::view_transform(const Point &from, const Point &to, const Vector &up)
+Matrix4 Camera::view_transform(const Point &from, const Point &to, const Vector &up)
 {
     Vector forward = normalize(to - from);
     Vector upn = normalize(up);
     Vector left = cross(forward, upn);
     Vector true_up = cross(left, forward);
 
-    Matrix orientation(4,4, { left.x(),      left.y(),     left.z(),    0,
-                              true_up.x(),   true_up.y(),  true_up.z(), 0,
-                              -forward.x(), -forward.y(), -forward.z(), 0,
-                              0,             0,            0,           1 });
+    Matrix4 orientation({ left.x(),      left.y(),     left.z(),    0,
+                          true_up.x(),   true_up.y(),  true_up.z(), 0,
+                          -forward.x(), -forward.y(), -forward.z(), 0,
+                          0,             0,            0,           1 });
     
-    return orientation * Matrix::translation(-from.x(), -from.y(), -from.z());
+    return orientation * Matrix4::translation(-from.x(), -from.y(), -from.z());
 }
 
 void Camera::setTransform(const Point &from, const Point &to, const Vector &up)
 {
-    Matrix T = Camera::view_transform(from, to, up);
+    Matrix4 T = Camera::view_transform(from, to, up);
     transform = T;
     inverse_transform = T.inverse();
 }
-void Camera::setTransform(const Matrix &m)
+void Camera::setTransform(const Matrix4 &m)
 {
     transform = m;
     inverse_transform = m.inverse();
@@ -47,11 +47,10 @@ Ray Camera::ray_for_pixel(const size_t px, const size_t py, double px_offset, do
 
     Point origin;
     if (aperture_radius > 0) { // implement focal blur
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_real_distribution<> dis(-aperture_radius, aperture_radius);
-        double aperture_x_offset = dis(gen);
-        double aperture_y_offset = dis(gen);
+        double lens_u, lens_v;
+        Sampler::current().get2D(lens_u, lens_v);
+        double aperture_x_offset = (2 * lens_u - 1) * aperture_radius;
+        double aperture_y_offset = (2 * lens_v - 1) * aperture_radius;
         origin = inverse_transform * Point(aperture_x_offset, aperture_y_offset, 0);
     }
     else {
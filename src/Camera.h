@@ -2,11 +2,18 @@
 
 #include "Point.h"
 #include "Vector.h"
-#include "Matrix.h"
+#include "Matrix4.h"
 #include "Ray.h"
+#include "Sampler.h"
+#include "ToneMap.h"
+#include "ImageIO.h"
+#include "Denoiser.h"
 #define DEFAULT_WIDTH 800
 #define DEFAULT_HEIGHT 600
 #define DEFAULT_FOV 1.05
+#define DEFAULT_ADAPTIVE_MIN_SAMPLES 4
+#define DEFAULT_ADAPTIVE_CONTRAST 0.1
+#define DEFAULT_PREVIEW_SCALE 8
 
 class Camera {
 public:
@@ -14,13 +21,25 @@ public:
     Camera(size_t width, size_t height, double fov) : 
                                                         hsize(width),
                                                         vsize(height),
-                                                        transform(Matrix::identity(4)),
-                                                        inverse_transform(Matrix::identity(4)),
+                                                        transform(Matrix4::identity()),
+                                                        inverse_transform(Matrix4::identity()),
                                                         fov(fov),
                                                         aperture_radius(0),
                                                         focal_length(1),
                                                         focal_samples(4),
-                                                        supersampling(1)
+                                                        supersampling(1),
+                                                        adaptive_threshold(0),
+                                                        adaptive_min_samples(DEFAULT_ADAPTIVE_MIN_SAMPLES),
+                                                        adaptive_contrast(DEFAULT_ADAPTIVE_CONTRAST),
+                                                        progressive(false),
+                                                        preview_scale(DEFAULT_PREVIEW_SCALE),
+                                                        time_limit(0),
+                                                        seed(DEFAULT_SAMPLER_SEED),
+                                                        aovs(false),
+                                                        exr_compression(ExrCompression::zip),
+                                                        denoise(false),
+                                                        denoise_radius(DEFAULT_DENOISE_RADIUS),
+                                                        packets(false)
     {
         setPixelSizeForFov(fov);
     }
@@ -33,25 +52,76 @@ public:
 
     Camera() : Camera(DEFAULT_WIDTH, DEFAULT_HEIGHT, DEFAULT_FOV) { }
 
-    static Matrix view_transform(const Point &from, const Point &to, const Vector &up);
+    static Matrix4 view_transform(const Point &from, const Point &to, const Vector &up);
 
     void setTransform(const Point &from, const Point &to, const Vector &up);
-    void setTransform(const Matrix &m);
+    void setTransform(const Matrix4 &m);
     void setFov(double f) { fov = f; setPixelSizeForFov(f); }
     void setFocalLength(double fl) { focal_length = fl; setPixelSizeForFov(fov); }
     void setAperture(double radius) { aperture_radius = radius; }
     void setFocalSamples(size_t samples) { focal_samples = samples; }
     void setSupersamplingLevel(size_t samples) { supersampling = samples; }
-    double getFov() { return fov; }
-    double getPixelSize() { return pixel_size; }
+    double getFov() const { return fov; }
+    double getPixelSize() const { return pixel_size; }
     // only use focal samples if we're using focal blur.
-    size_t getFocalSamples() {
+    size_t getFocalSamples() const {
         if ( aperture_radius > 0 )
             return focal_samples;
         else
             return 1; 
     }
-    size_t getSupersamplingLevel() { return supersampling; }
+    size_t getSupersamplingLevel() const { return supersampling; }
+    // Adaptive sampling: every pixel takes at least min_samples samples, and then stops as
+    // soon as the standard error of its color is at most threshold (in [0,1] color units).
+    // A pixel that then differs from any of its four neighbors by more than contrast in any
+    // channel takes every sample, since its first few may have missed an edge.
+    // supersampling x focal samples is the most it takes. A threshold of 0 turns it off.
+    void setAdaptiveSampling(double threshold, size_t min_samples = DEFAULT_ADAPTIVE_MIN_SAMPLES,
+                             double contrast = DEFAULT_ADAPTIVE_CONTRAST) {
+        adaptive_threshold = threshold;
+        adaptive_min_samples = min_samples;
+        adaptive_contrast = contrast;
+    }
+    bool isAdaptive() const { return adaptive_threshold > 0; }
+    double getAdaptiveThreshold() const { return adaptive_threshold; }
+    size_t getAdaptiveMinSamples() const { return adaptive_min_samples; }
+    double getAdaptiveContrast() const { return adaptive_contrast; }
+    // Progressive rendering: the image is rendered in passes of one sample per pixel,
+    // up to supersampling x focal samples, each pass refining the one before. The first
+    // pass is a preview at 1/preview_scale resolution (1 for none). A time limit in
+    // seconds (0 for none) stops the render early, after which every pixel keeps the
+    // samples it has.
+    void setProgressive(bool enabled) { progressive = enabled; }
+    void setPreviewScale(size_t scale) { preview_scale = scale; }
+    void setTimeLimit(double seconds) { time_limit = seconds; }
+    bool isProgressive() const { return progressive; }
+    size_t getPreviewScale() const { return preview_scale; }
+    double getTimeLimit() const { return time_limit; }
+    // Seed of the Sampler streams. Renders with the same seed come out the same.
+    void setSeed(uint64_t s) { seed = s; }
+    uint64_t getSeed() const { return seed; }
+    // How the linear framebuffer is turned into the displayed and saved image
+    void setToneMap(const ToneMap &tm) { tone_map = tm; }
+    const ToneMap& getToneMap() const { return tone_map; }
+    // Also record the depth, normal and albedo of each sample's first hit, written to
+    // EXR and PFM output alongside the color (see ImageIO.h)
+    void setAovs(bool enabled) { aovs = enabled; }
+    bool hasAovs() const { return aovs; }
+    void setExrCompression(ExrCompression c) { exr_compression = c; }
+    ExrCompression getExrCompression() const { return exr_compression; }
+    // Run the Denoiser over the finished image (and after every progressive pass). It
+    // needs the AOVs, which are recorded whenever this is on.
+    void setDenoise(bool enabled, size_t radius = DEFAULT_DENOISE_RADIUS) {
+        denoise = enabled;
+        denoise_radius = radius;
+    }
+    bool isDenoised() const { return denoise; }
+    size_t getDenoiseRadius() const { return denoise_radius; }
+    // Trace the camera rays of neighbouring pixels together as RayPackets, wherever
+    // each pixel takes one sample at a time: progressive passes and previews, and renders
+    // without supersampling or focal blur. The image is the same either way.
+    void setPackets(bool enabled) { packets = enabled; }
+    bool usesPackets() const { return packets; }
     void setPixelSize(double ps) { pixel_size = ps; }
     void setPixelSizeForFov(double fov) {
         // Compute pixel_size
@@ -73,9 +143,9 @@ public:
     size_t vsize;
     // The transform matrix represents how the world is transformed in front
     // of the camera. We apply its inverse when we generate the actual rays.
-    Matrix transform;
+    Matrix4 transform;
     // Cache inverse transform: it's an expensive operation
-    Matrix inverse_transform;
+    Matrix4 inverse_transform;
 
 private:
     double fov;
@@ -87,4 +157,17 @@ private:
     double focal_length;
     size_t focal_samples;
     size_t supersampling;
+    double adaptive_threshold;
+    size_t adaptive_min_samples;
+    double adaptive_contrast;
+    bool progressive;
+    size_t preview_scale;
+    double time_limit;
+    uint64_t seed;
+    ToneMap tone_map;
+    bool aovs;
+    ExrCompression exr_compression;
+    bool denoise;
+    size_t denoise_radius;
+    bool packets;
 };
\ No newline at end of file
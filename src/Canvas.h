@@ -1,18 +1,22 @@
 #pragma once
 
 #include <iostream>
-#include <gtkmm.h>
-#include <gdkmm/pixbuf.h>
 #include <exception>
 #include <mutex>
+#include <vector>
 #include "util.h"
 #include "Point.h"
 #include "Color.h"
+#include "Framebuffer.h"
+#include "ToneMap.h"
 
 struct pixel {
     unsigned char r = 0, g = 0, b = 0;
 };
 
+// Canvas is an 8-bit RGB image: the displayed and saved copy of a render, or a texture
+// loaded from a file. Rows are stored top to bottom with no padding, so data() can be
+// handed straight to an image library (the GUI wraps it in a GdkPixbuf).
 class Canvas
 {
 public:
@@ -20,27 +24,24 @@ public:
     Canvas(const std::string &filename);
     Canvas(const Canvas& obj);
     Canvas& operator=(const Canvas& rhs);
-    ~Canvas();
 
-   void put_pixel(int img_x, int img_y, guchar red, guchar green, guchar blue);
+   void put_pixel(int img_x, int img_y, unsigned char red, unsigned char green, unsigned char blue);
    void put_pixel(Point p, Color c );
+   // Tone maps the rectangle [x0,x1) x [y0,y1) of fb into the canvas. Takes no lock:
+   // threads may convert disjoint rectangles at the same time.
+   void put_framebuffer(const Framebuffer &fb, const ToneMap &tm, size_t x0, size_t y0, size_t x1, size_t y1);
    Color get_pixel(int img_x, int img_y) const;
    int get_width() const { return width; }
    int get_height() const { return height; }
+   // Every pixel set to c
+   void fill(const Color &c);
    void save(std::string filename);
-   Glib::RefPtr<Gdk::Pixbuf> getPixbuf() {
-       return pixbuf;
-   }
+   unsigned char* data() { return (unsigned char*) pixels.data(); }
+   const unsigned char* data() const { return (const unsigned char*) pixels.data(); }
 private:
     int width;
     int height;
 
-    Glib::RefPtr<Gdk::Pixbuf> pixbuf;
-    pixel **pixbuf_data;
+    std::vector<pixel> pixels;
     mutable std::mutex m_mutex;
-
-    // For initializing pixbuf_data:
-    // Creates an array of N=height pointers, each one pointing at the start of a pixel row
-    // in the given GdkPixbuf.
-    pixel** init_pixbuf_data_ptrs(const Glib::RefPtr<Gdk::Pixbuf> &pb, size_t width, size_t height);
-};
\ No newline at end of file
+};
@@ -19,7 +19,7 @@ bool Cone::localIntersect(const Ray &ray, Iset &iset_out)
         } else {
             hit = true;
             double t = -c / (2*b);
-            iset_out.insert(Intersection(t, shared_from_this()));
+            iset_out.insert(Intersection(t, this));
             return true;
         }
     }
@@ -40,12 +40,12 @@ bool Cone::localIntersect(const Ray &ray, Iset &iset_out)
     double y0 = ray.origin.y() + t0 * ray.dir.y();
     if ( min_y < y0 && y0 < max_y ) {
         hit = true;
-        iset_out.insert(Intersection(t0, shared_from_this()));
+        iset_out.insert(Intersection(t0, this));
     }
     double y1 = ray.origin.y() + t1 * ray.dir.y();
     if ( min_y < y1 && y1 < max_y ) {
         hit = true;
-        iset_out.insert(Intersection(t1, shared_from_this()));
+        iset_out.insert(Intersection(t1, this));
     }
 
     return ( hit || caphit );
@@ -91,14 +91,14 @@ inline bool Cone::intersect_caps(const Ray &ray, Iset &iset_out)
     double t = (min_y - ray.origin.y()) / ray.dir.y();
     if (check_cap(ray, t, min_y)) {
         hit = true;
-        iset_out.insert(Intersection(t, shared_from_this()));
+        iset_out.insert(Intersection(t, this));
     }
 
     // do the same for top of cone (plane where y=max_y)
     t = (max_y - ray.origin.y()) / ray.dir.y();
     if (check_cap(ray, t, max_y)) {
         hit = true;
-        iset_out.insert(Intersection(t, shared_from_this()));
+        iset_out.insert(Intersection(t, this));
     }
     return hit;
 }
\ No newline at end of file
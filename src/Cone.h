@@ -14,17 +14,17 @@ public:
         std::shared_ptr<Shape> ret(new Cone());
         return ret;
     }
-    static std::shared_ptr<Shape> make(const Matrix &M)
+    static std::shared_ptr<Shape> make(const Matrix4 &M)
     {
         std::shared_ptr<Shape> ret(new Cone(M));
         return ret;
     }
-    static std::shared_ptr<Shape> make(const Matrix &M, double min_y, double max_y)
+    static std::shared_ptr<Shape> make(const Matrix4 &M, double min_y, double max_y)
     {
         std::shared_ptr<Shape> ret(new Cone(M, min_y, max_y));
         return ret;
     }
-    static std::shared_ptr<Shape> make(const Matrix &M, double min_y, double max_y, bool closed)
+    static std::shared_ptr<Shape> make(const Matrix4 &M, double min_y, double max_y, bool closed)
     {
         std::shared_ptr<Shape> ret(new Cone(M, min_y, max_y, closed));
         return ret;
@@ -48,7 +48,7 @@ public:
 
     void divide(size_t threshold) override { }
 
-    bool includes(const std::shared_ptr<Shape> &shape) { return shape == shared_from_this(); }
+    bool includes(const Shape *shape) const override { return shape == this; }
 
     double minimum() const { return min_y; }
     void minimum(double m) { min_y = m; }
@@ -64,11 +64,11 @@ private:
                  is_closed(false) { }
     Cone(double min_y, double max_y) : Shape(), min_y(min_y), max_y(max_y), is_closed(false) { }
     Cone(double min_y, double max_y, bool closed) : Shape(), min_y(min_y), max_y(max_y), is_closed(closed) { }
-    Cone(const Matrix &M) : Shape(M),
+    Cone(const Matrix4 &M) : Shape(M),
                                 min_y(-std::numeric_limits<double>::infinity()),
                                 max_y(std::numeric_limits<double>::infinity()) { }
-    Cone(const Matrix &M, double min_y, double max_y) : Shape(M), min_y(min_y), max_y(max_y), is_closed(false) { }
-    Cone(const Matrix &M, double min_y, double max_y, bool closed) : Shape(M), min_y(min_y), max_y(max_y), is_closed(closed) { }
+    Cone(const Matrix4 &M, double min_y, double max_y) : Shape(M), min_y(min_y), max_y(max_y), is_closed(false) { }
+    Cone(const Matrix4 &M, double min_y, double max_y, bool closed) : Shape(M), min_y(min_y), max_y(max_y), is_closed(closed) { }
 
     inline bool check_cap(const Ray &ray, double t, double y);
     inline bool intersect_caps(const Ray &ray, Iset &iset_out);
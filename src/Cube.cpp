@@ -3,6 +3,7 @@
 #include <math.h>
 #include <memory>
 #include <utility>
+#include <limits>
 
 // Basic idea: consider a cube as 3 pairs of parallel planes
 // that are one unit away from the origin in object space.
@@ -10,10 +11,79 @@
 // The two intersections on a cube will be the largest minimum
 // and the smallest maximum t value for each of x, y, z 
 bool Cube::localIntersect(const Ray &ray, Iset &iset_out) 
+{
+    double tmin, tmax;
+    if ( !slabs(ray, tmin, tmax) ) {
+        return false; // iset_out remains empty
+    }
+
+    iset_out.insert(Intersection(tmin, this));
+    iset_out.insert(Intersection(tmax, this));
+    return true;
+}
+
+bool Cube::localIntersectClosest(const Ray &ray, Intersection &hit_out)
+{
+    double tmin, tmax;
+    if ( !slabs(ray, tmin, tmax) ) {
+        return false;
+    }
+    double t = (tmin > 0) ? tmin : tmax;
+    if ( t > 0 && t < hit_out.t ) {
+        hit_out = Intersection(t, this);
+        return true;
+    }
+    return false;
+}
+
+bool Cube::localIntersectAny(const Ray &ray, double max_t)
+{
+    double tmin, tmax;
+    if ( !slabs(ray, tmin, tmax) ) {
+        return false;
+    }
+    return ( tmin > 0 && tmin < max_t ) || ( tmax > 0 && tmax < max_t );
+}
+
+// slabs() for every lane at once
+PacketMask Cube::localIntersectPacket(const RayPacket &p, PacketMask lanes, PacketHits &hits)
+{
+    const double *o[3] = { p.ox, p.oy, p.oz };
+    const double *d[3] = { p.dx, p.dy, p.dz };
+    double tmin[PACKET_SIZE], tmax[PACKET_SIZE];
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        tmin[i] = -std::numeric_limits<double>::infinity();
+        tmax[i] = std::numeric_limits<double>::infinity();
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        for (int i = 0; i < PACKET_SIZE; i++) {
+            double t0 = (-1 - o[axis][i]) / d[axis][i];
+            double t1 = (1 - o[axis][i]) / d[axis][i];
+            double lo = (t0 > t1) ? t1 : t0;
+            double hi = (t0 > t1) ? t0 : t1;
+            tmin[i] = std::max(tmin[i], lo);
+            tmax[i] = std::min(tmax[i], hi);
+        }
+    }
+    PacketMask found = 0;
+    forEachLane(lanes, [&](int lane) {
+        if ( tmin[lane] > tmax[lane] ) {
+            return;
+        }
+        double t = (tmin[lane] > 0) ? tmin[lane] : tmax[lane];
+        if ( t > 0 && t < hits.t[lane] ) {
+            hits.set(lane, Intersection(t, this));
+            found |= 1u << lane;
+        }
+    });
+    return found;
+}
+
+// Computes the entry and exit t values of the ray. Returns false on a miss.
+inline bool Cube::slabs(const Ray &ray, double &tmin, double &tmax)
 {
     std::pair<double,double> xtminmax, ytminmax, ztminmax;
     double xtmin, xtmax, ytmin, ytmax, ztmin, ztmax;
-    double tmin, tmax;
     xtminmax = check_axis(ray.origin.x(), ray.dir.x());
     ytminmax = check_axis(ray.origin.y(), ray.dir.y());
     ztminmax = check_axis(ray.origin.z(), ray.dir.z());
@@ -29,11 +99,8 @@ bool Cube::localIntersect(const Ray &ray, Iset &iset_out)
     tmax = std::min({xtmax, ytmax, ztmax});
 
     if (tmin > tmax) { // we missed
-        return false; // iset_out remains empty
+        return false;
     }
-
-    iset_out.insert(Intersection(tmin, shared_from_this()));
-    iset_out.insert(Intersection(tmax, shared_from_this()));
     return true;
 }
 
@@ -95,8 +162,8 @@ inline std::pair<double,double> Cube::check_axis(double origin, double direction
 //    if ( ztmax < tmax )
 //        tmax = ztmax;
 //
-//    iset_out.insert(Intersection(tmin, shared_from_this()));
-//    iset_out.insert(Intersection(tmax, shared_from_this()));
+//    iset_out.insert(Intersection(tmin, this));
+//    iset_out.insert(Intersection(tmax, this));
 //    return true;
 //}
 
@@ -12,24 +12,28 @@ public:
         std::shared_ptr<Shape> ret(new Cube());
         return ret;
     }
-    static std::shared_ptr<Shape> make(const Matrix &M)
+    static std::shared_ptr<Shape> make(const Matrix4 &M)
     {
         std::shared_ptr<Shape> ret(new Cube(M));
         return ret;
     }
     bool localIntersect(const Ray &ray, Iset &iset_out) override;
+    bool localIntersectClosest(const Ray &ray, Intersection &hit_out) override;
+    bool localIntersectAny(const Ray &ray, double max_t) override;
+    PacketMask localIntersectPacket(const RayPacket &packet, PacketMask lanes, PacketHits &hits) override;
     Vector localNormalAt(const Point &obj_p, const Intersection *const ip) const override;
     BoundingBox bounds() const override {
         return BoundingBox( Point(-1,-1,-1) , Point(1,1,1) );
     }
 
     void divide(size_t threshold) override { }
-    bool includes(const std::shared_ptr<Shape> &shape) { return shape == shared_from_this(); }
+    bool includes(const Shape *shape) const override { return shape == this; }
     
 private:
     Cube() : Shape() { }
-    Cube(const Matrix &M) : Shape(M) { }
+    Cube(const Matrix4 &M) : Shape(M) { }
 
+    inline bool slabs(const Ray &ray, double &tmin, double &tmax);
     inline std::pair<double,double> check_axis(double origin, double direction);
     //inline void check_axis(bool sign, double origin, double invdir, double &tmin_out, double &tmax_out);
 };
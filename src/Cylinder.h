@@ -13,17 +13,17 @@ public:
         std::shared_ptr<Shape> ret(new Cylinder());
         return ret;
     }
-    static std::shared_ptr<Shape> make(const Matrix &M)
+    static std::shared_ptr<Shape> make(const Matrix4 &M)
     {
         std::shared_ptr<Shape> ret(new Cylinder(M));
         return ret;
     }
-    static std::shared_ptr<Shape> make(const Matrix &M, double min_y, double max_y)
+    static std::shared_ptr<Shape> make(const Matrix4 &M, double min_y, double max_y)
     {
         std::shared_ptr<Shape> ret(new Cylinder(M, min_y, max_y));
         return ret;
     }
-    static std::shared_ptr<Shape> make(const Matrix &M, double min_y, double max_y, bool closed)
+    static std::shared_ptr<Shape> make(const Matrix4 &M, double min_y, double max_y, bool closed)
     {
         std::shared_ptr<Shape> ret(new Cylinder(M, min_y, max_y, closed));
         return ret;
@@ -45,7 +45,7 @@ public:
     }
 
     void divide(size_t threshold) override { }
-    bool includes(const std::shared_ptr<Shape> &shape) { return shape == shared_from_this(); }
+    bool includes(const Shape *shape) const override { return shape == this; }
 
     double minimum() const { return min_y; }
     void minimum(double m) { min_y = m; }
@@ -61,11 +61,11 @@ private:
                  is_closed(false) { }
     Cylinder(double min_y, double max_y) : Shape(), min_y(min_y), max_y(max_y), is_closed(false) { }
     Cylinder(double min_y, double max_y, bool closed) : Shape(), min_y(min_y), max_y(max_y), is_closed(closed) { }
-    Cylinder(const Matrix &M) : Shape(M),
+    Cylinder(const Matrix4 &M) : Shape(M),
                                 min_y(-std::numeric_limits<double>::infinity()),
                                 max_y(std::numeric_limits<double>::infinity()) { }
-    Cylinder(const Matrix &M, double min_y, double max_y) : Shape(M), min_y(min_y), max_y(max_y), is_closed(false) { }
-    Cylinder(const Matrix &M, double min_y, double max_y, bool closed) : Shape(M), min_y(min_y), max_y(max_y), is_closed(closed) { }
+    Cylinder(const Matrix4 &M, double min_y, double max_y) : Shape(M), min_y(min_y), max_y(max_y), is_closed(false) { }
+    Cylinder(const Matrix4 &M, double min_y, double max_y, bool closed) : Shape(M), min_y(min_y), max_y(max_y), is_closed(closed) { }
 
     inline bool check_cap(const Ray &ray, double t);
     inline bool intersect_caps(const Ray &ray, Iset &iset_out);
@@ -0,0 +1,175 @@
+#include "Denoiser.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+
+// Below this an albedo channel is too dark to divide by, and the light is taken as the color
+#define MIN_DEMODULATE_ALBEDO 0.01
+// Added to the variance in the brightness weight, so converged pixels still blend a little
+#define MIN_DENOISE_VARIANCE 1e-5
+// Pixels are compared by their brightness averaged over this many pixels around, which is
+// less noisy than their own. A few samples give a poor estimate of the variance, so that
+// is pooled over a wider window.
+#define DENOISE_GUIDE_RADIUS 1
+#define DENOISE_VARIANCE_RADIUS 2
+
+static float demodulate_factor(float albedo)
+{
+    return ( albedo > MIN_DEMODULATE_ALBEDO ) ? albedo : 1.0f;
+}
+
+// The mean of value(qx, qy) over the pixels of the image within r of (x, y), and how many
+// there were
+template <typename F>
+static double window_mean(size_t x, size_t y, size_t r, size_t width, size_t height, F value, size_t &count)
+{
+    double sum = 0;
+    count = 0;
+    for (size_t qy = ( y > r ? y - r : 0 ); qy <= std::min(height - 1, y + r); qy++) {
+        for (size_t qx = ( x > r ? x - r : 0 ); qx <= std::min(width - 1, x + r); qx++) {
+            sum += value(qx, qy);
+            count++;
+        }
+    }
+    return sum / count;
+}
+
+// Calls fn for every tile of the image, on the given number of threads
+template <typename F>
+static void for_each_tile(size_t width, size_t height, size_t tile_size, size_t threads, F fn)
+{
+    TileScheduler scheduler(width, height, tile_size, threads);
+    auto work = [&](size_t threadnum) {
+        Tile tile;
+        while ( scheduler.next(threadnum, tile) ) {
+            fn(tile);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; i++) {
+        pool.push_back(std::thread(work, i));
+    }
+    work(0);
+    for (auto &th : pool) {
+        th.join();
+    }
+}
+
+void Denoiser::denoise(const Framebuffer &in, Framebuffer &out, size_t threads, size_t tile_size) const
+{
+    if ( !in.hasAovs() ) {
+        throw std::logic_error("Cannot denoise a framebuffer without AOVs");
+    }
+    if ( out.width() != in.width() || out.height() != in.height() ) {
+        throw std::invalid_argument("Denoiser output must be the same size as its input");
+    }
+    size_t width = in.width();
+    size_t height = in.height();
+
+    std::vector<Feature> features(width * height);
+    threads = std::max<size_t>(1, threads);
+    // Filtering a pixel reads the features of its neighbors in other tiles, so they are
+    // all gathered first
+    for_each_tile(width, height, tile_size, threads, [&](const Tile &tile) {
+        gather_tile(in, tile, features);
+    });
+    for_each_tile(width, height, tile_size, threads, [&](const Tile &tile) {
+        denoise_tile(features, width, height, tile, in, out);
+    });
+}
+
+void Denoiser::gather_tile(const Framebuffer &in, const Tile &tile, std::vector<Feature> &features) const
+{
+    size_t width = in.width();
+    size_t height = in.height();
+    for (size_t y = tile.y0; y < tile.y1; y++) {
+        for (size_t x = tile.x0; x < tile.x1; x++) {
+            Feature &f = features[y * width + x];
+            Color c = in.get(x, y);
+            Color a = in.albedo(x, y);
+            Vector n = in.normal(x, y);
+            double len = n.length();
+            for (int i = 0; i < 3; i++) {
+                f.albedo[i] = a.ptr()[i];
+                f.light[i] = c.ptr()[i] / demodulate_factor(f.albedo[i]);
+                f.normal[i] = ( len > 0 ) ? n.ptr()[i] / len : 0;
+            }
+            f.depth = in.depth(x, y);
+
+            size_t guide_pixels, variance_pixels;
+            f.lum = window_mean(x, y, DENOISE_GUIDE_RADIUS, width, height, [&](size_t qx, size_t qy) {
+                return Framebuffer::luminance(in.get(qx, qy));
+            }, guide_pixels);
+            // The mean of n pixels varies 1/n as much as one of them
+            f.variance = window_mean(x, y, DENOISE_VARIANCE_RADIUS, width, height, [&](size_t qx, size_t qy) {
+                return in.variance(qx, qy);
+            }, variance_pixels) / guide_pixels;
+        }
+    }
+}
+
+void Denoiser::denoise_tile(const std::vector<Feature> &features, size_t width, size_t height,
+                            const Tile &tile, const Framebuffer &in, Framebuffer &out) const
+{
+    const int r = radius;
+    const double sigma_space = std::max(1.0, radius / 2.0);
+    // Each weight is exp() of a sum of these terms, so one exp() per neighbor
+    const double k_space = -0.5 / (sigma_space * sigma_space);
+    const double k_albedo = -0.5 / (sigma_albedo * sigma_albedo);
+    const double k_color = ( sigma_color > 0 ) ? -0.5 / (sigma_color * sigma_color) : 0;
+
+    for (size_t y = tile.y0; y < tile.y1; y++) {
+        for (size_t x = tile.x0; x < tile.x1; x++) {
+            const Feature &p = features[y * width + x];
+            bool p_hit = ( p.normal[0] != 0 || p.normal[1] != 0 || p.normal[2] != 0 );
+            double k_depth = ( p.depth > 0 ) ? -0.5 / std::pow(sigma_depth * p.depth, 2) : 0;
+
+            double sum[3] = { 0, 0, 0 };
+            double total = 0;
+            size_t qy0 = std::max(0, (int)y - r), qy1 = std::min((int)height - 1, (int)y + r);
+            size_t qx0 = std::max(0, (int)x - r), qx1 = std::min((int)width - 1, (int)x + r);
+            for (size_t qy = qy0; qy <= qy1; qy++) {
+                for (size_t qx = qx0; qx <= qx1; qx++) {
+                    const Feature &q = features[qy * width + qx];
+                    double cos_n = p.normal[0] * q.normal[0] + p.normal[1] * q.normal[1] + p.normal[2] * q.normal[2];
+                    bool q_hit = ( q.normal[0] != 0 || q.normal[1] != 0 || q.normal[2] != 0 );
+                    double e;
+                    if ( p_hit != q_hit ) {
+                        continue; // an object's edge against the background
+                    } else if ( p_hit ) {
+                        if ( cos_n <= 0 ) {
+                            continue;
+                        }
+                        double dz = q.depth - p.depth;
+                        e = normal_power * std::log(cos_n) + k_depth * dz * dz;
+                    } else {
+                        e = 0;
+                    }
+                    double dx = (double)qx - x, dy = (double)qy - y;
+                    double da = 0;
+                    for (int i = 0; i < 3; i++) {
+                        double a = q.albedo[i] - p.albedo[i];
+                        da += a * a;
+                    }
+                    // The difference of two noisy means has the sum of their variances
+                    double dl = q.lum - p.lum;
+                    double var = p.variance + q.variance + MIN_DENOISE_VARIANCE;
+                    e += k_space * (dx * dx + dy * dy) + k_albedo * da + k_color * dl * dl / var;
+                    double w = std::exp(e);
+                    for (int i = 0; i < 3; i++) {
+                        sum[i] += w * q.light[i];
+                    }
+                    total += w;
+                }
+            }
+
+            // The pixel itself always has weight 1, so total > 0
+            Color c;
+            for (int i = 0; i < 3; i++) {
+                c.ptr()[i] = sum[i] / total * demodulate_factor(p.albedo[i]);
+            }
+            out.set(x, y, c, in.samples(x, y));
+        }
+    }
+}
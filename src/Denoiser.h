@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Framebuffer.h"
+#include "TileScheduler.h"
+#include <vector>
+#define DEFAULT_DENOISE_RADIUS 2
+#define DEFAULT_DENOISE_SIGMA_ALBEDO 0.1
+#define DEFAULT_DENOISE_SIGMA_DEPTH 0.05
+#define DEFAULT_DENOISE_NORMAL_POWER 16
+#define DEFAULT_DENOISE_SIGMA_COLOR 2.5
+
+// Denoiser is a joint bilateral filter for a rendered Framebuffer. It averages each
+// pixel with its neighbors within radius, weighted by how close they are and by how
+// much their first hit looks like the pixel's own: same albedo, same normal, same depth.
+// Noise from soft shadows, focal blur and antialiasing is smoothed away, while the
+// edges of objects and textures, which show up in those buffers, stay sharp.
+//
+// It filters the light arriving at the surface (color divided by albedo) rather than
+// the color, and multiplies the albedo back in afterwards, so textures aren't blurred.
+// Neighbors whose brightness, averaged over the 3x3 pixels around, differs by more than
+// the pixels' own noise explains (Framebuffer::variance) count less, which keeps shadow
+// edges, reflections and highlights that the buffers can't see.
+//
+// The framebuffer must have AOVs (Framebuffer::enableAovs).
+class Denoiser
+{
+public:
+    Denoiser(size_t radius = DEFAULT_DENOISE_RADIUS) :
+        radius(radius),
+        sigma_albedo(DEFAULT_DENOISE_SIGMA_ALBEDO),
+        sigma_depth(DEFAULT_DENOISE_SIGMA_DEPTH),
+        normal_power(DEFAULT_DENOISE_NORMAL_POWER),
+        sigma_color(DEFAULT_DENOISE_SIGMA_COLOR) { }
+
+    void setRadius(size_t r) { radius = r; }
+    // How different neighbors may be before they stop counting: albedo in color units,
+    // depth as a fraction of the pixel's depth, brightness in standard deviations of the
+    // pixels' noise (0 turns that term off). The normal weight is the cosine between the
+    // normals to this power.
+    void setSigmaAlbedo(double s) { sigma_albedo = s; }
+    void setSigmaDepth(double s) { sigma_depth = s; }
+    void setNormalPower(double p) { normal_power = p; }
+    void setSigmaColor(double s) { sigma_color = s; }
+    size_t getRadius() const { return radius; }
+
+    // Writes the filtered colors of in to out, which must be the same size. The AOVs and
+    // sample counts of out are left alone. Tiles are gathered and filtered on the given
+    // number of threads.
+    void denoise(const Framebuffer &in, Framebuffer &out, size_t threads = 1,
+                 size_t tile_size = DEFAULT_TILE_SIZE) const;
+
+private:
+    // The buffers of one pixel, gathered before filtering
+    struct Feature {
+        float light[3];
+        float albedo[3];
+        float normal[3]; // unit length, or zero where the samples hit nothing
+        float depth;
+        float lum;      // luminance of the color, clamped as displayed, over the 3x3 pixels around
+        float variance; // of lum
+    };
+
+    void gather_tile(const Framebuffer &in, const Tile &tile, std::vector<Feature> &features) const;
+    void denoise_tile(const std::vector<Feature> &features, size_t width, size_t height,
+                      const Tile &tile, const Framebuffer &in, Framebuffer &out) const;
+
+    size_t radius;
+    double sigma_albedo;
+    double sigma_depth;
+    double normal_power;
+    double sigma_color;
+};
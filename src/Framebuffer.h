@@ -0,0 +1,134 @@
+#pragma once
+
+#include "Color.h"
+#include "Vector.h"
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Framebuffer holds the rendered image in linear, unclamped color: the running sum and
+// weight of the samples of every pixel, in single precision. Colors brighter than white
+// survive until a ToneMap turns the image into displayable bytes.
+//
+// With AOVs enabled it also keeps the mean depth, normal and albedo of the first surface
+// the camera samples hit, and the variance of the samples' brightness, for compositing
+// and denoising.
+//
+// There is no locking. Render threads each write only the pixels of their own tiles,
+// and nothing reads a pixel while its tile is being rendered.
+class Framebuffer
+{
+public:
+    Framebuffer(size_t width, size_t height) : w(width), h(height), pixels(width * height) { }
+
+    size_t width() const { return w; }
+    size_t height() const { return h; }
+
+    // Every pixel back to black, with no samples
+    void clear() {
+        pixels.assign(w * h, Pixel());
+        if ( !aovs.empty() ) {
+            aovs.assign(w * h, Aov());
+        }
+    }
+
+    void enableAovs(bool enabled) { aovs.assign(enabled ? w * h : 0, Aov()); }
+    bool hasAovs() const { return !aovs.empty(); }
+
+    // Replaces the pixel with color c, the mean of the given number of samples
+    void set(size_t x, size_t y, const Color &c, size_t samples = 1) {
+        Pixel &p = pixels[y * w + x];
+        p.rgb[0] = (float)(c.x() * samples);
+        p.rgb[1] = (float)(c.y() * samples);
+        p.rgb[2] = (float)(c.z() * samples);
+        p.weight = samples;
+    }
+    // Adds a sample to the pixel's mean
+    void add(size_t x, size_t y, const Color &c) {
+        Pixel &p = pixels[y * w + x];
+        p.rgb[0] += (float)c.x();
+        p.rgb[1] += (float)c.y();
+        p.rgb[2] += (float)c.z();
+        p.weight += 1;
+    }
+    // The mean of the pixel's samples, black if it has none
+    Color get(size_t x, size_t y) const {
+        const Pixel &p = pixels[y * w + x];
+        if ( p.weight == 0 ) {
+            return Color(0, 0, 0);
+        }
+        return Color(p.rgb[0] / p.weight, p.rgb[1] / p.weight, p.rgb[2] / p.weight);
+    }
+    size_t samples(size_t x, size_t y) const { return (size_t)pixels[y * w + x].weight; }
+
+    // Adds one sample's first hit and its color to the pixel's AOVs. Needs enableAovs(true).
+    void addAov(size_t x, size_t y, double depth, const Vector &normal, const Color &albedo, const Color &color) {
+        Aov &a = aovs[y * w + x];
+        a.depth += (float)depth;
+        for (int i = 0; i < 3; i++) {
+            a.normal[i] += (float)normal.ptr()[i];
+            a.albedo[i] += (float)albedo.ptr()[i];
+        }
+        float lum = luminance(color);
+        a.lum += lum;
+        a.lum2 += lum * lum;
+        a.weight += 1;
+    }
+    // Means of the AOV samples, zero if there are none. The normal is averaged, not
+    // renormalized, so it is shorter than 1 where the samples disagree.
+    double depth(size_t x, size_t y) const {
+        const Aov &a = aovs[y * w + x];
+        return a.weight ? a.depth / a.weight : 0;
+    }
+    Vector normal(size_t x, size_t y) const {
+        const Aov &a = aovs[y * w + x];
+        if ( a.weight == 0 ) {
+            return Vector(0, 0, 0);
+        }
+        return Vector(a.normal[0] / a.weight, a.normal[1] / a.weight, a.normal[2] / a.weight);
+    }
+    Color albedo(size_t x, size_t y) const {
+        const Aov &a = aovs[y * w + x];
+        if ( a.weight == 0 ) {
+            return Color(0, 0, 0);
+        }
+        return Color(a.albedo[0] / a.weight, a.albedo[1] / a.weight, a.albedo[2] / a.weight);
+    }
+    // Variance of the pixel's mean luminance, as displayed (clamped to [0,1]). Zero with
+    // fewer than two samples.
+    double variance(size_t x, size_t y) const {
+        const Aov &a = aovs[y * w + x];
+        if ( a.weight < 2 ) {
+            return 0;
+        }
+        double mean = a.lum / a.weight;
+        double sample_var = std::max(0.0, (a.lum2 - a.weight * mean * mean) / (a.weight - 1));
+        return sample_var / a.weight;
+    }
+    // Rec. 709 luminance of c clamped to [0,1]
+    static float luminance(const Color &c) {
+        return 0.2126f * std::min(1.0f, std::max(0.0f, (float)c.x())) +
+               0.7152f * std::min(1.0f, std::max(0.0f, (float)c.y())) +
+               0.0722f * std::min(1.0f, std::max(0.0f, (float)c.z()));
+    }
+
+private:
+    struct Pixel {
+        float rgb[3] = { 0, 0, 0 };
+        float weight = 0;
+    };
+
+    struct Aov {
+        float depth = 0;
+        float normal[3] = { 0, 0, 0 };
+        float albedo[3] = { 0, 0, 0 };
+        float lum = 0;  // sum of the samples' luminance, and of its square
+        float lum2 = 0;
+        float weight = 0;
+    };
+
+    size_t w;
+    size_t h;
+    std::vector<Pixel> pixels;
+    std::vector<Aov> aovs; // empty unless enabled
+};
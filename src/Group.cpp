@@ -3,10 +3,49 @@
 #include "util.h"
 #include <math.h>
 #include <memory>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+// Relative costs of testing a BVH node's bounding box and intersecting a primitive
+const double SAH_TRAVERSAL_COST = 1.0;
+const double SAH_INTERSECT_COST = 1.0;
+
+// The Group for node idx of a tree that buildBinaryBVH() built over prims, which index
+// into shapes, and its bounds. Each prim carries its bounds in the Group's space, so that
+// they are transformed only once per build instead of once per level.
+std::shared_ptr<Group> groupFromNode(const std::vector<LinearBVHNode> &nodes, uint32_t idx,
+                                     const std::vector<BVHBuildPrim> &prims, const shapePtrVec &shapes,
+                                     BoundingBox &box)
+{
+    auto node = Group::make();
+    const LinearBVHNode &n = nodes[idx];
+    if ( n.count > 0 ) {
+        for (uint32_t i = n.offset; i < n.offset + n.count; i++) {
+            node->addChild(shapes[prims[i].index], prims[i].box);
+            box.add(prims[i].box);
+        }
+        return node;
+    }
+    BoundingBox first, second;
+    node->addChild(groupFromNode(nodes, idx + 1, prims, shapes, first), first);
+    node->addChild(groupFromNode(nodes, n.offset, prims, shapes, second), second);
+    box.add(first);
+    box.add(second);
+    return node;
+}
+
+} // namespace
 
 
 bool Group::localIntersect(const Ray &ray, Iset &iset_out) 
 {
+    if ( linear.isBuilt() ) {
+        return linear.intersect(ray, iset_out);
+    }
     if ( ! bbox.intersects(ray) ) {
         return false;
     }
@@ -19,6 +58,65 @@ bool Group::localIntersect(const Ray &ray, Iset &iset_out)
     return hit;
 }
 
+// Since hit_out.t shrinks as closer hits are found, children and subgroups (i.e. BVH nodes)
+// whose bounding box starts beyond the best hit so far are never even tested.
+bool Group::localIntersectClosest(const Ray &ray, Intersection &hit_out)
+{
+    if ( linear.isBuilt() ) {
+        return linear.intersectClosest(ray, hit_out);
+    }
+    if ( ! bbox.intersects(ray, hit_out.t) ) {
+        return false;
+    }
+    bool hit = false;
+    for (const auto &c : children) {
+        if ( c->intersectClosest(ray, hit_out) ) {
+            hit = true;
+        }
+    }
+    return hit;
+}
+
+// Stops at the first child that blocks the ray. BVH nodes that begin beyond max_t
+// (i.e. past the light) are skipped.
+bool Group::localIntersectAny(const Ray &ray, double max_t)
+{
+    if ( linear.isBuilt() ) {
+        return linear.intersectAny(ray, max_t);
+    }
+    if ( ! bbox.intersects(ray, max_t) ) {
+        return false;
+    }
+    for (const auto &c : children) {
+        if ( c->intersectAny(ray, max_t) ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Lanes whose ray misses the bounding box, or meets it only beyond their best hit, are
+// dropped before the children are tested
+PacketMask Group::localIntersectPacket(const RayPacket &packet, PacketMask lanes, PacketHits &hits)
+{
+    if ( linear.isBuilt() ) {
+        return linear.intersectPacket(packet, lanes, hits);
+    }
+    PacketMask inside = 0;
+    forEachLane(lanes, [&](int lane) {
+        if ( bbox.intersects(packet.ray(lane), hits.t[lane]) ) {
+            inside |= 1u << lane;
+        }
+    });
+    PacketMask found = 0;
+    if ( inside ) {
+        for (const auto &c : children) {
+            found |= c->intersectPacket(packet, inside, hits);
+        }
+    }
+    return found;
+}
+
 Vector Group::localNormalAt(const Point &obj_p, const Intersection *const ip) const
 {
     throw std::logic_error("Cannot call localNormalAt on group");
@@ -26,41 +124,217 @@ Vector Group::localNormalAt(const Point &obj_p, const Intersection *const ip) co
 
 void Group::divide(size_t threshold)
 {
+    std::vector<BoundingBox> bounds;
+    bounds.reserve(children.size());
+    for ( const auto &c : children ) {
+        bounds.push_back(c->parentBounds());
+    }
+    divide(threshold, std::move(bounds), bvhBuildSpawnDepth(0));
+}
+
+// The subgroups are divided before they are added, so that nothing above them is touched
+// and the two can be divided at the same time
+void Group::divide(size_t threshold, std::vector<BoundingBox> bounds, int spawn)
+{
+    std::shared_ptr<Group> left, right;
     if (threshold <= children.size() ) {
-        std::pair<shapePtrVec,shapePtrVec> parts = partitionChildren();
-        shapePtrVec left = std::get<0>(parts);
-        shapePtrVec right = std::get<1>(parts);
-        if ( left.size() > 0 )
-            addChild(Group::make(left));
-        if ( right.size() > 0 )
-            addChild(Group::make(right));
+        std::vector<BoundingBox> left_bounds, right_bounds;
+        std::pair<shapePtrVec,shapePtrVec> parts = partitionChildren(bounds, left_bounds, right_bounds);
+        shapePtrVec &left_children = std::get<0>(parts);
+        shapePtrVec &right_children = std::get<1>(parts);
+        if ( left_children.size() > 0 ) {
+            left = Group::make();
+            for (size_t i = 0; i < left_children.size(); i++) {
+                left->addChild(left_children[i], left_bounds[i]);
+            }
+        }
+        if ( right_children.size() > 0 ) {
+            right = Group::make();
+            for (size_t i = 0; i < right_children.size(); i++) {
+                right->addChild(right_children[i], right_bounds[i]);
+            }
+        }
+        size_t moved = left_children.size() + right_children.size();
+        if ( left && right && spawn > 0 && moved >= BVH_BUILD_PARALLEL_MIN_PRIMS ) {
+            std::thread t([&] { left->divide(threshold, std::move(left_bounds), spawn - 1); });
+            right->divide(threshold, std::move(right_bounds), spawn - 1);
+            t.join();
+        } else {
+            if ( left )
+                left->divide(threshold, std::move(left_bounds), spawn);
+            if ( right )
+                right->divide(threshold, std::move(right_bounds), spawn);
+        }
     }
 
     for ( auto c : children ) {
         c->divide(threshold);
     }
+    if ( left )
+        addChild(left, left->bbox);
+    if ( right )
+        addChild(right, right->bbox);
+}
+
+void Group::divideSAH(size_t max_leaf_size)
+{
+    divideTopDown(max_leaf_size, BVHMethod::sah);
+}
+
+void Group::divideTopDown(size_t max_leaf_size, BVHMethod method)
+{
+    if ( max_leaf_size < 1 ) {
+        max_leaf_size = 1;
+    }
+
+    shapePtrVec bounded;
+    std::vector<BVHBuildPrim> prims;
+    shapePtrVec unbounded;
+    for ( auto c : children ) {
+        c->divideSAH(max_leaf_size);
+        BoundingBox box = c->parentBounds();
+        if ( box.isFinite() ) {
+            prims.push_back(BVHBuildPrim{ box, box.centroid(), (uint32_t)bounded.size() });
+            bounded.push_back(c);
+        } else {
+            unbounded.push_back(c);
+        }
+    }
+    if ( prims.size() <= max_leaf_size ) {
+        return;
+    }
+
+    std::vector<LinearBVHNode> nodes = buildBinaryBVH(prims, max_leaf_size, method);
+    BoundingBox left_box, right_box;
+    auto left = groupFromNode(nodes, 1, prims, bounded, left_box);
+    auto right = groupFromNode(nodes, nodes[0].offset, prims, bounded, right_box);
+
+    children.clear();
+    for ( auto c : unbounded ) {
+        addChild(c);
+    }
+    addChild(left, left_box);
+    addChild(right, right_box);
+}
+
+void Group::buildBVH(BVHMethod method, size_t leaf_size, size_t width)
+{
+    setBVHWidth(width);
+    if ( method == BVHMethod::none ) {
+        return;
+    }
+    if ( method == BVHMethod::midpoint ) {
+        divide(leaf_size);
+    } else {
+        divideTopDown(leaf_size, method);
+    }
+    flatten();
+}
+
+void Group::setBVHWidth(size_t width)
+{
+    if ( width != 2 && width != 4 && width != 8 ) {
+        throw std::invalid_argument("BVH width must be 2, 4 or 8");
+    }
+    bvh_width = width;
+}
+
+BVHStats Group::bvhStats() const
+{
+    BVHStats stats;
+    double root_area = bbox.surfaceArea();
+    if ( !bbox.isFinite() ) {
+        // Planes make the root infinitely large. Measure against the bounded part instead.
+        BoundingBox finite;
+        for ( const auto &c : children ) {
+            BoundingBox cbox = c->parentBounds();
+            if ( cbox.isFinite() ) {
+                finite.add(cbox);
+            }
+        }
+        root_area = finite.surfaceArea();
+    }
+    collectStats(stats, 1, root_area > 0 ? root_area : 1);
+    return stats;
+}
+
+void Group::collectStats(BVHStats &stats, size_t depth, double root_area) const
+{
+    // Nodes that can't be culled (unbounded ones) are visited by every ray
+    double p_visit = bbox.isFinite() ? bbox.surfaceArea() / root_area : 1;
+
+    size_t nprims = 0;
+    size_t ngroups = 0;
+    for ( const auto &c : children ) {
+        auto g = std::dynamic_pointer_cast<Group>(c);
+        if ( g ) {
+            g->collectStats(stats, depth + 1, root_area);
+            ngroups++;
+        } else {
+            nprims++;
+        }
+    }
+
+    stats.nodes++;
+    stats.depth = std::max(stats.depth, depth);
+    stats.primitives += nprims;
+    stats.sahCost += p_visit * (SAH_TRAVERSAL_COST + nprims * SAH_INTERSECT_COST);
+    if ( ngroups == 0 ) {
+        stats.leaves++;
+        stats.maxLeafSize = std::max(stats.maxLeafSize, nprims);
+    } else {
+        stats.interiorPrimitives += nprims;
+    }
+}
+
+std::ostream& operator<<(std::ostream &os, const BVHStats &stats)
+{
+    os << stats.nodes << " nodes, depth " << stats.depth << ", "
+       << stats.leaves << " leaves (avg " << stats.avgLeafSize() << ", max " << stats.maxLeafSize << " shapes), "
+       << stats.interiorPrimitives << " shapes in interior nodes, SAH cost " << stats.sahCost;
+    return os;
 }
 
 std::pair<shapePtrVec,shapePtrVec> Group::partitionChildren()
+{
+    std::vector<BoundingBox> bounds, left_bounds, right_bounds;
+    bounds.reserve(children.size());
+    for ( const auto &c : children ) {
+        bounds.push_back(c->parentBounds());
+    }
+    return partitionChildren(bounds, left_bounds, right_bounds);
+}
+
+// One pass that moves the children that stay down over the ones that go
+std::pair<shapePtrVec,shapePtrVec> Group::partitionChildren(std::vector<BoundingBox> &bounds,
+                                                            std::vector<BoundingBox> &left_bounds,
+                                                            std::vector<BoundingBox> &right_bounds)
 {
     auto split = bbox.splitBounds();
     BoundingBox left = std::get<0>(split);
     BoundingBox right = std::get<1>(split);
 
     shapePtrVec left_children, right_children;
-
-    for ( auto it = children.begin(); it != children.end(); ) {
-        if (left.contains((*it)->parentBounds())) {
-            left_children.push_back(*it);
-            children.erase(it);
+    size_t kept = 0;
+    for ( size_t i = 0; i < children.size(); i++ ) {
+        if (left.contains(bounds[i])) {
+            left_children.push_back(std::move(children[i]));
+            left_bounds.push_back(bounds[i]);
         }
-        else if (right.contains((*it)->parentBounds())) {
-            right_children.push_back(*it);
-            children.erase(it);
+        else if (right.contains(bounds[i])) {
+            right_children.push_back(std::move(children[i]));
+            right_bounds.push_back(bounds[i]);
         } else {
-            ++it;
+            if ( kept != i ) {
+                children[kept] = std::move(children[i]);
+                bounds[kept] = bounds[i];
+            }
+            kept++;
         }
-    } 
+    }
+    children.resize(kept);
+    bounds.resize(kept);
+    linear.clear();
 
     return std::pair<shapePtrVec,shapePtrVec>(left_children,right_children);
-}
\ No newline at end of file
+}
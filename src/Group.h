@@ -2,12 +2,33 @@
 
 #include "Ray.h"
 #include "Shape.h"
+#include "LinearBVH.h"
 #include <utility>
 #include <memory>
 #include <vector>
 
 typedef std::vector<std::shared_ptr<Shape>> shapePtrVec;
 
+// Shape of a BVH, as returned by Group::bvhStats(). Every Group in the tree is a node;
+// a leaf is a Group with no Group children. Primitives are all other shapes, and CSGs
+// count as primitives.
+struct BVHStats {
+    size_t nodes = 0;
+    size_t leaves = 0;
+    size_t depth = 0;
+    size_t primitives = 0;
+    size_t interiorPrimitives = 0; // primitives held by nodes that also have subgroups
+    size_t maxLeafSize = 0;
+    // Expected cost of tracing a ray through the tree, in units of one primitive
+    // intersection, relative to a ray that hits the root's bounding box
+    double sahCost = 0;
+
+    double avgLeafSize() const {
+        return leaves ? (double)(primitives - interiorPrimitives) / leaves : 0;
+    }
+};
+std::ostream& operator<<(std::ostream &os, const BVHStats &stats);
+
 class Group final : public Shape {
 public:
     static std::shared_ptr<Group> make()
@@ -15,7 +36,7 @@ public:
         std::shared_ptr<Group> ret(new Group());
         return ret;
     }
-    static std::shared_ptr<Group> make(const Matrix &M)
+    static std::shared_ptr<Group> make(const Matrix4 &M)
     {
         std::shared_ptr<Group> ret(new Group(M));
         return ret;
@@ -26,23 +47,33 @@ public:
         return ret;
     }
     bool localIntersect(const Ray &ray, Iset &iset_out) override;
+    bool localIntersectClosest(const Ray &ray, Intersection &hit_out) override;
+    bool localIntersectAny(const Ray &ray, double max_t) override;
+    PacketMask localIntersectPacket(const RayPacket &packet, PacketMask lanes, PacketHits &hits) override;
     Vector localNormalAt(const Point &obj_p, const Intersection *const ip) const override; // should never be called on a group
 
     bool isEmpty() const { return children.empty(); }
     void addChild(const std::shared_ptr<Shape> &shape) {
+        addChild(shape, shape->parentBounds());
+    }
+    // The same for a shape whose bounds in this Group's space (its parentBounds()) are
+    // already known, as they are while a BVH is built
+    void addChild(const std::shared_ptr<Shape> &shape, BoundingBox pbounds) {
         children.push_back(shape);
-        auto selfptr = shared_from_this();
-        //auto selfptr = std::dynamic_pointer_cast<Group>(shared_from_this());
-        shape->setParent(selfptr);
-        BoundingBox pbounds = shape->parentBounds();
+        shape->setParent(this);
         bbox.add(pbounds);
+        linear.clear();
 
-        // update bbox on each parent in the chain
-        auto p = selfptr;
-        auto c = selfptr;
+        // update bbox on each parent in the chain. Any flattened BVH that may have
+        // inlined this Group is now stale too.
+        Shape *p = this;
+        Shape *c = this;
         while ( (p = p->getParent()) != nullptr) {
             pbounds = pbounds.transform(c->getTransform()); // get bounding box in next parent space
             p->bbox.add(pbounds);
+            if ( auto pg = dynamic_cast<Group*>(p) ) {
+                pg->linear.clear();
+            }
             c = c->getParent();
         }
 
@@ -56,14 +87,14 @@ public:
     // re-create bounding box from child list. Otherwise just use local bbox member.
     BoundingBox bounds() const override {
         BoundingBox box = BoundingBox();
-        for (auto c : children) {
+        for (const auto &c : children) {
             BoundingBox cbox = c->parentBounds();
             box.add(cbox);
         }
         return box;
     }
-    bool includes(const std::shared_ptr<Shape> &shape) {
-        for ( auto c : children ) {
+    bool includes(const Shape *shape) const override {
+        for ( const auto &c : children ) {
             if ( c->includes(shape) )
                 return true;
         }
@@ -71,9 +102,37 @@ public:
     }
 
     // Recursive function divides group children into subgroups. Essentially creates
-    // a BVH from this Group.
+    // a BVH from this Group. Each child's bounds are transformed once, and large
+    // subgroups are divided side by side on other threads.
     void divide(size_t threshold) override;
 
+    // Builds a BVH using the surface area heuristic, evaluated over a fixed number of bins
+    // along each axis (see buildBinaryBVH). Unlike divide(), every bounded child ends up
+    // in a leaf of at most max_leaf_size shapes; only unbounded shapes such as planes stay
+    // in this Group. Nested Groups are divided first and then treated as single shapes.
+    void divideSAH(size_t max_leaf_size) override;
+
+    // Builds a BVH with the given method: midpoint uses divide(), sah divideSAH(), and
+    // lbvh builds like divideSAH() but orders the children along a Morton curve (nested
+    // Groups still get SAH trees). leaf_size is the threshold passed to divide() or the
+    // max_leaf_size of the others. The resulting tree is then flattened into nodes of
+    // width children.
+    void buildBVH(BVHMethod method, size_t leaf_size, size_t width = DEFAULT_BVH_WIDTH);
+
+    // Compiles the Group hierarchy below this one into a LinearBVH, which the intersect
+    // functions then use instead of walking the children. Adding a child to this Group
+    // or to any Group below it discards the LinearBVH again.
+    void flatten() { linear.build(*this, bvh_width); }
+    bool isFlattened() const { return linear.isBuilt(); }
+    size_t flattenedNodeCount() const { return linear.nodeCount(); }
+    // Children per node of the LinearBVH that flatten() builds: 2, 4 or 8
+    void setBVHWidth(size_t width);
+    size_t getBVHWidth() const { return bvh_width; }
+
+    // Walks the tree below this Group. Assumes subgroups have identity transforms, as
+    // the ones divide() and divideSAH() create do.
+    BVHStats bvhStats() const;
+
     // partitionChildren() is used by divide() to create the BVH.
     // Returns a pair of lists of children corresponding to the split bbox.
     // Note: this will remove the child shapes that it partitions.
@@ -81,8 +140,21 @@ public:
 
 private:
     Group() : Shape() { }
-    Group(const Matrix &M) : Shape(M) { }
+    Group(const Matrix4 &M) : Shape(M) { }
     Group(const shapePtrVec &children) : Shape(), children(children) { bbox = bounds(); }
 
+    void collectStats(BVHStats &stats, size_t depth, double root_area) const;
+    // divide() and partitionChildren() for children whose bounds in this Group's space are
+    // in bounds. partitionChildren() leaves bounds with those of the children that stay.
+    void divide(size_t threshold, std::vector<BoundingBox> bounds, int spawn);
+    std::pair<shapePtrVec,shapePtrVec> partitionChildren(std::vector<BoundingBox> &bounds,
+                                                         std::vector<BoundingBox> &left_bounds,
+                                                         std::vector<BoundingBox> &right_bounds);
+    // divideSAH() with the tree built by buildBinaryBVH() with the given method
+    void divideTopDown(size_t max_leaf_size, BVHMethod method);
+
     shapePtrVec children;
+    size_t bvh_width = DEFAULT_BVH_WIDTH;
+    LinearBVH linear;
+    friend class LinearBVH;
 };
@@ -0,0 +1,549 @@
+#include "ImageIO.h"
+#include "util.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <zlib.h>
+#ifdef JRAY_GDK_PIXBUF
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#endif
+
+namespace {
+
+const unsigned char PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+std::string lower_extension(const std::string &filename)
+{
+    std::string ext = getFileExtension(filename);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext;
+}
+
+std::ofstream open_output(const std::string &filename)
+{
+    std::ofstream out(filename, std::ios::binary);
+    if ( !out ) {
+        throw std::runtime_error("Cannot open " + filename + " for writing");
+    }
+    return out;
+}
+
+void check_written(std::ofstream &out, const std::string &filename)
+{
+    out.flush();
+    if ( !out ) {
+        throw std::runtime_error("Error writing " + filename);
+    }
+}
+
+void put_u32(std::string &s, uint32_t v)
+{
+    s.push_back((char)(v >> 24));
+    s.push_back((char)(v >> 16));
+    s.push_back((char)(v >> 8));
+    s.push_back((char)v);
+}
+
+uint32_t get_u32(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+void write_png_chunk(std::ofstream &out, const char *type, const std::string &data)
+{
+    std::string chunk;
+    put_u32(chunk, data.size());
+    chunk.append(type, 4);
+    chunk += data;
+    // The CRC covers the type and the data, not the length
+    uLong crc = crc32(0L, (const Bytef*)chunk.data() + 4, chunk.size() - 4);
+    put_u32(chunk, crc);
+    out.write(chunk.data(), chunk.size());
+}
+
+unsigned char paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if ( pa <= pb && pa <= pc ) return a;
+    if ( pb <= pc ) return b;
+    return c;
+}
+
+// 8-bit, non-interlaced PNGs: gray, RGB, palette, with or without alpha. Alpha is dropped.
+void load_png(const std::string &filename, const std::string &file,
+              std::vector<unsigned char> &rgb, size_t &width, size_t &height)
+{
+    const unsigned char *p = (const unsigned char*)file.data();
+    size_t pos = sizeof(PNG_SIGNATURE);
+    int color_type = -1;
+    std::string idat, palette;
+    while ( pos + 12 <= file.size() ) {
+        uint32_t len = get_u32(p + pos);
+        std::string type(file, pos + 4, 4);
+        if ( len > file.size() - pos - 12 ) {
+            break;
+        }
+        const unsigned char *data = p + pos + 8;
+        if ( type == "IHDR" && len >= 13 ) {
+            width = get_u32(data);
+            height = get_u32(data + 4);
+            if ( data[8] != 8 || data[12] != 0 ) {
+                throw std::runtime_error("Cannot read " + filename + ": only 8-bit, non-interlaced PNGs are supported");
+            }
+            color_type = data[9];
+        } else if ( type == "PLTE" ) {
+            palette.assign((const char*)data, len);
+        } else if ( type == "IDAT" ) {
+            idat.append((const char*)data, len);
+        } else if ( type == "IEND" ) {
+            break;
+        }
+        pos += len + 12;
+    }
+
+    size_t channels;
+    switch (color_type) {
+        case 0: channels = 1; break; // gray
+        case 2: channels = 3; break; // RGB
+        case 3: channels = 1; break; // palette index
+        case 4: channels = 2; break; // gray, alpha
+        case 6: channels = 4; break; // RGBA
+        default:
+            throw std::runtime_error("Cannot read " + filename + ": unsupported or missing PNG header");
+    }
+    size_t stride = width * channels;
+    std::vector<unsigned char> raw(height * (stride + 1));
+    uLongf raw_size = raw.size();
+    if ( uncompress(raw.data(), &raw_size, (const Bytef*)idat.data(), idat.size()) != Z_OK ||
+         raw_size != raw.size() ) {
+        throw std::runtime_error("Cannot read " + filename + ": corrupt PNG image data");
+    }
+
+    // Undo each row's filter in place. Bytes are compared with the same channel of the
+    // pixel to the left, and with the row above.
+    for (size_t y = 0; y < height; y++) {
+        unsigned char *row = &raw[y * (stride + 1)];
+        unsigned char filter = row[0];
+        unsigned char *cur = row + 1;
+        const unsigned char *prev = ( y > 0 ) ? row - stride : nullptr;
+        for (size_t i = 0; i < stride; i++) {
+            int a = ( i >= channels ) ? cur[i - channels] : 0;
+            int b = prev ? prev[i] : 0;
+            int c = ( prev && i >= channels ) ? prev[i - channels] : 0;
+            switch (filter) {
+                case 0: break;
+                case 1: cur[i] += a; break;
+                case 2: cur[i] += b; break;
+                case 3: cur[i] += (a + b) / 2; break;
+                case 4: cur[i] += paeth(a, b, c); break;
+                default:
+                    throw std::runtime_error("Cannot read " + filename + ": bad PNG row filter");
+            }
+        }
+    }
+
+    rgb.resize(width * height * 3);
+    for (size_t y = 0; y < height; y++) {
+        const unsigned char *src = &raw[y * (stride + 1) + 1];
+        unsigned char *dst = &rgb[y * width * 3];
+        for (size_t x = 0; x < width; x++, src += channels, dst += 3) {
+            if ( color_type == 3 ) {
+                if ( 3 * (size_t)src[0] + 2 >= palette.size() ) {
+                    throw std::runtime_error("Cannot read " + filename + ": PNG palette index out of range");
+                }
+                std::memcpy(dst, palette.data() + 3 * src[0], 3);
+            } else if ( channels < 3 ) {
+                dst[0] = dst[1] = dst[2] = src[0];
+            } else {
+                std::memcpy(dst, src, 3);
+            }
+        }
+    }
+}
+
+// Binary (P6) PPM with a maxval of at most 255
+void load_ppm(const std::string &filename, const std::string &file,
+              std::vector<unsigned char> &rgb, size_t &width, size_t &height)
+{
+    size_t pos = 2;
+    long fields[3];
+    for (int f = 0; f < 3; f++) {
+        // Whitespace and comments may come between the header fields
+        while ( pos < file.size() && (isspace((unsigned char)file[pos]) || file[pos] == '#') ) {
+            if ( file[pos] == '#' ) {
+                pos = file.find('\n', pos);
+                if ( pos == std::string::npos ) pos = file.size();
+            } else {
+                pos++;
+            }
+        }
+        char *end;
+        fields[f] = std::strtol(file.c_str() + pos, &end, 10);
+        pos = end - file.c_str();
+    }
+    pos++; // the single whitespace character before the pixels
+    width = fields[0];
+    height = fields[1];
+    if ( fields[0] <= 0 || fields[1] <= 0 || fields[2] <= 0 || fields[2] > 255 ||
+         pos + width * height * 3 > file.size() ) {
+        throw std::runtime_error("Cannot read " + filename + ": bad or truncated PPM");
+    }
+    rgb.assign(file.begin() + pos, file.begin() + pos + width * height * 3);
+    if ( fields[2] != 255 ) {
+        for (auto &v : rgb) {
+            v = (unsigned char)(v * 255 / fields[2]);
+        }
+    }
+}
+
+// PFM of one channel ("Pf") or three ("PF"), from the bottom row up
+void write_pfm(const std::string &filename, size_t width, size_t height, int channels,
+               const std::function<void(size_t, size_t, float*)> &pixel)
+{
+    // A negative scale means little endian floats; write whatever this machine uses
+    uint16_t probe = 1;
+    bool little_endian = *(unsigned char*)&probe == 1;
+
+    std::ofstream out = open_output(filename);
+    out << ( channels == 1 ? "Pf\n" : "PF\n" ) << width << " " << height << "\n"
+        << ( little_endian ? "-1.0" : "1.0" ) << "\n";
+    std::vector<float> row(width * channels);
+    for (size_t y = height; y-- > 0; ) {
+        for (size_t x = 0; x < width; x++) {
+            pixel(x, y, &row[x * channels]);
+        }
+        out.write((const char*)row.data(), row.size() * sizeof(float));
+    }
+    check_written(out, filename);
+}
+
+// EXR files are little endian throughout
+void put_le32(std::string &s, uint32_t v)
+{
+    s.push_back((char)v);
+    s.push_back((char)(v >> 8));
+    s.push_back((char)(v >> 16));
+    s.push_back((char)(v >> 24));
+}
+
+void put_le64(std::string &s, uint64_t v)
+{
+    put_le32(s, (uint32_t)v);
+    put_le32(s, (uint32_t)(v >> 32));
+}
+
+void put_float(std::string &s, float f)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    put_le32(s, bits);
+}
+
+void put_attribute(std::string &header, const char *name, const char *type, const std::string &value)
+{
+    header.append(name).push_back('\0');
+    header.append(type).push_back('\0');
+    put_le32(header, value.size());
+    header += value;
+}
+
+std::string exr_box(size_t width, size_t height)
+{
+    std::string box;
+    put_le32(box, 0);
+    put_le32(box, 0);
+    put_le32(box, width - 1);
+    put_le32(box, height - 1);
+    return box;
+}
+
+struct ExrChannel {
+    const char *name;
+    std::function<float(size_t, size_t)> value;
+};
+
+// ZIP compression as OpenEXR does it: bytes split into even and odd halves, then each
+// byte stored as the difference from the one before, then deflated. Returns the data
+// unchanged if that doesn't make it smaller, which readers also accept.
+std::string exr_zip(const std::string &raw)
+{
+    std::string t(raw.size(), '\0');
+    size_t half = (raw.size() + 1) / 2;
+    for (size_t i = 0; i < raw.size(); i++) {
+        t[(i % 2) ? half + i / 2 : i / 2] = raw[i];
+    }
+    unsigned char *p = (unsigned char*)&t[0];
+    for (size_t i = t.size(); i-- > 1; ) {
+        p[i] = (unsigned char)(p[i] - p[i - 1] + 128);
+    }
+    uLongf packed_size = compressBound(t.size());
+    std::string packed(packed_size, '\0');
+    if ( compress2((Bytef*)&packed[0], &packed_size, p, t.size(), Z_DEFAULT_COMPRESSION) != Z_OK ||
+         packed_size >= raw.size() ) {
+        return raw;
+    }
+    packed.resize(packed_size);
+    return packed;
+}
+
+#ifdef JRAY_GDK_PIXBUF
+void load_gdk_pixbuf(const std::string &filename, std::vector<unsigned char> &rgb, size_t &width, size_t &height)
+{
+    GError *error = nullptr;
+    GdkPixbuf *pb = gdk_pixbuf_new_from_file(filename.c_str(), &error);
+    if ( !pb ) {
+        std::string msg = "Cannot read " + filename + ": " + error->message;
+        g_error_free(error);
+        throw std::runtime_error(msg);
+    }
+    width = gdk_pixbuf_get_width(pb);
+    height = gdk_pixbuf_get_height(pb);
+    int channels = gdk_pixbuf_get_n_channels(pb);
+    int rowstride = gdk_pixbuf_get_rowstride(pb);
+    const guchar *pixels = gdk_pixbuf_read_pixels(pb);
+    rgb.resize(width * height * 3);
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            std::memcpy(&rgb[(y * width + x) * 3], pixels + y * rowstride + x * channels, 3);
+        }
+    }
+    g_object_unref(pb);
+}
+
+void save_gdk_pixbuf(const std::string &filename, const std::string &type,
+                     const unsigned char *rgb, size_t width, size_t height)
+{
+    GdkPixbuf *pb = gdk_pixbuf_new_from_data(rgb, GDK_COLORSPACE_RGB, FALSE, 8, width, height,
+                                             width * 3, nullptr, nullptr);
+    GError *error = nullptr;
+    gboolean ok = gdk_pixbuf_save(pb, filename.c_str(), type.c_str(), &error, NULL);
+    g_object_unref(pb);
+    if ( !ok ) {
+        std::string msg = "Error writing " + filename + ": " + error->message;
+        g_error_free(error);
+        throw std::runtime_error(msg);
+    }
+}
+#endif
+
+} // namespace
+
+bool is_float_image(const std::string &filename)
+{
+    std::string ext = lower_extension(filename);
+    return ( ext == "pfm" || ext == "exr" );
+}
+
+bool can_save_image(const std::string &filename)
+{
+    std::string ext = lower_extension(filename);
+    if ( ext == "png" || ext == "ppm" || is_float_image(filename) ) {
+        return true;
+    }
+#ifdef JRAY_GDK_PIXBUF
+    if ( ext == "jpg" || ext == "jpeg" || ext == "bmp" ) {
+        return true;
+    }
+#endif
+    return false;
+}
+
+void save_image(const std::string &filename, const unsigned char *rgb, size_t width, size_t height)
+{
+    std::string ext = lower_extension(filename);
+    if ( ext == "png" ) {
+        save_png(filename, rgb, width, height);
+    } else if ( ext == "ppm" ) {
+        save_ppm(filename, rgb, width, height);
+#ifdef JRAY_GDK_PIXBUF
+    } else if ( ext == "jpg" || ext == "jpeg" || ext == "bmp" ) {
+        save_gdk_pixbuf(filename, ( ext == "bmp" ) ? "bmp" : "jpeg", rgb, width, height);
+#endif
+    } else {
+        throw std::invalid_argument("Bad filename extension given");
+    }
+}
+
+void save_png(const std::string &filename, const unsigned char *rgb, size_t width, size_t height)
+{
+    std::string ihdr;
+    put_u32(ihdr, width);
+    put_u32(ihdr, height);
+    ihdr += std::string("\x08\x02\x00\x00\x00", 5); // 8-bit RGB, no interlacing
+
+    // Every row uses the Sub filter (each byte minus the same channel of the pixel to
+    // its left), which compresses rendered gradients much better than none.
+    size_t stride = width * 3;
+    std::vector<unsigned char> raw(height * (stride + 1));
+    for (size_t y = 0; y < height; y++) {
+        const unsigned char *src = rgb + y * stride;
+        unsigned char *dst = &raw[y * (stride + 1)];
+        dst[0] = 1;
+        for (size_t i = 0; i < stride; i++) {
+            dst[i + 1] = src[i] - ( i >= 3 ? src[i - 3] : 0 );
+        }
+    }
+    uLongf packed_size = compressBound(raw.size());
+    std::string idat(packed_size, '\0');
+    if ( compress2((Bytef*)&idat[0], &packed_size, raw.data(), raw.size(), Z_DEFAULT_COMPRESSION) != Z_OK ) {
+        throw std::runtime_error("Error compressing " + filename);
+    }
+    idat.resize(packed_size);
+
+    std::ofstream out = open_output(filename);
+    out.write((const char*)PNG_SIGNATURE, sizeof(PNG_SIGNATURE));
+    write_png_chunk(out, "IHDR", ihdr);
+    write_png_chunk(out, "IDAT", idat);
+    write_png_chunk(out, "IEND", "");
+    check_written(out, filename);
+}
+
+void save_ppm(const std::string &filename, const unsigned char *rgb, size_t width, size_t height)
+{
+    std::ofstream out = open_output(filename);
+    out << "P6\n" << width << " " << height << "\n255\n";
+    out.write((const char*)rgb, width * height * 3);
+    check_written(out, filename);
+}
+
+void save_pfm(const std::string &filename, const Framebuffer &fb)
+{
+    auto put3 = [](float *out, const Tuple &t) {
+        out[0] = t.x();
+        out[1] = t.y();
+        out[2] = t.z();
+    };
+    write_pfm(filename, fb.width(), fb.height(), 3, [&](size_t x, size_t y, float *out) {
+        put3(out, fb.get(x, y));
+    });
+    if ( !fb.hasAovs() ) {
+        return;
+    }
+
+    std::string stem = filename.substr(0, filename.rfind('.'));
+    write_pfm(stem + ".depth.pfm", fb.width(), fb.height(), 1, [&](size_t x, size_t y, float *out) {
+        out[0] = fb.depth(x, y);
+    });
+    write_pfm(stem + ".normal.pfm", fb.width(), fb.height(), 3, [&](size_t x, size_t y, float *out) {
+        put3(out, fb.normal(x, y));
+    });
+    write_pfm(stem + ".albedo.pfm", fb.width(), fb.height(), 3, [&](size_t x, size_t y, float *out) {
+        put3(out, fb.albedo(x, y));
+    });
+    write_pfm(stem + ".samples.pfm", fb.width(), fb.height(), 1, [&](size_t x, size_t y, float *out) {
+        out[0] = fb.samples(x, y);
+    });
+}
+
+void save_exr(const std::string &filename, const Framebuffer &fb, ExrCompression compression)
+{
+    const size_t width = fb.width();
+    const size_t height = fb.height();
+
+    // Channels must be in alphabetical order, upper case first
+    std::vector<ExrChannel> channels = {
+        { "B", [&](size_t x, size_t y) { return (float)fb.get(x, y).z(); } },
+        { "G", [&](size_t x, size_t y) { return (float)fb.get(x, y).y(); } },
+        { "R", [&](size_t x, size_t y) { return (float)fb.get(x, y).x(); } }
+    };
+    if ( fb.hasAovs() ) {
+        std::vector<ExrChannel> aovs = {
+            { "Z", [&](size_t x, size_t y) { return (float)fb.depth(x, y); } },
+            { "albedo.B", [&](size_t x, size_t y) { return (float)fb.albedo(x, y).z(); } },
+            { "albedo.G", [&](size_t x, size_t y) { return (float)fb.albedo(x, y).y(); } },
+            { "albedo.R", [&](size_t x, size_t y) { return (float)fb.albedo(x, y).x(); } },
+            { "normal.X", [&](size_t x, size_t y) { return (float)fb.normal(x, y).x(); } },
+            { "normal.Y", [&](size_t x, size_t y) { return (float)fb.normal(x, y).y(); } },
+            { "normal.Z", [&](size_t x, size_t y) { return (float)fb.normal(x, y).z(); } },
+            { "samples", [&](size_t x, size_t y) { return (float)fb.samples(x, y); } }
+        };
+        channels.insert(channels.end(), aovs.begin(), aovs.end());
+    }
+
+    std::string chlist;
+    for (const auto &ch : channels) {
+        chlist.append(ch.name).push_back('\0');
+        put_le32(chlist, 2);      // FLOAT
+        put_le32(chlist, 0);      // pLinear and three reserved bytes
+        put_le32(chlist, 1);      // x sampling
+        put_le32(chlist, 1);      // y sampling
+    }
+    chlist.push_back('\0');
+
+    std::string header;
+    put_le32(header, 20000630); // magic number
+    put_le32(header, 2);        // version 2, single part scanline file
+    put_attribute(header, "channels", "chlist", chlist);
+    put_attribute(header, "compression", "compression", std::string(1, compression == ExrCompression::zip ? 3 : 0));
+    put_attribute(header, "dataWindow", "box2i", exr_box(width, height));
+    put_attribute(header, "displayWindow", "box2i", exr_box(width, height));
+    put_attribute(header, "lineOrder", "lineOrder", std::string(1, '\0')); // increasing y
+    std::string one, center;
+    put_float(one, 1.0f);
+    put_float(center, 0.0f);
+    put_float(center, 0.0f);
+    put_attribute(header, "pixelAspectRatio", "float", one);
+    put_attribute(header, "screenWindowCenter", "v2f", center);
+    put_attribute(header, "screenWindowWidth", "float", one);
+    header.push_back('\0');
+
+    // The offset table of the blocks comes before them, so it's written last
+    const size_t lines_per_block = ( compression == ExrCompression::zip ) ? 16 : 1;
+    const size_t blocks = (height + lines_per_block - 1) / lines_per_block;
+    std::ofstream out = open_output(filename);
+    out.write(header.data(), header.size());
+    std::streampos table_pos = out.tellp();
+    out.write(std::string(blocks * 8, '\0').data(), blocks * 8);
+
+    std::string offsets;
+    std::string raw, block;
+    for (size_t y0 = 0; y0 < height; y0 += lines_per_block) {
+        put_le64(offsets, (uint64_t)out.tellp());
+        raw.clear();
+        for (size_t y = y0; y < std::min(height, y0 + lines_per_block); y++) {
+            for (const auto &ch : channels) {
+                for (size_t x = 0; x < width; x++) {
+                    put_float(raw, ch.value(x, y));
+                }
+            }
+        }
+        const std::string &data = ( compression == ExrCompression::zip ) ? exr_zip(raw) : raw;
+        block.clear();
+        put_le32(block, y0);
+        put_le32(block, data.size());
+        out.write(block.data(), block.size());
+        out.write(data.data(), data.size());
+    }
+    out.seekp(table_pos);
+    out.write(offsets.data(), offsets.size());
+    check_written(out, filename);
+}
+
+void load_image(const std::string &filename, std::vector<unsigned char> &rgb, size_t &width, size_t &height)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if ( !in ) {
+        throw std::runtime_error("Cannot open " + filename);
+    }
+    std::string file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    if ( file.size() >= sizeof(PNG_SIGNATURE) && std::memcmp(file.data(), PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) == 0 ) {
+        load_png(filename, file, rgb, width, height);
+    } else if ( file.compare(0, 2, "P6") == 0 ) {
+        load_ppm(filename, file, rgb, width, height);
+    } else {
+#ifdef JRAY_GDK_PIXBUF
+        load_gdk_pixbuf(filename, rgb, width, height);
+#else
+        throw std::runtime_error("Cannot read " + filename + ": only PNG and PPM images are supported "
+                                 "in a build without gdk-pixbuf");
+#endif
+    }
+}
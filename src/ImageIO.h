@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Framebuffer.h"
+#include <string>
+#include <vector>
+
+// Reading and writing image files without GTK. Images are 8-bit RGB, rows top to bottom
+// with no padding.
+//
+// PNG and PPM are built in (PNG through zlib). When jray is built with gdk-pixbuf
+// (JRAY_GDK_PIXBUF), it handles every other format, e.g. JPEG textures and BMP output.
+
+// True if jray can write a file with this name's extension. PFM and EXR are linear float
+// and are written from a Framebuffer, see save_pfm() and save_exr().
+bool can_save_image(const std::string &filename);
+// True for the linear float formats
+bool is_float_image(const std::string &filename);
+
+// Write rgb (width x height x 3 bytes) to filename, choosing the format from its extension.
+// Throws std::invalid_argument for an unsupported extension and std::runtime_error if
+// the file can't be written.
+void save_image(const std::string &filename, const unsigned char *rgb, size_t width, size_t height);
+void save_png(const std::string &filename, const unsigned char *rgb, size_t width, size_t height);
+void save_ppm(const std::string &filename, const unsigned char *rgb, size_t width, size_t height);
+
+// Linear, unclamped colors of fb as a Portable Float Map. If fb has AOVs, they go to
+// files next to it: for out.pfm, out.depth.pfm, out.normal.pfm, out.albedo.pfm and
+// out.samples.pfm.
+void save_pfm(const std::string &filename, const Framebuffer &fb);
+
+enum class ExrCompression {
+    none,
+    zip   // zlib, in blocks of 16 scanlines
+};
+
+// Linear colors of fb as 32-bit float R, G, B channels of a scanline OpenEXR file. If fb
+// has AOVs they are written as the channels Z (depth), normal.X/Y/Z, albedo.R/G/B and
+// samples. The file is written a block of scanlines at a time, straight from fb.
+void save_exr(const std::string &filename, const Framebuffer &fb, ExrCompression compression = ExrCompression::zip);
+
+// Read filename into rgb. Throws std::runtime_error if it can't be read or decoded.
+void load_image(const std::string &filename, std::vector<unsigned char> &rgb, size_t &width, size_t &height);
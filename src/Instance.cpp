@@ -0,0 +1,50 @@
+#include "Instance.h"
+#include <stdexcept>
+
+// The geometry fills in its own shape as obj. Hand that on as the inner shape and
+// report the hit as our own.
+bool Instance::localIntersect(const Ray &ray, Iset &iset_out)
+{
+    size_t first = iset_out.size();
+    bool hit = geometry->intersect(ray, iset_out);
+    for (size_t i = first; i < iset_out.size(); i++) {
+        iset_out[i].inner = iset_out[i].obj;
+        iset_out[i].obj = this;
+    }
+    return hit;
+}
+
+bool Instance::localIntersectClosest(const Ray &ray, Intersection &hit_out)
+{
+    if ( geometry->intersectClosest(ray, hit_out) ) {
+        hit_out.inner = hit_out.obj;
+        hit_out.obj = this;
+        return true;
+    }
+    return false;
+}
+
+bool Instance::localIntersectAny(const Ray &ray, double max_t)
+{
+    return geometry->intersectAny(ray, max_t);
+}
+
+PacketMask Instance::localIntersectPacket(const RayPacket &packet, PacketMask lanes, PacketHits &hits)
+{
+    PacketMask found = geometry->intersectPacket(packet, lanes, hits);
+    forEachLane(found, [&](int lane) {
+        hits.hit[lane].inner = hits.hit[lane].obj;
+        hits.hit[lane].obj = this;
+    });
+    return found;
+}
+
+// obj_p is in the space of the geometry's root, where the parent chain of the inner
+// shape ends, so its normalAt() gives the normal in that space too.
+Vector Instance::localNormalAt(const Point &obj_p, const Intersection *const ip) const
+{
+    if ( !ip || !ip->inner ) {
+        throw std::logic_error("Instance::localNormalAt needs the intersection to find the shape that was hit");
+    }
+    return ip->inner->normalAt(obj_p, ip);
+}
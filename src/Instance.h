@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Ray.h"
+#include "Shape.h"
+#include "Group.h"
+#include <memory>
+
+// An Instance places a shared copy of some geometry in the scene. The geometry is a
+// Group with its BVH already built, such as the one ObjParser makes, and is parsed and
+// stored only once however many Instances refer to it. Each Instance adds only its own
+// transform, material and shadow flag, so scene memory grows with the unique geometry
+// rather than with the number of copies.
+//
+// The geometry's root is never added to a parent, since it has many: the parent chain
+// of a shape inside it ends at the root. An Instance is a primitive to the BVH of the
+// Group it is in, which makes that BVH the top level over the instances and the
+// geometry's own BVH the bottom level.
+//
+// Hits report the Instance as their obj, so that shading finds the Instance's material
+// and transform, and the shape within the geometry as their inner shape, which the
+// normal is then taken from. The geometry must not contain Instances itself, and must
+// not be changed once it is instanced.
+class Instance final : public Shape {
+public:
+    static std::shared_ptr<Instance> make(const std::shared_ptr<Group> &geometry)
+    {
+        std::shared_ptr<Instance> ret(new Instance(geometry));
+        return ret;
+    }
+    static std::shared_ptr<Instance> make(const std::shared_ptr<Group> &geometry, const Matrix4 &M)
+    {
+        std::shared_ptr<Instance> ret(new Instance(geometry, M));
+        return ret;
+    }
+    bool localIntersect(const Ray &ray, Iset &iset_out) override;
+    bool localIntersectClosest(const Ray &ray, Intersection &hit_out) override;
+    bool localIntersectAny(const Ray &ray, double max_t) override;
+    PacketMask localIntersectPacket(const RayPacket &packet, PacketMask lanes, PacketHits &hits) override;
+    Vector localNormalAt(const Point &obj_p, const Intersection *const ip) const override;
+    BoundingBox bounds() const override { return geometry->parentBounds(); }
+
+    // The geometry's BVH is built before it is shared
+    void divide(size_t threshold) override { }
+    bool includes(const Shape *shape) const override { return shape == this; }
+
+    const std::shared_ptr<Group>& getGeometry() const { return geometry; }
+
+private:
+    Instance(const std::shared_ptr<Group> &geometry) : Shape(), geometry(geometry) { }
+    Instance(const std::shared_ptr<Group> &geometry, const Matrix4 &M) : Shape(M), geometry(geometry) { }
+
+    std::shared_ptr<Group> geometry;
+};
@@ -2,7 +2,8 @@
 #include "Point.h"
 #include "Vector.h"
 #include "Color.h"
-#include <random>
+#include "Sampler.h"
+#include <vector>
 
 class Light {
 public:
@@ -15,7 +16,7 @@ public:
                                             samples(1),
                                             jitter(false)
     { 
-        samplePoints.push_back(pointAt(0,0));
+        samplePoints.push_back(cellCenter(0,0));
     }
     Light(const Point &p, const Vector &uvec, int usteps, const Vector &vvec, int vsteps, const Color &i, bool jitter) :
                                             pos(p),
@@ -27,9 +28,11 @@ public:
                                             samples(usteps*vsteps),
                                             jitter(jitter)
     {
+        // The cell centers, not jittered points: a scene is loaded outside of any camera
+        // sample, and its shading mustn't depend on what the Sampler drew before
         for (int v = 0; v < vsteps; v++) {
             for (int u = 0; u < usteps; u++) {
-                samplePoints.push_back(pointAt(u,v));
+                samplePoints.push_back(cellCenter(u,v));
             }
         }
     }
@@ -37,15 +40,20 @@ public:
     Point pointAt(double u, double v) const
     {
         if (jitter) {
-            std::random_device rd;
-            std::mt19937 gen(rd());
-            std::uniform_real_distribution<double> dis(0.0, 1.0);
-            return pos + (u + dis(gen))*(uvec/usteps) + (v + dis(gen))*(vvec/vsteps);
+            // A random point in cell (u,v), taken from the current sample
+            double ju, jv;
+            Sampler::current().get2D(ju, jv);
+            return pos + (u + ju)*(uvec/usteps) + (v + jv)*(vvec/vsteps);
         } else {
-            return pos + (u + 0.5)*(uvec/usteps) + (v + 0.5)*(vvec/vsteps);
+            return cellCenter(u, v);
         }
     }
 
+    Point cellCenter(double u, double v) const
+    {
+        return pos + (u + 0.5)*(uvec/usteps) + (v + 0.5)*(vvec/vsteps);
+    }
+
     bool jitter;
     Point pos;
     Vector uvec;
@@ -0,0 +1,720 @@
+#include "LinearBVH.h"
+#include "Group.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+// A run of primitives or a subgroup, waiting to be placed in the tree
+struct LinearBVH::Item {
+    BoundingBox box;
+    Group *group;             // non-null for an inlined subgroup
+    std::vector<Shape*> prims; // otherwise the primitives of one leaf
+};
+
+namespace {
+
+// Rounds outwards when narrowing the bounds to float
+float roundDown(double d)
+{
+    float f = (float)d;
+    return ( (double)f > d ) ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+}
+float roundUp(double d)
+{
+    float f = (float)d;
+    return ( (double)f < d ) ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+}
+
+bool isInlinable(const std::shared_ptr<Shape> &s)
+{
+    return ( std::dynamic_pointer_cast<Group>(s) &&
+             s->getTransform() == Matrix4::identity() &&
+             s->castsShadow() );
+}
+
+const int SAH_BINS = 16;
+
+int sahBin(const Point &centroid, int axis, double cmin, double extent)
+{
+    return std::min(SAH_BINS - 1, (int)(SAH_BINS * (centroid.ptr()[axis] - cmin) / extent));
+}
+
+} // namespace
+
+LinearBVHNode makeLinearBVHNode(const BoundingBox &box)
+{
+    LinearBVHNode n;
+    n.min[0] = roundDown(box.min.x());
+    n.min[1] = roundDown(box.min.y());
+    n.min[2] = roundDown(box.min.z());
+    n.max[0] = roundUp(box.max.x());
+    n.max[1] = roundUp(box.max.y());
+    n.max[2] = roundUp(box.max.z());
+    n.offset = 0;
+    n.count = 0;
+    n.axis = 0;
+    return n;
+}
+
+uint16_t linearBVHSplitAxis(const LinearBVHNode &n0, const LinearBVHNode &n1)
+{
+    uint16_t axis = 0;
+    double best = 0, best_sep = 0;
+    for (int i = 0; i < 3; i++) {
+        double sep = (n1.min[i] + n1.max[i]) - (n0.min[i] + n0.max[i]);
+        if ( std::fabs(sep) > best ) { // NaN (from unbounded children) never wins
+            best = std::fabs(sep);
+            best_sep = sep;
+            axis = i;
+        }
+    }
+    return ( best_sep < 0 ) ? (axis | LINEAR_BVH_SECOND_LOWER) : axis;
+}
+
+BVHCounters& BVHCounters::current()
+{
+    static thread_local BVHCounters counters;
+    return counters;
+}
+
+namespace {
+
+// Fills in the wide node at index idx for the binary node at bidx, and the nodes below it
+template <int W>
+void collapseNode(const std::vector<LinearBVHNode> &binary, uint32_t bidx,
+                  std::vector<WideBVHNode<W>> &wide, uint32_t idx)
+{
+    // Open up the interior child with the largest surface area until there are W children
+    std::vector<uint32_t> kids;
+    const LinearBVHNode &root = binary[bidx];
+    if ( root.count > 0 ) {
+        kids.push_back(bidx);
+    } else if ( root.offset != 0 ) {
+        kids.push_back(bidx + 1);
+        kids.push_back(root.offset);
+    }
+    while ( kids.size() < W ) {
+        int best = -1;
+        double best_area = -1;
+        for (size_t i = 0; i < kids.size(); i++) {
+            const LinearBVHNode &k = binary[kids[i]];
+            if ( k.count > 0 ) {
+                continue;
+            }
+            double dx = k.max[0] - k.min[0], dy = k.max[1] - k.min[1], dz = k.max[2] - k.min[2];
+            double area = dx * dy + dy * dz + dz * dx;
+            if ( !(area <= best_area) ) { // infinite and NaN (unbounded) areas go first
+                best_area = area;
+                best = i;
+            }
+        }
+        if ( best < 0 ) {
+            break;
+        }
+        uint32_t k = kids[best];
+        kids[best] = k + 1;
+        kids.insert(kids.begin() + best + 1, binary[k].offset);
+    }
+
+    WideBVHNode<W> node = WideBVHNode<W>();
+    node.size = kids.size();
+    for (size_t c = 0; c < kids.size(); c++) {
+        const LinearBVHNode &k = binary[kids[c]];
+        for (int axis = 0; axis < 3; axis++) {
+            node.min[axis][c] = k.min[axis];
+            node.max[axis][c] = k.max[axis];
+        }
+        node.count[c] = k.count;
+        node.child[c] = k.offset;
+    }
+    wide[idx] = node;
+
+    for (size_t c = 0; c < kids.size(); c++) {
+        if ( binary[kids[c]].count == 0 ) {
+            uint32_t child = wide.size();
+            wide.push_back(WideBVHNode<W>());
+            wide[idx].child[c] = child;
+            collapseNode(binary, kids[c], wide, child);
+        }
+    }
+}
+
+// The checks behind BVHNodes::valid(). Children always come after their parent, so one
+// pass in array order sees every node's level before it passes it on to the children.
+bool validNodes(const LinearBVHNode *nodes, size_t count, size_t prim_count)
+{
+    std::vector<uint8_t> level(count, 1);
+    for (size_t i = 0; i < count; i++) {
+        const LinearBVHNode &n = nodes[i];
+        if ( n.count > 0 ) {
+            if ( n.offset > prim_count || n.count > prim_count - n.offset ) {
+                return false;
+            }
+        } else if ( n.offset != 0 ) {
+            if ( n.offset <= i + 1 || n.offset >= count || (n.axis & ~LINEAR_BVH_SECOND_LOWER) > 2 || level[i] >= LINEAR_BVH_MAX_DEPTH ) {
+                return false;
+            }
+            level[i + 1] = std::max(level[i + 1], (uint8_t)(level[i] + 1));
+            level[n.offset] = std::max(level[n.offset], (uint8_t)(level[i] + 1));
+        }
+    }
+    return true;
+}
+
+template <int W>
+bool validNodes(const WideBVHNode<W> *nodes, size_t count, size_t prim_count)
+{
+    std::vector<uint8_t> level(count, 1);
+    for (size_t i = 0; i < count; i++) {
+        const WideBVHNode<W> &n = nodes[i];
+        if ( n.size > W ) {
+            return false;
+        }
+        for (uint32_t c = 0; c < n.size; c++) {
+            if ( n.count[c] > 0 ) {
+                if ( n.child[c] > prim_count || n.count[c] > prim_count - n.child[c] ) {
+                    return false;
+                }
+            } else {
+                if ( n.child[c] <= i || n.child[c] >= count || level[i] >= LINEAR_BVH_MAX_DEPTH ) {
+                    return false;
+                }
+                level[n.child[c]] = std::max(level[n.child[c]], (uint8_t)(level[i] + 1));
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+template <int W>
+std::vector<WideBVHNode<W>> collapseLinearBVH(const std::vector<LinearBVHNode> &binary)
+{
+    std::vector<WideBVHNode<W>> wide(1);
+    if ( !binary.empty() ) {
+        collapseNode(binary, 0, wide, 0);
+    }
+    wide.shrink_to_fit();
+    return wide;
+}
+
+template std::vector<WideBVHNode<4>> collapseLinearBVH<4>(const std::vector<LinearBVHNode> &binary);
+template std::vector<WideBVHNode<8>> collapseLinearBVH<8>(const std::vector<LinearBVHNode> &binary);
+
+void BVHNodes::assign(std::vector<LinearBVHNode> nodes, size_t width)
+{
+    clear();
+    switch ( width ) {
+    case 2:
+        binary = std::move(nodes);
+        break;
+    case 4:
+        wide4 = collapseLinearBVH<4>(nodes);
+        break;
+    case 8:
+        wide8 = collapseLinearBVH<8>(nodes);
+        break;
+    default:
+        throw std::invalid_argument("BVH width must be 2, 4 or 8");
+    }
+    w = width;
+}
+
+void BVHNodes::view(size_t width, const std::shared_ptr<const void> &storage, const void *data, size_t count)
+{
+    nodeBytes(width); // checks the width
+    clear();
+    w = width;
+    this->storage = storage;
+    viewed = data;
+    viewed_count = count;
+}
+
+void BVHNodes::clear()
+{
+    binary.clear();
+    binary.shrink_to_fit();
+    wide4.clear();
+    wide4.shrink_to_fit();
+    wide8.clear();
+    wide8.shrink_to_fit();
+    storage.reset();
+    viewed = nullptr;
+    viewed_count = 0;
+    w = 2;
+}
+
+size_t BVHNodes::size() const
+{
+    if ( viewed ) {
+        return viewed_count;
+    }
+    switch ( w ) {
+    case 4:  return wide4.size();
+    case 8:  return wide8.size();
+    default: return binary.size();
+    }
+}
+
+const void* BVHNodes::data() const
+{
+    switch ( w ) {
+    case 4:  return nodeArray(wide4);
+    case 8:  return nodeArray(wide8);
+    default: return nodeArray(binary);
+    }
+}
+
+size_t BVHNodes::nodeBytes(size_t width)
+{
+    switch ( width ) {
+    case 2:  return sizeof(LinearBVHNode);
+    case 4:  return sizeof(WideBVHNode<4>);
+    case 8:  return sizeof(WideBVHNode<8>);
+    default: throw std::invalid_argument("BVH width must be 2, 4 or 8");
+    }
+}
+
+bool BVHNodes::valid(size_t prim_count) const
+{
+    if ( size() == 0 ) {
+        return false;
+    }
+    switch ( w ) {
+    case 4:  return validNodes(nodeArray(wide4), size(), prim_count);
+    case 8:  return validNodes(nodeArray(wide8), size(), prim_count);
+    default: return validNodes(nodeArray(binary), size(), prim_count);
+    }
+}
+
+BVHBuildPrimIter sahPartition(BVHBuildPrimIter begin, BVHBuildPrimIter end)
+{
+    BoundingBox cbounds;
+    for (auto it = begin; it != end; ++it) {
+        cbounds.add(it->centroid);
+    }
+
+    double best_cost = std::numeric_limits<double>::infinity();
+    int best_axis = -1;
+    int best_bin = 0;
+
+    for (int axis = 0; axis < 3; axis++) {
+        double cmin = cbounds.min[axis];
+        double extent = cbounds.max[axis] - cmin;
+        if ( extent <= 0 ) {
+            continue;
+        }
+
+        BoundingBox bin_box[SAH_BINS];
+        size_t bin_count[SAH_BINS] = { 0 };
+        for (auto it = begin; it != end; ++it) {
+            int b = sahBin(it->centroid, axis, cmin, extent);
+            bin_box[b].add(it->box);
+            bin_count[b]++;
+        }
+
+        // Sweep from the right to get the area and count of everything past each split,
+        // then from the left to evaluate each of the SAH_BINS-1 split planes. An empty bin
+        // has an empty box, which leaves acc as it is.
+        double right_area[SAH_BINS];
+        size_t right_count[SAH_BINS];
+        BoundingBox acc;
+        size_t count = 0;
+        for (int b = SAH_BINS - 1; b > 0; b--) {
+            acc.add(bin_box[b]);
+            count += bin_count[b];
+            right_area[b] = acc.surfaceArea();
+            right_count[b] = count;
+        }
+        acc = BoundingBox();
+        count = 0;
+        for (int b = 0; b < SAH_BINS - 1; b++) {
+            acc.add(bin_box[b]);
+            count += bin_count[b];
+            if ( count == 0 || right_count[b+1] == 0 ) {
+                continue;
+            }
+            double cost = acc.surfaceArea() * count + right_area[b+1] * right_count[b+1];
+            if ( cost < best_cost ) {
+                best_cost = cost;
+                best_axis = axis;
+                best_bin = b;
+            }
+        }
+    }
+
+    if ( best_axis < 0 ) {
+        // All centroids coincide, so no plane separates them. Split by count instead.
+        return begin + (end - begin) / 2;
+    }
+
+    double cmin = cbounds.min[best_axis];
+    double extent = cbounds.max[best_axis] - cmin;
+    return std::partition(begin, end, [=](const BVHBuildPrim &p) {
+        return sahBin(p.centroid, best_axis, cmin, extent) <= best_bin;
+    });
+}
+
+namespace {
+
+// Bits of each coordinate in a Morton code
+const int MORTON_BITS = 21;
+
+// Spreads the low MORTON_BITS bits of v out to every third bit
+uint64_t expandMortonBits(uint64_t v)
+{
+    v &= (1ull << MORTON_BITS) - 1;
+    v = (v | v << 32) & 0x1f00000000ffffull;
+    v = (v | v << 16) & 0x1f0000ff0000ffull;
+    v = (v | v << 8) & 0x100f00f00f00f00full;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
+
+// The position of p within bounds along a Morton curve
+uint64_t mortonCode(const Point &p, const BoundingBox &bounds)
+{
+    uint64_t code = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        double extent = bounds.max[axis] - bounds.min[axis];
+        double f = ( extent > 0 ) ? (p.ptr()[axis] - bounds.min[axis]) / extent : 0;
+        uint64_t q = std::min<uint64_t>((1ull << MORTON_BITS) - 1, (uint64_t)(f * (1ull << MORTON_BITS)));
+        code |= expandMortonBits(q) << (2 - axis);
+    }
+    return code;
+}
+
+// Sorts [begin,end), with its halves sorted side by side while spawn lasts
+template <typename It>
+void parallelSort(It begin, It end, int spawn)
+{
+    size_t n = end - begin;
+    if ( spawn <= 0 || n < BVH_BUILD_PARALLEL_MIN_PRIMS ) {
+        std::sort(begin, end);
+        return;
+    }
+    It mid = begin + n / 2;
+    std::thread t([=] { parallelSort(begin, mid, spawn - 1); });
+    parallelSort(mid, end, spawn - 1);
+    t.join();
+    std::inplace_merge(begin, mid, end);
+}
+
+struct BinaryBVHBuild {
+    std::vector<BVHBuildPrim> &prims;
+    size_t max_leaf_size;
+    BVHMethod method;
+    std::vector<uint64_t> codes; // lbvh: the Morton code of each prim, which are sorted by it
+};
+
+// Where [begin,end) is split, reordering it if need be
+size_t splitBinaryNode(BinaryBVHBuild &b, size_t begin, size_t end, size_t depth)
+{
+    BVHBuildPrimIter first = b.prims.begin() + begin;
+    BVHBuildPrimIter last = b.prims.begin() + end;
+    if ( depth >= LINEAR_BVH_MAX_DEPTH / 2 ) {
+        BoundingBox cbounds;
+        for (auto it = first; it != last; ++it) {
+            cbounds.add(it->centroid);
+        }
+        int axis = 0;
+        Vector extent = cbounds.max - cbounds.min;
+        if ( extent.y() > extent.x() ) axis = 1;
+        if ( extent.z() > extent.ptr()[axis] ) axis = 2;
+        BVHBuildPrimIter mid = first + (end - begin) / 2;
+        std::nth_element(first, mid, last, [=](const BVHBuildPrim &p, const BVHBuildPrim &q) {
+            return p.centroid.ptr()[axis] < q.centroid.ptr()[axis];
+        });
+        return mid - b.prims.begin();
+    }
+    if ( b.method == BVHMethod::lbvh ) {
+        // The codes are sorted, so the prims whose code has the highest differing bit set
+        // are the ones from the first code at or above the last one's prefix up to that bit
+        uint64_t lo = b.codes[begin];
+        uint64_t hi = b.codes[end - 1];
+        if ( lo == hi ) {
+            return begin + (end - begin) / 2;
+        }
+        int bit = 63 - __builtin_clzll(lo ^ hi);
+        auto codes = b.codes.begin();
+        return std::lower_bound(codes + begin, codes + end, (hi >> bit) << bit) - codes;
+    }
+    return sahPartition(first, last) - b.prims.begin();
+}
+
+// Appends the subtree over prims [begin,end) to nodes in depth-first order, and returns
+// its bounds. While spawn lasts, a large node's second subtree is built on another thread
+// into nodes of its own, which are then moved in after the first.
+BoundingBox buildBinaryNode(BinaryBVHBuild &b, size_t begin, size_t end, size_t depth, int spawn,
+                            std::vector<LinearBVHNode> &nodes)
+{
+    uint32_t idx = nodes.size();
+    nodes.push_back(LinearBVHNode());
+
+    size_t n = end - begin;
+    if ( n <= b.max_leaf_size ) {
+        BoundingBox box;
+        for (size_t i = begin; i < end; i++) {
+            box.add(b.prims[i].box);
+        }
+        nodes[idx] = makeLinearBVHNode(box);
+        nodes[idx].offset = begin;
+        nodes[idx].count = n;
+        return box;
+    }
+
+    size_t mid = splitBinaryNode(b, begin, end, depth);
+    BoundingBox box, second_box;
+    uint32_t second;
+    if ( spawn > 0 && n >= BVH_BUILD_PARALLEL_MIN_PRIMS ) {
+        std::vector<LinearBVHNode> second_nodes;
+        std::thread t([&] { second_box = buildBinaryNode(b, mid, end, depth + 1, spawn - 1, second_nodes); });
+        box = buildBinaryNode(b, begin, mid, depth + 1, spawn - 1, nodes);
+        t.join();
+        second = nodes.size();
+        for (auto &node : second_nodes) {
+            if ( node.count == 0 ) {
+                node.offset += second;
+            }
+        }
+        nodes.insert(nodes.end(), second_nodes.begin(), second_nodes.end());
+    } else {
+        box = buildBinaryNode(b, begin, mid, depth + 1, spawn, nodes);
+        second = nodes.size();
+        second_box = buildBinaryNode(b, mid, end, depth + 1, spawn, nodes);
+    }
+    box.add(second_box);
+
+    LinearBVHNode node = makeLinearBVHNode(box);
+    node.offset = second;
+    node.axis = linearBVHSplitAxis(nodes[idx + 1], nodes[second]);
+    nodes[idx] = node;
+    return box;
+}
+
+} // namespace
+
+int bvhBuildSpawnDepth(size_t threads)
+{
+    if ( threads == 0 ) {
+        threads = std::thread::hardware_concurrency();
+    }
+    if ( threads <= 1 ) {
+        return 0;
+    }
+    int depth = 1;
+    while ( ((size_t)1 << (depth - 1)) < threads ) {
+        depth++;
+    }
+    return depth;
+}
+
+std::vector<LinearBVHNode> buildBinaryBVH(std::vector<BVHBuildPrim> &prims, size_t max_leaf_size,
+                                          BVHMethod method, size_t threads)
+{
+    std::vector<LinearBVHNode> nodes;
+    if ( prims.empty() ) {
+        nodes.push_back(makeLinearBVHNode(BoundingBox()));
+        return nodes;
+    }
+    int spawn = bvhBuildSpawnDepth(threads);
+    BinaryBVHBuild b{ prims, std::max<size_t>(1, std::min<size_t>(max_leaf_size, UINT16_MAX)), method, {} };
+    if ( method == BVHMethod::lbvh ) {
+        BoundingBox cbounds;
+        for (const auto &p : prims) {
+            cbounds.add(p.centroid);
+        }
+        std::vector<std::pair<uint64_t, uint32_t>> keyed(prims.size());
+        for (size_t i = 0; i < prims.size(); i++) {
+            keyed[i] = std::make_pair(mortonCode(prims[i].centroid, cbounds), (uint32_t)i);
+        }
+        parallelSort(keyed.begin(), keyed.end(), spawn);
+        std::vector<BVHBuildPrim> sorted;
+        sorted.reserve(prims.size());
+        b.codes.reserve(prims.size());
+        for (const auto &k : keyed) {
+            sorted.push_back(prims[k.second]);
+            b.codes.push_back(k.first);
+        }
+        prims.swap(sorted);
+    }
+    nodes.reserve(2 * prims.size() / b.max_leaf_size + 1);
+    buildBinaryNode(b, 0, prims.size(), 1, spawn, nodes);
+    return nodes;
+}
+
+void LinearBVH::clear()
+{
+    nodes.clear();
+    nodes.shrink_to_fit();
+    tree.clear();
+    prims.clear();
+    prims.shrink_to_fit();
+    depth = 0;
+    built = false;
+}
+
+void LinearBVH::build(Group &root, size_t width)
+{
+    clear();
+    flattenGroup(root, 1);
+    if ( depth > MAX_DEPTH ) {
+        clear();
+        return;
+    }
+    tree.assign(std::move(nodes), width);
+    nodes = std::vector<LinearBVHNode>();
+    built = true;
+}
+
+uint32_t LinearBVH::addNode(const BoundingBox &box)
+{
+    nodes.push_back(makeLinearBVHNode(box));
+    return nodes.size() - 1;
+}
+
+// Emits the node (or subtree) for one Group. A Group may hold any number of primitives and
+// subgroups, so its primitives are collected into leaves and the leaves and subgroups are
+// then paired off into a balanced binary tree.
+uint32_t LinearBVH::flattenGroup(Group &g, size_t d)
+{
+    std::vector<Item> items;
+    Item leaf;
+    leaf.group = nullptr;
+    for ( const auto &c : g.children ) {
+        if ( isInlinable(c) ) {
+            Group *sub = static_cast<Group*>(c.get());
+            if ( !sub->children.empty() ) {
+                items.push_back(Item{ sub->bbox, sub, {} });
+            }
+            // It will never be traversed on its own now, so don't keep two copies
+            sub->linear.clear();
+        } else {
+            // A transformed Group is intersected through its own LinearBVH. Dividing
+            // this tree may have discarded it.
+            Group *sub = dynamic_cast<Group*>(c.get());
+            if ( sub && !sub->linear.isBuilt() ) {
+                sub->flatten();
+            }
+            leaf.prims.push_back(c.get());
+            leaf.box.add(c->parentBounds());
+            if ( leaf.prims.size() == UINT16_MAX ) {
+                items.push_back(leaf);
+                leaf = Item();
+                leaf.group = nullptr;
+            }
+        }
+    }
+    if ( !leaf.prims.empty() ) {
+        items.push_back(leaf);
+    }
+    if ( items.empty() ) {
+        // An empty Group: a leaf with no primitives. Only the root can be empty, since
+        // empty subgroups are skipped above.
+        uint32_t idx = addNode(BoundingBox());
+        depth = std::max(depth, d);
+        return idx;
+    }
+    return flattenItems(items, 0, items.size(), d);
+}
+
+uint32_t LinearBVH::flattenItems(std::vector<Item> &items, size_t begin, size_t end, size_t d)
+{
+    if ( end - begin == 1 ) {
+        Item &item = items[begin];
+        if ( item.group ) {
+            return flattenGroup(*item.group, d);
+        }
+        uint32_t idx = addNode(item.box);
+        nodes[idx].offset = prims.size();
+        nodes[idx].count = item.prims.size();
+        prims.insert(prims.end(), item.prims.begin(), item.prims.end());
+        depth = std::max(depth, d);
+        return idx;
+    }
+
+    BoundingBox box;
+    for (size_t i = begin; i < end; i++) {
+        box.add(items[i].box);
+    }
+    uint32_t idx = addNode(box);
+
+    size_t mid = begin + (end - begin) / 2;
+    flattenItems(items, begin, mid, d + 1);
+    uint32_t second = flattenItems(items, mid, end, d + 1);
+
+    // Order the children along the axis where their centers are furthest apart, whichever
+    // of the two lies lower on it
+    uint16_t axis = linearBVHSplitAxis(nodes[idx + 1], nodes[second]);
+    nodes[idx].offset = second;
+    nodes[idx].axis = axis;
+    return idx;
+}
+
+bool LinearBVH::intersect(const Ray &ray, Iset &iset_out) const
+{
+    const double no_limit = std::numeric_limits<double>::infinity();
+    bool hit = false;
+    tree.traverse(ray, no_limit, false, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++) {
+            if ( prims[i]->intersect(ray, iset_out) ) {
+                hit = true;
+            }
+        }
+        return false;
+    });
+    return hit;
+}
+
+// hit_out.t shrinks as we go, so this also culls everything beyond the best hit
+bool LinearBVH::intersectClosest(const Ray &ray, Intersection &hit_out) const
+{
+    bool hit = false;
+    tree.traverse(ray, hit_out.t, true, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++) {
+            if ( prims[i]->intersectClosest(ray, hit_out) ) {
+                hit = true;
+            }
+        }
+        return false;
+    });
+    return hit;
+}
+
+bool LinearBVH::intersectAny(const Ray &ray, double max_t) const
+{
+    return tree.traverse(ray, max_t, true, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++) {
+            if ( prims[i]->intersectAny(ray, max_t) ) {
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+PacketMask LinearBVH::intersectPacket(const RayPacket &packet, PacketMask lanes, PacketHits &hits) const
+{
+    PacketMask found = 0;
+    tree.traversePacket(packet, lanes, hits.t,
+        [&](uint32_t first, uint32_t count, PacketMask mask) {
+            for (uint32_t i = first; i < first + count; i++) {
+                found |= prims[i]->intersectPacket(packet, mask, hits);
+            }
+        },
+        [&](const Ray &ray, int lane, uint32_t first, uint32_t count) {
+            Intersection hit;
+            hit.t = hits.t[lane];
+            for (uint32_t i = first; i < first + count; i++) {
+                if ( prims[i]->intersectClosest(ray, hit) ) {
+                    hits.set(lane, hit);
+                    found |= 1u << lane;
+                }
+            }
+        });
+    return found;
+}
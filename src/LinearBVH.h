@@ -0,0 +1,646 @@
+#pragma once
+
+#include "Ray.h"
+#include "RayPacket.h"
+#include "BoundingBox.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+class Shape;
+class Group;
+
+// One node of a LinearBVH. Bounds are stored in single precision, rounded outwards so
+// that a node never reports a miss for a ray that hits its contents.
+struct LinearBVHNode {
+    float min[3];
+    float max[3];
+    uint32_t offset; // leaf: index of its first primitive. interior: index of its second child
+    uint16_t count;  // number of primitives in a leaf, 0 for an interior node
+                     // (a leaf with count 0 is an empty root, and has offset 0)
+    uint16_t axis;   // interior: axis along which the children are separated, with
+                     // LINEAR_BVH_SECOND_LOWER set if the second child lies lower on it
+};
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode should be 32 bytes");
+
+// The bits of LinearBVHNode::axis
+#define LINEAR_BVH_AXIS_MASK 3
+#define LINEAR_BVH_SECOND_LOWER 4
+
+// A node with the given bounds and everything else zeroed
+LinearBVHNode makeLinearBVHNode(const BoundingBox &box);
+// The axis along which the centers of two sibling nodes are furthest apart, with
+// LINEAR_BVH_SECOND_LOWER set if second's center is the lower one
+uint16_t linearBVHSplitAxis(const LinearBVHNode &first, const LinearBVHNode &second);
+
+// Whether a ray should visit an interior node's second child before its first: the ray
+// heads towards the lower end of the split axis just when the second child lies there
+inline bool linearBVHSecondFirst(const LinearBVHNode &n, const bool *neg)
+{
+    return neg[n.axis & LINEAR_BVH_AXIS_MASK] != ((n.axis & LINEAR_BVH_SECOND_LOWER) != 0);
+}
+
+// A primitive's bounds while a BVH is being built over it. index tells the builder
+// which primitive it is.
+struct BVHBuildPrim {
+    BoundingBox box;
+    Point centroid;
+    uint32_t index;
+};
+typedef std::vector<BVHBuildPrim>::iterator BVHBuildPrimIter;
+
+// Binned surface area heuristic split. Reorders [begin,end) so that the prims before the
+// returned iterator go in the left child. Both sides are always non-empty.
+BVHBuildPrimIter sahPartition(BVHBuildPrimIter begin, BVHBuildPrimIter end);
+
+// How a BVH is built: not at all, by halving the bounding box on its longest axis
+// (midpoint), with the binned surface area heuristic (sah), or by sorting the primitives
+// along a Morton curve and splitting where their codes first differ (lbvh). lbvh builds
+// several times faster than sah but traces somewhat slower, which pays off for huge meshes
+// that are traced by few rays.
+enum class BVHMethod { none, midpoint, sah, lbvh };
+
+// Nodes with at least this many primitives build one of their subtrees on another thread
+#define BVH_BUILD_PARALLEL_MIN_PRIMS (1 << 12)
+// Levels of a top-down build at which a node hands a subtree to another thread: enough to
+// keep threads threads busy (0 for every hardware thread), and one more to even out
+// uneven splits. 0 for a single thread.
+int bvhBuildSpawnDepth(size_t threads);
+
+// Builds a binary tree over prims with the sah or lbvh method and returns its nodes in
+// depth-first order, laid out as in LinearBVH. prims are reordered so that each leaf holds
+// a contiguous run of them, which its offset indexes. Leaves have at most max_leaf_size
+// prims (no more than a leaf's count can hold). Past half the traversal stack's depth,
+// splits give way to median splits so that even badly clustered prims fit the stack.
+// Large subtrees are built side by side on up to about threads threads; 0 uses every
+// hardware thread, 1 builds on the calling thread alone. The tree doesn't depend on it.
+std::vector<LinearBVHNode> buildBinaryBVH(std::vector<BVHBuildPrim> &prims, size_t max_leaf_size,
+                                          BVHMethod method = BVHMethod::sah, size_t threads = 0);
+
+// Slab test against a node's bounds, with the ray's reciprocal direction computed once
+// per traversal. An axis where the ray lies in the slab's plane gives NaN and is ignored,
+// which errs on the side of a hit.
+struct LinearBVHRay {
+    double o[3];
+    double inv[3];
+    bool neg[3];
+
+    LinearBVHRay(const Ray &r) {
+        for (int i = 0; i < 3; i++) {
+            o[i] = r.origin.ptr()[i];
+            inv[i] = 1.0 / r.dir.ptr()[i];
+            neg[i] = inv[i] < 0;
+        }
+    }
+
+    bool hit(const LinearBVHNode &n, double &tmin, double &tmax) const {
+        tmin = -std::numeric_limits<double>::infinity();
+        tmax = std::numeric_limits<double>::infinity();
+        for (int i = 0; i < 3; i++) {
+            double t0 = (n.min[i] - o[i]) * inv[i];
+            double t1 = (n.max[i] - o[i]) * inv[i];
+            if ( t0 > t1 ) {
+                std::swap(t0, t1);
+            }
+            if ( t0 > tmin ) tmin = t0;
+            if ( t1 < tmax ) tmax = t1;
+        }
+        return tmin <= tmax;
+    }
+};
+
+// LinearBVHRay for every lane of a packet. Nodes are ordered by the direction of the
+// packet's first lane, which for a coherent packet is the direction of all of them.
+struct LinearBVHPacket {
+    double o[3][PACKET_SIZE];
+    double inv[3][PACKET_SIZE];
+    bool neg[3];
+
+    LinearBVHPacket(const RayPacket &p, PacketMask lanes) {
+        const double *po[3] = { p.ox, p.oy, p.oz };
+        const double *pd[3] = { p.dx, p.dy, p.dz };
+        for (int axis = 0; axis < 3; axis++) {
+            for (int i = 0; i < PACKET_SIZE; i++) {
+                o[axis][i] = po[axis][i];
+                inv[axis][i] = 1.0 / pd[axis][i];
+            }
+            neg[axis] = inv[axis][packetFirstLane(lanes)] < 0;
+        }
+    }
+
+    // The lanes that hit n somewhere in front of the origin and before max_t[lane]
+    PacketMask hit(const LinearBVHNode &n, PacketMask lanes, const double *max_t) const {
+        double near;
+        return hitBox(n.min, n.max, 1, lanes, max_t, near);
+    }
+
+    // The same for a box whose bounds along axis a are min[a * stride] and max[a * stride].
+    // near is the least distance at which one of the lanes that hit enters it.
+    PacketMask hitBox(const float *min, const float *max, size_t stride, PacketMask lanes,
+                      const double *max_t, double &near) const {
+        double tmin[PACKET_SIZE], tmax[PACKET_SIZE];
+        for (int i = 0; i < PACKET_SIZE; i++) {
+            tmin[i] = -std::numeric_limits<double>::infinity();
+            tmax[i] = std::numeric_limits<double>::infinity();
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            double bmin = min[axis * stride];
+            double bmax = max[axis * stride];
+            for (int i = 0; i < PACKET_SIZE; i++) {
+                double t0 = (bmin - o[axis][i]) * inv[axis][i];
+                double t1 = (bmax - o[axis][i]) * inv[axis][i];
+                double lo = (t0 > t1) ? t1 : t0;
+                double hi = (t0 > t1) ? t0 : t1;
+                tmin[i] = (lo > tmin[i]) ? lo : tmin[i];
+                tmax[i] = (hi < tmax[i]) ? hi : tmax[i];
+            }
+        }
+        PacketMask ret = 0;
+        near = std::numeric_limits<double>::infinity();
+        for (int i = 0; i < PACKET_SIZE; i++) {
+            bool h = ( tmin[i] <= tmax[i] && tmax[i] > 0 && tmin[i] < max_t[i] );
+            ret |= (PacketMask)h << i;
+        }
+        ret &= lanes;
+        forEachLane(ret, [&](int lane) {
+            near = std::min(near, tmin[lane]);
+        });
+        return ret;
+    }
+};
+
+// Deepest tree that traverseLinearBVH() can walk
+#define LINEAR_BVH_MAX_DEPTH 64
+// When fewer of a packet's rays than this reach a node, the packet has diverged and the
+// subtree below is walked one ray at a time
+#define LINEAR_BVH_PACKET_MIN_RAYS 2
+
+// Work done by the calling thread's BVH traversals, for comparing tree layouts: the
+// nodes visited and the boxes tested. A binary node is one box; a wide node tests the
+// boxes of all its children. A box tested against a packet counts once, however many
+// lanes it has.
+struct BVHCounters {
+    uint64_t nodes = 0;
+    uint64_t boxes = 0;
+
+    void add(uint64_t n, uint64_t b) {
+        nodes += n;
+        boxes += b;
+    }
+    static BVHCounters& current();
+};
+
+// Walks a node array iteratively, nearer child first, and calls leaf(offset, count) for
+// every leaf the ray passes through. With cull set, nodes that lie entirely behind the ray
+// origin or begin at or beyond max_t are skipped. max_t is re-read at every node, so a
+// leaf callback can shrink it as hits are found. Returns true as soon as leaf does.
+// The walk may start at any node (root) to visit only the subtree below it.
+template <typename LeafFn>
+bool traverseLinearBVH(const LinearBVHNode *nodes, const Ray &ray, const double &max_t,
+                       bool cull, LeafFn leaf, uint32_t root = 0)
+{
+    LinearBVHRay test(ray);
+    uint32_t stack[LINEAR_BVH_MAX_DEPTH];
+    int sp = 0;
+    uint32_t idx = root;
+    double tmin, tmax;
+    uint64_t visited = 0;
+
+    while ( true ) {
+        const LinearBVHNode &n = nodes[idx];
+        visited++;
+        if ( test.hit(n, tmin, tmax) && ( !cull || (tmax > 0 && tmin < max_t) ) ) {
+            if ( n.count > 0 ) {
+                if ( leaf(n.offset, n.count) ) {
+                    BVHCounters::current().add(visited, visited);
+                    return true;
+                }
+            } else if ( n.offset != 0 ) {
+                if ( linearBVHSecondFirst(n, test.neg) ) {
+                    stack[sp++] = idx + 1;
+                    idx = n.offset;
+                } else {
+                    stack[sp++] = n.offset;
+                    idx = idx + 1;
+                }
+                continue;
+            }
+        }
+        if ( sp == 0 ) {
+            BVHCounters::current().add(visited, visited);
+            return false;
+        }
+        idx = stack[--sp];
+    }
+}
+
+// Closest-hit walk of a node array for the given lanes of a packet. Each node's box is
+// tested against all the lanes that reached it at once, and packet_leaf(offset, count,
+// mask) is called with the lanes that reach a leaf. Once fewer than
+// LINEAR_BVH_PACKET_MIN_RAYS lanes are left, each of them walks the rest of the subtree
+// on its own, calling ray_leaf(ray, lane, offset, count). Nodes behind a lane's origin
+// or beyond max_t[lane] are skipped, and the leaf callbacks may shrink max_t.
+template <typename PacketLeafFn, typename RayLeafFn>
+void traverseLinearBVHPacket(const LinearBVHNode *nodes, const RayPacket &packet, PacketMask lanes,
+                             const double *max_t, PacketLeafFn packet_leaf, RayLeafFn ray_leaf)
+{
+    if ( !lanes ) {
+        return;
+    }
+    LinearBVHPacket test(packet, lanes);
+    struct Entry {
+        uint32_t idx;
+        PacketMask lanes;
+    };
+    Entry stack[LINEAR_BVH_MAX_DEPTH];
+    int sp = 0;
+    uint32_t idx = 0;
+    uint64_t visited = 0;
+
+    while ( true ) {
+        const LinearBVHNode &n = nodes[idx];
+        PacketMask hit = test.hit(n, lanes, max_t);
+        visited++;
+        if ( hit && n.count > 0 ) {
+            packet_leaf(n.offset, n.count, hit);
+        } else if ( hit && n.offset != 0 ) {
+            if ( packetLaneCount(hit) < LINEAR_BVH_PACKET_MIN_RAYS ) {
+                forEachLane(hit, [&](int lane) {
+                    Ray ray = packet.ray(lane);
+                    traverseLinearBVH(nodes, ray, max_t[lane], true, [&](uint32_t first, uint32_t count) {
+                        ray_leaf(ray, lane, first, count);
+                        return false;
+                    }, idx);
+                });
+            } else {
+                if ( linearBVHSecondFirst(n, test.neg) ) {
+                    stack[sp++] = Entry{ idx + 1, hit };
+                    idx = n.offset;
+                } else {
+                    stack[sp++] = Entry{ n.offset, hit };
+                    idx = idx + 1;
+                }
+                lanes = hit;
+                continue;
+            }
+        }
+        if ( sp == 0 ) {
+            BVHCounters::current().add(visited, visited);
+            return;
+        }
+        --sp;
+        idx = stack[sp].idx;
+        lanes = stack[sp].lanes;
+    }
+}
+
+// Children per node of the BVHs that Groups and meshes are traced through. 2 walks the
+// binary tree as built; 4 and 8 collapse it into WideBVHNodes. The binary tree visits the
+// nearer child first and traces the dragon fastest (about 900 Krays/s against 760 for 4
+// and 860 for 8), so it is the default.
+#define DEFAULT_BVH_WIDTH 2
+
+// A node with up to W children, W a multiple of 4. The children's bounds are stored axis
+// by axis, so that one slab test over arrays of W checks all of them at once. As in
+// LinearBVHNode, they are rounded outwards to float.
+template <int W>
+struct WideBVHNode {
+    float min[3][W];
+    float max[3][W];
+    uint32_t child[W]; // leaf child: index of its first primitive. interior: index of its node
+    uint16_t count[W]; // primitives in a leaf child, 0 for an interior one
+    uint32_t size;     // children in use, from the first. Only an empty root has none.
+};
+
+// Collapses a binary node array into nodes of up to W children: each node takes the place
+// of its largest interior children with their own children until it has W of them.
+// Primitives keep their indices. Depth can only shrink.
+template <int W>
+std::vector<WideBVHNode<W>> collapseLinearBVH(const std::vector<LinearBVHNode> &binary);
+
+// A ray narrowed to float for the wide slab tests, so that one register holds the bounds
+// of four children (eight with AVX). The origin is rounded towards whichever side makes
+// each slab's entry come out earlier and its exit later, and the distances are widened
+// by a few ulps afterwards, so no child is ever missed for the lack of precision.
+struct WideBVHRay {
+    float o_near[3], o_far[3];
+    float inv[3];
+    bool neg[3]; // the ray enters the slab through its max plane
+
+    WideBVHRay(const Ray &r) {
+        for (int i = 0; i < 3; i++) {
+            double o = r.origin.ptr()[i];
+            double inv_d = 1.0 / r.dir.ptr()[i];
+            float lo = (float)o, hi = lo;
+            if ( (double)lo > o ) lo = std::nextafter(lo, -std::numeric_limits<float>::infinity());
+            if ( (double)hi < o ) hi = std::nextafter(hi, std::numeric_limits<float>::infinity());
+            inv[i] = (float)inv_d;
+            neg[i] = inv_d < 0;
+            // (b - o) * inv shrinks as o grows when inv > 0, and grows when inv < 0
+            o_near[i] = neg[i] ? lo : hi;
+            o_far[i] = neg[i] ? hi : lo;
+        }
+    }
+};
+
+// Relative error allowed for in a float slab distance: the subtraction, the product and
+// the rounding of 1/dir
+#define WIDE_BVH_SLACK (4 * std::numeric_limits<float>::epsilon())
+
+// The children of n that ray hits, as a mask, and where it enters each. With cull set,
+// children entirely behind the origin or beginning at or beyond max_t are left out.
+// With SSE, four children are tested per register.
+template <int W>
+inline uint32_t wideBVHHit(const WideBVHNode<W> &n, const WideBVHRay &ray, double max_t, bool cull,
+                           float *tmin)
+{
+    // Rounded up, so that no child before max_t is culled
+    float limit = (float)max_t;
+    limit += WIDE_BVH_SLACK * std::fabs(limit);
+    uint32_t ret = 0;
+#if defined(JRAY_SIMD_SSE2) || defined(JRAY_SIMD_AVX)
+    const __m128 slack = _mm_set1_ps(WIDE_BVH_SLACK);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    for (int c = 0; c < W; c += 4) {
+        __m128 lo = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+        __m128 hi = _mm_set1_ps(std::numeric_limits<float>::infinity());
+        for (int axis = 0; axis < 3; axis++) {
+            const float *bnear = ray.neg[axis] ? n.max[axis] : n.min[axis];
+            const float *bfar = ray.neg[axis] ? n.min[axis] : n.max[axis];
+            __m128 inv = _mm_set1_ps(ray.inv[axis]);
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(bnear + c), _mm_set1_ps(ray.o_near[axis])), inv);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(bfar + c), _mm_set1_ps(ray.o_far[axis])), inv);
+            // With a NaN t0 or t1, from a ray in a slab's plane, max and min return the
+            // second operand, so the NaN is ignored as in LinearBVHRay::hit()
+            lo = _mm_max_ps(t0, lo);
+            hi = _mm_min_ps(t1, hi);
+        }
+        lo = _mm_sub_ps(lo, _mm_mul_ps(slack, _mm_andnot_ps(sign, lo)));
+        hi = _mm_add_ps(hi, _mm_mul_ps(slack, _mm_andnot_ps(sign, hi)));
+        __m128 h = _mm_cmple_ps(lo, hi);
+        if ( cull ) {
+            h = _mm_and_ps(h, _mm_cmpgt_ps(hi, _mm_setzero_ps()));
+            h = _mm_and_ps(h, _mm_cmplt_ps(lo, _mm_set1_ps(limit)));
+        }
+        _mm_storeu_ps(tmin + c, lo);
+        ret |= (uint32_t)_mm_movemask_ps(h) << c;
+    }
+#else
+    for (int c = 0; c < W; c++) {
+        float lo = -std::numeric_limits<float>::infinity();
+        float hi = std::numeric_limits<float>::infinity();
+        for (int axis = 0; axis < 3; axis++) {
+            float bnear = ray.neg[axis] ? n.max[axis][c] : n.min[axis][c];
+            float bfar = ray.neg[axis] ? n.min[axis][c] : n.max[axis][c];
+            // NaN, from a ray in a slab's plane, is ignored as in LinearBVHRay::hit()
+            float t0 = (bnear - ray.o_near[axis]) * ray.inv[axis];
+            float t1 = (bfar - ray.o_far[axis]) * ray.inv[axis];
+            lo = (t0 > lo) ? t0 : lo;
+            hi = (t1 < hi) ? t1 : hi;
+        }
+        lo -= WIDE_BVH_SLACK * std::fabs(lo);
+        hi += WIDE_BVH_SLACK * std::fabs(hi);
+        bool h = ( lo <= hi && ( !cull || (hi > 0 && lo < limit) ) );
+        tmin[c] = lo;
+        ret |= (uint32_t)h << c;
+    }
+#endif
+    return ret & ((1u << n.size) - 1);
+}
+
+// A child waiting on a wide traversal's stack, with the distance at which it was entered
+struct WideBVHEntry {
+    double t;
+    uint32_t child;
+    uint32_t count;
+    PacketMask lanes;
+};
+
+// Pushes e onto stack[first, sp), which is kept sorted with the nearest child on top
+inline void pushWideBVHEntry(WideBVHEntry *stack, int first, int &sp, const WideBVHEntry &e)
+{
+    int j = sp++;
+    while ( j > first && stack[j - 1].t < e.t ) {
+        stack[j] = stack[j - 1];
+        j--;
+    }
+    stack[j] = e;
+}
+
+// traverseLinearBVH() for a wide node array. The children that the ray hits are visited
+// in the order it enters them, and a child that it enters at or beyond max_t is skipped
+// when it comes up, which culls more than the binary walk can once a hit is found.
+template <int W, typename LeafFn>
+bool traverseWideBVH(const WideBVHNode<W> *nodes, const Ray &ray, const double &max_t,
+                     bool cull, LeafFn leaf, uint32_t root = 0)
+{
+    WideBVHRay test(ray);
+    WideBVHEntry stack[LINEAR_BVH_MAX_DEPTH * (W - 1) + 1];
+    int sp = 0;
+    uint32_t idx = root;
+    uint64_t visited = 0, tested = 0;
+
+    while ( true ) {
+        const WideBVHNode<W> &n = nodes[idx];
+        float tmin[W];
+        uint32_t hit = wideBVHHit(n, test, max_t, cull, tmin);
+        visited++;
+        tested += n.size;
+        if ( hit && !(hit & (hit - 1)) ) {
+            // Just one child: no need to order anything
+            int c = __builtin_ctz(hit);
+            if ( n.count[c] == 0 ) {
+                idx = n.child[c];
+                continue;
+            }
+            if ( leaf(n.child[c], n.count[c]) ) {
+                BVHCounters::current().add(visited, tested);
+                return true;
+            }
+        } else {
+            int first = sp;
+            for (int c = 0; c < W; c++) {
+                if ( (hit >> c) & 1 ) {
+                    pushWideBVHEntry(stack, first, sp, WideBVHEntry{ tmin[c], n.child[c], n.count[c], 0 });
+                }
+            }
+        }
+        while ( true ) {
+            if ( sp == 0 ) {
+                BVHCounters::current().add(visited, tested);
+                return false;
+            }
+            const WideBVHEntry &e = stack[--sp];
+            if ( cull && e.t >= max_t ) {
+                continue;
+            }
+            if ( e.count == 0 ) {
+                idx = e.child;
+                break;
+            }
+            if ( leaf(e.child, e.count) ) {
+                BVHCounters::current().add(visited, tested);
+                return true;
+            }
+        }
+    }
+}
+
+// traverseLinearBVHPacket() for a wide node array. Each child's box is tested against
+// all the lanes that reached its node, and the children are visited in the order the
+// nearest of their lanes enters them.
+template <int W, typename PacketLeafFn, typename RayLeafFn>
+void traverseWideBVHPacket(const WideBVHNode<W> *nodes, const RayPacket &packet, PacketMask lanes,
+                           const double *max_t, PacketLeafFn packet_leaf, RayLeafFn ray_leaf)
+{
+    if ( !lanes ) {
+        return;
+    }
+    LinearBVHPacket test(packet, lanes);
+    WideBVHEntry stack[LINEAR_BVH_MAX_DEPTH * (W - 1) + 1];
+    int sp = 0;
+    uint32_t idx = 0;
+    uint64_t visited = 0, tested = 0;
+
+    while ( true ) {
+        const WideBVHNode<W> &n = nodes[idx];
+        visited++;
+        tested += n.size;
+        int first = sp;
+        for (uint32_t c = 0; c < n.size; c++) {
+            double near;
+            PacketMask hit = test.hitBox(&n.min[0][c], &n.max[0][c], W, lanes, max_t, near);
+            if ( hit ) {
+                pushWideBVHEntry(stack, first, sp, WideBVHEntry{ near, n.child[c], n.count[c], hit });
+            }
+        }
+        while ( true ) {
+            if ( sp == 0 ) {
+                BVHCounters::current().add(visited, tested);
+                return;
+            }
+            const WideBVHEntry e = stack[--sp];
+            if ( e.count > 0 ) {
+                packet_leaf(e.child, e.count, e.lanes);
+            } else if ( packetLaneCount(e.lanes) < LINEAR_BVH_PACKET_MIN_RAYS ) {
+                forEachLane(e.lanes, [&](int lane) {
+                    Ray ray = packet.ray(lane);
+                    traverseWideBVH(nodes, ray, max_t[lane], true, [&](uint32_t first, uint32_t count) {
+                        ray_leaf(ray, lane, first, count);
+                        return false;
+                    }, e.child);
+                });
+            } else {
+                idx = e.child;
+                lanes = e.lanes;
+                break;
+            }
+        }
+    }
+}
+
+// The nodes of a BVH, either as the binary tree it was built as or collapsed into wide
+// nodes. The traversals take the same callbacks as traverseLinearBVH() and
+// traverseLinearBVHPacket().
+class BVHNodes
+{
+public:
+    // Takes over a binary node array and collapses it to the given width: 2, 4 or 8
+    void assign(std::vector<LinearBVHNode> binary, size_t width);
+    // Uses count nodes of the given width that are already laid out at data, in memory
+    // that storage keeps alive, such as a mapped MeshCache file. Nothing is copied.
+    void view(size_t width, const std::shared_ptr<const void> &storage, const void *data, size_t count);
+    void clear();
+    size_t width() const { return w; }
+    size_t size() const;
+    // The node array, of size() nodes of nodeBytes() each
+    const void* data() const;
+    static size_t nodeBytes(size_t width);
+    // Whether every child index and primitive range points inside the arrays, and the
+    // tree fits the traversal stacks. Worth checking for nodes that came from a file.
+    bool valid(size_t prim_count) const;
+
+    template <typename LeafFn>
+    bool traverse(const Ray &ray, const double &max_t, bool cull, LeafFn leaf) const {
+        switch ( w ) {
+        case 4:  return traverseWideBVH(nodeArray(wide4), ray, max_t, cull, leaf);
+        case 8:  return traverseWideBVH(nodeArray(wide8), ray, max_t, cull, leaf);
+        default: return traverseLinearBVH(nodeArray(binary), ray, max_t, cull, leaf);
+        }
+    }
+
+    template <typename PacketLeafFn, typename RayLeafFn>
+    void traversePacket(const RayPacket &packet, PacketMask lanes, const double *max_t,
+                        PacketLeafFn packet_leaf, RayLeafFn ray_leaf) const {
+        switch ( w ) {
+        case 4:  traverseWideBVHPacket(nodeArray(wide4), packet, lanes, max_t, packet_leaf, ray_leaf); break;
+        case 8:  traverseWideBVHPacket(nodeArray(wide8), packet, lanes, max_t, packet_leaf, ray_leaf); break;
+        default: traverseLinearBVHPacket(nodeArray(binary), packet, lanes, max_t, packet_leaf, ray_leaf); break;
+        }
+    }
+
+private:
+    template <typename Node>
+    const Node* nodeArray(const std::vector<Node> &owned) const {
+        return viewed ? static_cast<const Node*>(viewed) : owned.data();
+    }
+
+    size_t w = 2;
+    std::vector<LinearBVHNode> binary;
+    std::vector<WideBVHNode<4>> wide4;
+    std::vector<WideBVHNode<8>> wide8;
+    // Set by view() instead of the vectors
+    std::shared_ptr<const void> storage;
+    const void *viewed = nullptr;
+    size_t viewed_count = 0;
+};
+
+// LinearBVH compiles the Group hierarchy that divide() or divideSAH() built into a
+// contiguous array of nodes in depth-first order. The first child of an interior node is
+// the next node in the array. The binary tree may then be collapsed into wide nodes
+// (BVHNodes). Traversal is iterative, visits the nearer children first, and refers to
+// primitives by raw pointer, so no refcounts are touched and no matrix is applied for
+// the identity-transformed subgroups that make up the tree.
+//
+// Subgroups are inlined into the tree only if they have an identity transform and cast
+// shadows. Any other Group, like every other Shape, is a primitive and is intersected
+// through its own intersect functions. The primitives remain owned by the Group.
+class LinearBVH
+{
+public:
+    // Rebuilds from root's current children, with nodes of width children (2, 4 or 8).
+    // Trees deeper than the traversal stack are left unbuilt, and callers fall back to
+    // walking the Group hierarchy.
+    void build(Group &root, size_t width = DEFAULT_BVH_WIDTH);
+    void clear();
+    bool isBuilt() const { return built; }
+    size_t nodeCount() const { return tree.size(); }
+    size_t width() const { return tree.width(); }
+    size_t primitiveCount() const { return prims.size(); }
+
+    // Same contracts as Group::localIntersect, localIntersectClosest and localIntersectAny
+    bool intersect(const Ray &ray, Iset &iset_out) const;
+    bool intersectClosest(const Ray &ray, Intersection &hit_out) const;
+    bool intersectAny(const Ray &ray, double max_t) const;
+    // Same contract as Shape::localIntersectPacket
+    PacketMask intersectPacket(const RayPacket &packet, PacketMask lanes, PacketHits &hits) const;
+
+    static const int MAX_DEPTH = LINEAR_BVH_MAX_DEPTH;
+
+private:
+    struct Item;
+    uint32_t flattenGroup(Group &g, size_t depth);
+    uint32_t flattenItems(std::vector<Item> &items, size_t begin, size_t end, size_t depth);
+    uint32_t addNode(const BoundingBox &box);
+
+    std::vector<LinearBVHNode> nodes; // the binary tree, while it is being built
+    BVHNodes tree;
+    std::vector<Shape*> prims;
+    size_t depth = 0;
+    bool built = false;
+};
@@ -1,17 +1,24 @@
 #include "MainWindow.h"
+#include "ImageIO.h"
 
-MainWindow::MainWindow(size_t numRenderThreads, SceneConfig &config, std::string filename) 
+MainWindow::MainWindow(size_t numRenderThreads, SceneConfig &config, std::string filename, size_t tile_size, bool denoise) 
                          :  m_VBox(Gtk::ORIENTATION_VERTICAL, 8),
                             m_ButtonBox(Gtk::ORIENTATION_VERTICAL),
                             m_Button_Save("Save to file"),
                             m_Button_ReRender("Re-render"),
                             m_filename(filename),
-                            m_renderer(numRenderThreads, config),
+                            m_renderer(numRenderThreads, config, tile_size),
                             m_threads(numRenderThreads),
+                            m_tile_size(tile_size),
+                            m_denoise(denoise),
                             m_Dispatcher(),
                             m_RenderThread(nullptr),
+                            m_passes_shown(0),
                             config(config)
 {
+    if ( m_denoise ) {
+        m_renderer.setDenoise(true);
+    }
     signal_delete_event().connect(sigc::mem_fun(*this, &MainWindow::on_window_delete ) );
 
     set_title("Jared's Raytracer");
@@ -40,9 +47,7 @@ MainWindow::MainWindow(size_t numRenderThreads, SceneConfig &config, std::string
     m_Dispatcher.connect(sigc::mem_fun(*this, &MainWindow::on_render_notify));
 
     // fill image with gray pixels as a placeholder
-    auto refPixbuf = m_renderer.getPixbuf();
-    refPixbuf->fill(0xaaaaaaff);
-    m_Image.set(refPixbuf);
+    wrap_canvas();
 
     show_all();
     start_render();
@@ -60,19 +65,28 @@ void MainWindow::on_rerender_clicked()
     m_Button_Save.set_sensitive(false); 
     kill_render();
     reload_config();
-    
-    auto refPixbuf = m_renderer.getPixbuf();
-    refPixbuf->fill(0xaaaaaaff);
-    m_Image.set(refPixbuf);
+    wrap_canvas();
 
     start_render();
 
 }
 
+void MainWindow::wrap_canvas()
+{
+    Canvas &canvas = m_renderer.getCanvas();
+    canvas.fill(Color(0xaa / 255.0, 0xaa / 255.0, 0xaa / 255.0));
+    m_pixbuf = Gdk::Pixbuf::create_from_data(canvas.data(), Gdk::COLORSPACE_RGB, false, 8,
+                                             canvas.get_width(), canvas.get_height(), canvas.get_width() * 3);
+    m_Image.set(m_pixbuf);
+}
+
 void MainWindow::reload_config()
 {
     config = SceneConfig(m_filename);
-    m_renderer = Renderer(m_threads, config);
+    m_renderer = Renderer(m_threads, config, m_tile_size);
+    if ( m_denoise ) {
+        m_renderer.setDenoise(true);
+    }
     set_size_request(config.getWidth(), config.getHeight());
     resize(config.getWidth(), config.getHeight());
 }
@@ -80,6 +94,8 @@ void MainWindow::reload_config()
 
 void MainWindow::start_render()
 {
+    m_passes_shown = 0;
+    set_title("Jared's Raytracer");
 
     m_render_start = std::chrono::steady_clock::now();
     m_TimeoutHandler = Glib::signal_timeout().connect(sigc::mem_fun(*this, &MainWindow::update_pixbuf), 10);
@@ -90,7 +106,7 @@ void MainWindow::start_render()
         m_RenderThread = new std::thread(
             [this]
             {
-                m_renderer.render(this);
+                m_renderer.render([this]() { notify(); });
             });
     }
 
@@ -100,8 +116,15 @@ void MainWindow::start_render()
 
 bool MainWindow::update_pixbuf()
 {
-    auto refPixbuf = m_renderer.getPixbuf();
-    m_Image.set(refPixbuf);
+    m_Image.set(m_pixbuf);
+    if ( m_renderer.isProgressive() ) {
+        // Progressive passes refine the whole image, so show how far along it is
+        size_t passes = m_renderer.getPassesDone();
+        if ( passes != m_passes_shown ) {
+            set_title("Jared's Raytracer (" + std::to_string(passes) + " samples per pixel)");
+            m_passes_shown = passes;
+        }
+    }
     if (m_RenderThread) {
         return true;
     }
@@ -140,6 +163,9 @@ void MainWindow::on_button_save_clicked()
     filter_images->add_mime_type("image/jpeg");
     filter_images->add_mime_type("image/png");
     filter_images->add_mime_type("image/bmp");
+    filter_images->add_pattern("*.ppm");
+    filter_images->add_pattern("*.exr");
+    filter_images->add_pattern("*.pfm");
     dialog.add_filter(filter_images);
 
     dialog.set_current_name("image.png");
@@ -147,21 +173,19 @@ void MainWindow::on_button_save_clicked()
     
     int result = dialog.run();
     std::string filename;
-    std::string fileext;
 
     switch (result)
     {
         case(Gtk::RESPONSE_OK):
             filename = dialog.get_filename();
-            fileext = getFileExtension(filename);
-            if (fileext != "jpg" && fileext != "jpeg" && fileext != "png" && fileext != "bmp") {
+            if (!can_save_image(filename)) {
                 Gtk::MessageDialog errorDialog(dialog, "Invalid file extension");
-                errorDialog.set_secondary_text("Please specify a supported image file extension (jpg, bmp, png)");
+                errorDialog.set_secondary_text("Please specify a supported image file extension (png, jpg, bmp, ppm, exr, pfm)");
                 errorDialog.set_transient_for(dialog);
                 errorDialog.run();
                 break;
             }
-            m_renderer.getCanvas().save(filename);
+            m_renderer.save(filename);
             break;
         case(Gtk::RESPONSE_CANCEL):
             break;
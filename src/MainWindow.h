@@ -10,7 +10,8 @@
 class MainWindow : public Gtk::Window
 {
 public:
-    MainWindow(size_t numRenderThreads, SceneConfig &config, std::string filename);
+    MainWindow(size_t numRenderThreads, SceneConfig &config, std::string filename, size_t tile_size = DEFAULT_TILE_SIZE,
+               bool denoise = false);
     virtual ~MainWindow();
 
     void on_loader_area_prepared();
@@ -28,6 +29,8 @@ public:
 
     bool update_pixbuf();
     void kill_render();
+    // Shows the renderer's canvas, which is wrapped rather than copied
+    void wrap_canvas();
 
 protected:
     Gtk::Box m_VBox;
@@ -36,14 +39,18 @@ protected:
     Gtk::Button m_Button_ReRender;
     Gtk::Frame m_Frame;
     Gtk::Image m_Image;
+    Glib::RefPtr<Gdk::Pixbuf> m_pixbuf;
     std::string m_filename; // hold on to this for reloading config to re-render
     Renderer m_renderer;
     size_t m_threads;
+    size_t m_tile_size;
+    bool m_denoise; // denoise even if the scene doesn't ask for it
     std::chrono::time_point<std::chrono::steady_clock> m_render_start;
 
     sigc::connection m_TimeoutHandler;
     Glib::Dispatcher m_Dispatcher;
     std::thread* m_RenderThread;
+    size_t m_passes_shown; // progressive passes shown in the title
 
     // The config object is passed to the constructor, and lasts for the duration of the program.
     // I'm OK with this being a reference member because we don't need operator= for MainWindow.
@@ -0,0 +1,38 @@
+#include "MappedFile.h"
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &filename, bool sequential)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if ( fd < 0 ) {
+        throw std::runtime_error("Cannot open " + filename);
+    }
+    struct stat st;
+    if ( fstat(fd, &st) != 0 ) {
+        close(fd);
+        throw std::runtime_error("Cannot stat " + filename);
+    }
+    len = st.st_size;
+    if ( len > 0 ) {
+        addr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if ( addr == MAP_FAILED ) {
+            addr = nullptr;
+            close(fd);
+            throw std::runtime_error("Cannot map " + filename);
+        }
+        madvise(addr, len, sequential ? MADV_SEQUENTIAL : MADV_NORMAL);
+    }
+    // The mapping stays valid once the descriptor is closed
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if ( addr ) {
+        munmap(addr, len);
+    }
+}
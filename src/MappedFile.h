@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// A whole file mapped read-only into memory. Pages are read in by the kernel as they are
+// touched, so even a file of several GB is never copied onto the heap. Throws
+// std::runtime_error if the file can't be opened or mapped. An empty file maps to
+// nothing, with a null data(). Unless sequential is false, the kernel is told that the
+// file will be read front to back.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &filename, bool sequential = true);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return static_cast<const char*>(addr); }
+    size_t size() const { return len; }
+
+private:
+    void *addr = nullptr;
+    size_t len = 0;
+};
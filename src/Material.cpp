@@ -4,7 +4,7 @@
 #include "util.h"
 #include <math.h>
 
-//Color Material::lighting(const std::shared_ptr<Shape> &obj, const Light &light, const Point &p, const Vector &eye, const Vector &n, double intensity) const
+//Color Material::lighting(const Shape *obj, const Light &light, const Point &p, const Vector &eye, const Vector &n, double intensity) const
 //{
 //    Color color;
 //    if ( m_pattern_ptr ) {
@@ -43,14 +43,9 @@
 //    return ambient + diffuse*intensity + specular*intensity;
 //}
 
-Color Material::lighting(const std::shared_ptr<Shape> &obj, const Light &light, const Point &p, const Vector &eye, const Vector &n, double intensity) const
+Color Material::lighting(const Shape *obj, const Light &light, const Point &p, const Vector &eye, const Vector &n, double intensity) const
 {
-    Color color;
-    if ( m_pattern_ptr ) {
-        color = m_pattern_ptr->patternAtShape(obj, p);
-    } else {
-        color = m_color;
-    }
+    Color color = colorAt(obj, p);
     Color effective_color = color * light.intensity;
     Color ambient = effective_color * m_ambient;
 
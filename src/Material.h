@@ -63,7 +63,11 @@ public:
     }
     friend bool operator!=(const Material &m1, const Material &m2) { return !(m1 == m2); }
     
-    Color lighting(const std::shared_ptr<Shape> &obj, const Light &l, const Point &p, const Vector &eye, const Vector &n, double intensity) const;
+    Color lighting(const Shape *obj, const Light &l, const Point &p, const Vector &eye, const Vector &n, double intensity) const;
+    // Surface color at p on obj: the pattern if there is one, otherwise the plain color
+    Color colorAt(const Shape *obj, const Point &p) const {
+        return m_pattern_ptr ? m_pattern_ptr->patternAtShape(obj, p) : m_color;
+    }
     
     void setColor(const Color &c) { m_color = c; }
     void setPattern(const std::shared_ptr<Pattern> &p) { m_pattern_ptr = p; }
@@ -75,15 +79,15 @@ public:
     void setTransparency(double transparency) { m_transparency = transparency; }
     void setRefractiveIndex(double rindex) { m_refractive_index = rindex; }
 
-    Color getColor() { return m_color; }
-    std::shared_ptr<Pattern> getPattern() { return m_pattern_ptr; }
-    double getAmbient() { return m_ambient; }
-    double getDiffuse() { return m_diffuse; }
-    double getSpecular() { return m_specular; }
-    double getShininess() { return m_shininess; }
-    double getReflective() { return m_reflective; }
-    double getTransparency() { return m_transparency; }
-    double getRefractiveIndex() { return m_refractive_index; }
+    Color getColor() const { return m_color; }
+    std::shared_ptr<Pattern> getPattern() const { return m_pattern_ptr; }
+    double getAmbient() const { return m_ambient; }
+    double getDiffuse() const { return m_diffuse; }
+    double getSpecular() const { return m_specular; }
+    double getShininess() const { return m_shininess; }
+    double getReflective() const { return m_reflective; }
+    double getTransparency() const { return m_transparency; }
+    double getRefractiveIndex() const { return m_refractive_index; }
 
 private:
     std::shared_ptr<Pattern> m_pattern_ptr;
@@ -70,3 +70,8 @@ Matrix operator*(const Matrix &m1, const Matrix &m2);
 Matrix operator*(const Matrix &m1, double f);
 Matrix operator*(double f, const Matrix &m1);
 Matrix operator/(const Matrix& m1, double f);
+
+// Point and Vector overloads of the Matrix-Tuple multiply. Besides returning the right type,
+// these keep overload resolution unambiguous now that a Matrix converts to a Matrix4.
+inline Point operator*(const Matrix &m, const Point &p) { return Point(m * static_cast<const Tuple&>(p)); }
+inline Vector operator*(const Matrix &m, const Vector &v) { return Vector(m * static_cast<const Tuple&>(v)); }
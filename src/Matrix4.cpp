@@ -0,0 +1,235 @@
+#include "Matrix4.h"
+
+Matrix4::Matrix4(std::initializer_list<double> list)
+{
+    if (list.size() != 16) {
+        throw std::invalid_argument("Bad initializer list given to Matrix4 constructor");
+    }
+    auto itr = list.begin();
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            (*this)(i,j) = *itr++;
+        }
+    }
+}
+
+Matrix4::Matrix4(const Matrix &M)
+{
+    if (M.rows() != 4 || M.cols() != 4) {
+        throw std::invalid_argument("Cannot convert non-4x4 Matrix to Matrix4");
+    }
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            (*this)(i,j) = M(i,j);
+        }
+    }
+}
+
+Matrix4::operator Matrix() const
+{
+    Matrix M(4,4);
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            M(i,j) = (*this)(i,j);
+        }
+    }
+    return M;
+}
+
+bool Matrix4::isIdentity() const
+{
+    const Matrix4 &a = *this;
+    return doubleEqual(a(0,0) , 1) &&
+           doubleEqual(a(1,1) , 1) &&
+           doubleEqual(a(2,2) , 1) &&
+           doubleEqual(a(3,3) , 1);
+}
+
+Matrix4 Matrix4::transpose() const
+{
+    Matrix4 ret;
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            ret.m[i][j] = m[j][i];
+        }
+    }
+    return ret;
+}
+
+// Both det() and inverse() expand the 4x4 determinant using the 2x2 minors of the top two
+// rows (s0..s5) and of the bottom two rows (c0..c5), rather than recursing into 3x3
+// submatrices like Matrix does.
+double Matrix4::det() const
+{
+    const Matrix4 &a = *this;
+    double s0 = a(0,0) * a(1,1) - a(1,0) * a(0,1);
+    double s1 = a(0,0) * a(1,2) - a(1,0) * a(0,2);
+    double s2 = a(0,0) * a(1,3) - a(1,0) * a(0,3);
+    double s3 = a(0,1) * a(1,2) - a(1,1) * a(0,2);
+    double s4 = a(0,1) * a(1,3) - a(1,1) * a(0,3);
+    double s5 = a(0,2) * a(1,3) - a(1,2) * a(0,3);
+
+    double c5 = a(2,2) * a(3,3) - a(3,2) * a(2,3);
+    double c4 = a(2,1) * a(3,3) - a(3,1) * a(2,3);
+    double c3 = a(2,1) * a(3,2) - a(3,1) * a(2,2);
+    double c2 = a(2,0) * a(3,3) - a(3,0) * a(2,3);
+    double c1 = a(2,0) * a(3,2) - a(3,0) * a(2,2);
+    double c0 = a(2,0) * a(3,1) - a(3,0) * a(2,1);
+
+    return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+}
+
+Matrix4 Matrix4::inverse() const
+{
+    const Matrix4 &a = *this;
+    double s0 = a(0,0) * a(1,1) - a(1,0) * a(0,1);
+    double s1 = a(0,0) * a(1,2) - a(1,0) * a(0,2);
+    double s2 = a(0,0) * a(1,3) - a(1,0) * a(0,3);
+    double s3 = a(0,1) * a(1,2) - a(1,1) * a(0,2);
+    double s4 = a(0,1) * a(1,3) - a(1,1) * a(0,3);
+    double s5 = a(0,2) * a(1,3) - a(1,2) * a(0,3);
+
+    double c5 = a(2,2) * a(3,3) - a(3,2) * a(2,3);
+    double c4 = a(2,1) * a(3,3) - a(3,1) * a(2,3);
+    double c3 = a(2,1) * a(3,2) - a(3,1) * a(2,2);
+    double c2 = a(2,0) * a(3,3) - a(3,0) * a(2,3);
+    double c1 = a(2,0) * a(3,2) - a(3,0) * a(2,2);
+    double c0 = a(2,0) * a(3,1) - a(3,0) * a(2,1);
+
+    double d = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    if ( d == 0 ) {
+        throw std::logic_error("Cannot inverse non-invertible matrix");
+    }
+    double invdet = 1.0 / d;
+
+    Matrix4 B;
+    B(0,0) = ( a(1,1) * c5 - a(1,2) * c4 + a(1,3) * c3) * invdet;
+    B(0,1) = (-a(0,1) * c5 + a(0,2) * c4 - a(0,3) * c3) * invdet;
+    B(0,2) = ( a(3,1) * s5 - a(3,2) * s4 + a(3,3) * s3) * invdet;
+    B(0,3) = (-a(2,1) * s5 + a(2,2) * s4 - a(2,3) * s3) * invdet;
+
+    B(1,0) = (-a(1,0) * c5 + a(1,2) * c2 - a(1,3) * c1) * invdet;
+    B(1,1) = ( a(0,0) * c5 - a(0,2) * c2 + a(0,3) * c1) * invdet;
+    B(1,2) = (-a(3,0) * s5 + a(3,2) * s2 - a(3,3) * s1) * invdet;
+    B(1,3) = ( a(2,0) * s5 - a(2,2) * s2 + a(2,3) * s1) * invdet;
+
+    B(2,0) = ( a(1,0) * c4 - a(1,1) * c2 + a(1,3) * c0) * invdet;
+    B(2,1) = (-a(0,0) * c4 + a(0,1) * c2 - a(0,3) * c0) * invdet;
+    B(2,2) = ( a(3,0) * s4 - a(3,1) * s2 + a(3,3) * s0) * invdet;
+    B(2,3) = (-a(2,0) * s4 + a(2,1) * s2 - a(2,3) * s0) * invdet;
+
+    B(3,0) = (-a(1,0) * c3 + a(1,1) * c1 - a(1,2) * c0) * invdet;
+    B(3,1) = ( a(0,0) * c3 - a(0,1) * c1 + a(0,2) * c0) * invdet;
+    B(3,2) = (-a(3,0) * s3 + a(3,1) * s1 - a(3,2) * s0) * invdet;
+    B(3,3) = ( a(2,0) * s3 - a(2,1) * s1 + a(2,2) * s0) * invdet;
+
+    return B;
+}
+
+/* Static functions */
+Matrix4 Matrix4::identity()
+{
+    return Matrix4({ 1, 0, 0, 0,
+                     0, 1, 0, 0,
+                     0, 0, 1, 0,
+                     0, 0, 0, 1 });
+}
+
+Matrix4 Matrix4::translation(double x, double y, double z)
+{
+    Matrix4 tr = identity();
+    tr(0,3) = x;
+    tr(1,3) = y;
+    tr(2,3) = z;
+    return tr;
+}
+Matrix4 Matrix4::scaling(double x, double y, double z)
+{
+    Matrix4 s = identity();
+    s(0,0) = x;
+    s(1,1) = y;
+    s(2,2) = z;
+    return s;
+}
+Matrix4 Matrix4::rotation_x(double radians)
+{
+    Matrix4 r = identity();
+    r(1,1) = cos(radians);
+    r(1,2) = -sin(radians);
+    r(2,1) = sin(radians);
+    r(2,2) = cos(radians);
+    return r;
+}
+Matrix4 Matrix4::rotation_y(double radians)
+{
+    Matrix4 r = identity();
+    r(0,0) = cos(radians);
+    r(0,2) = sin(radians);
+    r(2,0) = -sin(radians);
+    r(2,2) = cos(radians);
+    return r;
+}
+Matrix4 Matrix4::rotation_z(double radians)
+{
+    Matrix4 r = identity();
+    r(0,0) = cos(radians);
+    r(0,1) = -sin(radians);
+    r(1,0) = sin(radians);
+    r(1,1) = cos(radians);
+    return r;
+}
+Matrix4 Matrix4::shearing(double x_y, double x_z, double y_x, double y_z, double z_x, double z_y)
+{
+    Matrix4 s = identity();
+    s(0,1) = x_y;
+    s(0,2) = x_z;
+    s(1,0) = y_x;
+    s(1,2) = y_z;
+    s(2,0) = z_x;
+    s(2,1) = z_y;
+    return s;
+}
+
+/* Non-member functions */
+
+bool operator==(const Matrix4 &A, const Matrix4 &B)
+{
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            if (!doubleEqual(A(i,j) , B(i,j))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool operator!=(const Matrix4 &A, const Matrix4 &B)
+{
+    return !(A == B);
+}
+
+bool operator==(const Matrix4 &A, const Matrix &B)
+{
+    if (B.rows() != 4 || B.cols() != 4) {
+        return false;
+    }
+    return A == Matrix4(B);
+}
+
+bool operator==(const Matrix &A, const Matrix4 &B) { return B == A; }
+bool operator!=(const Matrix4 &A, const Matrix &B) { return !(A == B); }
+bool operator!=(const Matrix &A, const Matrix4 &B) { return !(B == A); }
+
+std::ostream& operator<<(std::ostream &os, const Matrix4 &M)
+{
+    for (int i = 0; i < 4; i++) {
+        os << M(i,0);
+        for (int j = 1; j < 4; j++) {
+            os << " ";
+            os << M(i,j);
+        }
+        os << std::endl;
+    }
+    return os;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include "util.h"
+#include "Tuple.h"
+#include "Vector.h"
+#include "Point.h"
+#include "Matrix.h"
+#include "Simd.h"
+#include <initializer_list>
+#include <iostream>
+
+// Matrix4 is a fixed-size 4x4 matrix with its elements stored inline, in column-major order
+// so that the SIMD kernels in Simd.h can load whole columns.
+// It is what shapes, patterns, the camera and rays use for their transforms: copying one
+// never allocates, element access isn't range checked, and the inverse and transpose are
+// computed in closed form. The general Matrix class is still used for arbitrary sizes
+// (submatrix, cofactor) and converts to and from Matrix4.
+class Matrix4 {
+
+public:
+    Matrix4() : m{} { } // zero matrix, like Matrix(4,4)
+    Matrix4(std::initializer_list<double> list);
+    // Converting from a Matrix throws std::invalid_argument unless it is 4x4
+    Matrix4(const Matrix &M);
+    operator Matrix() const;
+
+    // Element access. Unlike Matrix, no bounds checking is done here.
+    double& operator()(unsigned r, unsigned c) { return m[c][r]; }
+    double operator()(unsigned r, unsigned c) const { return m[c][r]; }
+
+    Matrix4& operator*=(const Matrix4 &B);
+
+    static Matrix4 identity();
+    static Matrix4 translation(double x, double y, double z);
+    static Matrix4 scaling(double x, double y, double z);
+    static Matrix4 rotation_x(double radians);
+    static Matrix4 rotation_y(double radians);
+    static Matrix4 rotation_z(double radians);
+    static Matrix4 shearing(double x_y, double x_z, double y_x, double y_z, double z_x, double z_y);
+
+    bool isIdentity() const;
+    Matrix4 transpose() const;
+    double det() const;
+    // Throws std::logic_error if the matrix is not invertible, just like Matrix::inverse()
+    Matrix4 inverse() const;
+
+    Matrix4 translate(double x, double y, double z) const { return translation(x,y,z) * (*this); }
+    Matrix4 scale(double x, double y, double z) const { return scaling(x,y,z) * (*this); }
+    Matrix4 rotate_x(double radians) const { return rotation_x(radians) * (*this); }
+    Matrix4 rotate_y(double radians) const { return rotation_y(radians) * (*this); }
+    Matrix4 rotate_z(double radians) const { return rotation_z(radians) * (*this); }
+    Matrix4 shear(double x_y, double x_z, double y_x, double y_z, double z_x, double z_y) const {
+        return shearing(x_y, x_z, y_x, y_z, z_x, z_y) * (*this);
+    }
+
+    friend Matrix4 operator*(const Matrix4 &A, const Matrix4 &B);
+    friend Tuple operator*(const Matrix4 &M, const Tuple &t);
+    friend Point operator*(const Matrix4 &M, const Point &p);
+    friend Vector operator*(const Matrix4 &M, const Vector &v);
+
+    friend std::ostream& operator<<(std::ostream& os, const Matrix4 &M);
+
+private:
+    double m[4][4]; // m[column][row]
+};
+
+inline Matrix4 operator*(const Matrix4 &A, const Matrix4 &B)
+{
+    Matrix4 C;
+    simd_mat4_mul(&A.m[0][0], &B.m[0][0], &C.m[0][0]);
+    return C;
+}
+
+inline Matrix4& Matrix4::operator*=(const Matrix4 &B)
+{
+    return (*this = (*this) * B);
+}
+
+inline Tuple operator*(const Matrix4 &M, const Tuple &t)
+{
+    double r[4];
+    simd_mat4_mul_tuple(&M.m[0][0], t.ptr(), r);
+    return Tuple(r[0], r[1], r[2], r[3]);
+}
+
+// Points and vectors skip the bottom row: a Point always comes back with w=1 and a Vector
+// with w=0. Vectors also skip the translation column.
+inline Point operator*(const Matrix4 &M, const Point &p)
+{
+    Point ret;
+    simd_mat4_mul_xyz(&M.m[0][0], p.ptr(), true, ret.ptr());
+    ret[3] = 1;
+    return ret;
+}
+
+inline Vector operator*(const Matrix4 &M, const Vector &v)
+{
+    Vector ret;
+    simd_mat4_mul_xyz(&M.m[0][0], v.ptr(), false, ret.ptr());
+    ret[3] = 0;
+    return ret;
+}
+
+bool operator==(const Matrix4 &A, const Matrix4 &B);
+bool operator!=(const Matrix4 &A, const Matrix4 &B);
+// Mixed comparisons, so comparing a Matrix4 with a Matrix isn't ambiguous
+bool operator==(const Matrix4 &A, const Matrix &B);
+bool operator==(const Matrix &A, const Matrix4 &B);
+bool operator!=(const Matrix4 &A, const Matrix &B);
+bool operator!=(const Matrix &A, const Matrix4 &B);
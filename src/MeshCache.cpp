@@ -0,0 +1,435 @@
+#include "MeshCache.h"
+#include "MappedFile.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char MESH_CACHE_MAGIC[8] = { 'J', 'R', 'A', 'Y', 'M', 'E', 'S', 'H' };
+// Bump whenever the layout of the file changes in a way the record sizes don't show
+const uint32_t MESH_CACHE_VERSION = 3;
+const uint32_t MESH_CACHE_BYTE_ORDER = 0x01020304;
+// Every array starts at a multiple of this, so that it is aligned once mapped
+const uint64_t MESH_CACHE_ALIGN = 64;
+
+struct MeshCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    // The sizes of the records, as this build lays them out
+    uint32_t vertex_bytes;
+    uint32_t normal_bytes;
+    uint32_t face_bytes;
+    uint32_t node_bytes;
+    // The builder settings
+    uint32_t leaf_size;
+    uint32_t width;
+    uint32_t precision;
+    uint32_t method; // of the meshes' BVHs, as meshBVHMethod() gives it
+    // The obj file the meshes were built from
+    uint64_t source_size;
+    uint64_t source_mtime; // in ns
+    uint64_t source_hash;
+    uint64_t group_count;
+    uint64_t mesh_count;
+    uint64_t vertex_count;
+    uint64_t normal_count;
+    uint64_t face_count;
+    uint64_t node_count;
+    // Offsets of the arrays in the file
+    uint64_t meshes_at;
+    uint64_t vertices_at;
+    uint64_t normals_at;
+    uint64_t faces_at;
+    uint64_t nodes_at;
+    uint64_t file_size;
+};
+
+// One mesh: the group of the obj file it is in, as in ObjParser::meshes, and its ranges
+// of the face and node arrays
+struct MeshCacheRecord {
+    uint64_t group;
+    uint64_t first_face;
+    uint64_t face_count;
+    uint64_t first_node;
+    uint64_t node_count;
+    double min[3];
+    double max[3];
+};
+
+inline uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+// A fast 64-bit hash, four words at a time. Not cryptographic: it only tells whether a
+// file has changed.
+uint64_t hashBytes(const char *p, size_t n)
+{
+    const uint64_t k1 = 0x9e3779b97f4a7c15ULL;
+    const uint64_t k2 = 0xc2b2ae3d27d4eb4fULL;
+    uint64_t h[4] = { n, k1, k2, n ^ k1 };
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        for (int l = 0; l < 4; l++) {
+            uint64_t w;
+            std::memcpy(&w, p + i + 8 * l, 8);
+            h[l] = rotl(h[l] + w * k2, 31) * k1;
+        }
+    }
+    uint64_t out = n;
+    for (; i < n; i++) {
+        out = (out ^ (uint8_t)p[i]) * 0x100000001b3ULL;
+    }
+    for (int l = 0; l < 4; l++) {
+        out = rotl(out ^ (h[l] * k2), 27) * k1 + 0x52dce729;
+    }
+    out ^= out >> 33;
+    out *= k2;
+    out ^= out >> 29;
+    return out;
+}
+
+uint64_t hashFile(const std::string &filename)
+{
+    MappedFile file(filename);
+    return hashBytes(file.data(), file.size());
+}
+
+uint64_t mtimeNs(const struct stat &st)
+{
+#ifdef __APPLE__
+    const struct timespec &ts = st.st_mtimespec;
+#else
+    const struct timespec &ts = st.st_mtim;
+#endif
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+std::string joinPath(const std::string &dir, const std::string &name)
+{
+    return ( !dir.empty() && dir.back() == '/' ) ? dir + name : dir + "/" + name;
+}
+
+uint64_t alignUp(uint64_t at)
+{
+    return (at + MESH_CACHE_ALIGN - 1) / MESH_CACHE_ALIGN * MESH_CACHE_ALIGN;
+}
+
+// Whether count records of the given size starting at an aligned offset fit in the file
+bool fits(uint64_t at, uint64_t count, uint64_t bytes, uint64_t file_size)
+{
+    return at % MESH_CACHE_ALIGN == 0 && at <= file_size && count <= (file_size - at) / bytes;
+}
+
+// Whether [first, first + count) lies within [0, total)
+bool inRange(uint64_t first, uint64_t count, uint64_t total)
+{
+    return first <= total && count <= total - first;
+}
+
+// The header for this build's layout of a Mesh, with the arrays left empty
+template <typename Mesh>
+MeshCacheHeader makeHeader(BVHMethod method, size_t leaf_size, size_t width, MeshPrecision precision)
+{
+    MeshCacheHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, MESH_CACHE_MAGIC, sizeof(h.magic));
+    h.version = MESH_CACHE_VERSION;
+    h.byte_order = MESH_CACHE_BYTE_ORDER;
+    h.vertex_bytes = sizeof(typename Mesh::Vertex);
+    h.normal_bytes = sizeof(Vector);
+    h.face_bytes = sizeof(typename Mesh::Face);
+    h.node_bytes = BVHNodes::nodeBytes(width);
+    h.leaf_size = leaf_size;
+    h.width = width;
+    h.precision = (uint32_t)precision;
+    h.method = (uint32_t)meshBVHMethod(method);
+    return h;
+}
+
+// Whether the header describes a file of file_size bytes that this build can use as is
+bool validHeader(const MeshCacheHeader &h, const MeshCacheHeader &expected, uint64_t file_size)
+{
+    return std::memcmp(h.magic, expected.magic, sizeof(h.magic)) == 0 &&
+           h.version == expected.version && h.byte_order == expected.byte_order &&
+           h.vertex_bytes == expected.vertex_bytes && h.normal_bytes == expected.normal_bytes &&
+           h.face_bytes == expected.face_bytes && h.node_bytes == expected.node_bytes &&
+           h.leaf_size == expected.leaf_size && h.width == expected.width &&
+           h.precision == expected.precision && h.method == expected.method && h.file_size == file_size && h.group_count > 0 &&
+           fits(h.meshes_at, h.mesh_count, sizeof(MeshCacheRecord), file_size) &&
+           fits(h.vertices_at, h.vertex_count, h.vertex_bytes, file_size) &&
+           fits(h.normals_at, h.normal_count, h.normal_bytes, file_size) &&
+           fits(h.faces_at, h.face_count, h.face_bytes, file_size) &&
+           fits(h.nodes_at, h.node_count, h.node_bytes, file_size);
+}
+
+// Adds a mesh over the mapped arrays for each record, to the group it was in
+template <typename Mesh>
+bool addCachedMeshes(const std::shared_ptr<MappedFile> &file, const MeshCacheHeader &h,
+                     const std::vector<std::shared_ptr<Group>> &groups)
+{
+    typedef typename Mesh::Vertex Vertex;
+    typedef typename Mesh::Face Face;
+    const char *base = file->data();
+    const MeshCacheRecord *records = reinterpret_cast<const MeshCacheRecord*>(base + h.meshes_at);
+    for (uint64_t i = 0; i < h.mesh_count; i++) {
+        const MeshCacheRecord &r = records[i];
+        if ( r.group >= h.group_count || r.node_count == 0 || !inRange(r.first_face, r.face_count, h.face_count) ||
+             !inRange(r.first_node, r.node_count, h.node_count) ) {
+            return false;
+        }
+    }
+    // The header can be intact over a damaged payload, and a bad index would only show
+    // once a ray reads through it, so every face and node is checked up front
+    const Face *all_faces = reinterpret_cast<const Face*>(base + h.faces_at);
+    for (uint64_t i = 0; i < h.face_count; i++) {
+        const Face &f = all_faces[i];
+        for (int c = 0; c < 3; c++) {
+            if ( f.v[c] >= h.vertex_count ) {
+                return false;
+            }
+            if ( f.n[0] != Mesh::NO_NORMAL && f.n[c] >= h.normal_count ) {
+                return false;
+            }
+        }
+    }
+
+    std::shared_ptr<const Vertex> vertices(file, reinterpret_cast<const Vertex*>(base + h.vertices_at));
+    std::shared_ptr<const Vector> normals(file, reinterpret_cast<const Vector*>(base + h.normals_at));
+    for (uint64_t i = 0; i < h.mesh_count; i++) {
+        const MeshCacheRecord &r = records[i];
+        std::shared_ptr<const Face> faces(file, reinterpret_cast<const Face*>(base + h.faces_at) + r.first_face);
+        BVHNodes nodes;
+        nodes.view(h.width, file, base + h.nodes_at + r.first_node * h.node_bytes, r.node_count);
+        if ( !nodes.valid(r.face_count) ) {
+            return false;
+        }
+        BoundingBox box(Point(r.min[0], r.min[1], r.min[2]), Point(r.max[0], r.max[1], r.max[2]));
+        groups[r.group]->addChild(Mesh::make(vertices, normals, faces, r.face_count, std::move(nodes), box));
+    }
+    return true;
+}
+
+template <typename Mesh>
+bool saveMeshes(const std::string &path, const ObjParser &parser, MeshCacheHeader h, uint64_t source_size,
+                uint64_t source_mtime, uint64_t source_hash)
+{
+    typedef typename Mesh::Vertex Vertex;
+    typedef typename Mesh::Face Face;
+    std::vector<std::shared_ptr<Mesh>> meshes;
+    std::vector<MeshCacheRecord> records;
+    for (const auto &gm : parser.meshes) {
+        auto mesh = std::dynamic_pointer_cast<Mesh>(gm.second);
+        if ( !mesh || mesh->bvhWidth() != h.width ) {
+            throw std::logic_error("MeshCache: the meshes were not built with the cache's settings");
+        }
+        BoundingBox box = mesh->bounds();
+        MeshCacheRecord r = { gm.first, h.face_count, mesh->faceCount(), h.node_count, mesh->nodeCount(),
+                              { box.min.x(), box.min.y(), box.min.z() }, { box.max.x(), box.max.y(), box.max.z() } };
+        records.push_back(r);
+        meshes.push_back(mesh);
+        h.face_count += r.face_count;
+        h.node_count += r.node_count;
+    }
+    // All the meshes share the vertex and normal arrays
+    const Vertex *vertices = meshes.empty() ? nullptr : meshes[0]->vertexData();
+    const Vector *normals = meshes.empty() ? nullptr : meshes[0]->normalData();
+
+    h.source_size = source_size;
+    h.source_mtime = source_mtime;
+    h.source_hash = source_hash;
+    h.group_count = parser.group_count;
+    h.mesh_count = records.size();
+    h.vertex_count = vertices ? parser.vertices.size() : 0;
+    h.normal_count = normals ? parser.normals.size() : 0;
+    h.meshes_at = alignUp(sizeof(h));
+    h.vertices_at = alignUp(h.meshes_at + h.mesh_count * sizeof(MeshCacheRecord));
+    h.normals_at = alignUp(h.vertices_at + h.vertex_count * sizeof(Vertex));
+    h.faces_at = alignUp(h.normals_at + h.normal_count * sizeof(Vector));
+    h.nodes_at = alignUp(h.faces_at + h.face_count * sizeof(Face));
+    h.file_size = h.nodes_at + h.node_count * h.node_bytes;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    uint64_t at = 0;
+    auto put = [&](uint64_t to, const void *data, uint64_t bytes) {
+        static const char zeros[MESH_CACHE_ALIGN] = { 0 };
+        out.write(zeros, to - at);
+        out.write(static_cast<const char*>(data), bytes);
+        at = to + bytes;
+    };
+    put(0, &h, sizeof(h));
+    put(h.meshes_at, records.data(), h.mesh_count * sizeof(MeshCacheRecord));
+    put(h.vertices_at, vertices, h.vertex_count * sizeof(Vertex));
+    put(h.normals_at, normals, h.normal_count * sizeof(Vector));
+    put(h.faces_at, nullptr, 0);
+    for (const auto &mesh : meshes) {
+        put(at, mesh->faceData(), mesh->faceCount() * sizeof(Face));
+    }
+    put(h.nodes_at, nullptr, 0);
+    for (const auto &mesh : meshes) {
+        put(at, mesh->bvh().data(), mesh->nodeCount() * h.node_bytes);
+    }
+    out.close();
+    return !out.fail();
+}
+
+} // namespace
+
+MeshCache::MeshCache(const std::string &filename, BVHMethod bvh_method, size_t bvh_leaf_size, MeshPrecision precision,
+                     size_t bvh_width, const std::string &dir) :
+    filename(filename), bvh_method(bvh_method), bvh_leaf_size(bvh_leaf_size), precision(precision),
+    bvh_width(bvh_width)
+{
+    // The name is the obj's, a hash of where the obj is, so that files of the same name
+    // from different places get caches of their own in a shared directory, and a hash of
+    // the settings. The first two make up the prefix that all of the obj's caches share.
+    char *real = realpath(filename.c_str(), nullptr);
+    std::string where = real ? real : filename;
+    free(real);
+    std::ostringstream key;
+    key << "v" << MESH_CACHE_VERSION << "|" << bvh_leaf_size << "|" << bvh_width << "|" << (int)precision
+        << "|" << (int)meshBVHMethod(bvh_method);
+    std::string k = key.str();
+
+    size_t slash = filename.find_last_of('/');
+    std::string base = ( slash == std::string::npos ) ? filename : filename.substr(slash + 1);
+    if ( !dir.empty() ) {
+        cache_dir = dir;
+    } else {
+        cache_dir = ( slash == std::string::npos ) ? "." : filename.substr(0, slash + 1);
+    }
+    std::ostringstream prefix;
+    prefix << base << "." << std::hex << std::setw(8) << std::setfill('0')
+           << (uint32_t)hashBytes(where.data(), where.size()) << ".";
+    cache_prefix = prefix.str();
+    std::ostringstream name;
+    name << cache_prefix << std::hex << std::setw(16) << std::setfill('0') << hashBytes(k.data(), k.size()) << ".jmesh";
+    cache_path = ( dir.empty() && slash == std::string::npos ) ? name.str() : joinPath(cache_dir, name.str());
+}
+
+std::shared_ptr<Group> MeshCache::load() const
+{
+    struct stat st;
+    if ( stat(filename.c_str(), &st) != 0 || access(cache_path.c_str(), R_OK) != 0 ) {
+        return nullptr;
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<MappedFile> file;
+    try {
+        // Rays touch the arrays all over
+        file = std::make_shared<MappedFile>(cache_path, false);
+    } catch (const std::runtime_error &e) {
+        return nullptr;
+    }
+
+    MeshCacheHeader h;
+    MeshCacheHeader expected = ( precision == MeshPrecision::single_precision )
+                               ? makeHeader<FloatTriangleMesh>(bvh_method, bvh_leaf_size, bvh_width, precision)
+                               : makeHeader<TriangleMesh>(bvh_method, bvh_leaf_size, bvh_width, precision);
+    if ( file->size() < sizeof(h) ) {
+        return nullptr;
+    }
+    std::memcpy(&h, file->data(), sizeof(h));
+    if ( !validHeader(h, expected, file->size()) || h.source_size != (uint64_t)st.st_size ) {
+        return nullptr;
+    }
+    // Only touched: the contents decide. The cache is never written here, so that it can
+    // sit in a read-only directory or be shared, and a touched obj is hashed on every load
+    // until the cache is saved again.
+    if ( h.source_mtime != mtimeNs(st) && h.source_hash != hashFile(filename) ) {
+        return nullptr;
+    }
+
+    // The groups as ObjParser makes them: every g line adds one to obj
+    auto obj = Group::make();
+    std::vector<std::shared_ptr<Group>> groups(1, obj);
+    for (uint64_t i = 1; i < h.group_count; i++) {
+        groups.push_back(Group::make());
+        obj->addChild(groups.back());
+    }
+    bool ok = ( precision == MeshPrecision::single_precision ) ? addCachedMeshes<FloatTriangleMesh>(file, h, groups)
+                                                              : addCachedMeshes<TriangleMesh>(file, h, groups);
+    if ( !ok ) {
+        return nullptr;
+    }
+    obj->buildBVH(bvh_method, bvh_leaf_size, bvh_width);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Loaded " << filename << " from " << cache_path << ": " << h.face_count << " triangles in "
+              << h.mesh_count << " meshes in " << std::fixed << std::setprecision(3) << seconds << " s"
+              << std::endl;
+    std::cout.unsetf(std::ios_base::floatfield);
+    std::cout << std::setprecision(6);
+    return obj;
+}
+
+bool MeshCache::save(const ObjParser &parser) const
+{
+    struct stat st;
+    if ( stat(filename.c_str(), &st) != 0 ) {
+        std::cerr << "Cannot write mesh cache: " << filename << " is gone" << std::endl;
+        return false;
+    }
+    size_t slash = cache_path.find_last_of('/');
+    if ( slash != std::string::npos && slash > 0 ) {
+        mkdir(cache_path.substr(0, slash).c_str(), 0777); // fails harmlessly if it exists
+    }
+
+    std::string tmp = cache_path + ".tmp" + std::to_string(getpid());
+    bool ok;
+    if ( precision == MeshPrecision::single_precision ) {
+        ok = saveMeshes<FloatTriangleMesh>(tmp, parser,
+                                           makeHeader<FloatTriangleMesh>(bvh_method, bvh_leaf_size, bvh_width, precision),
+                                           st.st_size, mtimeNs(st), hashFile(filename));
+    } else {
+        ok = saveMeshes<TriangleMesh>(tmp, parser,
+                                      makeHeader<TriangleMesh>(bvh_method, bvh_leaf_size, bvh_width, precision),
+                                      st.st_size, mtimeNs(st), hashFile(filename));
+    }
+    if ( !ok || std::rename(tmp.c_str(), cache_path.c_str()) != 0 ) {
+        std::remove(tmp.c_str());
+        std::cerr << "Cannot write mesh cache " << cache_path << std::endl;
+        return false;
+    }
+    std::cout << "Saved mesh cache " << cache_path << std::endl;
+    removeOtherCaches();
+    return true;
+}
+
+// Caches of the same obj with other settings, or from before it changed, would otherwise
+// pile up, so an obj keeps just the one that was written last
+void MeshCache::removeOtherCaches() const
+{
+    DIR *d = opendir(cache_dir.c_str());
+    if ( !d ) {
+        return;
+    }
+    const std::string suffix = ".jmesh";
+    size_t slash = cache_path.find_last_of('/');
+    std::string own = ( slash == std::string::npos ) ? cache_path : cache_path.substr(slash + 1);
+    while ( struct dirent *e = readdir(d) ) {
+        std::string name = e->d_name;
+        if ( name.size() > cache_prefix.size() + suffix.size() && name.compare(0, cache_prefix.size(), cache_prefix) == 0 &&
+             name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0 ) {
+            std::string path = joinPath(cache_dir, name);
+            if ( name != own && std::remove(path.c_str()) == 0 ) {
+                std::cout << "Removed old mesh cache " << path << std::endl;
+            }
+        }
+    }
+    closedir(d);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Group.h"
+#include "ObjParser.h"
+#include "TriangleMesh.h"
+#include <memory>
+#include <string>
+
+// MeshCache keeps what ObjParser builds from an obj file in a binary file: the vertex and
+// normal arrays, and the faces and flattened BVH of every mesh, laid out exactly as the
+// meshes use them. Loading maps the file and points the meshes straight at it, so nothing
+// is parsed, built or even copied, and the pages are only read in as rays reach them.
+// Only the BVH over the meshes themselves, which has one primitive per group, is rebuilt.
+//
+// A cache belongs to one obj file and one set of mesh builder settings: the leaf size,
+// BVH width, precision and mesh BVH method (see meshBVHMethod), which make up its name
+// together with where the obj is. It lives next to the obj file unless a directory is
+// given, and saving one removes the obj's other caches there, so there is only ever one
+// per obj. The file starts with a versioned header that records the size, modification
+// time and a hash of the contents of the obj file it was built from, as well as the
+// sizes of the records in it. A cache only loads if all of that matches, so a stale one,
+// or one written by a build with a different layout, is simply rebuilt. The obj file is
+// only hashed if its modification time has changed. Loading never writes to the cache.
+class MeshCache
+{
+public:
+    MeshCache(const std::string &filename, BVHMethod bvh_method = BVHMethod::sah, size_t bvh_leaf_size = 4,
+              MeshPrecision precision = DEFAULT_MESH_PRECISION, size_t bvh_width = DEFAULT_BVH_WIDTH,
+              const std::string &dir = "");
+
+    // Where the cache is, or would be written
+    const std::string& path() const { return cache_path; }
+
+    // The geometry ObjParser would build from the obj file, with the BVH built with
+    // bvh_method, or nullptr if there is no valid cache for it
+    std::shared_ptr<Group> load() const;
+
+    // Writes the meshes parser built from the obj file with the same settings. The file is
+    // written under another name and then renamed, so a cache is never seen half written.
+    // Returns false, with a warning, if it can't be written.
+    bool save(const ObjParser &parser) const;
+
+private:
+    void removeOtherCaches() const;
+
+    std::string filename;
+    BVHMethod bvh_method;
+    size_t bvh_leaf_size;
+    MeshPrecision precision;
+    size_t bvh_width;
+    std::string cache_dir;
+    std::string cache_prefix; // of the names of all of the obj's caches
+    std::string cache_path;
+};
@@ -1,126 +1,479 @@
 #include "ObjParser.h"
-#include <fstream>
+#include "MappedFile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <locale>
+#include <sstream>
+#include <thread>
 
-ObjParser::ObjParser(const std::string &filename) : obj(Group::make()), cur_group(obj)
+namespace {
+
+// Adds one mesh to each group that has faces, all sharing one copy of the vertices
+template <typename Mesh, typename GroupFaces, typename MeshList>
+void addMeshes(GroupFaces &group_faces, const std::vector<Point> &vertices, const std::vector<Vector> &normals,
+               BVHMethod method, size_t leaf_size, size_t width, size_t &face_count, MeshList &meshes)
 {
-    std::ifstream file;
-    file.exceptions(std::ifstream::badbit | std::ifstream::failbit);
-    file.open(filename);
-    file.exceptions(std::ifstream::badbit);
-    std::cout << "Parsing file " << filename << "..." << std::flush;
-    parse(file);
-    std::cout << " Done." << std::endl;
-    file.close();
+    auto shared_vertices = Mesh::makeVertices(vertices);
+    auto shared_normals = std::make_shared<const std::vector<Vector>>(normals);
+    for (size_t i = 0; i < group_faces.size(); i++) {
+        auto &gf = group_faces[i];
+        if ( !gf.second.empty() ) {
+            face_count += gf.second.size();
+            auto mesh = Mesh::make(shared_vertices, shared_normals, std::move(gf.second), leaf_size, width,
+                                   method);
+            gf.first->addChild(mesh);
+            meshes.emplace_back(i, mesh);
+        }
+    }
+}
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
 }
 
-ObjParser::ObjParser(std::istream &is) : obj(Group::make()), cur_group(obj)
+inline bool isDigit(char c)
 {
-    parse(is);
+    return c >= '0' && c <= '9';
 }
 
-void ObjParser::parse(std::istream &is)
+inline const char* skipSpaces(const char *p, const char *end)
 {
-    std::string line;
-    size_t linenum = 0;
+    while ( p < end && isSpace(*p) ) {
+        p++;
+    }
+    return p;
+}
 
-    while (std::getline(is, line)) {
-        linenum++;
-        //std::cout << "Line num: " << linenum << std::endl;
-        std::istringstream iss(line);
-        std::string cmd;
-        if ( !(iss >> cmd) ) { continue; }
+// Reads an integer at p, which is left after it. False if there is none.
+bool parseInt(const char *&p, const char *end, long &out)
+{
+    const char *s = p;
+    bool neg = false;
+    if ( s < end && (*s == '-' || *s == '+') ) {
+        neg = (*s == '-');
+        s++;
+    }
+    if ( s == end || !isDigit(*s) ) {
+        return false;
+    }
+    long v = 0;
+    while ( s < end && isDigit(*s) ) {
+        v = v * 10 + (*s - '0');
+        s++;
+    }
+    out = neg ? -v : v;
+    p = s;
+    return true;
+}
 
-        if ( cmd == "v" ) {
-            Point p;
-            if ( iss >> p ) {
-                vertices.push_back(p);
+// Reads a decimal number at p, which is left after it. A number with at most 15
+// significant digits and a power of ten of at most 22 either way is one multiplication
+// or division of two exactly representable doubles, and so comes out correctly
+// rounded, just as from strtod. Anything else goes through a stream in the "C" locale.
+bool parseDouble(const char *&p, const char *end, double &out)
+{
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char *s = p;
+    bool neg = false;
+    if ( s < end && (*s == '-' || *s == '+') ) {
+        neg = (*s == '-');
+        s++;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0;   // significant digits in mantissa
+    int exponent = 0; // power of ten to scale mantissa by
+    bool any = false;
+    while ( s < end && isDigit(*s) ) {
+        if ( digits < 19 ) {
+            mantissa = mantissa * 10 + (*s - '0');
+            digits += (mantissa != 0);
+        } else {
+            digits++;
+            exponent++;
+        }
+        any = true;
+        s++;
+    }
+    if ( s < end && *s == '.' ) {
+        s++;
+        while ( s < end && isDigit(*s) ) {
+            if ( digits < 19 ) {
+                mantissa = mantissa * 10 + (*s - '0');
+                digits += (mantissa != 0);
+                exponent--;
+            } else {
+                digits++;
             }
+            any = true;
+            s++;
         }
+    }
+    if ( !any ) {
+        return false;
+    }
+    if ( s < end && (*s == 'e' || *s == 'E') ) {
+        const char *e = s + 1;
+        long exp;
+        if ( parseInt(e, end, exp) ) {
+            exponent += (int)std::max(-100000L, std::min(100000L, exp));
+            s = e;
+        }
+    }
+    if ( s < end && !isSpace(*s) ) {
+        return false;
+    }
 
-        if ( cmd == "vn" ) {
-            Vector n;
-            if ( iss >> n ) {
-                normals.push_back(n);
-            }
+    if ( digits <= 15 && exponent >= -22 && exponent <= 22 ) {
+        double v = (double)mantissa;
+        v = (exponent < 0) ? v / pow10[-exponent] : v * pow10[exponent];
+        out = neg ? -v : v;
+    } else {
+        std::istringstream iss(std::string(p, s));
+        iss.imbue(std::locale::classic());
+        if ( !(iss >> out) ) {
+            return false;
+        }
+    }
+    p = s;
+    return true;
+}
+
+// Reads three numbers into t's x, y and z. Anything after them is ignored.
+template <typename T>
+bool parseTriple(const char *p, const char *end, T &t)
+{
+    for (int i = 0; i < 3; i++) {
+        p = skipSpaces(p, end);
+        if ( !parseDouble(p, end, t[i]) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Where the chunk that would start at p really starts: at the beginning of the next line
+const char* lineStart(const char *begin, const char *end, const char *p)
+{
+    if ( p <= begin ) {
+        return begin;
+    }
+    const char *eol = static_cast<const char*>(std::memchr(p - 1, '\n', end - (p - 1)));
+    return eol ? eol + 1 : end;
+}
+
+} // namespace
+
+struct ObjParser::Polygon {
+    size_t ncorners;
+    size_t nvertices; // vertices and normals this chunk had read before the polygon
+    size_t nnormals;
+    size_t new_groups; // g lines between the previous polygon in this chunk and this one
+};
+
+// A run of whole lines, parsed on its own thread. Faces can only be resolved once the
+// vertices and normals of all the chunks before this one have been counted, so they
+// are kept as read until then.
+struct ObjParser::Chunk {
+    const char *begin, *end;
+    // The first chunk knows how many vertices and normals came before it from the start,
+    // and resolves its faces as it goes
+    bool resolve_now = false;
+    size_t vertex_offset = 0;
+    size_t normal_offset = 0;
+    std::vector<Point> vertices;
+    std::vector<Vector> normals;
+    std::vector<Polygon> polygons;
+    std::vector<long> corners; // vertex and normal index of every corner, in turn
+    size_t trailing_groups = 0; // g lines after the last polygon
+    std::vector<long> vindices, nindices; // the valid corners of the polygon being resolved
+
+    // The resolved triangles. The first list continues the group the chunk began in,
+    // and every g line starts another.
+    std::vector<std::vector<MeshFace>> faces;
+};
+
+ObjParser::ObjParser(const std::string &filename, BVHMethod bvh_method, size_t bvh_leaf_size, MeshPrecision precision,
+                     size_t bvh_width, size_t threads) :
+    obj(Group::make()), cur_group(obj), bvh_method(bvh_method), bvh_leaf_size(bvh_leaf_size), precision(precision),
+    bvh_width(bvh_width)
+{
+    MappedFile file(filename);
+    std::cout << "Parsing file " << filename << "..." << std::flush;
+    auto start = std::chrono::steady_clock::now();
+    size_t chunks = parse(file.data(), file.data() + file.size(), threads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double mb = file.size() / 1e6;
+    std::cout << " Done. " << std::fixed << std::setprecision(1) << mb << " MB in " << std::setprecision(3)
+              << seconds << " s (" << std::setprecision(0) << (seconds > 0 ? mb / seconds : 0) << " MB/s, "
+              << chunks << ( chunks == 1 ? " thread)" : " threads)" ) << std::endl;
+    std::cout.unsetf(std::ios_base::floatfield);
+    std::cout << std::setprecision(6);
+    build();
+    std::cout << "Mesh: " << face_count << " triangles in " << meshes.size() << " meshes"
+              << ( precision == MeshPrecision::single_precision ? " (single precision)" : "" ) << std::endl;
+    if ( bvh_method != BVHMethod::none ) {
+        std::cout << "BVH: " << obj->bvhStats() << std::endl;
+    }
+}
+
+ObjParser::ObjParser(std::istream &is, BVHMethod bvh_method, size_t bvh_leaf_size, MeshPrecision precision,
+                     size_t bvh_width, size_t threads) :
+    obj(Group::make()), cur_group(obj), bvh_method(bvh_method), bvh_leaf_size(bvh_leaf_size), precision(precision),
+    bvh_width(bvh_width)
+{
+    std::string text((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    parse(text.data(), text.data() + text.size(), threads);
+    build();
+}
+
+size_t ObjParser::parse(const char *begin, const char *end, size_t threads)
+{
+    size_t size = end - begin;
+    if ( threads == 0 ) {
+        threads = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(),
+                                                         size / OBJ_PARSE_MIN_CHUNK_SIZE));
+    }
+    threads = std::max<size_t>(1, std::min(threads, size));
+
+    std::vector<Chunk> chunks(threads);
+    for (size_t i = 0; i < threads; i++) {
+        chunks[i].begin = lineStart(begin, end, begin + size * i / threads);
+        chunks[i].end = lineStart(begin, end, begin + size * (i + 1) / threads);
+    }
+    auto runAll = [&](const std::function<void(size_t)> &work) {
+        std::vector<std::thread> pool;
+        for (size_t i = 1; i < threads; i++) {
+            pool.push_back(std::thread(work, i));
+        }
+        work(0);
+        for (auto &th : pool) {
+            th.join();
         }
+    };
+
+    chunks[0].resolve_now = true;
+    chunks[0].vertex_offset = vertices.size();
+    chunks[0].normal_offset = normals.size();
+
+    runAll([&](size_t i) { parseChunk(chunks[i]); });
+
+    // Each chunk's first vertex and normal in the whole file
+    size_t nvertices = vertices.size(), nnormals = normals.size();
+    for (auto &chunk : chunks) {
+        chunk.vertex_offset = nvertices;
+        chunk.normal_offset = nnormals;
+        nvertices += chunk.vertices.size();
+        nnormals += chunk.normals.size();
+    }
+
+    if ( threads > 1 ) {
+        runAll([&](size_t i) { resolveChunk(chunks[i]); });
+    }
 
-        if ( cmd == "f" ) {
-            // vectors to hold parts of each space-deliniated vertex parameter
-            std::vector<int> vindices; // vertex indices
-            std::vector<int> nindices; // normal indices
-
-            std::string vertex_tmp; // vertex specifier string, e.g. 1/2/3 or 2/102/1 or 4//303
-            int vindex_tmp; // vertex index component
-            int nindex_tmp; // normal index component
-            bool normals_given = true; // will set this to false later if normal is unset for any vertex
-            int nnormals = 0;
-
-            while ( iss >> vertex_tmp ) {
-                nindex_tmp = 0; // ensures any unset normal index has value 0 (works nicely since obj indices begin at 1)
-                std::istringstream vertex_iss(vertex_tmp);
-                std::string substr;
-
-                std::vector<std::string> parts;
-                while (vertex_iss.good()) {
-                    std::getline(vertex_iss, substr, '/');
-                    parts.push_back(substr);
-                }
-                vindex_tmp = std::stoi(parts[0]);
-                if (parts.size() == 3) {
-                    nindex_tmp = std::stoi(parts[2]);
-                    nnormals++;
-                }
-
-                if (abs(vindex_tmp) > vertices.size()) { continue; }
-                vindices.push_back(vindex_tmp);
-                nindices.push_back(nindex_tmp); // will push 0 if field left blank, which is fine
+    if ( vertices.empty() ) {
+        vertices.swap(chunks[0].vertices);
+    }
+    if ( normals.empty() ) {
+        normals.swap(chunks[0].normals);
+    }
+    vertices.reserve(nvertices);
+    normals.reserve(nnormals);
+    group_faces.clear();
+    group_faces.emplace_back(cur_group, std::vector<MeshFace>());
+    for (auto &chunk : chunks) {
+        vertices.insert(vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        for (size_t j = 0; j < chunk.faces.size(); j++) {
+            if ( j > 0 ) {
+                // named groups are kinda pointless but we'll use the g command as a hint
+                // to create a subgroup.
+                auto g = Group::make();
+                cur_group = g;
+                obj->addChild(g);
+                group_faces.emplace_back(g, std::vector<MeshFace>());
+            }
+            std::vector<MeshFace> &dest = group_faces.back().second;
+            if ( dest.empty() ) {
+                dest.swap(chunk.faces[j]);
+            } else {
+                dest.insert(dest.end(), chunk.faces[j].begin(), chunk.faces[j].end());
             }
-            int npoints = vindices.size();
-            if (npoints < 3 || npoints > vertices.size() ) { continue; }
-            if (nnormals > normals.size()) { continue; }
+        }
+        chunk = Chunk();
+    }
+    return threads;
+}
 
-            if (nnormals < npoints) {
-                normals_given = false;
+void ObjParser::parseChunk(Chunk &chunk)
+{
+    const char *line = chunk.begin;
+    const char *end = chunk.end;
+    size_t new_groups = 0;
+    chunk.faces.emplace_back();
+    while ( line < end ) {
+        const char *eol = static_cast<const char*>(std::memchr(line, '\n', end - line));
+        if ( !eol ) {
+            eol = end;
+        }
+        const char *p = skipSpaces(line, eol);
+        const char *cmd = p;
+        while ( p < eol && !isSpace(*p) ) {
+            p++;
+        }
+        size_t cmd_len = p - cmd;
+
+        if ( cmd_len == 1 && cmd[0] == 'v' ) {
+            Point v(0, 0, 0);
+            if ( parseTriple(p, eol, v) ) {
+                chunk.vertices.push_back(v);
+            }
+        } else if ( cmd_len == 2 && cmd[0] == 'v' && cmd[1] == 'n' ) {
+            Vector n(0, 0, 0);
+            if ( parseTriple(p, eol, n) ) {
+                chunk.normals.push_back(n);
+            }
+        } else if ( cmd_len == 1 && cmd[0] == 'f' ) {
+            Polygon poly = { 0, chunk.vertices.size(), chunk.normals.size(), new_groups };
+            poly.ncorners = parseCorners(p, eol, chunk.corners);
+            if ( chunk.resolve_now ) {
+                addPolygon(chunk, poly, chunk.corners.data());
+                chunk.corners.clear();
+            } else {
+                chunk.polygons.push_back(poly);
             }
-            
-            // Triangulation loop for any arbitrary polygon.
-            for (int i = 1; i <= (npoints - 2); ++i) {
-                std::shared_ptr<Shape> t;
-                int vi1 = vindices[0]-1;
-                int vi2 = vindices[i]-1;
-                int vi3 = vindices[i+1]-1;
-                int ni1 = nindices[0]-1;
-                int ni2 = nindices[i]-1;
-                int ni3 = nindices[i+1]-1;
-
-                vi1 = vi1 < 0 ? vertices.size() + vi1 + 1 : vi1;
-                vi2 = vi2 < 0 ? vertices.size() + vi2 + 1 : vi2;
-                vi3 = vi3 < 0 ? vertices.size() + vi3 + 1 : vi3;
-                ni1 = ni1 < 0 ? normals.size() + ni1 + 1 : ni1;
-                ni2 = ni2 < 0 ? normals.size() + ni2 + 1 : ni2;
-                ni3 = ni3 < 0 ? normals.size() + ni3 + 1 : ni3;
-
-                //std::cout << "Making Triangle " << vertices[vi1] << vertices[vi2] << vertices[vi3] << std::endl;
-                if (normals_given) {
-                    t = Triangle::make(vertices[vi1], vertices[vi2], vertices[vi3], normals[ni1], normals[ni2], normals[ni3]);
-                } else {
-                    t = Triangle::make(vertices[vi1], vertices[vi2], vertices[vi3]);
-                }
-                cur_group->addChild(t);
+            new_groups = 0;
+        } else if ( cmd_len == 1 && cmd[0] == 'g' ) {
+            if ( chunk.resolve_now ) {
+                chunk.faces.emplace_back();
+            } else {
+                new_groups++;
             }
         }
+        line = eol + 1;
+    }
+    chunk.trailing_groups = new_groups;
+}
+
+// Each corner is v, v/t, v//n or v/t/n. Malformed corners are left out here; the
+// indices are checked once they can be resolved. Returns the corners appended.
+size_t ObjParser::parseCorners(const char *p, const char *end, std::vector<long> &corners)
+{
+    size_t n = 0;
+    while ( (p = skipSpaces(p, end)) < end ) {
+        long vindex = 0;
+        long nindex = 0; // 0 if unset, which is fine since obj indices begin at 1
+        long tindex;
+        bool valid = parseInt(p, end, vindex);
+        if ( valid && p < end && *p == '/' ) {
+            p++;
+            parseInt(p, end, tindex); // texture coordinates aren't used
+            if ( p < end && *p == '/' ) {
+                p++;
+                parseInt(p, end, nindex);
+            }
+        }
+        // Skip whatever is left of a malformed corner
+        while ( p < end && !isSpace(*p) ) {
+            valid = false;
+            p++;
+        }
+        if ( valid ) {
+            corners.push_back(vindex);
+            corners.push_back(nindex);
+            n++;
+        }
+    }
+    return n;
+}
+
+void ObjParser::resolveChunk(Chunk &chunk)
+{
+    if ( chunk.resolve_now ) {
+        return;
+    }
+    const long *corners = chunk.corners.data();
+    for (const auto &poly : chunk.polygons) {
+        addPolygon(chunk, poly, corners);
+        corners += 2 * poly.ncorners;
+    }
+    for (size_t i = 0; i < chunk.trailing_groups; i++) {
+        chunk.faces.emplace_back();
+    }
+    chunk.corners = std::vector<long>();
+    chunk.polygons = std::vector<Polygon>();
+}
 
-        // named groups are kinda pointless but we'll use the g command as a hint
-        // to create a subgroup.
-        if ( cmd == "g" ) {
-            auto g = Group::make();
-            cur_group = g;
-            obj->addChild(g);
+// Indices count from 1, or back from the last vertex or normal read so far if negative.
+// Corners whose vertex doesn't exist are left out, and the normals are only used if
+// every corner has a valid one.
+void ObjParser::addPolygon(Chunk &chunk, const Polygon &poly, const long *corners)
+{
+    for (size_t g = 0; g < poly.new_groups; g++) {
+        chunk.faces.emplace_back();
+    }
+    size_t vcount = chunk.vertex_offset + poly.nvertices;
+    size_t ncount = chunk.normal_offset + poly.nnormals;
+    std::vector<long> &vindices = chunk.vindices, &nindices = chunk.nindices;
+    vindices.clear();
+    nindices.clear();
+    size_t nnormals = 0;
+    for (size_t c = 0; c < poly.ncorners; c++) {
+        long vindex = corners[2 * c], nindex = corners[2 * c + 1];
+        if ( vindex == 0 || (size_t)std::labs(vindex) > vcount ) { continue; }
+        if ( nindex != 0 && (size_t)std::labs(nindex) <= ncount ) {
+            nnormals++;
         }
+        vindices.push_back(vindex);
+        nindices.push_back(nindex);
+    }
+    size_t npoints = vindices.size();
+    if ( npoints < 3 ) { return; }
 
+    // An index resolves against the vertices and normals read before this face
+    auto resolve = [](long index, size_t count) -> uint32_t {
+        return index < 0 ? count + index : index - 1;
+    };
+    bool normals_given = ( nnormals == npoints );
+    std::vector<MeshFace> &faces = chunk.faces.back();
 
+    // Triangulation loop for any arbitrary polygon.
+    for (size_t i = 1; i + 1 < npoints; ++i) {
+        MeshFace f;
+        f.v[0] = resolve(vindices[0], vcount);
+        f.v[1] = resolve(vindices[i], vcount);
+        f.v[2] = resolve(vindices[i+1], vcount);
+        if ( normals_given ) {
+            f.n[0] = resolve(nindices[0], ncount);
+            f.n[1] = resolve(nindices[i], ncount);
+            f.n[2] = resolve(nindices[i+1], ncount);
+        } else {
+            f.n[0] = f.n[1] = f.n[2] = TriangleMesh::NO_NORMAL;
+        }
+        faces.push_back(f);
     }
+}
 
-    obj->divide(4);
+void ObjParser::build()
+{
+    if ( precision == MeshPrecision::single_precision ) {
+        addMeshes<FloatTriangleMesh>(group_faces, vertices, normals, bvh_method, bvh_leaf_size, bvh_width,
+                                     face_count, meshes);
+    } else {
+        addMeshes<TriangleMesh>(group_faces, vertices, normals, bvh_method, bvh_leaf_size, bvh_width,
+                                face_count, meshes);
+    }
+    group_count = group_faces.size();
+    group_faces.clear();
 
-}
\ No newline at end of file
+    obj->buildBVH(bvh_method, bvh_leaf_size, bvh_width);
+}
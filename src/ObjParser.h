@@ -1,15 +1,29 @@
 #pragma once
 #include "Group.h"
 #include "Point.h"
-#include "Triangle.h"
+#include "TriangleMesh.h"
+#include <string>
 #include <vector>
 
+// With threads left at 0, ObjParser gives each thread at least this many bytes of text
+#define OBJ_PARSE_MIN_CHUNK_SIZE (1 << 20)
+
 class ObjParser
 {
 public:
     ObjParser() { };
-    ObjParser(const std::string &filename);
-    ObjParser(std::istream &is);
+    // The faces of each group (g) become one TriangleMesh, which builds its own BVH with
+    // bvh_leaf_size faces per leaf (see meshBVHMethod). The groups and meshes are then
+    // turned into a BVH with the given method. precision is the type the meshes store their vertices in, and
+    // bvh_width the children per node of all the BVHs. The text is parsed on the given
+    // number of threads; 0 uses every hardware thread for files large enough to gain.
+    ObjParser(const std::string &filename, BVHMethod bvh_method = BVHMethod::sah, size_t bvh_leaf_size = 4,
+              MeshPrecision precision = DEFAULT_MESH_PRECISION, size_t bvh_width = DEFAULT_BVH_WIDTH,
+              size_t threads = 0);
+    // Files are memory-mapped and parsed in place. A stream is read into memory first.
+    ObjParser(std::istream &is, BVHMethod bvh_method = BVHMethod::sah, size_t bvh_leaf_size = 4,
+              MeshPrecision precision = DEFAULT_MESH_PRECISION, size_t bvh_width = DEFAULT_BVH_WIDTH,
+              size_t threads = 0);
     
     std::vector<Point> vertices;
     std::vector<Vector> normals;
@@ -17,8 +31,36 @@ public:
     std::shared_ptr<Group> obj;
     std::shared_ptr<Group> cur_group;
 
+    // Every mesh made, in order, with the index of the group it went into: 0 for obj
+    // itself, then one for each g line in the file. Every such group is a child of obj.
+    std::vector<std::pair<size_t, std::shared_ptr<Shape>>> meshes;
+    size_t group_count = 1;
+
 private:
+    // The faces of each group (g), which become one TriangleMesh once all vertices are known
+    typedef std::vector<std::pair<std::shared_ptr<Group>, std::vector<MeshFace>>> GroupFaces;
+    struct Polygon;
+    struct Chunk;
+
+    // Reads the vertices, normals and faces in [begin, end) without copying the text.
+    // The text is split into one chunk of whole lines per thread, and the chunks are
+    // parsed side by side and then joined. Returns the number of threads used.
+    size_t parse(const char *begin, const char *end, size_t threads);
+    static void parseChunk(Chunk &chunk);
+    static size_t parseCorners(const char *p, const char *end, std::vector<long> &corners);
+    // Turns a chunk's polygons into triangles, once it is known how many vertices and
+    // normals came before it
+    static void resolveChunk(Chunk &chunk);
+    static void addPolygon(Chunk &chunk, const Polygon &poly, const long *corners);
+    // Turns the faces into meshes and builds the BVH
+    void build();
+
+    GroupFaces group_faces;
 
-    void parse(std::istream &is);
+    BVHMethod bvh_method = BVHMethod::sah;
+    size_t bvh_leaf_size = 4;
+    MeshPrecision precision = DEFAULT_MESH_PRECISION;
+    size_t bvh_width = DEFAULT_BVH_WIDTH;
+    size_t face_count = 0;
 
 };
\ No newline at end of file
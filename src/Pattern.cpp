@@ -4,7 +4,7 @@
 #define GRID_LINE_HALFWIDTH 0.035
 
 
-Color Pattern::patternAtShape(const std::shared_ptr<Shape> &sp, const Point &p) const
+Color Pattern::patternAtShape(const Shape *sp, const Point &p) const
 {
     //Point obj_p = sp->getInverseTransform() * p;
     Point obj_p = sp->world_to_object(p);
@@ -1,7 +1,7 @@
 #pragma once
 
 #include "Color.h"
-#include "Matrix.h"
+#include "Matrix4.h"
 #include "UVPattern.h"
 #include <memory>
 #include <functional>
@@ -11,13 +11,13 @@ class Shape;
 
 class Pattern {
 public:
-    void setTransform(const Matrix &M) {
+    void setTransform(const Matrix4 &M) {
         transform = M;
         inverse_transform = M.inverse();
     }
-    Matrix getTransform() const { return transform; }
+    const Matrix4& getTransform() const { return transform; }
 
-    Color patternAtShape(const std::shared_ptr<Shape> &sp, const Point &p) const;
+    Color patternAtShape(const Shape *sp, const Point &p) const;
     virtual Color patternAt(const Point &pattern_point) const = 0;
 
 protected:
@@ -25,12 +25,12 @@ protected:
     // Keep constructors protected here and private in derived classes.
     // Derived classes will define static make() functions which will
     // return shared_ptr<Pattern>
-    Pattern() : transform(Matrix::identity(4)),
-                inverse_transform(Matrix::identity(4)) { }
-    Pattern(const Matrix &T) : transform(T),
+    Pattern() : transform(Matrix4::identity()),
+                inverse_transform(Matrix4::identity()) { }
+    Pattern(const Matrix4 &T) : transform(T),
                                inverse_transform(T.inverse()) { }
-    Matrix transform;
-    Matrix inverse_transform;
+    Matrix4 transform;
+    Matrix4 inverse_transform;
 };
 
 class SolidPattern : public Pattern {
@@ -41,7 +41,7 @@ public:
         std::shared_ptr<Pattern> ret(new SolidPattern(c));
         return ret;
     }
-    static std::shared_ptr<Pattern> make(const Matrix &T, const Color &c)
+    static std::shared_ptr<Pattern> make(const Matrix4 &T, const Color &c)
     {
         std::shared_ptr<Pattern> ret(new SolidPattern(T,c));
         return ret;
@@ -51,7 +51,7 @@ public:
 
 private:
     SolidPattern(const Color &c) : Pattern(), color(c) { }
-    SolidPattern(const Matrix &T, const Color &c) : Pattern(T), color(c) { }
+    SolidPattern(const Matrix4 &T, const Color &c) : Pattern(T), color(c) { }
     Color color;
 };
 
@@ -63,7 +63,7 @@ public:
         std::shared_ptr<Pattern> ret(new BlendedPattern(a,b));
         return ret;
     }
-    static std::shared_ptr<Pattern> make(const Matrix &T, const Color &a, const Color &b)
+    static std::shared_ptr<Pattern> make(const Matrix4 &T, const Color &a, const Color &b)
     {
         std::shared_ptr<Pattern> ret(new BlendedPattern(T,a,b));
         return ret;
@@ -73,7 +73,7 @@ public:
         std::shared_ptr<Pattern> ret(new BlendedPattern(a,b));
         return ret;
     }
-    static std::shared_ptr<Pattern> make(const Matrix &T,
+    static std::shared_ptr<Pattern> make(const Matrix4 &T,
                                          const std::shared_ptr<Pattern> &a,
                                          const std::shared_ptr<Pattern> &b)
     {
@@ -87,12 +87,12 @@ private:
     BlendedPattern(const Color &a, const Color &b) : Pattern(),
                                                     pattern_a(SolidPattern::make(a)),
                                                     pattern_b(SolidPattern::make(b)) { }
-    BlendedPattern(const Matrix &T, const Color &a, const Color &b) : Pattern(T),
+    BlendedPattern(const Matrix4 &T, const Color &a, const Color &b) : Pattern(T),
                                                                      pattern_a(SolidPattern::make(a)),
                                                                      pattern_b(SolidPattern::make(b)) { }
     BlendedPattern(const std::shared_ptr<Pattern> &a, const std::shared_ptr<Pattern> &b) :
             Pattern(), pattern_a(a), pattern_b(b) { }
-    BlendedPattern(const Matrix &T, const std::shared_ptr<Pattern> &a, const std::shared_ptr<Pattern> &b) :
+    BlendedPattern(const Matrix4 &T, const std::shared_ptr<Pattern> &a, const std::shared_ptr<Pattern> &b) :
             Pattern(T), pattern_a(a), pattern_b(b) { }
 
     std::shared_ptr<Pattern> pattern_a;
@@ -107,7 +107,7 @@ public:
         std::shared_ptr<Pattern> ret(new StripePattern(a,b));
         return ret;
     }
-    static std::shared_ptr<Pattern> make(const Matrix &T, const Color &a, const Color &b)
+    static std::shared_ptr<Pattern> make(const Matrix4 &T, const Color &a, const Color &b)
     {
         std::shared_ptr<Pattern> ret(new StripePattern(T,a,b));
         return ret;
@@ -117,7 +117,7 @@ public:
         std::shared_ptr<Pattern> ret(new StripePattern(a,b));
         return ret;
     }
-    static std::shared_ptr<Pattern> make(const Matrix &T,
+    static std::shared_ptr<Pattern> make(const Matrix4 &T,
                                          const std::shared_ptr<Pattern> &a,
                                          const std::shared_ptr<Pattern> &b)
     {
@@ -131,12 +131,12 @@ private:
     StripePattern(const Color &a, const Color &b) : Pattern(),
                                                     pattern_a(SolidPattern::make(a)),
                                                     pattern_b(SolidPattern::make(b)) { }
-    StripePattern(const Matrix &T, const Color &a, const Color &b) : Pattern(T),
+    StripePattern(const Matrix4 &T, const Color &a, const Color &b) : Pattern(T),
                                                                      pattern_a(SolidPattern::make(a)),
                                                                      pattern_b(SolidPattern::make(b)) { }
     StripePattern(const std::shared_ptr<Pattern> &a, const std::shared_ptr<Pattern> &b) :
             Pattern(), pattern_a(a), pattern_b(b) { }
-    StripePattern(const Matrix &T, const std::shared_ptr<Pattern> &a, const std::shared_ptr<Pattern> &b) :
+    StripePattern(const Matrix4 &T, const std::shared_ptr<Pattern> &a, const std::shared_ptr<Pattern> &b) :
             Pattern(T), pattern_a(a), pattern_b(b) { }
 
     std::shared_ptr<Pattern> pattern_a;
@@ -151,7 +151,7 @@ public:
         std::shared_ptr<Pattern> ret(new GradientPattern(a,b));
         return ret;
     }
-    static std::shared_ptr<Pattern> make(const Matrix &T, const Color &a, const Color &b)
+    static std::shared_ptr<Pattern> make(const Matrix4 &T, const Color &a, const Color &b)
     {
         std::shared_ptr<Pattern> ret(new GradientPattern(T,a,b));
         return ret;
@@ -161,7 +161,7 @@ public:
         std::shared_ptr<Pattern> ret(new GradientPattern(a,b));
         return ret;
     }
-    static std::shared_ptr<Pattern> make(const Matrix &T,
+    static std::shared_ptr<Pattern> make(const Matrix4 &T,
                                          const std::shared_ptr<Pattern> &a,
                                          const std::shared_ptr<Pattern> &b)
     {
@@ -175,12 +175,12 @@ private:
     GradientPattern(const Color &a, const Color &b) : Pattern(),
                                                     pattern_a(SolidPattern::make(a)),
                                                     pattern_b(SolidPattern::make(b)) { }
-    GradientPattern(const Matrix &T, const Color &a, const Color &b) : Pattern(T),
+    GradientPattern(const Matrix4 &T, const Color &a, const Color &b) : Pattern(T),
                                                                      pattern_a(SolidPattern::make(a)),
                                                                      pattern_b(SolidPattern::make(b)) { }
     GradientPattern(const std::shared_ptr<Pattern> &a, const std::shared_ptr<Pattern> &b) :
             Pattern(), pattern_a(a), pattern_b(b) { }
-    GradientPattern(const Matrix &T, const std::shared_ptr<Pattern> &a, const std::shared_ptr<Pattern> &b) :
+    GradientPattern(const Matrix4 &T, const std::shared_ptr<Pattern> &a, const std::shared_ptr<Pattern> &b) :
             Pattern(T), pattern_a(a), pattern_b(b) { }
 
     std::shared_ptr<Pattern> pattern_a;
@@ -195,7 +195,7 @@ public:
         std::shared_ptr<Pattern> ret(new RingPattern(a,b));
         return ret;
     }
-    static std::shared_ptr<Pattern> make(const Matrix &T, const Color &a, const Color &b)
+    static std::shared_ptr<Pattern> make(const Matrix4 &T, const Color &a, const Color &b)
     {
         std::shared_ptr<Pattern> ret(new RingPattern(T,a,b));
         return ret;
@@ -205,7 +205,7 @@ public:
         std::shared_ptr<Pattern> ret(new RingPattern(a,b));
         return ret;
     }
-    static std::shared_ptr<Pattern> make(const Matrix &T,
+    static std::shared_ptr<Pattern> make(const Matrix4 &T,
                                          const std::shared_ptr<Pattern> &a,
                                          const std::shared_ptr<Pattern> &b)
     {
@@ -219,12 +219,12 @@ private:
     RingPattern(const Color &a, const Color &b) : Pattern(),
                                                     pattern_a(SolidPattern::make(a)),
                                                     pattern_b(SolidPattern::make(b)) { }
-    RingPattern(const Matrix &T, const Color &a, const Color &b) : Pattern(T),
+    RingPattern(const Matrix4 &T, const Color &a, const Color &b) : Pattern(T),
                                                                      pattern_a(SolidPattern::make(a)),
                                                                      pattern_b(SolidPattern::make(b)) { }
     RingPattern(const std::shared_ptr<Pattern> &a, const std::shared_ptr<Pattern> &b) :
             Pattern(), pattern_a(a), pattern_b(b) { }
-    RingPattern(const Matrix &T, const std::shared_ptr<Pattern> &a, const std::shared_ptr<Pattern> &b) :
+    RingPattern(const Matrix4 &T, const std::shared_ptr<Pattern> &a, const std::shared_ptr<Pattern> &b) :
             Pattern(T), pattern_a(a), pattern_b(b) { }
 
     std::shared_ptr<Pattern> pattern_a;
@@ -239,7 +239,7 @@ public:
         std::shared_ptr<Pattern> ret(new CheckerPattern(a,b));
         return ret;
     }
-    static std::shared_ptr<Pattern> make(const Matrix &T, const Color &a, const Color &b)
+    static std::shared_ptr<Pattern> make(const Matrix4 &T, const Color &a, const Color &b)
     {
         std::shared_ptr<Pattern> ret(new CheckerPattern(T,a,b));
         return ret;
@@ -249,7 +249,7 @@ public:
         std::shared_ptr<Pattern> ret(new CheckerPattern(a,b));
         return ret;
     }
-    static std::shared_ptr<Pattern> make(const Matrix &T,
+    static std::shared_ptr<Pattern> make(const Matrix4 &T,
                                          const std::shared_ptr<Pattern> &a,
                                          const std::shared_ptr<Pattern> &b)
     {
@@ -263,12 +263,12 @@ private:
     CheckerPattern(const Color &a, const Color &b) : Pattern(),
                                                     pattern_a(SolidPattern::make(a)),
                                                     pattern_b(SolidPattern::make(b)) { }
-    CheckerPattern(const Matrix &T, const Color &a, const Color &b) : Pattern(T),
+    CheckerPattern(const Matrix4 &T, const Color &a, const Color &b) : Pattern(T),
                                                                      pattern_a(SolidPattern::make(a)),
                                                                      pattern_b(SolidPattern::make(b)) { }
     CheckerPattern(const std::shared_ptr<Pattern> &a, const std::shared_ptr<Pattern> &b) :
             Pattern(), pattern_a(a), pattern_b(b) { }
-    CheckerPattern(const Matrix &T, const std::shared_ptr<Pattern> &a, const std::shared_ptr<Pattern> &b) :
+    CheckerPattern(const Matrix4 &T, const std::shared_ptr<Pattern> &a, const std::shared_ptr<Pattern> &b) :
             Pattern(T), pattern_a(a), pattern_b(b) { }
 
     std::shared_ptr<Pattern> pattern_a;
@@ -347,7 +347,7 @@ public:
         std::shared_ptr<Pattern> ret(new TextureMapPattern(uvp, map_fcn));
         return ret;
     }
-    static std::shared_ptr<Pattern> make(const Matrix &T, std::shared_ptr<UVPattern> uvp, std::function<UVPoint(const Point&)> map_fcn)
+    static std::shared_ptr<Pattern> make(const Matrix4 &T, std::shared_ptr<UVPattern> uvp, std::function<UVPoint(const Point&)> map_fcn)
     {
         std::shared_ptr<Pattern> ret(new TextureMapPattern(T, uvp, map_fcn));
         return ret;
@@ -360,7 +360,7 @@ private:
                                                                                             _uvp(uvp),
                                                                                             _map_fcn(map_fcn)
                                                                                             { }
-    TextureMapPattern(const Matrix &T, std::shared_ptr<UVPattern> uvp, std::function<UVPoint(const Point&)> map_fcn) : Pattern(T),
+    TextureMapPattern(const Matrix4 &T, std::shared_ptr<UVPattern> uvp, std::function<UVPoint(const Point&)> map_fcn) : Pattern(T),
                                                                                             _uvp(uvp),
                                                                                             _map_fcn(map_fcn)
                                                                                             { }
@@ -377,7 +377,7 @@ public:
         std::shared_ptr<Pattern> ret(new CubeMapPattern(uvp_left,uvp_right,uvp_front,uvp_back,uvp_up,uvp_down));
         return ret;
     }
-    static std::shared_ptr<Pattern> make(const Matrix &T, std::shared_ptr<UVPattern> uvp_left, std::shared_ptr<UVPattern> uvp_right,
+    static std::shared_ptr<Pattern> make(const Matrix4 &T, std::shared_ptr<UVPattern> uvp_left, std::shared_ptr<UVPattern> uvp_right,
                                          std::shared_ptr<UVPattern> uvp_front, std::shared_ptr<UVPattern> uvp_back,
                                          std::shared_ptr<UVPattern> uvp_up, std::shared_ptr<UVPattern> uvp_down)
     {
@@ -398,7 +398,7 @@ private:
                                                                                             _uvp_up(uvp_up),
                                                                                             _uvp_down(uvp_down)
                                                                                             { }
-    CubeMapPattern(const Matrix &T, std::shared_ptr<UVPattern> uvp_left, std::shared_ptr<UVPattern> uvp_right,
+    CubeMapPattern(const Matrix4 &T, std::shared_ptr<UVPattern> uvp_left, std::shared_ptr<UVPattern> uvp_right,
                    std::shared_ptr<UVPattern> uvp_front, std::shared_ptr<UVPattern> uvp_back,
                    std::shared_ptr<UVPattern> uvp_up, std::shared_ptr<UVPattern> uvp_down) : Pattern(T),
                                                                                             _uvp_left(uvp_left),
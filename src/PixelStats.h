@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Color.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// PixelStats keeps the running mean of a pixel's samples, and the variance of the samples
+// as they will be displayed (clamped to [0,1]), using Welford's update. The variance
+// tells adaptive sampling when the mean has stopped changing: a sample that is brighter
+// than white in every channel looks no different on screen, so it shouldn't ask for more.
+class PixelStats {
+public:
+    PixelStats() : n(0) {
+        for (int i = 0; i < 3; i++) {
+            shown_mean[i] = 0;
+            m2[i] = 0;
+        }
+    }
+
+    void add(const Color &c) {
+        n++;
+        sum += c;
+        for (int i = 0; i < 3; i++) {
+            double x = std::min(1.0, std::max(0.0, c.ptr()[i]));
+            double delta = x - shown_mean[i];
+            shown_mean[i] += delta / n;
+            m2[i] += delta * (x - shown_mean[i]);
+        }
+    }
+
+    size_t count() const { return n; }
+    Color mean() const { return n ? sum / (double)n : Color(); }
+
+    // True once the standard error of the mean is at most threshold in every channel.
+    // Needs at least two samples.
+    bool converged(double threshold) const {
+        if ( n < 2 ) {
+            return false;
+        }
+        // variance of the mean = sample variance / n
+        double limit = threshold * threshold * n * (n - 1);
+        return ( m2[0] <= limit && m2[1] <= limit && m2[2] <= limit );
+    }
+
+    // Largest difference between two colors in any channel, as displayed
+    static double contrast(const Color &a, const Color &b) {
+        double ret = 0;
+        for (int i = 0; i < 3; i++) {
+            double x = std::min(1.0, std::max(0.0, a.ptr()[i]));
+            double y = std::min(1.0, std::max(0.0, b.ptr()[i]));
+            ret = std::max(ret, std::fabs(x - y));
+        }
+        return ret;
+    }
+
+private:
+    size_t n;
+    Color sum;
+    double shown_mean[3];
+    double m2[3];
+};
@@ -12,10 +12,48 @@ bool Plane::localIntersect(const Ray &ray, Iset &iset_out)
         return false;
     }
     double t = -ray.origin.y() / ray.dir.y();
-    iset_out.insert(Intersection(t, shared_from_this()));
+    iset_out.insert(Intersection(t, this));
     return true;
 }
 
+bool Plane::localIntersectClosest(const Ray &ray, Intersection &hit_out)
+{
+    if (abs(ray.dir.y()) < EPSILON) {
+        return false;
+    }
+    double t = -ray.origin.y() / ray.dir.y();
+    if ( t > 0 && t < hit_out.t ) {
+        hit_out = Intersection(t, this);
+        return true;
+    }
+    return false;
+}
+
+bool Plane::localIntersectAny(const Ray &ray, double max_t)
+{
+    if (abs(ray.dir.y()) < EPSILON) {
+        return false;
+    }
+    double t = -ray.origin.y() / ray.dir.y();
+    return ( t > 0 && t < max_t );
+}
+
+PacketMask Plane::localIntersectPacket(const RayPacket &p, PacketMask lanes, PacketHits &hits)
+{
+    double t[PACKET_SIZE];
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        t[i] = (abs(p.dy[i]) < EPSILON) ? -1 : -p.oy[i] / p.dy[i];
+    }
+    PacketMask found = 0;
+    forEachLane(lanes, [&](int lane) {
+        if ( t[lane] > 0 && t[lane] < hits.t[lane] ) {
+            hits.set(lane, Intersection(t[lane], this));
+            found |= 1u << lane;
+        }
+    });
+    return found;
+}
+
 Vector Plane::localNormalAt(const Point &obj_p, const Intersection *const ip) const
 {
     // probably the simplest normal function.
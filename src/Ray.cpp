@@ -53,6 +53,11 @@ Icomps Intersection::prepComps(const Ray &r)
     // Similarly, under_point is used when we do refractions
     ret.under_point = ret.point - ret.normalv * EPSILON;
 
+    // Without the full intersection list we can't tell which shapes contain this point,
+    // so assume a vacuum on both sides. The overload below fills in the real values.
+    ret.rindex_from = 1.0;
+    ret.rindex_to = 1.0;
+
     return ret;
 }
 
@@ -62,11 +67,13 @@ Icomps Intersection::prepComps(const Ray &r, const Iset &xs)
 {
     Icomps ret = prepComps(r); // Single-argument version does everything else first
 
-    std::vector<std::shared_ptr<Shape>> containing_shapes;
+    // Reused between calls so that we don't allocate for every shaded point
+    static thread_local std::vector<const Shape*> containing_shapes;
+    containing_shapes.clear();
 
     // Loop through (note: SORTED) set of all intersections. We want to keep track of
     // all containing shapes that the ray passed through to get to *this* intersection.
-    for ( auto i : xs ) {
+    for ( const auto &i : xs ) {
 
         // If we've reached this intersection, we know rindex_from: it's that of the last containing shape.
         if ( i == *this ) {
@@ -102,3 +109,34 @@ Icomps Intersection::prepComps(const Ray &r, const Iset &xs)
 
     return ret;
 }
+
+
+void Iset::sort_from(size_t first)
+{
+    sort_range(xs, first);
+    if (first == 0) {
+        sorted = true;
+    }
+}
+
+// Stable sort by t. Intersection lists are short, so a plain insertion sort beats
+// std::stable_sort here, and unlike std::stable_sort it never allocates a buffer.
+void Iset::sort_range(std::vector<Intersection> &v, size_t first)
+{
+    if ( v.size() - first > 32 ) {
+        std::stable_sort(v.begin() + first, v.end());
+        return;
+    }
+    for (size_t i = first + 1; i < v.size(); i++) {
+        if ( !(v[i] < v[i-1]) ) {
+            continue;
+        }
+        Intersection tmp = std::move(v[i]);
+        size_t j = i;
+        while ( j > first && tmp < v[j-1] ) {
+            v[j] = std::move(v[j-1]);
+            --j;
+        }
+        v[j] = std::move(tmp);
+    }
+}
\ No newline at end of file
@@ -2,10 +2,12 @@
 
 #include "Point.h"
 #include "Vector.h"
-#include "Matrix.h"
+#include "Matrix4.h"
+#include <cstdint>
 #include <memory>
 #include <utility>
-#include <set>
+#include <vector>
+#include <initializer_list>
 
 // Forward declarations
 class Shape;
@@ -14,7 +16,7 @@ class Intersection;
 // Icomps is a simple struct for storing precomputed intersection computations.
 struct Icomps {
     double t;
-    std::shared_ptr<Shape> obj;
+    const Shape *obj;
     Point point;
     Point over_point; // Slightly offset by EPSILON in the direction of the normal vector.
                       // over_point is used in shading to prevent shadow acne
@@ -34,23 +36,24 @@ class Ray {
 public:
     Ray(Point p, Vector d): origin(p), dir(d) { }
     inline Point pos(double t) const { return ( origin + dir*t ); }
-    inline Ray transform(const Matrix &M) const { return Ray(M * origin, M * dir); }
+    inline Ray transform(const Matrix4 &M) const { return Ray(M * origin, M * dir); }
     Point origin;
     Vector dir;
 };
 
-// Iset: a simple std::multiset used to store all intersections of a Ray.
-// We use multiset instead of unique set because in certain cases 
-// (i.e, a hit tangent to the object) our intersect function will return 
-// two identical intersections and this fact will help us distinguish those.
-
-typedef std::multiset<Intersection> Iset;
+class Iset;
 
 class Intersection {
 public:
-    Intersection() : t(0.0), obj(nullptr) { }
-    Intersection(double t, const std::shared_ptr<Shape> &object) : t(t), obj(object) { }
-    Intersection(double t, double u, double v, const std::shared_ptr<Shape> &object) : t(t), u(u), v(v), obj(object) { }
+    Intersection() : t(0.0), face(0), obj(nullptr), inner(nullptr) { }
+    Intersection(double t, const Shape *object) : t(t), face(0), obj(object), inner(nullptr) { }
+    Intersection(double t, double u, double v, const Shape *object) : t(t), u(u), v(v), face(0), obj(object), inner(nullptr) { }
+    Intersection(double t, double u, double v, uint32_t face, const Shape *object) : t(t), u(u), v(v), face(face), obj(object), inner(nullptr) { }
+    // For callers that hold the shape by shared_ptr. Only the raw pointer is kept.
+    template <typename S>
+    Intersection(double t, const std::shared_ptr<S> &object) : Intersection(t, object.get()) { }
+    template <typename S>
+    Intersection(double t, double u, double v, const std::shared_ptr<S> &object) : Intersection(t, u, v, object.get()) { }
     friend bool operator<(const Intersection &i1, const Intersection &i2) { return i1.t < i2.t; }
     friend bool operator==(const Intersection &i1, const Intersection &i2)
         { return (i1.t == i2.t && i1.obj == i2.obj); }
@@ -62,19 +65,91 @@ public:
 
     double t;
     double u,v; // These values are only used for normal interpolation on smooth triangles.
-    std::shared_ptr<Shape> obj;
+    uint32_t face; // Which face of a TriangleMesh was hit
+    // Not owning: shapes are owned by the World (or Group/CSG) they were added to, which
+    // outlives every Intersection found while rendering it. Copying a raw pointer keeps
+    // the traversal and shading path free of atomic refcount updates.
+    const Shape *obj;
+    // When obj is an Instance, the shape within its shared geometry that was hit, which
+    // u, v and face refer to. Null otherwise.
+    const Shape *inner;
+};
+
+// Iset: a flat list used to store all intersections of a Ray.
+// This used to be a std::multiset, which cost a node allocation and a tree rebalance
+// for every single hit. Now intersections are appended to a vector that is reused
+// from ray to ray (clear() keeps its capacity), and the list is only sorted when
+// someone actually iterates over it. hit() doesn't need sorted order at all.
+// Like the multiset, sorting is stable: a hit tangent to an object yields two
+// identical intersections, and they keep the order in which they were inserted.
+#define ISET_INITIAL_CAPACITY 64
+
+class Iset {
+public:
+    typedef std::vector<Intersection>::const_iterator const_iterator;
+    typedef const_iterator iterator;
+
+    Iset() : sorted(true) { xs.reserve(ISET_INITIAL_CAPACITY); }
+    Iset(std::initializer_list<Intersection> list) : xs(list), sorted(false) { }
+
+    void insert(const Intersection &i) {
+        if ( sorted && !xs.empty() && i < xs.back() ) {
+            sorted = false;
+        }
+        xs.push_back(i);
+    }
+    void clear() { xs.clear(); sorted = true; }
+    size_t size() const { return xs.size(); }
+    bool empty() const { return xs.empty(); }
+
+    // Iteration always happens in order of increasing t
+    const_iterator begin() const { sort(); return xs.begin(); }
+    const_iterator end() const { sort(); return xs.end(); }
+
+    // Access to the unsorted storage. Aggregate shapes (CSG) use these to work on the
+    // intersections they appended to the end of the list without any extra allocation.
+    Intersection& operator[](size_t i) { return xs[i]; }
+    const Intersection& operator[](size_t i) const { return xs[i]; }
+    void truncate(size_t n) {
+        if (n < xs.size()) xs.resize(n);
+        if (n == 0) sorted = true;
+    }
+    void sort_from(size_t first);
+
+    bool isSorted() const { return sorted; }
+
+private:
+    void sort() const {
+        if ( !sorted ) {
+            sort_range(xs, 0);
+            sorted = true;
+        }
+    }
+    static void sort_range(std::vector<Intersection> &v, size_t first);
+
+    mutable std::vector<Intersection> xs;
+    mutable bool sorted;
 };
 
 inline Intersection hit(const Iset &iset)
 {
-    // return first non-negative Intersection (easy since std::multiset is sorted
-    // and we defined comparison operator for Intersection to use t value)
-    auto itr = iset.begin();
-    while (itr != iset.end()) {
-        if (itr->t > 0) {
-            return (*itr);
+    // return the non-negative Intersection with the smallest t value. If the list is
+    // already sorted that is simply the first one, otherwise we have to look at all of them.
+    // Either way we never sort here.
+    const Intersection *best = nullptr;
+    for (size_t i = 0; i < iset.size(); i++) {
+        const Intersection &x = iset[i];
+        if (x.t > 0) {
+            if ( iset.isSorted() ) {
+                return x;
+            }
+            if ( !best || x.t < best->t ) {
+                best = &x;
+            }
         }
-        ++itr;
+    }
+    if (best) {
+        return *best;
     }
     // if no match, return empty Intersection
     Intersection i = Intersection();
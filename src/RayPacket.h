@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Ray.h"
+#include "Matrix4.h"
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// Rays per packet: 4, 8 or 16. Eight doubles fill two AVX or four SSE2 registers per
+// component. Set with -DJRAY_PACKET_SIZE (cmake -DJRAY_PACKET_SIZE=16).
+#ifndef JRAY_PACKET_SIZE
+#define JRAY_PACKET_SIZE 8
+#endif
+#define PACKET_SIZE JRAY_PACKET_SIZE
+static_assert(PACKET_SIZE == 4 || PACKET_SIZE == 8 || PACKET_SIZE == 16, "JRAY_PACKET_SIZE must be 4, 8 or 16");
+
+// A set of lanes of a packet, one bit per lane
+typedef uint32_t PacketMask;
+#define PACKET_ALL_LANES ((PacketMask)((1u << PACKET_SIZE) - 1))
+
+inline int packetLaneCount(PacketMask mask) { return __builtin_popcount(mask); }
+// Index of the lowest lane in a non-empty mask
+inline int packetFirstLane(PacketMask mask) { return __builtin_ctz(mask); }
+
+// Calls fn(lane) for every lane in mask, lowest first
+template <typename Fn>
+inline void forEachLane(PacketMask mask, Fn fn)
+{
+    while ( mask ) {
+        int lane = packetFirstLane(mask);
+        fn(lane);
+        mask &= mask - 1;
+    }
+}
+
+// RayPacket is PACKET_SIZE rays stored as a structure of arrays, one array per
+// component, so that the packet intersection kernels can run the same test on every lane
+// with plain loops over fixed-size arrays, which the compiler turns into SIMD code.
+// The functions that trace a packet take a mask of the lanes to trace; the other lanes
+// may hold anything (a new packet's are zero) and are never reported as hits.
+struct RayPacket {
+    double ox[PACKET_SIZE], oy[PACKET_SIZE], oz[PACKET_SIZE];
+    double dx[PACKET_SIZE], dy[PACKET_SIZE], dz[PACKET_SIZE];
+
+    RayPacket() : ox{}, oy{}, oz{}, dx{}, dy{}, dz{} { }
+
+    void set(int lane, const Ray &r) {
+        ox[lane] = r.origin.x(); oy[lane] = r.origin.y(); oz[lane] = r.origin.z();
+        dx[lane] = r.dir.x(); dy[lane] = r.dir.y(); dz[lane] = r.dir.z();
+    }
+    Ray ray(int lane) const {
+        return Ray(Point(ox[lane], oy[lane], oz[lane]), Vector(dx[lane], dy[lane], dz[lane]));
+    }
+
+    // Every lane transformed by M, as Ray::transform() does to one ray
+    RayPacket transform(const Matrix4 &M) const {
+        RayPacket p;
+        for (int i = 0; i < PACKET_SIZE; i++) {
+            p.ox[i] = M(0,0)*ox[i] + M(0,1)*oy[i] + M(0,2)*oz[i] + M(0,3);
+            p.oy[i] = M(1,0)*ox[i] + M(1,1)*oy[i] + M(1,2)*oz[i] + M(1,3);
+            p.oz[i] = M(2,0)*ox[i] + M(2,1)*oy[i] + M(2,2)*oz[i] + M(2,3);
+            p.dx[i] = M(0,0)*dx[i] + M(0,1)*dy[i] + M(0,2)*dz[i];
+            p.dy[i] = M(1,0)*dx[i] + M(1,1)*dy[i] + M(1,2)*dz[i];
+            p.dz[i] = M(2,0)*dx[i] + M(2,1)*dy[i] + M(2,2)*dz[i];
+        }
+        return p;
+    }
+};
+
+// The first n lanes
+inline PacketMask packetLanes(size_t n) { return ( n >= 32 ) ? ~0u : (1u << n) - 1; }
+
+// The closest hit found so far for each lane of a packet. t[lane] is that lane's running
+// t_max, just like hit_out.t in Shape::intersectClosest(), and is kept in its own array
+// so the kernels can compare against all lanes at once.
+struct PacketHits {
+    double t[PACKET_SIZE];
+    Intersection hit[PACKET_SIZE];
+
+    PacketHits() { reset(); }
+    // Every lane back to no hit, with no limit on t
+    void reset() {
+        for (int i = 0; i < PACKET_SIZE; i++) {
+            t[i] = std::numeric_limits<double>::infinity();
+            hit[i] = Intersection(t[i], nullptr);
+        }
+    }
+    void set(int lane, const Intersection &i) {
+        t[lane] = i.t;
+        hit[lane] = i;
+    }
+};
@@ -1,85 +1,433 @@
-#include <random>
+#include <iomanip>
+#include <functional>
 #include "Renderer.h"
-#include "MainWindow.h"
+#include "ImageIO.h"
 
 Canvas& Renderer::getCanvas() {
     return m_canvas;
 }
 
-void Renderer::render(MainWindow *caller)
+// Traces n <= PACKET_SIZE camera samples as one packet and shades their hits. make_ray(i)
+// starts sample i on the thread's Sampler and returns its ray. Each sample's Sampler is
+// put back the way its ray left it before the hit is shaded, so the area lights draw the
+// same numbers as when the ray is traced on its own.
+template <typename MakeRay>
+void Renderer::trace_packet(size_t n, MakeRay make_ray, Iset &iset, Color *colors, SurfaceInfo *surfaces)
+{
+    Sampler &sampler = Sampler::current();
+    Sampler after_ray[PACKET_SIZE];
+    RayPacket packet;
+    for (size_t i = 0; i < n; i++) {
+        packet.set(i, make_ray(i));
+        after_ray[i] = sampler;
+    }
+    PacketHits hits;
+    m_world.intersectPacket(packet, packetLanes(n), hits);
+    for (size_t i = 0; i < n; i++) {
+        sampler = after_ray[i];
+        colors[i] = m_world.colorAtHit(packet.ray(i), hits.hit[i], iset, REFLECTION_RECURSION_LIMIT,
+                                       surfaces ? &surfaces[i] : nullptr);
+        iset.clear();
+    }
+}
+
+void Renderer::save(const std::string &filename)
+{
+    if ( is_float_image(filename) ) {
+        try {
+            if ( getFileExtension(filename) == "exr" ) {
+                save_exr(filename, getOutput(), m_camera.getExrCompression());
+            } else {
+                save_pfm(filename, getOutput());
+            }
+        } catch ( std::runtime_error &e ) {
+            std::cerr << "Error saving file " << filename << ": " << e.what() << std::endl;
+        }
+    } else {
+        m_canvas.save(filename);
+    }
+}
+
+void Renderer::render(const std::function<void()> &on_finish)
 {
     m_killrender = false;
 
+    m_stats.assign(numThreads, RenderThreadStats());
+    m_render_start = std::chrono::steady_clock::now();
+    m_passes_done = 0;
+    m_framebuffer.enableAovs(m_camera.hasAovs() || m_camera.isDenoised());
+    m_framebuffer.clear();
+
+    if ( m_camera.isProgressive() ) {
+        render_progressive();
+        // Passes denoise as they finish, but not one cut short by the time limit
+        if ( m_camera.isDenoised() && m_out_of_time && ! m_killrender ) {
+            denoise();
+        }
+    } else {
+        run_pass(PASS_ALL_SAMPLES);
+        if ( m_camera.isAdaptive() && m_camera.getAdaptiveContrast() > 0 && ! m_killrender && find_edges() ) {
+            run_pass(PASS_EDGES);
+        }
+        if ( m_camera.isDenoised() && ! m_killrender ) {
+            denoise();
+        }
+    }
+
+    // A thread is idle from the moment it runs out of tiles to steal until the last one finishes
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_render_start).count();
+    for (auto &st : m_stats) {
+        st.idle = std::max(0.0, wall - st.busy);
+    }
+    if ( ! m_killrender )
+        print_thread_stats();
+
+    // Do not notify if we've been killed, otherwise this will trigger
+    // the MainWindow notify function to cleanup and kill any newer threads.
+    if (on_finish && ! m_killrender)
+        on_finish();
+}
+
+// Renders every tile of the image once, on all threads
+void Renderer::run_pass(long pass)
+{
     std::vector<std::thread> threads;
+    TileScheduler scheduler(width, height, tileSize, numThreads);
 
     for (size_t i = 0; i < numThreads; i++) {
-        threads.push_back( std::thread(&Renderer::render_portion, this, i) );
-        std::cout << "Started thread " << i << std::endl;
+        threads.push_back( std::thread(&Renderer::render_tiles, this, i, std::ref(scheduler), pass) );
+        if ( pass == PASS_ALL_SAMPLES )
+            std::cout << "Started thread " << i << std::endl;
     }
 
     for (auto &th: threads) {
         if (th.joinable()) th.join();
     }
+}
 
-    // Do not notify if:
-    // 1.) If caller is null, we are not in GUI mode and there is no window to notify.
-    // 2.) We've been killed, otherwise this will trigger
-    //     the MainWindow notify function to cleanup and kill any newer threads.
-    if (caller && ! m_killrender)
-        caller->notify();
+void Renderer::render_progressive()
+{
+    size_t passes = m_camera.getSupersamplingLevel() * m_camera.getFocalSamples();
+    m_out_of_time = false;
+
+    if ( m_camera.getPreviewScale() > 1 ) {
+        run_pass(PASS_PREVIEW);
+        // The preview stays on the canvas until each tile's first pass replaces it
+        m_framebuffer.clear();
+    }
+    for (size_t pass = 0; pass < passes; pass++) {
+        if ( m_killrender || out_of_time() ) {
+            break;
+        }
+        run_pass(pass);
+        if ( m_killrender ) {
+            break;
+        }
+        if ( m_out_of_time ) {
+            std::cout << "Time limit reached during pass " << pass + 1 << std::endl;
+            break;
+        }
+        m_passes_done = pass + 1;
+        if ( m_camera.isDenoised() ) {
+            denoise();
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_render_start).count();
+        std::cout << "Pass " << m_passes_done << "/" << passes << " done after " << elapsed << " seconds" << std::endl;
+        if ( m_on_pass ) {
+            m_on_pass(m_passes_done);
+        }
+    }
 }
 
-void Renderer::render_portion(size_t threadnum)
+// Denoises the whole framebuffer into m_denoised and shows it. The accumulated samples
+// are left alone, so progressive passes carry on adding to them.
+void Renderer::denoise()
 {
-    for (size_t y = 0; y < height; y++) {
+    auto start = std::chrono::steady_clock::now();
+    m_denoised = m_framebuffer;
+    Denoiser denoiser(m_camera.getDenoiseRadius());
+    denoiser.denoise(m_framebuffer, m_denoised, numThreads, tileSize);
+    m_canvas.put_framebuffer(m_denoised, m_camera.getToneMap(), 0, 0, width, height);
+    std::cout << "Denoised in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+              << " seconds" << std::endl;
+}
+
+bool Renderer::out_of_time() const
+{
+    double limit = m_camera.getTimeLimit();
+    return ( limit > 0 &&
+             std::chrono::duration<double>(std::chrono::steady_clock::now() - m_render_start).count() >= limit );
+}
+
+void Renderer::render_tiles(size_t threadnum, TileScheduler &scheduler, long pass)
+{
+    RenderThreadStats &stats = m_stats[threadnum];
+    Sampler::current().setSeed(m_camera.getSeed());
+    Iset iset; // intersection list reused for every ray this thread traces
+    Tile tile;
+    bool stolen;
+    BVHCounters &counters = BVHCounters::current();
+    BVHCounters counted = counters;
+    while ( scheduler.next(threadnum, tile, stolen) ) {
         if (m_killrender) return;
-        if (y % numThreads == threadnum) {
-            render_pixel_row(y);
+        auto tile_start = std::chrono::steady_clock::now();
+        if ( pass == PASS_ALL_SAMPLES ) {
+            render_tile(tile, iset, stats);
+        } else if ( pass == PASS_PREVIEW ) {
+            render_tile_preview(tile, iset);
+        } else if ( pass == PASS_EDGES ) {
+            render_tile_edges(tile, iset, stats);
+        } else {
+            render_tile_pass(tile, iset, stats, pass);
         }
+        // The tile is this thread's alone, so its pixels can be shown without locking
+        m_canvas.put_framebuffer(m_framebuffer, m_camera.getToneMap(), tile.x0, tile.y0, tile.x1, tile.y1);
+        stats.busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - tile_start).count();
+        stats.tiles++;
+        if (stolen) stats.stolen++;
     }
+    stats.bvh.add(counters.nodes - counted.nodes, counters.boxes - counted.boxes);
 }
 
-void Renderer::render_pixel_row(int y)
+void Renderer::render_tile(const Tile &tile, Iset &iset, RenderThreadStats &stats)
 {
     size_t samples = m_camera.getSupersamplingLevel();
     size_t focal_samples = m_camera.getFocalSamples();
+    // Every supersample and every focal blur sample is its own camera sample, so the
+    // pixel and lens positions are stratified together across all of them.
+    size_t max_samples = samples * focal_samples;
+    size_t min_samples = max_samples;
+    double threshold = m_camera.getAdaptiveThreshold();
+    if ( m_camera.isAdaptive() ) {
+        // Two samples are the fewest that give a variance
+        min_samples = std::min(max_samples, std::max<size_t>(2, m_camera.getAdaptiveMinSamples()));
+    }
+    if ( min_samples == max_samples && m_camera.usesPackets() ) {
+        // Every pixel takes every sample, so trace each sample of a row as a packet.
+        // Adaptive sampling decides per pixel whether to go on, so it traces single rays.
+        for (size_t y = tile.y0; y < tile.y1; y++) {
+            for (size_t i = 0; i < max_samples; i++) {
+                if (m_killrender) return;
+                render_row_packets(y, tile.x0, tile.x1, i, iset, stats);
+            }
+        }
+        return;
+    }
+    // Pixels that stop early here may still get the rest of their samples from
+    // render_tile_edges(), once their neighbors in other tiles are known too
+    for (size_t y = tile.y0; y < tile.y1; y++) {
+        for (size_t x = tile.x0; x < tile.x1; x++) {
+            if (m_killrender) return;
+            PixelStats pixel;
+            for (size_t i = 0; i < max_samples; i++) {
+                if ( i >= min_samples && pixel.converged(threshold) ) {
+                    break;
+                }
+                pixel.add(sample_pixel(x, y, i, samples > 1, iset));
+            }
+            stats.samples += pixel.count();
+            m_framebuffer.set(x, y, pixel.mean(), pixel.count());
+        }
+    }
+}
+
+// Marks the pixels that adaptive sampling stopped early but that differ from one of their
+// four neighbors by more than the adaptive contrast, since their first few samples may
+// have missed an edge. Runs between the passes, so that neighbors across tile borders are
+// compared too and no thread is changing them. Returns whether any pixel is marked.
+bool Renderer::find_edges()
+{
+    size_t max_samples = m_camera.getSupersamplingLevel() * m_camera.getFocalSamples();
+    double contrast = m_camera.getAdaptiveContrast();
+    bool any = false;
+    m_edges.assign(width * height, 0);
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            if ( m_framebuffer.samples(x, y) >= max_samples ) {
+                continue;
+            }
+            Color m = m_framebuffer.get(x, y);
+            bool edge = ( (x > 0 && PixelStats::contrast(m, m_framebuffer.get(x - 1, y)) > contrast) ||
+                          (x + 1 < width && PixelStats::contrast(m, m_framebuffer.get(x + 1, y)) > contrast) ||
+                          (y > 0 && PixelStats::contrast(m, m_framebuffer.get(x, y - 1)) > contrast) ||
+                          (y + 1 < height && PixelStats::contrast(m, m_framebuffer.get(x, y + 1)) > contrast) );
+            m_edges[y * width + x] = edge;
+            any = any || edge;
+        }
+    }
+    return any;
+}
 
-    Iset iset;
+// Adds the samples that render_tile() skipped to each of the tile's pixels that
+// find_edges() marked, so that they end up with all of them
+void Renderer::render_tile_edges(const Tile &tile, Iset &iset, RenderThreadStats &stats)
+{
+    size_t samples = m_camera.getSupersamplingLevel();
+    size_t max_samples = samples * m_camera.getFocalSamples();
+    for (size_t y = tile.y0; y < tile.y1; y++) {
+        if (m_killrender) return;
+        for (size_t x = tile.x0; x < tile.x1; x++) {
+            if ( !m_edges[y * width + x] ) {
+                continue;
+            }
+            for (size_t i = m_framebuffer.samples(x, y); i < max_samples; i++) {
+                m_framebuffer.add(x, y, sample_pixel(x, y, i, samples > 1, iset));
+                stats.samples++;
+            }
+        }
+    }
+}
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<> dis(0, 1);
+// Traces sample number index of pixel (x, y), jittered within the pixel if jitter is
+// set, and returns its color. With AOVs on, the sample's first hit goes into them.
+Color Renderer::sample_pixel(size_t x, size_t y, size_t index, bool jitter, Iset &iset)
+{
+    Sampler &sampler = Sampler::current();
+    sampler.startSample(x, y, index);
+    double px_offset = 0.5;
+    double py_offset = 0.5;
+    if ( jitter ) {
+        sampler.get2D(px_offset, py_offset);
+    }
+    Ray r = m_camera.ray_for_pixel(x, y, px_offset, py_offset);
+    Color c;
+    if ( m_framebuffer.hasAovs() ) {
+        SurfaceInfo surface;
+        c = m_world.colorAt(r, iset, REFLECTION_RECURSION_LIMIT, &surface);
+        m_framebuffer.addAov(x, y, surface.depth, surface.normal, surface.albedo, c);
+    } else {
+        c = m_world.colorAt(r, iset);
+    }
+    iset.clear();
+    return c;
+}
 
-    for (size_t x = 0; x < width; x++) {
-        if (m_killrender) break;
-        Color final_color;
-        Color focal_color;
-        double px_offset, py_offset;
+// Adds sample number pass to every pixel of the tile's running mean. Pixels
+// are left alone once the time limit is up, so a pass may end part way through.
+void Renderer::render_tile_pass(const Tile &tile, Iset &iset, RenderThreadStats &stats, size_t pass)
+{
+    bool jitter = m_camera.getSupersamplingLevel() > 1;
 
-        for (size_t i = 0; i < samples; i++) {
-            if ( samples == 1 ) {
-                px_offset = py_offset = 0.5;
-            } else {
-                px_offset = dis(gen);
-                py_offset = dis(gen);
+    for (size_t y = tile.y0; y < tile.y1; y++) {
+        if ( m_killrender ) return;
+        if ( out_of_time() ) {
+            m_out_of_time = true;
+            return;
+        }
+        if ( m_camera.usesPackets() ) {
+            render_row_packets(y, tile.x0, tile.x1, pass, iset, stats);
+            continue;
+        }
+        for (size_t x = tile.x0; x < tile.x1; x++) {
+            m_framebuffer.add(x, y, sample_pixel(x, y, pass, jitter, iset));
+            stats.samples++;
+        }
+    }
+}
+
+// Adds sample number index to each pixel of row y from x0 to x1, tracing PACKET_SIZE
+// neighbouring pixels at a time
+void Renderer::render_row_packets(size_t y, size_t x0, size_t x1, size_t index, Iset &iset, RenderThreadStats &stats)
+{
+    bool jitter = m_camera.getSupersamplingLevel() > 1;
+    Sampler &sampler = Sampler::current();
+    bool aovs = m_framebuffer.hasAovs();
+    Color colors[PACKET_SIZE];
+    SurfaceInfo surfaces[PACKET_SIZE];
+
+    for (size_t x = x0; x < x1; x += PACKET_SIZE) {
+        size_t n = std::min<size_t>(PACKET_SIZE, x1 - x);
+        trace_packet(n, [&](size_t i) {
+            sampler.startSample(x + i, y, index);
+            double px_offset = 0.5;
+            double py_offset = 0.5;
+            if ( jitter ) {
+                sampler.get2D(px_offset, py_offset);
             }
-            // implement focal blur by taking multiple samples with same pixel offset
-            focal_color = Color(0,0,0);
-            for (size_t j = 0; j < focal_samples; j++) {
-                Ray r = m_camera.ray_for_pixel(x, y, px_offset, py_offset);
-                Color c = m_world.colorAt(r, iset);
+            return m_camera.ray_for_pixel(x + i, y, px_offset, py_offset);
+        }, iset, colors, aovs ? surfaces : nullptr);
+        for (size_t i = 0; i < n; i++) {
+            m_framebuffer.add(x + i, y, colors[i]);
+            if ( aovs ) {
+                m_framebuffer.addAov(x + i, y, surfaces[i].depth, surfaces[i].normal, surfaces[i].albedo, colors[i]);
+            }
+        }
+        stats.samples += n;
+    }
+}
+
+// Traces the center of each preview_scale x preview_scale block and fills the block
+// with it. Blocks are aligned to the image, so one may be split between two tiles; both
+// halves trace the same sample.
+void Renderer::render_tile_preview(const Tile &tile, Iset &iset)
+{
+    size_t scale = m_camera.getPreviewScale();
+    Sampler &sampler = Sampler::current();
+    bool packets = m_camera.usesPackets();
+    Color colors[PACKET_SIZE];
+
+    for (size_t by = tile.y0 / scale * scale; by < tile.y1; by += scale) {
+        if (m_killrender) return;
+        size_t by1 = std::min(by + scale, height);
+        size_t first_bx = tile.x0 / scale * scale;
+        size_t blocks = (tile.x1 - first_bx + scale - 1) / scale;
+        // A packet of blocks at a time, or one with packets off
+        size_t step = packets ? PACKET_SIZE : 1;
+        for (size_t b = 0; b < blocks; b += step) {
+            size_t n = std::min(step, blocks - b);
+            auto make_ray = [&](size_t i) {
+                size_t bx = first_bx + (b + i) * scale;
+                size_t bx1 = std::min(bx + scale, width);
+                sampler.startSample(bx, by, 0);
+                return m_camera.ray_for_pixel(bx, by, (bx1 - bx) / 2.0, (by1 - by) / 2.0);
+            };
+            if ( packets ) {
+                trace_packet(n, make_ray, iset, colors, nullptr);
+            } else {
+                colors[0] = m_world.colorAt(make_ray(0), iset);
                 iset.clear();
-                focal_color += c;
             }
-            focal_color /= focal_samples;
-            final_color += focal_color;
+
+            for (size_t i = 0; i < n; i++) {
+                size_t bx = first_bx + (b + i) * scale;
+                size_t bx1 = std::min(bx + scale, width);
+                for (size_t y = std::max(by, tile.y0); y < std::min(by1, tile.y1); y++) {
+                    for (size_t x = std::max(bx, tile.x0); x < std::min(bx1, tile.x1); x++) {
+                        m_framebuffer.set(x, y, colors[i]);
+                    }
+                }
+            }
         }
+    }
+}
 
-        final_color /= samples;
-        
-        Point px = Point(x,y,0);
-        m_canvas.put_pixel(px, final_color);
+void Renderer::print_thread_stats() const
+{
+    std::cout << "Thread   busy (s)   idle (s)   tiles   stolen" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < m_stats.size(); i++) {
+        const RenderThreadStats &st = m_stats[i];
+        std::cout << std::setw(6) << i
+                  << std::setw(11) << st.busy
+                  << std::setw(11) << st.idle
+                  << std::setw(8) << st.tiles
+                  << std::setw(9) << st.stolen << std::endl;
+    }
+
+    size_t total = 0;
+    BVHCounters bvh;
+    for (const auto &st : m_stats) {
+        total += st.samples;
+        bvh.add(st.bvh.nodes, st.bvh.boxes);
+    }
+    std::cout << std::setprecision(2) << "Samples per pixel: " << (double)total / (width * height)
+              << " (max " << m_camera.getSupersamplingLevel() * m_camera.getFocalSamples() << ")" << std::endl;
+    if ( total > 0 ) {
+        std::cout << std::setprecision(1) << "BVH nodes visited per sample: " << (double)bvh.nodes / total
+                  << ", boxes tested: " << (double)bvh.boxes / total << std::endl;
     }
+    std::cout.unsetf(std::ios_base::floatfield);
+    std::cout << std::setprecision(6);
 }
 
 void Renderer::kill_render()
@@ -1,7 +1,7 @@
 #pragma once
-#include <gtkmm.h>
-#include <gdkmm/pixbuf.h>
 #include "Canvas.h"
+#include "Framebuffer.h"
+#include "Denoiser.h"
 #include "Color.h"
 #include "Pattern.h"
 #include "Camera.h"
@@ -9,46 +9,108 @@
 #include "Sphere.h"
 #include "Plane.h"
 #include "SceneConfig.h"
+#include "TileScheduler.h"
+#include "Sampler.h"
+#include "PixelStats.h"
+#include <atomic>
 #include <thread>
 #include <mutex>
+#include <chrono>
 #include <math.h>
+#include <functional>
 #define PI 3.1415926535898
 
-// Forward declaration of MainWindow
-class MainWindow;
+// Passes given to render_tiles() that aren't a progressive sample number
+#define PASS_ALL_SAMPLES -1 // the whole render in one pass
+#define PASS_PREVIEW -2     // progressive preview at reduced resolution
+#define PASS_EDGES -3       // adaptive sampling: the rest of the samples of the pixels on edges
+
+// Per-thread timing collected during a render
+struct RenderThreadStats {
+    double busy = 0; // seconds spent rendering tiles
+    double idle = 0; // seconds spent waiting for the other threads to finish
+    size_t tiles = 0;
+    size_t stolen = 0; // tiles taken from another thread's queue
+    size_t samples = 0; // camera samples taken, which adaptive sampling makes vary per pixel
+    BVHCounters bvh;    // BVH work of every ray traced for those samples
+};
 
 class Renderer 
 {
 public:
 
-    Renderer(size_t threads, const SceneConfig &config) :
+    Renderer(size_t threads, const SceneConfig &config, size_t tile_size = DEFAULT_TILE_SIZE) :
                                       m_killrender(false),
                                       width(config.getWidth()),
                                       height(config.getHeight()),
                                       m_camera(config.getCamera()),
                                       m_canvas(Canvas(config.getWidth(), config.getHeight())),
+                                      m_framebuffer(config.getWidth(), config.getHeight()),
+                                      m_denoised(config.getWidth(), config.getHeight()),
                                       m_world(config.getWorld()),
-                                      numThreads(threads) { }
+                                      numThreads(threads),
+                                      tileSize(tile_size),
+                                      m_passes_done(0),
+                                      m_out_of_time(false) { }
 
 
     void kill_render();
 
-    void render_pixel_row(int y);
-    void render_portion(size_t threadnum);
-    void render(MainWindow* caller);
+    void render_tile(const Tile &tile, Iset &iset, RenderThreadStats &stats);
+    void render_tile_pass(const Tile &tile, Iset &iset, RenderThreadStats &stats, size_t pass);
+    void render_tile_preview(const Tile &tile, Iset &iset);
+    void render_tile_edges(const Tile &tile, Iset &iset, RenderThreadStats &stats);
+    void render_tiles(size_t threadnum, TileScheduler &scheduler, long pass);
+    // Renders the scene. on_finish, if given, is called on this thread when the render
+    // completes, but not if it was killed.
+    void render(const std::function<void()> &on_finish = nullptr);
+
+    // Called on the render thread after each progressive pass, with the number of samples
+    // per pixel so far. No other thread touches the canvas while it runs.
+    void setPassCallback(const std::function<void(size_t)> &callback) { m_on_pass = callback; }
+    bool isProgressive() const { return m_camera.isProgressive(); }
+    // Overrides the scene's denoise setting
+    void setDenoise(bool enabled) { m_camera.setDenoise(enabled, m_camera.getDenoiseRadius()); }
+    size_t getPassesDone() const { return m_passes_done; }
 
-    Glib::RefPtr<Gdk::Pixbuf> getPixbuf() {
-        return m_canvas.getPixbuf();
-    }
+    const std::vector<RenderThreadStats>& getThreadStats() const { return m_stats; }
 
     Canvas& getCanvas();
+    // The rendered image in linear color, before tone mapping
+    const Framebuffer& getFramebuffer() const { return m_framebuffer; }
+    // The finished image: the denoised framebuffer if denoising is on
+    const Framebuffer& getOutput() const { return m_camera.isDenoised() ? m_denoised : m_framebuffer; }
+    // Saves the image in the format given by the file extension (see ImageIO.h). PFM
+    // files get the linear framebuffer, anything else the tone mapped canvas.
+    void save(const std::string &filename);
 
 private:
     bool m_killrender;
     size_t width;
     size_t height;
     Camera m_camera;
-    Canvas m_canvas;
+    Canvas m_canvas; // 8-bit copy of m_framebuffer for display and saving
+    Framebuffer m_framebuffer;
+    Framebuffer m_denoised; // copy of m_framebuffer with its colors denoised
     World m_world;
     size_t numThreads;
+    size_t tileSize;
+    std::vector<RenderThreadStats> m_stats;
+    std::chrono::time_point<std::chrono::steady_clock> m_render_start;
+
+    size_t m_passes_done; // progressive passes finished
+    std::atomic<bool> m_out_of_time; // set by the render threads when the time limit cuts a pass short
+    std::function<void(size_t)> m_on_pass;
+    std::vector<uint8_t> m_edges; // pixels that find_edges() gives every sample
+
+    void run_pass(long pass);
+    Color sample_pixel(size_t x, size_t y, size_t index, bool jitter, Iset &iset);
+    bool find_edges();
+    template <typename MakeRay>
+    void trace_packet(size_t n, MakeRay make_ray, Iset &iset, Color *colors, SurfaceInfo *surfaces);
+    void render_row_packets(size_t y, size_t x0, size_t x1, size_t index, Iset &iset, RenderThreadStats &stats);
+    void denoise();
+    void render_progressive();
+    bool out_of_time() const;
+    void print_thread_stats() const;
 };
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "Sampler.h"
+
+namespace {
+
+const uint32_t HALTON_PRIMES[SAMPLER_HALTON_DIMENSIONS] = {
+      2,   3,   5,   7,  11,  13,  17,  19,  23,  29,  31,  37,  41,  43,  47,  53,
+     59,  61,  67,  71,  73,  79,  83,  89,  97, 101, 103, 107, 109, 113, 127, 131
+};
+
+// splitmix64 finalizer: turns nearby inputs into unrelated outputs
+uint64_t mix64(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Top 53 bits as a double in [0,1)
+double toUnit(uint64_t bits)
+{
+    return (bits >> 11) * (1.0 / 9007199254740992.0);
+}
+
+} // namespace
+
+double radicalInverse(int dimension, uint64_t index)
+{
+    if ( dimension == 0 ) {
+        // Base 2 is a bit reversal
+        index = (index << 32) | (index >> 32);
+        index = ((index & 0x0000ffff0000ffffULL) << 16) | ((index & 0xffff0000ffff0000ULL) >> 16);
+        index = ((index & 0x00ff00ff00ff00ffULL) << 8) | ((index & 0xff00ff00ff00ff00ULL) >> 8);
+        index = ((index & 0x0f0f0f0f0f0f0f0fULL) << 4) | ((index & 0xf0f0f0f0f0f0f0f0ULL) >> 4);
+        index = ((index & 0x3333333333333333ULL) << 2) | ((index & 0xccccccccccccccccULL) >> 2);
+        index = ((index & 0x5555555555555555ULL) << 1) | ((index & 0xaaaaaaaaaaaaaaaaULL) >> 1);
+        return toUnit(index);
+    }
+
+    const uint32_t base = HALTON_PRIMES[dimension];
+    const double inv_base = 1.0 / base;
+    double f = inv_base;
+    double ret = 0;
+    while ( index > 0 ) {
+        ret += (index % base) * f;
+        index /= base;
+        f *= inv_base;
+    }
+    return ret < 1.0 ? ret : 0.99999999999999989; // largest double below 1
+}
+
+void Sampler::startSample(size_t x, size_t y, uint64_t sample_index)
+{
+    pixel_hash = mix64(seed ^ mix64(((uint64_t)x << 32) ^ (uint64_t)y));
+    index = sample_index;
+    dimension = 0;
+    rng.seed(pixel_hash, sample_index);
+}
+
+double Sampler::get1D()
+{
+    if ( dimension < SAMPLER_HALTON_DIMENSIONS ) {
+        // Cranley-Patterson rotation: shift this pixel's points by a fixed random offset
+        double offset = toUnit(mix64(pixel_hash + (uint64_t)(dimension + 1) * 0x9e3779b97f4a7c15ULL));
+        double r = radicalInverse(dimension, index) + offset;
+        dimension++;
+        return ( r >= 1.0 ) ? r - 1.0 : r;
+    }
+    dimension++;
+    return rng.uniform();
+}
+
+Sampler& Sampler::current()
+{
+    static thread_local Sampler sampler;
+    return sampler;
+}
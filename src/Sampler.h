@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#define DEFAULT_SAMPLER_SEED 0
+// Sample dimensions past this many come from the Sampler's PCG stream instead of Halton
+#define SAMPLER_HALTON_DIMENSIONS 32
+
+// PCG32 (pcg-random.org): 64 bits of state, 32-bit output, and 2^63 selectable streams.
+// Seeding is cheap, so a fresh stream can be started for every sample.
+class Pcg32 {
+public:
+    Pcg32() { seed(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL); }
+    Pcg32(uint64_t initstate, uint64_t initseq) { seed(initstate, initseq); }
+
+    void seed(uint64_t initstate, uint64_t initseq) {
+        state = 0;
+        inc = (initseq << 1) | 1;
+        next();
+        state += initstate;
+        next();
+    }
+    uint32_t next() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+        uint32_t rot = (uint32_t)(old >> 59);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
+    // Uniform in [0,1)
+    double uniform() { return next() * (1.0 / 4294967296.0); }
+
+private:
+    uint64_t state;
+    uint64_t inc;
+};
+
+// The index'th point of the van der Corput sequence in the base of the given Halton
+// dimension (the dimension'th prime). dimension must be below SAMPLER_HALTON_DIMENSIONS.
+double radicalInverse(int dimension, uint64_t index);
+
+// Sampler hands out the random numbers for one camera sample at a time: the position in
+// the pixel, the point on the lens, and the jitter of every area light cell that the
+// sample's shadow rays use, in that order. Each number is one dimension of the sample.
+//
+// The first SAMPLER_HALTON_DIMENSIONS dimensions come from the Halton sequence, indexed by
+// the sample's number within its pixel, so the samples of a pixel are spread evenly
+// instead of clumping. Each pixel shifts the sequence by its own random offset per
+// dimension, so neighbouring pixels don't share a pattern. Further dimensions come from a
+// PCG stream. Everything depends only on the seed, the pixel and the sample number, so a
+// render is the same no matter which thread draws which tile.
+class Sampler {
+public:
+    explicit Sampler(uint64_t seed = DEFAULT_SAMPLER_SEED) : seed(seed) { startSample(0, 0, 0); }
+
+    void setSeed(uint64_t s) { seed = s; startSample(0, 0, 0); }
+    uint64_t getSeed() const { return seed; }
+
+    // Starts sample number index of pixel (x, y). Every number drawn until the next
+    // call belongs to this sample.
+    void startSample(size_t x, size_t y, uint64_t index);
+
+    // Uniform in [0,1)
+    double get1D();
+    void get2D(double &u, double &v) {
+        u = get1D();
+        v = get1D();
+    }
+
+    // The calling thread's Sampler. The Renderer starts each sample on it, and the
+    // Camera and area Lights draw from it.
+    static Sampler& current();
+
+private:
+    uint64_t seed;
+    uint64_t pixel_hash;
+    uint64_t index;
+    int dimension;
+    Pcg32 rng;
+};
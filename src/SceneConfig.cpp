@@ -147,6 +147,70 @@ void SceneConfig::parse_yaml_add_camera(const YAML::Node &node)
     if (node["supersampling"]) {
         camera.setSupersamplingLevel(node["supersampling"].as<size_t>());
     }
+    if (node["adaptive-threshold"]) {
+        size_t min_samples = DEFAULT_ADAPTIVE_MIN_SAMPLES;
+        if (node["min-samples"]) {
+            min_samples = node["min-samples"].as<size_t>();
+        }
+        double contrast = DEFAULT_ADAPTIVE_CONTRAST;
+        if (node["adaptive-contrast"]) {
+            contrast = node["adaptive-contrast"].as<double>();
+        }
+        camera.setAdaptiveSampling(node["adaptive-threshold"].as<double>(), min_samples, contrast);
+    }
+    if (node["progressive"]) {
+        camera.setProgressive(node["progressive"].as<bool>());
+    }
+    if (node["preview-scale"]) {
+        camera.setPreviewScale(node["preview-scale"].as<size_t>());
+    }
+    if (node["time-limit"]) {
+        camera.setTimeLimit(node["time-limit"].as<double>());
+    }
+    if (node["seed"]) {
+        camera.setSeed(node["seed"].as<uint64_t>());
+    }
+    if (node["tone-map"] || node["exposure"] || node["gamma"]) {
+        ToneMap tm = camera.getToneMap();
+        ToneMapOperator op = tm.getOperator();
+        if (node["tone-map"]) {
+            try {
+                op = ToneMap::parseOperator(node["tone-map"].as<std::string>());
+            } catch (std::invalid_argument &e) {
+                yaml_error(node["tone-map"], e.what());
+            }
+        }
+        double exposure = node["exposure"] ? node["exposure"].as<double>() : tm.getExposure();
+        double gamma = node["gamma"] ? node["gamma"].as<double>() : tm.getGamma();
+        if ( gamma <= 0 ) {
+            yaml_error(node["gamma"], "Gamma must be positive");
+            gamma = tm.getGamma();
+        }
+        camera.setToneMap(ToneMap(op, exposure, gamma));
+    }
+    if (node["aovs"]) {
+        camera.setAovs(node["aovs"].as<bool>());
+    }
+    if (node["denoise"] || node["denoise-radius"]) {
+        size_t radius = node["denoise-radius"] ? node["denoise-radius"].as<size_t>() : DEFAULT_DENOISE_RADIUS;
+        camera.setDenoise(node["denoise"] ? node["denoise"].as<bool>() : true, radius);
+    }
+    if (node["packets"]) {
+        camera.setPackets(node["packets"].as<bool>());
+        if ( camera.usesPackets() && camera.isAdaptive() && !camera.isProgressive() ) {
+            yaml_warning(node["packets"], "Adaptive sampling traces camera rays one at a time, so packets are not used");
+        }
+    }
+    if (node["exr-compression"]) {
+        std::string c = node["exr-compression"].as<std::string>();
+        if ( c == "zip" ) {
+            camera.setExrCompression(ExrCompression::zip);
+        } else if ( c == "none" ) {
+            camera.setExrCompression(ExrCompression::none);
+        } else {
+            yaml_error(node["exr-compression"], "exr-compression must be 'zip' or 'none'");
+        }
+    }
     if ( (node["from"] || node["to"] || node["up"]) && 
         !(node["from"] && node["to"] && node["up"]) ) {
             yaml_error(node, "Camera object must include all three (or none) of: 'from', 'to', 'up'");
@@ -317,7 +381,10 @@ std::shared_ptr<Shape> SceneConfig::parse_yaml_make_group(const YAML::Node &node
     }
 
     // Create BVH to vastly speed up large groups
-    g->divide(4);
+    BVHMethod bvh_method;
+    size_t bvh_leaf_size, bvh_width;
+    parse_yaml_bvh_options(node, bvh_method, bvh_leaf_size, bvh_width);
+    g->buildBVH(bvh_method, bvh_leaf_size, bvh_width);
 
     return parse_yaml_make_shape_common(g, node, parent);
 }
@@ -374,21 +441,105 @@ std::shared_ptr<Shape> SceneConfig::parse_yaml_make_obj(const YAML::Node &node,
             yaml_error(node, "invalid filename");
     }
 
-    ObjParser parser;
-    try {
-        parser = ObjParser(filename);
-    } catch (const std::exception &e) {
-        std::cerr << "Error reading file: " << filename << std::endl;
-        exit(1);
+    BVHMethod bvh_method;
+    size_t bvh_leaf_size, bvh_width;
+    parse_yaml_bvh_options(node, bvh_method, bvh_leaf_size, bvh_width);
+
+    // Optional 'mesh-precision' (double or single) of the vertices
+    MeshPrecision precision = DEFAULT_MESH_PRECISION;
+    if (node["mesh-precision"]) {
+        std::string p = node["mesh-precision"].IsScalar() ? node["mesh-precision"].as<std::string>() : "";
+        if (p == "double") {
+            precision = MeshPrecision::double_precision;
+        } else if (p == "single") {
+            precision = MeshPrecision::single_precision;
+        } else {
+            yaml_error(node, "mesh-precision must be one of: double, single");
+        }
+    }
+
+    // Optional 'cache': true (the default) keeps the built meshes in a MeshCache next to
+    // the obj file, false neither reads nor writes one, and anything else is the
+    // directory to keep it in
+    bool use_cache = true;
+    std::string cache_dir;
+    if (node["cache"]) {
+        if (!node["cache"].IsScalar()) {
+            yaml_error(node, "cache must be true, false or a directory");
+        } else if (!YAML::convert<bool>::decode(node["cache"], use_cache)) {
+            cache_dir = node["cache"].as<std::string>();
+        }
+    }
+
+    // Every obj is an instance of the file's geometry, which is only parsed the first
+    // time it is used with these options
+    std::string key = filename + "|" + std::to_string((int)bvh_method) + "|" + std::to_string(bvh_leaf_size) + "|"
+                      + std::to_string(bvh_width) + "|" + std::to_string((int)precision);
+    auto it = obj_geometry.find(key);
+    if ( it == obj_geometry.end() ) {
+        MeshCache cache(filename, bvh_method, bvh_leaf_size, precision, bvh_width, cache_dir);
+        std::shared_ptr<Group> geometry = use_cache ? cache.load() : nullptr;
+        if ( !geometry ) {
+            ObjParser parser;
+            try {
+                parser = ObjParser(filename, bvh_method, bvh_leaf_size, precision, bvh_width);
+            } catch (const std::exception &e) {
+                std::cerr << "Error reading file: " << filename << std::endl;
+                exit(1);
+            }
+            if ( use_cache ) {
+                cache.save(parser);
+            }
+            geometry = parser.obj;
+        }
+        it = obj_geometry.insert(std::make_pair(key, geometry)).first;
+    } else {
+        std::cout << "Instancing " << filename << " again" << std::endl;
     }
 
-    return parse_yaml_make_shape_common(parser.obj, node, parent);
+    return parse_yaml_make_shape_common(Instance::make(it->second), node, parent);
+}
+
+// Optional 'bvh' (sah, lbvh, midpoint or none), 'bvh-leaf-size' and 'bvh-width' (2, 4 or 8)
+// attributes of groups and objs
+void SceneConfig::parse_yaml_bvh_options(const YAML::Node &node, BVHMethod &method, size_t &leaf_size, size_t &width)
+{
+    method = BVHMethod::sah;
+    leaf_size = 4;
+    width = DEFAULT_BVH_WIDTH;
+    if (node["bvh"]) {
+        std::string m = node["bvh"].IsScalar() ? node["bvh"].as<std::string>() : "";
+        if (m == "sah") {
+            method = BVHMethod::sah;
+        } else if (m == "lbvh") {
+            method = BVHMethod::lbvh;
+        } else if (m == "midpoint") {
+            method = BVHMethod::midpoint;
+        } else if (m == "none") {
+            method = BVHMethod::none;
+        } else {
+            yaml_error(node, "bvh must be one of: sah, lbvh, midpoint, none");
+        }
+    }
+    if (node["bvh-leaf-size"]) {
+        if (node["bvh-leaf-size"].IsScalar() && node["bvh-leaf-size"].as<int>() > 0)
+            leaf_size = node["bvh-leaf-size"].as<size_t>();
+        else
+            yaml_error(node, "bvh-leaf-size must be a positive number");
+    }
+    if (node["bvh-width"]) {
+        int w = node["bvh-width"].IsScalar() ? node["bvh-width"].as<int>() : 0;
+        if (w == 2 || w == 4 || w == 8)
+            width = w;
+        else
+            yaml_error(node, "bvh-width must be one of: 2, 4, 8");
+    }
 }
 
 std::shared_ptr<Shape> SceneConfig::parse_yaml_make_shape_common(const std::shared_ptr<Shape> &s, const YAML::Node &node, const std::shared_ptr<Shape> &parent) 
 {
     Material m;
-    Matrix transform = Matrix::identity(4);
+    Matrix4 transform = Matrix4::identity();
 
     if ( !parent && !node["material"] ) {
         yaml_warning(node, "No material specified for shape. Will use defaults.");
@@ -518,7 +669,7 @@ std::shared_ptr<Pattern> SceneConfig::parse_yaml_make_pattern(const YAML::Node &
     if ( node.IsMap() ) {
 
         std::string type;
-        Matrix transform = Matrix::identity(4);
+        Matrix4 transform = Matrix4::identity();
 
         if ( node["type"] ) {
             type = node["type"].as<std::string>();
@@ -744,7 +895,7 @@ std::shared_ptr<UVPattern> SceneConfig::parse_yaml_make_uv_pattern(const YAML::N
                 std::shared_ptr<UVPattern> uvp;
                 try {
                     uvp = UVImagePattern::make(filename);
-                } catch (Glib::FileError &e) {
+                } catch (std::runtime_error &e) {
                     yaml_error(node, std::string("Error creating pattern from image file: ") + e.what() );
                     return nullptr;
                 }
@@ -761,9 +912,9 @@ std::shared_ptr<UVPattern> SceneConfig::parse_yaml_make_uv_pattern(const YAML::N
     
 }
 
-void SceneConfig::parse_yaml_apply_transform(const YAML::Node &node, Matrix &transform)
+void SceneConfig::parse_yaml_apply_transform(const YAML::Node &node, Matrix4 &transform)
 {
-    Matrix tmp = transform;
+    Matrix4 tmp = transform;
 
     // Base case: node is not a matching defined string. Simply apply the transformation to given matrix.
     if ( node.IsSequence() ) {
@@ -12,6 +12,8 @@
 #include "Group.h"
 #include "CSG.h"
 #include "ObjParser.h"
+#include "Instance.h"
+#include "MeshCache.h"
 #include "UVPattern.h"
 #include <memory>
 #include <map>
@@ -57,7 +59,8 @@ private:
     std::shared_ptr<UVPattern> parse_yaml_make_uv_pattern(const YAML::Node &node);
 
 
-    void parse_yaml_apply_transform(const YAML::Node &node, Matrix &transform);
+    void parse_yaml_apply_transform(const YAML::Node &node, Matrix4 &transform);
+    void parse_yaml_bvh_options(const YAML::Node &node, BVHMethod &method, size_t &leaf_size, size_t &width);
 
     bool lookup_defined_yaml_node(const std::string &name, YAML::Node &dest_out);
 
@@ -67,6 +70,8 @@ private:
     YAML::Node yaml;
     std::map<std::string, YAML::Node> define_map; // holds the YAML::Node 
                                                   // given by each of our yaml 'define' objects
+    std::map<std::string, std::shared_ptr<Group>> obj_geometry; // each obj file parsed so far, keyed by
+                                                                 // its name and how it was built
     World world;
     Camera camera;
 
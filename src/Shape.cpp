@@ -11,6 +11,81 @@ bool Shape::intersect(const Ray &r, Iset &iset_out)
     return localIntersect(ray_transformed, iset_out);
 }
 
+bool Shape::intersectClosest(const Ray &r, Intersection &hit_out)
+{
+    Ray ray_transformed = r.transform(inverse_transform);
+
+    return localIntersectClosest(ray_transformed, hit_out);
+}
+
+bool Shape::intersectAny(const Ray &r, double max_t)
+{
+    if ( !shadows_enabled ) {
+        return false;
+    }
+    Ray ray_transformed = r.transform(inverse_transform);
+
+    return localIntersectAny(ray_transformed, max_t);
+}
+
+PacketMask Shape::intersectPacket(const RayPacket &packet, PacketMask lanes, PacketHits &hits)
+{
+    RayPacket packet_transformed = packet.transform(inverse_transform);
+
+    return localIntersectPacket(packet_transformed, lanes, hits);
+}
+
+bool Shape::localIntersectClosest(const Ray &ray, Intersection &hit_out)
+{
+    // Shapes without a specialized closest-hit test append their intersections to a
+    // per-thread scratch list, and we take them back off the end when we're done.
+    // (Appending rather than clearing keeps this safe if it's ever re-entered.)
+    static thread_local Iset scratch;
+    size_t first = scratch.size();
+    bool found = false;
+    localIntersect(ray, scratch);
+    for (size_t i = first; i < scratch.size(); i++) {
+        if ( scratch[i].t > 0 && scratch[i].t < hit_out.t ) {
+            hit_out = scratch[i];
+            found = true;
+        }
+    }
+    scratch.truncate(first);
+    return found;
+}
+
+bool Shape::localIntersectAny(const Ray &ray, double max_t)
+{
+    // Same scratch list approach as localIntersectClosest(). Intersections reported by
+    // CSG belong to its children, so check their shadow flags too.
+    static thread_local Iset scratch;
+    size_t first = scratch.size();
+    bool found = false;
+    localIntersect(ray, scratch);
+    for (size_t i = first; i < scratch.size(); i++) {
+        if ( scratch[i].t > 0 && scratch[i].t < max_t && scratch[i].obj->castsShadow() ) {
+            found = true;
+            break;
+        }
+    }
+    scratch.truncate(first);
+    return found;
+}
+
+PacketMask Shape::localIntersectPacket(const RayPacket &packet, PacketMask lanes, PacketHits &hits)
+{
+    PacketMask found = 0;
+    forEachLane(lanes, [&](int lane) {
+        Intersection hit;
+        hit.t = hits.t[lane];
+        if ( localIntersectClosest(packet.ray(lane), hit) ) {
+            hits.set(lane, hit);
+            found |= 1u << lane;
+        }
+    });
+    return found;
+}
+
 Vector Shape::normalAt(const Point &p, const Intersection *const ip) const
 {
     //Point obj_p = inverse_transform * p;
@@ -43,12 +118,12 @@ Vector Shape::normal_to_world(Vector n) const
     return n;
 }
 
-Material Shape::getMaterial() const
+const Material& Shape::getMaterial() const
 {
     // first use nearest modified material in parent group hierarchy,
     // otherwise use this object's own material which may have been
     // default constructed
-    auto p = parent;
+    const Shape *p = parent;
     while ( p ) {
         if ( p->material_modified )
             return p->getMaterial();
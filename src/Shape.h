@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Ray.h"
+#include "RayPacket.h"
 #include "Material.h"
 #include "BoundingBox.h"
 #include <utility>
@@ -8,9 +9,9 @@
 
 class Group;
 
-class Shape : public std::enable_shared_from_this<Shape> {
+class Shape {
 public:
-    void setTransform(const Matrix &M) {
+    void setTransform(const Matrix4 &M) {
         transform = M;
         inverse_transform = M.inverse();
     }
@@ -18,10 +19,10 @@ public:
         material = m;
         material_modified = true;
     }
-    const Matrix& getTransform() const { return transform; }
-    const Matrix& getInverseTransform() const { return inverse_transform; }
-    Material getMaterial() const;
-    bool castsShadow() { return shadows_enabled; }
+    const Matrix4& getTransform() const { return transform; }
+    const Matrix4& getInverseTransform() const { return inverse_transform; }
+    const Material& getMaterial() const;
+    bool castsShadow() const { return shadows_enabled; }
     bool castsShadow(bool enabled) {
         shadows_enabled = enabled;
         return shadows_enabled;
@@ -29,19 +30,40 @@ public:
 
     Vector normalAt(const Point &p, const Intersection *const ip = nullptr) const;
     bool intersect(const Ray &r, Iset &iset);
+    // Closest-hit query: looks only for an intersection with 0 < t < hit_out.t, and replaces
+    // hit_out with it if one is found. hit_out.t therefore acts as a running t_max, which lets
+    // aggregate shapes skip every child (or BVH node) that lies beyond the best hit so far.
+    bool intersectClosest(const Ray &r, Intersection &hit_out);
+    // Any-hit (occlusion) query for shadow rays: returns true as soon as any shadow-casting
+    // intersection with 0 < t < max_t is found. Shapes with shadows disabled are skipped
+    // entirely, along with all of their children.
+    bool intersectAny(const Ray &r, double max_t);
+    // Packet version of intersectClosest(): for every lane in lanes, looks for an
+    // intersection with 0 < t < hits.t[lane] and records it in hits. Returns the lanes
+    // that found one.
+    PacketMask intersectPacket(const RayPacket &packet, PacketMask lanes, PacketHits &hits);
 
     virtual Vector localNormalAt(const Point &obj_p, const Intersection *const ip = nullptr) const = 0;
     virtual bool localIntersect(const Ray &ray_transformed, Iset &iset_out) = 0;
+    // The default implementation collects all intersections with localIntersect() and picks
+    // the nearest. Shapes override this when they can do better.
+    virtual bool localIntersectClosest(const Ray &ray_transformed, Intersection &hit_out);
+    virtual bool localIntersectAny(const Ray &ray_transformed, double max_t);
+    // The default implementation traces the lanes one at a time with localIntersectClosest().
+    // Shapes override this with a kernel that tests all the lanes at once.
+    virtual PacketMask localIntersectPacket(const RayPacket &packet_transformed, PacketMask lanes, PacketHits &hits);
 
     // return bounding box within object space
     virtual BoundingBox bounds() const = 0;
 
     // divides shape (for Groups and CSG. Primitive shapes will do nothing)
     virtual void divide(size_t threshold) = 0;
+    // Like divide(), but builds a surface area heuristic BVH (see Group::divideSAH)
+    virtual void divideSAH(size_t max_leaf_size) { }
 
     // for aggregate shapes (Groups/CSG), test if children contain shape
     // (Primitive shapes will do nothing)
-    virtual bool includes(const std::shared_ptr<Shape> &shape) = 0;
+    virtual bool includes(const Shape *shape) const = 0;
 
     // return bounding box "outside of" object space
     BoundingBox parentBounds() const {
@@ -59,8 +81,9 @@ public:
     void setMaterialRefractiveIndex(double rindex) { material.setRefractiveIndex(rindex); material_modified = true; }
     void setMaterialTransparency(double transparency) { material.setTransparency(transparency); material_modified = true; }
 
-    std::shared_ptr<Shape> getParent() const { return parent; }
-    void setParent(const std::shared_ptr<Shape> &p) {
+    // The parent is not owned: it is the Group or CSG that owns this shape
+    Shape* getParent() const { return parent; }
+    void setParent(Shape *p) {
         parent = p;
     }
     Point world_to_object(Point p) const;
@@ -74,24 +97,24 @@ protected:
     // Keep constructors protected here and private in derived classes.
     // Derived classes will define static make() functions which will
     // return shared_ptr<Shape>.
-    Shape() : transform(Matrix::identity(4)),
-              inverse_transform(Matrix::identity(4)),
+    Shape() : transform(Matrix4::identity()),
+              inverse_transform(Matrix4::identity()),
               material(Material()),
               shadows_enabled(true),
               material_modified(false),
               parent(nullptr) { }
-    Shape(const Matrix &M) : transform(M),
+    Shape(const Matrix4 &M) : transform(M),
                              inverse_transform(M.inverse()),
                              material(Material()),
                              shadows_enabled(true),
                              material_modified(false),
                              parent(nullptr) { }
 
-    Matrix transform;
+    Matrix4 transform;
     // Cache the inverse of transform matrix for performance
-    Matrix inverse_transform;
+    Matrix4 inverse_transform;
     Material material;
     bool shadows_enabled;
     bool material_modified;
-    std::shared_ptr<Shape> parent;
+    Shape *parent;
 };
\ No newline at end of file
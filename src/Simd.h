@@ -0,0 +1,184 @@
+#pragma once
+#include <math.h>
+
+// SIMD kernels for the 4-wide double math behind Tuple and Matrix4.
+//
+// The instruction set is chosen at build time from the compiler's target flags: AVX
+// (4 doubles per register) when __AVX__ is defined, SSE2 (2 doubles per register) on
+// any other x86-64 build, and plain scalar code everywhere else. The cross product
+// additionally needs AVX2 for its lane permutes. Define JRAY_NO_SIMD to force the scalar
+// fallback (cmake -DJRAY_SIMD=OFF).
+//
+// All kernels use unaligned loads and stores: Tuples and Matrix4s live inside
+// heap-allocated shapes and materials, and C++11 operator new doesn't honor 32-byte
+// alignment. Matrices are passed as 16 doubles in column-major order, so that
+// matrix * tuple is a sum of the matrix columns scaled by the tuple components.
+// Except for simd_mat4_mul, out may be the same array as an input.
+
+#if !defined(JRAY_NO_SIMD) && defined(__AVX__)
+#define JRAY_SIMD_AVX 1
+#include <immintrin.h>
+#elif !defined(JRAY_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#define JRAY_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+inline const char *simd_name()
+{
+#if defined(JRAY_SIMD_AVX) && defined(__AVX2__)
+    return "AVX2";
+#elif defined(JRAY_SIMD_AVX)
+    return "AVX";
+#elif defined(JRAY_SIMD_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+inline void simd_add4(const double *a, const double *b, double *out)
+{
+#if defined(JRAY_SIMD_AVX)
+    _mm256_storeu_pd(out, _mm256_add_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b)));
+#elif defined(JRAY_SIMD_SSE2)
+    _mm_storeu_pd(out,     _mm_add_pd(_mm_loadu_pd(a),     _mm_loadu_pd(b)));
+    _mm_storeu_pd(out + 2, _mm_add_pd(_mm_loadu_pd(a + 2), _mm_loadu_pd(b + 2)));
+#else
+    out[0] = a[0] + b[0]; out[1] = a[1] + b[1]; out[2] = a[2] + b[2]; out[3] = a[3] + b[3];
+#endif
+}
+
+inline void simd_sub4(const double *a, const double *b, double *out)
+{
+#if defined(JRAY_SIMD_AVX)
+    _mm256_storeu_pd(out, _mm256_sub_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b)));
+#elif defined(JRAY_SIMD_SSE2)
+    _mm_storeu_pd(out,     _mm_sub_pd(_mm_loadu_pd(a),     _mm_loadu_pd(b)));
+    _mm_storeu_pd(out + 2, _mm_sub_pd(_mm_loadu_pd(a + 2), _mm_loadu_pd(b + 2)));
+#else
+    out[0] = a[0] - b[0]; out[1] = a[1] - b[1]; out[2] = a[2] - b[2]; out[3] = a[3] - b[3];
+#endif
+}
+
+inline void simd_mul4(const double *a, const double *b, double *out)
+{
+#if defined(JRAY_SIMD_AVX)
+    _mm256_storeu_pd(out, _mm256_mul_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b)));
+#elif defined(JRAY_SIMD_SSE2)
+    _mm_storeu_pd(out,     _mm_mul_pd(_mm_loadu_pd(a),     _mm_loadu_pd(b)));
+    _mm_storeu_pd(out + 2, _mm_mul_pd(_mm_loadu_pd(a + 2), _mm_loadu_pd(b + 2)));
+#else
+    out[0] = a[0] * b[0]; out[1] = a[1] * b[1]; out[2] = a[2] * b[2]; out[3] = a[3] * b[3];
+#endif
+}
+
+inline void simd_div4(const double *a, const double *b, double *out)
+{
+#if defined(JRAY_SIMD_AVX)
+    _mm256_storeu_pd(out, _mm256_div_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b)));
+#elif defined(JRAY_SIMD_SSE2)
+    _mm_storeu_pd(out,     _mm_div_pd(_mm_loadu_pd(a),     _mm_loadu_pd(b)));
+    _mm_storeu_pd(out + 2, _mm_div_pd(_mm_loadu_pd(a + 2), _mm_loadu_pd(b + 2)));
+#else
+    out[0] = a[0] / b[0]; out[1] = a[1] / b[1]; out[2] = a[2] / b[2]; out[3] = a[3] / b[3];
+#endif
+}
+
+inline void simd_scale4(const double *a, double f, double *out)
+{
+#if defined(JRAY_SIMD_AVX)
+    _mm256_storeu_pd(out, _mm256_mul_pd(_mm256_loadu_pd(a), _mm256_set1_pd(f)));
+#elif defined(JRAY_SIMD_SSE2)
+    __m128d s = _mm_set1_pd(f);
+    _mm_storeu_pd(out,     _mm_mul_pd(_mm_loadu_pd(a),     s));
+    _mm_storeu_pd(out + 2, _mm_mul_pd(_mm_loadu_pd(a + 2), s));
+#else
+    out[0] = a[0] * f; out[1] = a[1] * f; out[2] = a[2] * f; out[3] = a[3] * f;
+#endif
+}
+
+inline double simd_dot4(const double *a, const double *b)
+{
+#if defined(JRAY_SIMD_AVX)
+    __m256d p = _mm256_mul_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b));
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(p), _mm256_extractf128_pd(p, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+#elif defined(JRAY_SIMD_SSE2)
+    __m128d s = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(a),     _mm_loadu_pd(b)),
+                           _mm_mul_pd(_mm_loadu_pd(a + 2), _mm_loadu_pd(b + 2)));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+#else
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
+#endif
+}
+
+// Cross product of the xyz parts; out[3] is set to 0.
+inline void simd_cross3(const double *a, const double *b, double *out)
+{
+#if defined(JRAY_SIMD_AVX) && defined(__AVX2__)
+    // a.yzx * b.zxy - a.zxy * b.yzx. The w lane works out to a.w*b.w - a.w*b.w = 0.
+    __m256d va = _mm256_loadu_pd(a);
+    __m256d vb = _mm256_loadu_pd(b);
+    __m256d a_yzx = _mm256_permute4x64_pd(va, _MM_SHUFFLE(3, 0, 2, 1));
+    __m256d b_zxy = _mm256_permute4x64_pd(vb, _MM_SHUFFLE(3, 1, 0, 2));
+    __m256d a_zxy = _mm256_permute4x64_pd(va, _MM_SHUFFLE(3, 1, 0, 2));
+    __m256d b_yzx = _mm256_permute4x64_pd(vb, _MM_SHUFFLE(3, 0, 2, 1));
+    _mm256_storeu_pd(out, _mm256_sub_pd(_mm256_mul_pd(a_yzx, b_zxy), _mm256_mul_pd(a_zxy, b_yzx)));
+    out[3] = 0;
+#else
+    double x = a[1]*b[2] - a[2]*b[1];
+    double y = a[2]*b[0] - a[0]*b[2];
+    double z = a[0]*b[1] - a[1]*b[0];
+    out[0] = x; out[1] = y; out[2] = z; out[3] = 0;
+#endif
+}
+
+// out = M * t, with M column-major. SSE2 uses the scalar code: splatting each component
+// and adding two-lane halves ran at 0.7x the scalar loop in jray_bench, which the
+// compiler vectorizes about as well on its own.
+inline void simd_mat4_mul_tuple(const double *m, const double *t, double *out)
+{
+#if defined(JRAY_SIMD_AVX)
+    __m256d r = _mm256_mul_pd(_mm256_loadu_pd(m), _mm256_set1_pd(t[0]));
+    r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_loadu_pd(m + 4),  _mm256_set1_pd(t[1])));
+    r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_loadu_pd(m + 8),  _mm256_set1_pd(t[2])));
+    r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_loadu_pd(m + 12), _mm256_set1_pd(t[3])));
+    _mm256_storeu_pd(out, r);
+#else
+    double r[4];
+    for (int i = 0; i < 4; i++) {
+        r[i] = m[i]*t[0] + m[4+i]*t[1] + m[8+i]*t[2] + m[12+i]*t[3];
+    }
+    out[0] = r[0]; out[1] = r[1]; out[2] = r[2]; out[3] = r[3];
+#endif
+}
+
+// out = M * (x,y,z,w) for a known w of 1 (points) or 0 (vectors). The w lane of out
+// is left for the caller to overwrite. Scalar under SSE2, as for simd_mat4_mul_tuple.
+inline void simd_mat4_mul_xyz(const double *m, const double *t, bool translate, double *out)
+{
+#if defined(JRAY_SIMD_AVX)
+    __m256d r = _mm256_mul_pd(_mm256_loadu_pd(m), _mm256_set1_pd(t[0]));
+    r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_loadu_pd(m + 4), _mm256_set1_pd(t[1])));
+    r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_loadu_pd(m + 8), _mm256_set1_pd(t[2])));
+    if (translate) {
+        r = _mm256_add_pd(r, _mm256_loadu_pd(m + 12));
+    }
+    _mm256_storeu_pd(out, r);
+#else
+    double r[3];
+    for (int i = 0; i < 3; i++) {
+        r[i] = m[i]*t[0] + m[4+i]*t[1] + m[8+i]*t[2] + (translate ? m[12+i] : 0.0);
+    }
+    out[0] = r[0]; out[1] = r[1]; out[2] = r[2];
+#endif
+}
+
+// out = A * B, all column-major. Column j of the product is A times column j of B.
+// out may not alias A or B.
+inline void simd_mat4_mul(const double *a, const double *b, double *out)
+{
+    for (int j = 0; j < 4; j++) {
+        simd_mat4_mul_tuple(a, b + 4*j, out + 4*j);
+    }
+}
@@ -1,11 +1,71 @@
 #include "Sphere.h"
 #include <math.h>
 #include <memory>
+#include <algorithm>
 
 
 // Implements the ray-sphere intersection algorithm. Details here:
 // https://www.scratchapixel.com/lessons/3d-basic-rendering/minimal-ray-tracer-rendering-simple-shapes/ray-sphere-intersection
 bool Sphere::localIntersect(const Ray &ray, Iset &iset_out) 
+{
+    double t0, t1;
+    if ( !roots(ray, t0, t1) ) return false;
+
+    iset_out.insert(Intersection(t0, this));
+    iset_out.insert(Intersection(t1, this));
+    return true;
+}
+
+bool Sphere::localIntersectClosest(const Ray &ray, Intersection &hit_out)
+{
+    double t0, t1;
+    if ( !roots(ray, t0, t1) ) return false;
+
+    // t0 <= t1, so the first positive root is the nearer one
+    double t = (t0 > 0) ? t0 : t1;
+    if ( t > 0 && t < hit_out.t ) {
+        hit_out = Intersection(t, this);
+        return true;
+    }
+    return false;
+}
+
+bool Sphere::localIntersectAny(const Ray &ray, double max_t)
+{
+    double t0, t1;
+    if ( !roots(ray, t0, t1) ) return false;
+    return ( t0 > 0 && t0 < max_t ) || ( t1 > 0 && t1 < max_t );
+}
+
+// roots() for every lane at once, keeping the nearer positive root
+PacketMask Sphere::localIntersectPacket(const RayPacket &p, PacketMask lanes, PacketHits &hits)
+{
+    double t[PACKET_SIZE];
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        double a = p.dx[i]*p.dx[i] + p.dy[i]*p.dy[i] + p.dz[i]*p.dz[i];
+        double b = 2 * (p.dx[i]*p.ox[i] + p.dy[i]*p.oy[i] + p.dz[i]*p.oz[i]);
+        double c = p.ox[i]*p.ox[i] + p.oy[i]*p.oy[i] + p.oz[i]*p.oz[i] - 1;
+        double discr = b*b - 4.0*a*c;
+        double root = sqrt(std::max(discr, 0.0));
+        double q = (b > 0) ? -0.5 * (b + root) : -0.5 * (b - root);
+        double t0 = q / a;
+        double t1 = c / q;
+        double near = std::min(t0, t1);
+        double far = std::max(t0, t1);
+        t[i] = (discr < 0) ? -1 : (near > 0) ? near : far;
+    }
+    PacketMask found = 0;
+    forEachLane(lanes, [&](int lane) {
+        if ( t[lane] > 0 && t[lane] < hits.t[lane] ) {
+            hits.set(lane, Intersection(t[lane], this));
+            found |= 1u << lane;
+        }
+    });
+    return found;
+}
+
+// Computes both roots of the ray-sphere equation in increasing order. Returns false on a miss.
+inline bool Sphere::roots(const Ray &ray, double &t0, double &t1) const
 {
     // In object space, sphere is centered at 0,0,0
     // (Given ray is assumed to be already transformed to object space)
@@ -16,7 +76,6 @@ bool Sphere::localIntersect(const Ray &ray, Iset &iset_out)
     double c = dot(sphere_to_ray, sphere_to_ray) - 1;
     double discr = b*b - 4.0*a*c;
 
-    double t0, t1;
     if (discr < 0) return false;
     else if (discr == 0) t0 = t1 = -0.5 * b / a;
     else {
@@ -27,9 +86,6 @@ bool Sphere::localIntersect(const Ray &ray, Iset &iset_out)
         t1 = c / q;
     }
     if (t0 > t1) std::swap(t0,t1);
-
-    iset_out.insert(Intersection(t0, shared_from_this()));
-    iset_out.insert(Intersection(t1, shared_from_this()));
     return true;
 }
 
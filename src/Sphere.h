@@ -12,21 +12,26 @@ public:
         std::shared_ptr<Shape> ret(new Sphere());
         return ret;
     }
-    static std::shared_ptr<Shape> make(const Matrix &M)
+    static std::shared_ptr<Shape> make(const Matrix4 &M)
     {
         std::shared_ptr<Shape> ret(new Sphere(M));
         return ret;
     }
     bool localIntersect(const Ray &ray, Iset &iset_out) override;
+    bool localIntersectClosest(const Ray &ray, Intersection &hit_out) override;
+    bool localIntersectAny(const Ray &ray, double max_t) override;
+    PacketMask localIntersectPacket(const RayPacket &packet, PacketMask lanes, PacketHits &hits) override;
     Vector localNormalAt(const Point &obj_p, const Intersection *const ip) const override;
     BoundingBox bounds() const override {
         return BoundingBox( Point(-1,-1,-1) , Point(1,1,1) );
     }
 
     void divide(size_t threshold) override { }
-    bool includes(const std::shared_ptr<Shape> &shape) { return shape == shared_from_this(); }    
+    bool includes(const Shape *shape) const override { return shape == this; }    
 
 private:
     Sphere() : Shape() { }
-    Sphere(const Matrix &M) : Shape(M) { }
+    Sphere(const Matrix4 &M) : Shape(M) { }
+
+    inline bool roots(const Ray &ray, double &t0, double &t1) const;
 };
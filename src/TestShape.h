@@ -14,7 +14,7 @@ public:
         std::shared_ptr<Shape> ret(new TestShape());
         return ret;
     }
-    static std::shared_ptr<Shape> make(const Matrix &M)
+    static std::shared_ptr<Shape> make(const Matrix4 &M)
     {
         std::shared_ptr<Shape> ret(new TestShape(M));
         return ret;
@@ -25,12 +25,12 @@ public:
         return BoundingBox( Point(-EPSILON,-EPSILON,-EPSILON),Point(EPSILON,EPSILON,EPSILON) );
     }
 
-    bool includes(const std::shared_ptr<Shape> &shape) { return shape == shared_from_this(); }
+    bool includes(const Shape *shape) const override { return shape == this; }
     void divide(size_t threshold) override { }
 
     std::shared_ptr<Ray> saved_ray;
     
 private:
     TestShape() : Shape() { }
-    TestShape(const Matrix &M) : Shape(M) { }
+    TestShape(const Matrix4 &M) : Shape(M) { }
 };
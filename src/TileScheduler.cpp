@@ -0,0 +1,75 @@
+#include "TileScheduler.h"
+#include <algorithm>
+#include <stdexcept>
+
+TileScheduler::TileScheduler(size_t width, size_t height, size_t tile_size, size_t num_queues)
+{
+    if (tile_size == 0) {
+        throw std::invalid_argument("Tile size must be greater than zero");
+    }
+    if (num_queues == 0) {
+        num_queues = 1;
+    }
+    for (size_t i = 0; i < num_queues; i++) {
+        queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+    }
+
+    std::vector<Tile> tiles;
+    for (size_t y = 0; y < height; y += tile_size) {
+        for (size_t x = 0; x < width; x += tile_size) {
+            Tile t;
+            t.x0 = x;
+            t.y0 = y;
+            t.x1 = std::min(x + tile_size, width);
+            t.y1 = std::min(y + tile_size, height);
+            tiles.push_back(t);
+        }
+    }
+    num_tiles = tiles.size();
+
+    // Give each queue a contiguous run of tiles in scanline order, so that a thread
+    // working through its own queue stays in a coherent part of the image.
+    for (size_t i = 0; i < num_tiles; i++) {
+        size_t q = (i * num_queues) / num_tiles;
+        queues[q]->tiles.push_back(tiles[i]);
+    }
+}
+
+bool TileScheduler::next(size_t threadnum, Tile &tile_out, bool &stolen_out)
+{
+    size_t n = queues.size();
+    stolen_out = false;
+    if ( pop_front(*queues[threadnum % n], tile_out) ) {
+        return true;
+    }
+    // Our own queue is empty: steal from the back of the others, starting with our neighbor
+    for (size_t i = 1; i < n; i++) {
+        if ( pop_back(*queues[(threadnum + i) % n], tile_out) ) {
+            stolen_out = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TileScheduler::pop_front(WorkQueue &q, Tile &tile_out)
+{
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tiles.empty()) {
+        return false;
+    }
+    tile_out = q.tiles.front();
+    q.tiles.pop_front();
+    return true;
+}
+
+bool TileScheduler::pop_back(WorkQueue &q, Tile &tile_out)
+{
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tiles.empty()) {
+        return false;
+    }
+    tile_out = q.tiles.back();
+    q.tiles.pop_back();
+    return true;
+}
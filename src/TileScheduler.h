@@ -0,0 +1,48 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#define DEFAULT_TILE_SIZE 32
+
+// A Tile is a rectangular region of the image [x0,x1) x [y0,y1)
+struct Tile {
+    size_t x0, y0;
+    size_t x1, y1;
+};
+
+// TileScheduler splits the image into square tiles and hands them out to render threads.
+// Each thread owns a deque of tiles holding a contiguous run of the image. A thread takes
+// work from the front of its own deque, and once that is empty it steals from the back of
+// another thread's deque. Threads that drew the empty sky therefore help out the ones stuck
+// on expensive geometry instead of sitting idle until the render completes.
+class TileScheduler
+{
+public:
+    TileScheduler(size_t width, size_t height, size_t tile_size, size_t num_queues);
+
+    // Fetches the next tile for the given thread. Returns false when there is no work left.
+    // stolen_out is set to true if the tile was taken from another thread's queue.
+    bool next(size_t threadnum, Tile &tile_out, bool &stolen_out);
+    bool next(size_t threadnum, Tile &tile_out) {
+        bool stolen;
+        return next(threadnum, tile_out, stolen);
+    }
+
+    size_t tileCount() const { return num_tiles; }
+    size_t queueCount() const { return queues.size(); }
+
+private:
+    struct WorkQueue {
+        std::deque<Tile> tiles;
+        std::mutex mutex;
+    };
+
+    bool pop_front(WorkQueue &q, Tile &tile_out);
+    bool pop_back(WorkQueue &q, Tile &tile_out);
+
+    size_t num_tiles;
+    // WorkQueue holds a mutex, so it can't live directly in a (resizable) vector
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+};
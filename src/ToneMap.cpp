@@ -0,0 +1,53 @@
+#include "ToneMap.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+ToneMapOperator ToneMap::parseOperator(const std::string &name)
+{
+    if ( name == "clamp" ) {
+        return ToneMapOperator::clamp;
+    } else if ( name == "reinhard" ) {
+        return ToneMapOperator::reinhard;
+    } else if ( name == "aces" ) {
+        return ToneMapOperator::aces;
+    }
+    throw std::invalid_argument("Unknown tone map operator '" + name + "'");
+}
+
+double ToneMap::map(double v, double scale) const
+{
+    v *= scale;
+    if ( !(v > 0) ) { // also catches NaN
+        return 0;
+    }
+    switch (op) {
+        case ToneMapOperator::reinhard:
+            v = v / (1 + v);
+            break;
+        case ToneMapOperator::aces:
+            v = (v * (2.51 * v + 0.03)) / (v * (2.43 * v + 0.59) + 0.14);
+            break;
+        case ToneMapOperator::clamp:
+            break;
+    }
+    v = std::min(1.0, v);
+    if ( gamma != 1.0 ) {
+        v = std::pow(v, 1.0 / gamma);
+    }
+    return v;
+}
+
+Color ToneMap::apply(const Color &c) const
+{
+    double scale = std::exp2(exposure);
+    return Color(map(c.x(), scale), map(c.y(), scale), map(c.z(), scale));
+}
+
+void ToneMap::toBytes(const Color &c, unsigned char &r, unsigned char &g, unsigned char &b) const
+{
+    Color d = apply(c);
+    r = (unsigned char)(d.x() * 255.0 + 0.5);
+    g = (unsigned char)(d.y() * 255.0 + 0.5);
+    b = (unsigned char)(d.z() * 255.0 + 0.5);
+}
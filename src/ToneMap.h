@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Color.h"
+#include <string>
+
+// How a ToneMap squeezes linear color into [0,1]
+enum class ToneMapOperator {
+    clamp,    // anything brighter than white is white
+    reinhard, // c / (1 + c), per channel
+    aces      // the ACES filmic curve fit of Narkowicz (2015)
+};
+
+// ToneMap turns the linear colors of a Framebuffer into display values: scale by the
+// exposure, compress with the operator, then apply gamma. The defaults (clamp, exposure
+// 0, gamma 1) reproduce the plain clamped output jray has always written.
+class ToneMap
+{
+public:
+    ToneMap(ToneMapOperator op = ToneMapOperator::clamp, double exposure = 0, double gamma = 1.0) :
+        op(op), exposure(exposure), gamma(gamma) { }
+
+    // Parses "clamp", "reinhard" or "aces". Throws std::invalid_argument on anything else.
+    static ToneMapOperator parseOperator(const std::string &name);
+
+    // Display value in [0,1] of each channel
+    Color apply(const Color &c) const;
+    // Display value rounded to a byte
+    void toBytes(const Color &c, unsigned char &r, unsigned char &g, unsigned char &b) const;
+
+    ToneMapOperator getOperator() const { return op; }
+    double getExposure() const { return exposure; }
+    double getGamma() const { return gamma; }
+
+private:
+    double map(double v, double scale) const;
+
+    ToneMapOperator op;
+    double exposure; // in stops: each one doubles the brightness
+    double gamma;
+};
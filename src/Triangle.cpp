@@ -1,6 +1,68 @@
 #include "Triangle.h"
 
 bool Triangle::localIntersect(const Ray &ray, Iset &iset_out)
+{
+    double t, u, v;
+    if ( !hitTest(ray, t, u, v) ) {
+        return false;
+    }
+    // Uniquely for triangles, we construct the Intersection with u and v as well.
+    // This will be used for normal interpolation on smooth triangles.
+    iset_out.insert(Intersection(t, u, v, this));
+    return true;
+}
+
+bool Triangle::localIntersectClosest(const Ray &ray, Intersection &hit_out)
+{
+    double t, u, v;
+    if ( !hitTest(ray, t, u, v) || t <= 0 || t >= hit_out.t ) {
+        return false;
+    }
+    hit_out = Intersection(t, u, v, this);
+    return true;
+}
+
+bool Triangle::localIntersectAny(const Ray &ray, double max_t)
+{
+    double t, u, v;
+    return ( hitTest(ray, t, u, v) && t > 0 && t < max_t );
+}
+
+// hitTest() for every lane at once
+PacketMask Triangle::localIntersectPacket(const RayPacket &p, PacketMask lanes, PacketHits &hits)
+{
+    const double e1x = e1.x(), e1y = e1.y(), e1z = e1.z();
+    const double e2x = e2.x(), e2y = e2.y(), e2z = e2.z();
+    double t[PACKET_SIZE], u[PACKET_SIZE], v[PACKET_SIZE];
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        double cx = p.dy[i]*e2z - p.dz[i]*e2y;
+        double cy = p.dz[i]*e2x - p.dx[i]*e2z;
+        double cz = p.dx[i]*e2y - p.dy[i]*e2x;
+        double det = e1x*cx + e1y*cy + e1z*cz;
+        double f = 1.0 / det;
+        double sx = p.ox[i] - p1.x(), sy = p.oy[i] - p1.y(), sz = p.oz[i] - p1.z();
+        double uu = f * (sx*cx + sy*cy + sz*cz);
+        double qx = sy*e1z - sz*e1y;
+        double qy = sz*e1x - sx*e1z;
+        double qz = sx*e1y - sy*e1x;
+        double vv = f * (p.dx[i]*qx + p.dy[i]*qy + p.dz[i]*qz);
+        bool inside = ( abs(det) >= EPSILON && uu >= 0 && uu <= 1 && vv >= 0 && (uu+vv) <= 1 );
+        t[i] = inside ? f * (e2x*qx + e2y*qy + e2z*qz) : -1;
+        u[i] = uu;
+        v[i] = vv;
+    }
+    PacketMask found = 0;
+    forEachLane(lanes, [&](int lane) {
+        if ( t[lane] > 0 && t[lane] < hits.t[lane] ) {
+            hits.set(lane, Intersection(t[lane], u[lane], v[lane], this));
+            found |= 1u << lane;
+        }
+    });
+    return found;
+}
+
+// Moller-Trumbore ray-triangle test. Outputs t and the barycentric u, v of the hit.
+inline bool Triangle::hitTest(const Ray &ray, double &t, double &u, double &v) const
 {
     Vector dir_cross_e2 = cross(ray.dir, e2);
     double det = dot(e1, dir_cross_e2);
@@ -10,23 +72,19 @@ bool Triangle::localIntersect(const Ray &ray, Iset &iset_out)
 
     double f = 1.0 / det;
     Vector p1_to_origin = ray.origin - p1;
-    double u = f * dot(p1_to_origin, dir_cross_e2);
+    u = f * dot(p1_to_origin, dir_cross_e2);
     if ( u < 0 || u > 1 ) { // ray misses p1-p3 edge
         return false;
     }
 
     Vector origin_cross_e1 = cross(p1_to_origin, e1);
-    double v = f * dot(ray.dir, origin_cross_e1);
+    v = f * dot(ray.dir, origin_cross_e1);
     if ( v < 0 || (u+v) > 1 ) { // ray misses p2-p3 and p1-p2 edge
         return false;
     }
 
     // ray hits
-    double t = f * dot(e2, origin_cross_e1);
-
-    // Uniquely for triangles, we construct the Intersection with u and v as well.
-    // This will be used for normal interpolation on smooth triangles.
-    iset_out.insert(Intersection(t, u, v, shared_from_this()));
+    t = f * dot(e2, origin_cross_e1);
     return true;
 }
 
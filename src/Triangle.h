@@ -13,7 +13,7 @@ public:
         std::shared_ptr<Shape> ret(new Triangle(p1,p2,p3));
         return ret;
     }
-    static std::shared_ptr<Shape> make(const Point &p1, const Point &p2, const Point &p3, const Matrix &M)
+    static std::shared_ptr<Shape> make(const Point &p1, const Point &p2, const Point &p3, const Matrix4 &M)
     {
         std::shared_ptr<Shape> ret(new Triangle(p1,p2,p3,M));
         return ret;
@@ -23,12 +23,15 @@ public:
         std::shared_ptr<Shape> ret(new Triangle(p1,p2,p3,n1,n2,n3));
         return ret;
     }
-    static std::shared_ptr<Shape> make(const Point &p1, const Point &p2, const Point &p3, const Vector &n1, const Vector &n2, const Vector &n3, const Matrix &M)
+    static std::shared_ptr<Shape> make(const Point &p1, const Point &p2, const Point &p3, const Vector &n1, const Vector &n2, const Vector &n3, const Matrix4 &M)
     {
         std::shared_ptr<Shape> ret(new Triangle(p1,p2,p3,n1,n2,n3,M));
         return ret;
     }
     bool localIntersect(const Ray &ray, Iset &iset_out) override;
+    bool localIntersectClosest(const Ray &ray, Intersection &hit_out) override;
+    bool localIntersectAny(const Ray &ray, double max_t) override;
+    PacketMask localIntersectPacket(const RayPacket &packet, PacketMask lanes, PacketHits &hits) override;
     Vector localNormalAt(const Point &obj_p, const Intersection *const ip = nullptr) const override;
     BoundingBox bounds() const override {
         BoundingBox bb;
@@ -39,7 +42,7 @@ public:
     }
 
     void divide(size_t threshold) override { }
-    bool includes(const std::shared_ptr<Shape> &shape) { return shape == shared_from_this(); }
+    bool includes(const Shape *shape) const override { return shape == this; }
 
     Point p1, p2, p3;
     Vector e1, e2;
@@ -47,12 +50,14 @@ public:
     Vector n1, n2, n3; // n2 and n3 only used on smooth triangles
     
 private:
+    inline bool hitTest(const Ray &ray, double &t, double &u, double &v) const;
+
     Triangle(const Point &p1, const Point &p2, const Point &p3) : Shape() ,
                                                                   p1(p1), p2(p2), p3(p3),
                                                                   e1(p2-p1), e2(p3-p1),
                                                                   isSmooth(false),
                                                                   n1(normalize(cross(e2,e1))) { }
-    Triangle(const Point &p1, const Point &p2, const Point &p3, const Matrix &M) : Shape(M),
+    Triangle(const Point &p1, const Point &p2, const Point &p3, const Matrix4 &M) : Shape(M),
                                                                                    p1(p1), p2(p2), p3(p3),
                                                                                    e1(p2-p1), e2(p3-p1),
                                                                                    isSmooth(false),
@@ -62,7 +67,7 @@ private:
                                                                   e1(p2-p1), e2(p3-p1),
                                                                   isSmooth(true),
                                                                   n1(n1), n2(n2), n3(n3) { }
-    Triangle(const Point &p1, const Point &p2, const Point &p3, const Vector &n1, const Vector &n2, const Vector &n3, const Matrix &M) : Shape(M),
+    Triangle(const Point &p1, const Point &p2, const Point &p3, const Vector &n1, const Vector &n2, const Vector &n3, const Matrix4 &M) : Shape(M),
                                                                                    p1(p1), p2(p2), p3(p3),
                                                                                    e1(p2-p1), e2(p3-p1),
                                                                                    isSmooth(true),
@@ -0,0 +1,313 @@
+#include "TriangleMesh.h"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <stdexcept>
+
+template <typename Real>
+const uint32_t TriangleMeshT<Real>::NO_NORMAL;
+
+template <typename Real>
+std::shared_ptr<const typename TriangleMeshT<Real>::VertexArray> TriangleMeshT<Real>::makeVertices(const std::vector<Point> &points)
+{
+    auto ret = std::make_shared<VertexArray>();
+    ret->reserve(points.size());
+    for (const auto &p : points) {
+        ret->push_back(Vertex{ (Real)p.x(), (Real)p.y(), (Real)p.z() });
+    }
+    return ret;
+}
+
+template <typename Real>
+TriangleMeshT<Real>::MeshRay::MeshRay(const Ray &r)
+{
+    for (int i = 0; i < 3; i++) {
+        o[i] = r.origin.ptr()[i];
+        d[i] = r.dir.ptr()[i];
+        dr[i] = (Real)d[i];
+    }
+}
+
+template <typename Real>
+TriangleMeshT<Real>::MeshPacket::MeshPacket(const RayPacket &p)
+{
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        d[0][i] = (Real)p.dx[i];
+        d[1][i] = (Real)p.dy[i];
+        d[2][i] = (Real)p.dz[i];
+    }
+}
+
+template <typename Real>
+void TriangleMeshT<Real>::buildBVH(std::vector<Face> unordered, size_t max_leaf_size, size_t width,
+                                   BVHMethod method)
+{
+    std::vector<BVHBuildPrim> prims;
+    prims.reserve(unordered.size());
+    for (size_t i = 0; i < unordered.size(); i++) {
+        BoundingBox fbox;
+        for (int k = 0; k < 3; k++) {
+            const Vertex &p = vertices.get()[unordered[i].v[k]];
+            fbox.add(Point(p.x, p.y, p.z));
+        }
+        prims.push_back(BVHBuildPrim{ fbox, fbox.centroid(), (uint32_t)i });
+        box.add(fbox);
+    }
+
+    std::vector<LinearBVHNode> binary = buildBinaryBVH(prims, max_leaf_size, meshBVHMethod(method));
+    auto ordered = std::make_shared<std::vector<Face>>();
+    ordered->reserve(prims.size());
+    for (const auto &p : prims) {
+        ordered->push_back(unordered[p.index]);
+    }
+    faces = std::shared_ptr<const Face>(ordered, ordered->data());
+    face_count = ordered->size();
+    nodes.assign(std::move(binary), width);
+}
+
+// Triangle tests accept hits up to a few ulps outside the edges, so that a ray through a
+// shared edge can't slip between two faces when Real is float.
+#define MESH_EDGE_SLACK(Real) (4 * std::numeric_limits<Real>::epsilon())
+
+template <typename Real>
+bool TriangleMeshT<Real>::localIntersect(const Ray &ray, Iset &iset_out)
+{
+    const double no_limit = std::numeric_limits<double>::infinity();
+    MeshRay mray(ray);
+    bool hit = false;
+    nodes.traverse(ray, no_limit, false, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++) {
+            double t, u, v;
+            if ( hitTest<Real>(faces.get()[i], mray, MESH_EDGE_SLACK(Real), t, u, v) ) {
+                refine(faces.get()[i], mray, no_limit, t, u, v);
+                iset_out.insert(Intersection(t, u, v, i, this));
+                hit = true;
+            }
+        }
+        return false;
+    });
+    return hit;
+}
+
+// Tracks the best hit locally and builds the Intersection only once. Each new best hit is
+// refined before it is kept, so that best_t is exact and a float hit that is really
+// behind the origin (on the face the ray leaves) is dropped.
+template <typename Real>
+bool TriangleMeshT<Real>::localIntersectClosest(const Ray &ray, Intersection &hit_out)
+{
+    MeshRay mray(ray);
+    double best_t = hit_out.t;
+    double best_u = 0, best_v = 0;
+    uint32_t best_face = 0;
+    bool hit = false;
+    nodes.traverse(ray, best_t, true, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++) {
+            double t, u, v;
+            if ( hitTest<Real>(faces.get()[i], mray, MESH_EDGE_SLACK(Real), t, u, v) && t > 0 && t < best_t &&
+                 refine(faces.get()[i], mray, best_t, t, u, v) ) {
+                best_t = t;
+                best_u = u;
+                best_v = v;
+                best_face = i;
+                hit = true;
+            }
+        }
+        return false;
+    });
+    if ( hit ) {
+        hit_out = Intersection(best_t, best_u, best_v, best_face, this);
+    }
+    return hit;
+}
+
+template <typename Real>
+bool TriangleMeshT<Real>::localIntersectAny(const Ray &ray, double max_t)
+{
+    MeshRay mray(ray);
+    return nodes.traverse(ray, max_t, true, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++) {
+            double t, u, v;
+            if ( hitTest<Real>(faces.get()[i], mray, MESH_EDGE_SLACK(Real), t, u, v) && t > 0 && t < max_t &&
+                 refine(faces.get()[i], mray, max_t, t, u, v) ) {
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+// The faces of a leaf are tested against all the lanes that reach it at once. Like
+// localIntersectClosest(), each lane refines a new best hit before keeping it, and the
+// best hits are recorded at the end.
+template <typename Real>
+PacketMask TriangleMeshT<Real>::localIntersectPacket(const RayPacket &packet, PacketMask lanes, PacketHits &hits)
+{
+    MeshPacket mpacket(packet);
+    double best_t[PACKET_SIZE], best_u[PACKET_SIZE], best_v[PACKET_SIZE];
+    uint32_t best_face[PACKET_SIZE];
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        best_t[i] = hits.t[i];
+    }
+    PacketMask found = 0;
+    nodes.traversePacket(packet, lanes, best_t,
+        [&](uint32_t first, uint32_t count, PacketMask mask) {
+            double t[PACKET_SIZE], u[PACKET_SIZE], v[PACKET_SIZE];
+            for (uint32_t i = first; i < first + count; i++) {
+                PacketMask hit = hitTestPacket(faces.get()[i], packet, mpacket, mask, best_t, t, u, v);
+                forEachLane(hit, [&](int lane) {
+                    MeshRay mray(packet.ray(lane));
+                    if ( refine(faces.get()[i], mray, best_t[lane], t[lane], u[lane], v[lane]) ) {
+                        best_t[lane] = t[lane];
+                        best_u[lane] = u[lane];
+                        best_v[lane] = v[lane];
+                        best_face[lane] = i;
+                        found |= 1u << lane;
+                    }
+                });
+            }
+        },
+        [&](const Ray &ray, int lane, uint32_t first, uint32_t count) {
+            MeshRay mray(ray);
+            for (uint32_t i = first; i < first + count; i++) {
+                double t, u, v;
+                if ( hitTest<Real>(faces.get()[i], mray, MESH_EDGE_SLACK(Real), t, u, v) && t > 0 && t < best_t[lane] &&
+                     refine(faces.get()[i], mray, best_t[lane], t, u, v) ) {
+                    best_t[lane] = t;
+                    best_u[lane] = u;
+                    best_v[lane] = v;
+                    best_face[lane] = i;
+                    found |= 1u << lane;
+                }
+            }
+        });
+    forEachLane(found, [&](int lane) {
+        hits.set(lane, Intersection(best_t[lane], best_u[lane], best_v[lane], best_face[lane], this));
+    });
+    return found;
+}
+
+// hitTest() in Real for every lane at once, with the same arithmetic, so that a lane
+// finds exactly the hits its ray would on its own. Returns the lanes of mask that hit
+// the face with 0 < t < max_t[lane], and their t, u and v.
+template <typename Real>
+inline PacketMask TriangleMeshT<Real>::hitTestPacket(const Face &f, const RayPacket &p, const MeshPacket &mp,
+                                                     PacketMask lanes, const double *max_t,
+                                                     double *t, double *u, double *v) const
+{
+    typedef Real T;
+    const T slack = MESH_EDGE_SLACK(Real);
+    const Vertex &a = vertices.get()[f.v[0]];
+    const Vertex &b = vertices.get()[f.v[1]];
+    const Vertex &c = vertices.get()[f.v[2]];
+    const T e1[3] = { (T)b.x - (T)a.x, (T)b.y - (T)a.y, (T)b.z - (T)a.z };
+    const T e2[3] = { (T)c.x - (T)a.x, (T)c.y - (T)a.y, (T)c.z - (T)a.z };
+
+    PacketMask ret = 0;
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        const T d[3] = { mp.d[0][i], mp.d[1][i], mp.d[2][i] };
+        T dir_cross_e2[3] = { d[1]*e2[2] - d[2]*e2[1], d[2]*e2[0] - d[0]*e2[2], d[0]*e2[1] - d[1]*e2[0] };
+        T det = e1[0]*dir_cross_e2[0] + e1[1]*dir_cross_e2[1] + e1[2]*dir_cross_e2[2];
+        T inv_det = 1 / det;
+        const T s[3] = { (T)(p.ox[i] - a.x), (T)(p.oy[i] - a.y), (T)(p.oz[i] - a.z) };
+        T uu = inv_det * (s[0]*dir_cross_e2[0] + s[1]*dir_cross_e2[1] + s[2]*dir_cross_e2[2]);
+        T origin_cross_e1[3] = { s[1]*e1[2] - s[2]*e1[1], s[2]*e1[0] - s[0]*e1[2], s[0]*e1[1] - s[1]*e1[0] };
+        T vv = inv_det * (d[0]*origin_cross_e1[0] + d[1]*origin_cross_e1[1] + d[2]*origin_cross_e1[2]);
+        double tt = inv_det * (e2[0]*origin_cross_e1[0] + e2[1]*origin_cross_e1[1] + e2[2]*origin_cross_e1[2]);
+        // The same rejections as hitTest(), negated, so that NaNs pass the same way
+        bool h = ( !(std::fabs(det) < EPSILON) &&
+                   !(uu < -slack || uu > 1 + slack) &&
+                   !(vv < -slack || (uu+vv) > 1 + slack) &&
+                   tt > 0 && tt < max_t[i] );
+        t[i] = tt;
+        u[i] = uu;
+        v[i] = vv;
+        ret |= (PacketMask)h << i;
+    }
+    return ret & lanes;
+}
+
+// Moller-Trumbore ray-triangle test, as in Triangle::hitTest, computed in T. The vector
+// from the first corner to the ray origin is taken in double before narrowing, so that
+// the error in a float test scales with the size of the triangle rather than with its
+// distance from the origin.
+template <typename Real>
+template <typename T>
+inline bool TriangleMeshT<Real>::hitTest(const Face &f, const MeshRay &ray, T slack,
+                                         double &t, double &u, double &v) const
+{
+    const Vertex &a = vertices.get()[f.v[0]];
+    const Vertex &b = vertices.get()[f.v[1]];
+    const Vertex &c = vertices.get()[f.v[2]];
+    const T e1[3] = { (T)b.x - (T)a.x, (T)b.y - (T)a.y, (T)b.z - (T)a.z };
+    const T e2[3] = { (T)c.x - (T)a.x, (T)c.y - (T)a.y, (T)c.z - (T)a.z };
+    const T d[3] = { (T)ray.d[0], (T)ray.d[1], (T)ray.d[2] };
+
+    T dir_cross_e2[3] = { d[1]*e2[2] - d[2]*e2[1], d[2]*e2[0] - d[0]*e2[2], d[0]*e2[1] - d[1]*e2[0] };
+    T det = e1[0]*dir_cross_e2[0] + e1[1]*dir_cross_e2[1] + e1[2]*dir_cross_e2[2];
+    if ( std::fabs(det) < EPSILON ) { // ray is parallel
+        return false;
+    }
+
+    T inv_det = 1 / det;
+    const T s[3] = { (T)(ray.o[0] - a.x), (T)(ray.o[1] - a.y), (T)(ray.o[2] - a.z) };
+    T uu = inv_det * (s[0]*dir_cross_e2[0] + s[1]*dir_cross_e2[1] + s[2]*dir_cross_e2[2]);
+    if ( uu < -slack || uu > 1 + slack ) { // ray misses p1-p3 edge
+        return false;
+    }
+
+    T origin_cross_e1[3] = { s[1]*e1[2] - s[2]*e1[1], s[2]*e1[0] - s[0]*e1[2], s[0]*e1[1] - s[1]*e1[0] };
+    T vv = inv_det * (d[0]*origin_cross_e1[0] + d[1]*origin_cross_e1[1] + d[2]*origin_cross_e1[2]);
+    if ( vv < -slack || (uu+vv) > 1 + slack ) { // ray misses p2-p3 and p1-p2 edge
+        return false;
+    }
+
+    t = inv_det * (e2[0]*origin_cross_e1[0] + e2[1]*origin_cross_e1[1] + e2[2]*origin_cross_e1[2]);
+    u = uu;
+    v = vv;
+    return true;
+}
+
+// Redoes a hit found in Real in double precision. The single precision t can be off by
+// more than EPSILON far from the origin, which would put the over point below the surface,
+// and can come out just above 0 for a ray leaving the face, which would shadow the surface
+// with itself. Returns whether the refined t is still in (0, max_t).
+template <typename Real>
+inline bool TriangleMeshT<Real>::refine(const Face &f, const MeshRay &ray, double max_t,
+                                        double &t, double &u, double &v) const
+{
+    if ( sizeof(Real) < sizeof(double) ) {
+        double rt, ru, rv;
+        // The hit is already known to be inside the triangle, so don't reject it over
+        // rounding at the edges
+        if ( hitTest<double>(f, ray, 1.0, rt, ru, rv) ) {
+            t = rt;
+            u = ru;
+            v = rv;
+        }
+    }
+    return t > 0 && t < max_t;
+}
+
+template <typename Real>
+Vector TriangleMeshT<Real>::localNormalAt(const Point &obj_p, const Intersection *const ip) const
+{
+    if ( !ip ) {
+        throw std::logic_error("TriangleMesh::localNormalAt needs the intersection to find the face");
+    }
+    const Face &f = faces.get()[ip->face];
+    if ( f.n[0] == NO_NORMAL ) {
+        Point p1 = corner(ip->face, 0);
+        Vector e1 = corner(ip->face, 1) - p1;
+        Vector e2 = corner(ip->face, 2) - p1;
+        return normalize(cross(e2, e1));
+    }
+
+    // normal interpolation
+    const Vector &n1 = normals.get()[f.n[0]];
+    const Vector &n2 = normals.get()[f.n[1]];
+    const Vector &n3 = normals.get()[f.n[2]];
+    return (n2 * ip->u + n3 * ip->v + n1 * (1 - ip->u - ip->v) );
+}
+
+template class TriangleMeshT<double>;
+template class TriangleMeshT<float>;
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "Ray.h"
+#include "Shape.h"
+#include "LinearBVH.h"
+#include "util.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Precision of the vertex positions in a TriangleMesh. Single precision halves the
+// memory of the vertex array and runs the triangle tests in float.
+enum class MeshPrecision { double_precision, single_precision };
+
+// The default for OBJ files, set with the JRAY_FLOAT_GEOMETRY build option
+#ifdef JRAY_FLOAT_GEOMETRY
+#define DEFAULT_MESH_PRECISION MeshPrecision::single_precision
+#else
+#define DEFAULT_MESH_PRECISION MeshPrecision::double_precision
+#endif
+
+// One face of a TriangleMesh
+struct MeshFace {
+    uint32_t v[3]; // vertex indices of the corners
+    uint32_t n[3]; // normal indices of the corners, or NO_NORMAL in n[0] for a flat face
+};
+
+// The method a mesh's own BVH is built with, for a given scene method. A mesh always
+// gets a tree: an LBVH if asked for, and an SAH tree for anything else.
+inline BVHMethod meshBVHMethod(BVHMethod method)
+{
+    return ( method == BVHMethod::lbvh ) ? BVHMethod::lbvh : BVHMethod::sah;
+}
+
+// TriangleMeshT is a whole mesh as a single Shape: vertex and normal arrays that may be
+// shared between meshes, and one small index record per face. It has its own BVH over
+// the faces, built when the mesh is made (see buildBinaryBVH), or loaded ready-built
+// together with the arrays from a MeshCache file.
+//
+// Real is the type the vertex positions are stored in, and the type the triangle tests
+// run in. The hits that are reported are recomputed in double precision, so t (and thus
+// the over and under points that shading offsets by EPSILON) is as accurate as with
+// double vertices.
+//
+// Faces give the same results as the equivalent Triangles, including smooth-normal
+// interpolation. Intersections carry the index of the face that was hit.
+template <typename Real>
+class TriangleMeshT final : public Shape {
+public:
+    // Normal index of a flat-shaded face
+    static const uint32_t NO_NORMAL = UINT32_MAX;
+
+    typedef MeshFace Face;
+    struct Vertex {
+        Real x, y, z;
+    };
+    typedef std::vector<Vertex> VertexArray;
+
+    static std::shared_ptr<const VertexArray> makeVertices(const std::vector<Point> &points);
+
+    // Indices in faces must be valid for vertices and normals. max_leaf_size is the
+    // most faces the BVH puts in one leaf, and bvh_width the children per node (2, 4 or 8).
+    // The BVH is built with meshBVHMethod(bvh_method).
+    static std::shared_ptr<TriangleMeshT> make(const std::shared_ptr<const VertexArray> &vertices,
+                                               const std::shared_ptr<const std::vector<Vector>> &normals,
+                                               std::vector<Face> faces, size_t max_leaf_size = 4,
+                                               size_t bvh_width = DEFAULT_BVH_WIDTH,
+                                               BVHMethod bvh_method = BVHMethod::sah)
+    {
+        std::shared_ptr<TriangleMeshT> ret(new TriangleMeshT(vertices, normals, std::move(faces),
+                                                             max_leaf_size, bvh_width, bvh_method));
+        return ret;
+    }
+    static std::shared_ptr<TriangleMeshT> make(const std::shared_ptr<const std::vector<Point>> &points,
+                                               const std::shared_ptr<const std::vector<Vector>> &normals,
+                                               std::vector<Face> faces, size_t max_leaf_size = 4,
+                                               size_t bvh_width = DEFAULT_BVH_WIDTH,
+                                               BVHMethod bvh_method = BVHMethod::sah)
+    {
+        return make(makeVertices(*points), normals, std::move(faces), max_leaf_size, bvh_width, bvh_method);
+    }
+    // A mesh over arrays that already hold its faces in BVH order, and the BVH built over
+    // them, such as those in a mapped MeshCache file. Nothing is copied or rebuilt; the
+    // shared pointers keep the memory alive.
+    static std::shared_ptr<TriangleMeshT> make(const std::shared_ptr<const Vertex> &vertices,
+                                               const std::shared_ptr<const Vector> &normals,
+                                               const std::shared_ptr<const Face> &faces, size_t face_count,
+                                               BVHNodes nodes, const BoundingBox &box)
+    {
+        std::shared_ptr<TriangleMeshT> ret(new TriangleMeshT(vertices, normals, faces, face_count,
+                                                             std::move(nodes), box));
+        return ret;
+    }
+
+    bool localIntersect(const Ray &ray, Iset &iset_out) override;
+    bool localIntersectClosest(const Ray &ray, Intersection &hit_out) override;
+    bool localIntersectAny(const Ray &ray, double max_t) override;
+    PacketMask localIntersectPacket(const RayPacket &packet, PacketMask lanes, PacketHits &hits) override;
+    // Needs the Intersection, to know which face was hit
+    Vector localNormalAt(const Point &obj_p, const Intersection *const ip = nullptr) const override;
+    BoundingBox bounds() const override { return box; }
+
+    void divide(size_t threshold) override { }
+    bool includes(const Shape *shape) const override { return shape == this; }
+
+    // Faces are stored in BVH order, which is the order they were given in only when
+    // they all fit in one leaf.
+    size_t faceCount() const { return face_count; }
+    const Face& face(size_t i) const { return faces.get()[i]; }
+    Point corner(size_t face, int k) const {
+        const Vertex &p = vertices.get()[faces.get()[face].v[k]];
+        return Point(p.x, p.y, p.z);
+    }
+    size_t nodeCount() const { return nodes.size(); }
+    size_t bvhWidth() const { return nodes.width(); }
+
+    // The arrays behind the mesh, for MeshCache to write out
+    const Vertex* vertexData() const { return vertices.get(); }
+    const Vector* normalData() const { return normals.get(); }
+    const Face* faceData() const { return faces.get(); }
+    const BVHNodes& bvh() const { return nodes; }
+
+private:
+    // The ray, with its direction also narrowed to Real once per query
+    struct MeshRay {
+        double o[3];
+        double d[3];
+        Real dr[3];
+        MeshRay(const Ray &r);
+    };
+
+    // A packet's directions narrowed to Real, once per query
+    struct MeshPacket {
+        Real d[3][PACKET_SIZE];
+        MeshPacket(const RayPacket &p);
+    };
+
+    template <typename T>
+    inline bool hitTest(const Face &f, const MeshRay &ray, T slack, double &t, double &u, double &v) const;
+    inline PacketMask hitTestPacket(const Face &f, const RayPacket &packet, const MeshPacket &mpacket,
+                                    PacketMask lanes, const double *max_t, double *t, double *u, double *v) const;
+    inline bool refine(const Face &f, const MeshRay &ray, double max_t, double &t, double &u, double &v) const;
+    void buildBVH(std::vector<Face> unordered, size_t max_leaf_size, size_t width, BVHMethod method);
+
+    TriangleMeshT(const std::shared_ptr<const VertexArray> &vertices,
+                  const std::shared_ptr<const std::vector<Vector>> &normals,
+                  std::vector<Face> faces, size_t max_leaf_size, size_t bvh_width,
+                  BVHMethod bvh_method) : Shape(), vertices(vertices, vertices->data()),
+                                          normals(normals, normals->data()) {
+        buildBVH(std::move(faces), max_leaf_size, bvh_width, bvh_method);
+    }
+    TriangleMeshT(const std::shared_ptr<const Vertex> &vertices, const std::shared_ptr<const Vector> &normals,
+                  const std::shared_ptr<const Face> &faces, size_t face_count, BVHNodes nodes,
+                  const BoundingBox &box) : Shape(), vertices(vertices), normals(normals), faces(faces),
+                                            face_count(face_count), nodes(std::move(nodes)), box(box) { }
+
+    // The arrays may be held by vectors or by a mapped file; the shared pointers keep
+    // whichever it is alive
+    std::shared_ptr<const Vertex> vertices;
+    std::shared_ptr<const Vector> normals;
+    std::shared_ptr<const Face> faces;
+    size_t face_count = 0;
+    BVHNodes nodes;
+    BoundingBox box;
+};
+
+typedef TriangleMeshT<double> TriangleMesh;
+typedef TriangleMeshT<float> FloatTriangleMesh;
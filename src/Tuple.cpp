@@ -1,15 +1,7 @@
 #include "Tuple.h"
-#include "Matrix.h"
+#include "Matrix4.h"
 
 
-Tuple::Tuple(double x, double y, double z, double w) 
-{
-    data[0] = x;
-    data[1] = y;
-    data[2] = z;
-    data[3] = w;
-}
-
 const double& Tuple::operator[](int i) const
 {
     if (i < 0 || i > 3) {
@@ -36,73 +28,6 @@ Tuple Tuple::operator-() const
     return ret;
 }
 
-Tuple& Tuple::operator+=(const Tuple &t2)
-{
-    data[0] += t2.data[0];
-    data[1] += t2.data[1];
-    data[2] += t2.data[2];
-    data[3] += t2.data[3];
-    if ( !valid(*this) ) {
-        throw new std::logic_error("Invalid tuple type");
-    }
-    return *this;
-}
-Tuple& Tuple::operator-=(const Tuple &t2)
-{
-    data[0] -= t2.data[0];
-    data[1] -= t2.data[1];
-    data[2] -= t2.data[2];
-    data[3] -= t2.data[3];
-    if ( !valid(*this) ) {
-        throw new std::logic_error("Invalid tuple type");
-    }
-    return *this;
-}
-Tuple& Tuple::operator*=(const Tuple &t2)
-{
-    data[0] *= t2.data[0];
-    data[1] *= t2.data[1];
-    data[2] *= t2.data[2];
-    data[3] *= t2.data[3];
-    if ( !valid(*this) ) {
-        throw new std::logic_error("Invalid tuple type");
-    }
-    return *this;
-}
-Tuple& Tuple::operator/=(const Tuple &t2)
-{
-    data[0] /= t2.data[0];
-    data[1] /= t2.data[1];
-    data[2] /= t2.data[2];
-    data[3] /= t2.data[3];
-    if ( !valid(*this) ) {
-        throw new std::logic_error("Invalid tuple type");
-    }
-    return *this;
-}
-Tuple& Tuple::operator*=(const double f)
-{
-    data[0] *= f;
-    data[1] *= f;
-    data[2] *= f;
-    data[3] *= f;
-    if ( !valid(*this) ) {
-        throw new std::logic_error("Invalid tuple type");
-    }
-    return *this;
-}
-Tuple& Tuple::operator/=(const double f)
-{
-    data[0] /= f;
-    data[1] /= f;
-    data[2] /= f;
-    data[3] /= f;
-    if ( !valid(*this) ) {
-        throw new std::logic_error("Invalid tuple type");
-    }
-    return *this;
-}
-
 Tuple& Tuple::operator*=(const Matrix &m)
 {
     if (m.cols() != 4) { // Tuple has fixed size of 4
@@ -118,32 +43,32 @@ Tuple& Tuple::operator*=(const Matrix &m)
 
 Tuple Tuple::translate(double x, double y, double z)
 {
-    Matrix T = Matrix::translation(x,y,z);
+    Matrix4 T = Matrix4::translation(x,y,z);
     return (T * (*this));
 }
 Tuple Tuple::scale(double x, double y, double z)
 {
-    Matrix S = Matrix::scaling(x,y,z);
+    Matrix4 S = Matrix4::scaling(x,y,z);
     return (S * (*this));
 }
 Tuple Tuple::rotate_x(double radians)
 {
-    Matrix R = Matrix::rotation_x(radians);
+    Matrix4 R = Matrix4::rotation_x(radians);
     return (R * (*this));
 }
 Tuple Tuple::rotate_y(double radians)
 {
-    Matrix R = Matrix::rotation_y(radians);
+    Matrix4 R = Matrix4::rotation_y(radians);
     return (R * (*this));
 }
 Tuple Tuple::rotate_z(double radians)
 {
-    Matrix R = Matrix::rotation_z(radians);
+    Matrix4 R = Matrix4::rotation_z(radians);
     return (R * (*this));
 }
 Tuple Tuple::shear(double x_y, double x_z, double y_x, double y_z, double z_x, double z_y)
 {
-    Matrix S = Matrix::shearing(x_y, x_z, y_x, y_z, z_x, z_y);
+    Matrix4 S = Matrix4::shearing(x_y, x_z, y_x, y_z, z_x, z_y);
     return (S * (*this));
 }
 
@@ -167,79 +92,6 @@ bool operator!=(const Tuple &t1, const Tuple &t2)
     return !(t1 == t2);
 }
 
-Tuple operator+(const Tuple& t1, const Tuple& t2)
-{
-    Tuple ret( t1.data[0] + t2.data[0],
-               t1.data[1] + t2.data[1],
-               t1.data[2] + t2.data[2],
-               t1.data[3] + t2.data[3] );
-    if ( ! Tuple::valid(ret) ) {
-        throw new std::logic_error("Invalid Tuple type");
-    }
-    return ret;
-}
-Tuple operator-(const Tuple& t1, const Tuple& t2)
-{
-    Tuple ret( t1.data[0] - t2.data[0],
-               t1.data[1] - t2.data[1],
-               t1.data[2] - t2.data[2],
-               t1.data[3] - t2.data[3] );
-    if ( ! Tuple::valid(ret) ) {
-        throw new std::logic_error("Invalid Tuple type");
-    }
-    return ret;
-}
-Tuple operator*(const Tuple& t1, const Tuple& t2)
-{
-    Tuple ret( t1.data[0] * t2.data[0],
-               t1.data[1] * t2.data[1],
-               t1.data[2] * t2.data[2],
-               t1.data[3] * t2.data[3] );
-    if ( ! Tuple::valid(ret) ) {
-        throw new std::logic_error("Invalid Tuple type");
-    }
-    return ret;
-}
-Tuple operator/(const Tuple& t1, const Tuple& t2)
-{
-    Tuple ret( t1.data[0] / t2.data[0],
-               t1.data[1] / t2.data[1],
-               t1.data[2] / t2.data[2],
-               t1.data[3] / t2.data[3] );
-    if ( ! Tuple::valid(ret) ) {
-        throw new std::logic_error("Invalid Tuple type");
-    }
-    return ret;
-}
-
-Tuple operator*(const Tuple& t, double f)
-{
-    Tuple ret( t.data[0] * f, t.data[1] * f, t.data[2] * f, t.data[3] * f );
-    if ( ! Tuple::valid(ret) ) {
-        throw new std::logic_error("Invalid tuple type");
-    }
-    return ret;
-}
-Tuple operator*(double f, const Tuple& t)
-{
-    Tuple ret( t.data[0] * f, t.data[1] * f, t.data[2] * f, t.data[3] * f );
-    if ( ! Tuple::valid(ret) ) {
-        throw new std::logic_error("Invalid tuple type");
-    }
-    return ret;
-}
-Tuple operator/(const Tuple& t, double f)
-{
-    if ( f == 0 ) {
-        throw new std::runtime_error("Attempted to divide Tuple by zero");
-    }
-    Tuple ret( t.data[0] / f, t.data[1] / f, t.data[2] / f, t.data[3] / f );
-    if ( ! Tuple::valid(ret) ) {
-        throw new std::logic_error("Invalid tuple type");
-    }
-    return ret;
-}
-
 std::istream& operator>>(std::istream &is, Tuple &t) {
     is >> t.data[0] >> t.data[1] >> t.data[2] >> t.data[3];
     return is;
@@ -6,6 +6,7 @@
 #include <iostream>
 #include <math.h>
 #include "util.h"
+#include "Simd.h"
 
 class Matrix;
 
@@ -14,7 +15,12 @@ class Tuple
 public:
 
     Tuple() = default;
-    Tuple(double x, double y, double z, double w);
+    Tuple(double x, double y, double z, double w) {
+        data[0] = x;
+        data[1] = y;
+        data[2] = z;
+        data[3] = w;
+    }
 
     double x() const { return data[0]; };
     double y() const { return data[1]; };
@@ -23,6 +29,9 @@ public:
 
     const double& operator[](int i) const;
     double& operator[](int i);
+    // Unchecked access to the four components, for the SIMD kernels in Simd.h
+    const double* ptr() const { return data; }
+    double* ptr() { return data; }
 
     const Tuple& operator+() const { return *this; }
     Tuple operator-() const;
@@ -70,3 +79,118 @@ protected:
     double data[4];
     
 };
+
+// The arithmetic operators are defined here rather than in Tuple.cpp so that they inline
+// into the hot loops; an out-of-line call would cost more than the SIMD kernel saves.
+
+inline Tuple& Tuple::operator+=(const Tuple &t2)
+{
+    simd_add4(data, t2.data, data);
+    if ( !valid(*this) ) {
+        throw new std::logic_error("Invalid tuple type");
+    }
+    return *this;
+}
+inline Tuple& Tuple::operator-=(const Tuple &t2)
+{
+    simd_sub4(data, t2.data, data);
+    if ( !valid(*this) ) {
+        throw new std::logic_error("Invalid tuple type");
+    }
+    return *this;
+}
+inline Tuple& Tuple::operator*=(const Tuple &t2)
+{
+    simd_mul4(data, t2.data, data);
+    if ( !valid(*this) ) {
+        throw new std::logic_error("Invalid tuple type");
+    }
+    return *this;
+}
+inline Tuple& Tuple::operator/=(const Tuple &t2)
+{
+    simd_div4(data, t2.data, data);
+    if ( !valid(*this) ) {
+        throw new std::logic_error("Invalid tuple type");
+    }
+    return *this;
+}
+inline Tuple& Tuple::operator*=(const double f)
+{
+    simd_scale4(data, f, data);
+    if ( !valid(*this) ) {
+        throw new std::logic_error("Invalid tuple type");
+    }
+    return *this;
+}
+inline Tuple& Tuple::operator/=(const double f)
+{
+    simd_scale4(data, 1.0 / f, data);
+    if ( !valid(*this) ) {
+        throw new std::logic_error("Invalid tuple type");
+    }
+    return *this;
+}
+
+inline Tuple operator+(const Tuple& t1, const Tuple& t2)
+{
+    Tuple ret;
+    simd_add4(t1.data, t2.data, ret.data);
+    if ( ! Tuple::valid(ret) ) {
+        throw new std::logic_error("Invalid Tuple type");
+    }
+    return ret;
+}
+inline Tuple operator-(const Tuple& t1, const Tuple& t2)
+{
+    Tuple ret;
+    simd_sub4(t1.data, t2.data, ret.data);
+    if ( ! Tuple::valid(ret) ) {
+        throw new std::logic_error("Invalid Tuple type");
+    }
+    return ret;
+}
+inline Tuple operator*(const Tuple& t1, const Tuple& t2)
+{
+    Tuple ret;
+    simd_mul4(t1.data, t2.data, ret.data);
+    if ( ! Tuple::valid(ret) ) {
+        throw new std::logic_error("Invalid Tuple type");
+    }
+    return ret;
+}
+inline Tuple operator/(const Tuple& t1, const Tuple& t2)
+{
+    Tuple ret;
+    simd_div4(t1.data, t2.data, ret.data);
+    if ( ! Tuple::valid(ret) ) {
+        throw new std::logic_error("Invalid Tuple type");
+    }
+    return ret;
+}
+
+inline Tuple operator*(const Tuple& t, double f)
+{
+    Tuple ret;
+    simd_scale4(t.data, f, ret.data);
+    if ( ! Tuple::valid(ret) ) {
+        throw new std::logic_error("Invalid tuple type");
+    }
+    return ret;
+}
+inline Tuple operator*(double f, const Tuple& t)
+{
+    return t * f;
+}
+inline Tuple operator/(const Tuple& t, double f)
+{
+    if ( f == 0 ) {
+        throw new std::runtime_error("Attempted to divide Tuple by zero");
+    }
+    Tuple ret;
+    simd_scale4(t.data, 1.0 / f, ret.data);
+    if ( ! Tuple::valid(ret) ) {
+        throw new std::logic_error("Invalid tuple type");
+    }
+    return ret;
+}
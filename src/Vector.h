@@ -40,4 +40,42 @@ public:
 
 };
 
-Vector normalize(const Vector &v);
\ No newline at end of file
+// dot, cross, length and normalize run for every ray and every shading point, so they are
+// defined inline here on top of the kernels in Simd.h.
+inline double dot(const Vector &v1, const Vector &v2)
+{
+    return simd_dot4(v1.data, v2.data);
+}
+
+inline Vector cross(const Vector &v1, const Vector &v2)
+{
+    Vector ret;
+    simd_cross3(v1.data, v2.data, ret.data);
+    return ret;
+}
+
+inline double Vector::squared_length() const
+{
+    return data[0]*data[0] + data[1]*data[1] + data[2]*data[2];
+}
+
+inline double Vector::length() const
+{
+    return sqrt( squared_length() );
+}
+
+inline Vector Vector::normalize() const
+{
+    double len = length();
+    if ( len == 0 ) {
+        throw new std::runtime_error("Attempted to divide Tuple by zero");
+    }
+    Vector ret;
+    simd_scale4(data, 1.0 / len, ret.data);
+    return ret;
+}
+
+inline Vector normalize(const Vector &v)
+{
+    return v.normalize();
+}
\ No newline at end of file
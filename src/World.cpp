@@ -1,5 +1,6 @@
 #include "World.h"
 #include "Sphere.h"
+#include <limits>
 
 void World::make_default() {
     auto s1 = Sphere::make();
@@ -7,7 +8,7 @@ void World::make_default() {
     s1->setMaterial(m1);
     
     auto s2 = Sphere::make();
-    s2->setTransform(Matrix::scaling(0.5,0.5,0.5));
+    s2->setTransform(Matrix4::scaling(0.5,0.5,0.5));
 
     shapes.push_back(s1);
     shapes.push_back(s2);
@@ -17,25 +18,53 @@ void World::make_default() {
 
 void World::intersect(Ray ray, Iset &iset_out) const {
     //Iset local_intersects;
-    for (auto s: shapes) {
+    for (const auto &s: shapes) {
         s->intersect(ray, iset_out);
     }
 }
 
+bool World::intersectClosest(const Ray &ray, Intersection &hit_out) const {
+    hit_out = Intersection(std::numeric_limits<double>::infinity(), nullptr);
+    bool hit = false;
+    for (const auto &s: shapes) {
+        if ( s->intersectClosest(ray, hit_out) ) {
+            hit = true;
+        }
+    }
+    return hit;
+}
+
+PacketMask World::intersectPacket(const RayPacket &packet, PacketMask lanes, PacketHits &hits) const {
+    hits.reset();
+    PacketMask found = 0;
+    for (const auto &s: shapes) {
+        found |= s->intersectPacket(packet, lanes, hits);
+    }
+    return found;
+}
+
+bool World::occluded(const Ray &ray, double max_t) const {
+    for (const auto &s: shapes) {
+        if ( s->intersectAny(ray, max_t) ) {
+            return true;
+        }
+    }
+    return false;
+}
+
 Color World::shadeHit(const Icomps &comps, Iset &iset, int remaining) const {
-    Material m = comps.obj->getMaterial();
+    const Material &m = comps.obj->getMaterial();
     Color surface, reflected, refracted;
     iset.clear();
-    for (auto l : lights) {
+    for (const auto &l : lights) {
         surface += m.lighting(comps.obj, l, comps.over_point, comps.eyev, comps.normalv, lightIntensityAt(comps.over_point, l) );
-        //surface += m.lighting(comps.obj, l, comps.over_point, comps.eyev, comps.normalv, isShadowed(comps.over_point, iset, l.pos));
-        iset.clear();
+        //surface += m.lighting(comps.obj, l, comps.over_point, comps.eyev, comps.normalv, isShadowed(comps.over_point, l.pos));
     }
     reflected = reflectedColor(comps, iset, remaining);
     iset.clear();
     refracted = refractedColor(comps, iset, remaining);
 
-    if (comps.obj->getMaterial().getReflective() > 0 && comps.obj->getMaterial().getTransparency() > 0) {
+    if (m.getReflective() > 0 && m.getTransparency() > 0) {
         double reflectance = comps.schlick();
         return surface + reflected * reflectance + refracted * (1 - reflectance);
     } else {
@@ -82,40 +111,61 @@ Color World::refractedColor(const Icomps &comps, Iset &iset_out, int remaining)
     return colorAt(refracted, iset_out, remaining - 1) * tr;
 }
 
-Color World::colorAt(const Ray &r, Iset &iset_out, int remaining) const {
-    intersect(r, iset_out);
-    Intersection i = hit(iset_out);
+Color World::colorAt(const Ray &r, Iset &iset_out, int remaining, SurfaceInfo *first_hit) const {
+    Intersection i;
+    intersectClosest(r, i);
+    return colorAtHit(r, i, iset_out, remaining, first_hit);
+}
+
+Color World::colorAtHit(const Ray &r, Intersection i, Iset &iset_out, int remaining, SurfaceInfo *first_hit) const {
+    if ( first_hit ) {
+        *first_hit = SurfaceInfo();
+    }
     if ( i.isEmpty() ) {
         return Color::Black; // return black if no such intersection
     }
-    return shadeHit(i.prepComps(r, iset_out), iset_out, remaining);
+    // Refraction needs the full sorted list of intersections to work out which shapes
+    // contain the hit point. Only transparent surfaces refract, so everything else
+    // can be shaded from the closest hit alone.
+    Icomps comps;
+    if ( i.obj->getMaterial().getTransparency() > 0 ) {
+        intersect(r, iset_out);
+        i = hit(iset_out);
+        if ( i.isEmpty() ) {
+            return Color::Black;
+        }
+        comps = i.prepComps(r, iset_out);
+    } else {
+        comps = i.prepComps(r);
+    }
+    if ( first_hit ) {
+        first_hit->depth = comps.t * r.dir.length();
+        first_hit->normal = comps.normalv;
+        first_hit->albedo = comps.obj->getMaterial().colorAt(comps.obj, comps.point);
+    }
+    return shadeHit(comps, iset_out, remaining);
 }
 
-bool World::isShadowed(const Point &p, Iset &iset_out, const Point &lightpos) const {
+// Shadow rays only need a yes/no answer, so they use the any-hit query and never
+// build an intersection list
+bool World::isShadowed(const Point &p, const Point &lightpos) const {
     Vector v = lightpos - p;
     double distance = v.length();
     Vector direction = v.normalize();
     Ray r = Ray(p, direction);
-    intersect(r, iset_out);
-    Intersection ihit = hit(iset_out);
-    if (!ihit.isEmpty() && ihit.t < distance && ihit.obj->castsShadow()) {
-        return true;
-    }
-    return false;
+    return occluded(r, distance);
 }
 
 double World::lightIntensityAt(const Point &p, const Light &l ) const
 {
-    Iset iset;
     double total = 0.0;
 
     for (int v = 0; v < l.vsteps; v++) {
         for (int u = 0; u < l.usteps; u++) {
             Point lightpos = l.pointAt(u,v);
-            if ( !isShadowed(p, iset, lightpos) ) {
+            if ( !isShadowed(p, lightpos) ) {
                 total += 1.0;
             }
-            iset.clear();
         }
     }
     return total / l.samples;
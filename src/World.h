@@ -5,12 +5,25 @@
 #include <vector>
 #define REFLECTION_RECURSION_LIMIT 4
 
+// What a camera ray hit first, for the depth, normal and albedo channels of the output
+struct SurfaceInfo {
+    double depth = 0;                // distance along the ray, 0 if it hit nothing
+    Vector normal = Vector(0, 0, 0); // facing back along the ray, zero if it hit nothing
+    Color albedo = Color(0, 0, 0);   // surface color before lighting
+};
+
 class World {
 public:
 
     // default constructor and copy-control are fine here
     void make_default(); // adds a light and some "default" shapes for testing
     void intersect(Ray ray, Iset &iset_out) const;
+    // Finds only the nearest intersection with t > 0. Returns false if the ray hits nothing.
+    bool intersectClosest(const Ray &ray, Intersection &hit_out) const;
+    // intersectClosest() for the given lanes of a packet. Returns the lanes that hit something.
+    PacketMask intersectPacket(const RayPacket &packet, PacketMask lanes, PacketHits &hits) const;
+    // Occlusion query: true if any shadow-casting shape blocks the ray with 0 < t < max_t
+    bool occluded(const Ray &ray, double max_t) const;
 
     // These get* functions are for testing, but not used generally.
     // Beware of object lifetime issues with the returned references
@@ -22,8 +35,14 @@ public:
     Color shadeHit(const Icomps &comps, Iset &iset, int remaining) const;
     Color reflectedColor(const Icomps &comps, Iset &iset_out, int remaining) const;
     Color refractedColor(const Icomps &comps, Iset &iset_out, int remaining) const;
-    Color colorAt(const Ray &r, Iset &iset_out, int remaining = REFLECTION_RECURSION_LIMIT) const;
-    bool isShadowed(const Point &p, Iset &iset_out, const Point &lightpos) const;
+    // If first_hit is given, it is filled in for the closest hit of r
+    Color colorAt(const Ray &r, Iset &iset_out, int remaining = REFLECTION_RECURSION_LIMIT,
+                  SurfaceInfo *first_hit = nullptr) const;
+    // colorAt() for a ray whose closest hit i is already known, e.g. from intersectPacket().
+    // An empty i means the ray hit nothing.
+    Color colorAtHit(const Ray &r, Intersection i, Iset &iset_out, int remaining = REFLECTION_RECURSION_LIMIT,
+                     SurfaceInfo *first_hit = nullptr) const;
+    bool isShadowed(const Point &p, const Point &lightpos) const;
     double lightIntensityAt(const Point &p, const Light &l) const;
 
 private:
@@ -1,21 +1,32 @@
 #include <iostream>
-#include <gtkmm.h>
 #include <vector>
+#ifdef JRAY_GUI
+#include <gtkmm.h>
 #include "MainWindow.h"
+#endif
 #include "Renderer.h"
 #include "SceneConfig.h"
+#include "ImageIO.h"
 #include <getopt.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 void print_usage(const std::string &binname)
 {
-    std::cout << "Usage: " << binname << " [-h] [-t THREADS] [-o OUTPUT_IMAGE_FILE] [scene file]" << std::endl;
+    std::cout << "Usage: " << binname << " [-h] [-D] [-t THREADS] [-s TILE_SIZE] [-o OUTPUT_IMAGE_FILE] [scene file]" << std::endl;
     std::cout <<
     "Options:\n"
     "   -o, --output     :   Disables GUI and outputs image to specified file.\n"
-    "                        Filename must have extension .png, .jpg, or .bmp\n"
+    "                        Filename must have extension .png, .ppm, or .exr or .pfm (linear float),\n"
+    "                        or .jpg or .bmp if built with gdk-pixbuf.\n"
+#ifndef JRAY_GUI
+    "                        Required: this build has no GUI.\n"
+#endif
     "   -t, --threads    :   Specifies number of rendering threads to be used.\n"
     "                        Default: number of CPUs present on this machine\n"
+    "   -s, --tile-size  :   Width and height in pixels of the image tiles handed out to\n"
+    "                        rendering threads. Default: 32\n"
+    "   -D, --denoise    :   Denoises the render, as if the camera set 'denoise: true'\n"
     "   -d  --dir        :   Specifies working directory (for scene files and output images)\n"
     "                        Default: Current directory (.)\n"
     "   -h, --help       :   Print this help message\n"
@@ -35,20 +46,24 @@ bool file_exists(const std::string &filename)
 int main(int argc, char** argv)
 {
 	size_t threads = std::thread::hardware_concurrency();
+    size_t tile_size = DEFAULT_TILE_SIZE;
     std::string scenefile;
     std::string cwd = "";
     std::string output_imgfile = "";
+    bool denoise = false;
     int c;
     static struct option long_options[] = {
         {"output", required_argument, nullptr, 'o'},
         {"threads", required_argument, nullptr, 't'},
+        {"tile-size", required_argument, nullptr, 's'},
         {"dir", required_argument, nullptr, 'd'},
+        {"denoise", no_argument, nullptr, 'D'},
         {"help", no_argument, nullptr, 'h'},
         { nullptr, no_argument, nullptr, 0 }
     };
 
     while ( true ) {
-        c = getopt_long(argc, argv, "o:t:d:h", long_options, nullptr);
+        c = getopt_long(argc, argv, "o:t:s:d:Dh", long_options, nullptr);
         if (c == -1)
             break;
         
@@ -59,9 +74,19 @@ int main(int argc, char** argv)
             case 't':
                 threads = std::stoi(optarg);
                 break;
+            case 's':
+                if ( std::stoi(optarg) <= 0 ) {
+                    std::cerr << "Tile size must be a positive number of pixels." << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                tile_size = std::stoi(optarg);
+                break;
             case 'd':
                 cwd = optarg;
                 break;
+            case 'D':
+                denoise = true;
+                break;
             case 'h':
             case '?':
             default:
@@ -97,28 +122,45 @@ int main(int argc, char** argv)
     //std::cout << "threads: " << threads << std::endl;
     //std::cout << "scenefile: " << scenefile << std::endl;
 
-    // Create our Gtk application regardless of whether we display a window.
-    // We need the Gtk context created to construct a GdkPixbuf.
-    auto app = Gtk::Application::create("com.imjared.raytracer", Gio::APPLICATION_NON_UNIQUE);
+#ifndef JRAY_GUI
+    if ( output_imgfile == "" ) {
+        std::cerr << "This build of jray has no GUI: give an output file with -o." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+#endif
+    if ( output_imgfile != "" && !can_save_image(output_imgfile) ) {
+        std::cerr << "Output file must have one of these extensions: .png, .ppm, .exr, .pfm"
+#ifdef JRAY_GDK_PIXBUF
+                  << ", .jpg, .jpeg, .bmp"
+#endif
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
 
 	SceneConfig config = SceneConfig(scenefile);
 
     // If we're given an output file, render image and exit without displaying our main window.
+    // No GTK context is created, so this works on machines without a display.
     if ( output_imgfile != "" ) {
-        std::string fileext = getFileExtension(output_imgfile);
-        if (fileext != "jpg" && fileext != "jpeg" && fileext != "png" && fileext != "bmp") {
-            std::cerr << "Output file must have one of these extensions: .jpg, .jpeg, .png, .bmp" << std::endl;
-            exit(EXIT_FAILURE);
-        }
-	    auto renderer = new Renderer(threads, config);
-	    renderer->render(nullptr);
-	    renderer->getCanvas().save(output_imgfile);
+	    auto renderer = new Renderer(threads, config, tile_size);
+	    if ( denoise ) {
+	        renderer->setDenoise(true);
+	    }
+	    // Keep the output file up to date as progressive passes finish
+	    renderer->setPassCallback([&](size_t samples) {
+	        renderer->save(output_imgfile);
+	    });
+	    renderer->render();
+	    renderer->save(output_imgfile);
     }
+#ifdef JRAY_GUI
     // Otherwise, just run the application in the main window.
     else {
-        MainWindow window(threads, config, scenefile);
+        auto app = Gtk::Application::create("com.imjared.raytracer", Gio::APPLICATION_NON_UNIQUE);
+        MainWindow window(threads, config, scenefile, tile_size, denoise);
         return app->run(window);
     }
+#endif
 
 
 }
@@ -6,6 +6,7 @@
 #include "TestShape.h"
 #include "Group.h"
 #include <iostream>
+#include <limits>
 #include <memory>
 
 TEST(BoundingBoxTest, createEmptyBoundingBox) {
@@ -32,6 +33,15 @@ TEST(BoundingBoxTest, addBoundingBoxes) {
     EXPECT_EQ(box1.min, Point(-5,-7,-2));
     EXPECT_EQ(box1.max, Point(14,4,8));
 }
+TEST(BoundingBoxTest, addEmptyBoundingBox) {
+    BoundingBox box = BoundingBox(Point(-5,-2,0), Point(7,4,4));
+    box.add(BoundingBox());
+    EXPECT_EQ(box.min, Point(-5,-2,0));
+    EXPECT_EQ(box.max, Point(7,4,4));
+    BoundingBox empty;
+    empty.add(BoundingBox());
+    EXPECT_TRUE(empty.isEmpty());
+}
 TEST(BoundingBoxTest, checkBoxContainsPoint) {
     BoundingBox box = BoundingBox(Point(5,-2,0), Point(11,4,7));
     std::vector<bool> expected_results = { true, true, true,
@@ -75,6 +85,16 @@ TEST(BoundingBoxTest, transformBoundingBox) {
     EXPECT_EQ(box2.max, Point(1.41421, 1.70711, 1.70711));
 }
 
+TEST(BoundingBoxTest, transformUnboundedBoundingBox) {
+    double inf = std::numeric_limits<double>::infinity();
+    BoundingBox plane(Point(-inf, 0, -inf), Point(inf, 0, inf));
+    BoundingBox box = plane.transform(Matrix::translation(0,-2,0));
+    EXPECT_FALSE(box.isEmpty());
+    EXPECT_EQ(box.min, BoundingBox::minusInfinityPoint);
+    EXPECT_EQ(box.max, BoundingBox::infinityPoint);
+    EXPECT_TRUE(BoundingBox().transform(Matrix::translation(1,2,3)).isEmpty());
+}
+
 TEST(BoundingBoxTest, getShapeBoundsInParentSpace) {
     auto s = Sphere::make();
     s->setTransform(Matrix::translation(1,-3,5) * Matrix::scaling(0.5,2,4));
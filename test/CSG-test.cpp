@@ -16,6 +16,49 @@ TEST(CSGTest, createCSG) {
     EXPECT_EQ(csg->op, CSG_UNION);
     EXPECT_EQ(csg->left, s1);
     EXPECT_EQ(csg->right, s2);
-    EXPECT_EQ(s1->getParent(), csg);
-    EXPECT_EQ(s2->getParent(), csg);
-}
\ No newline at end of file
+    EXPECT_EQ(s1->getParent(), csg.get());
+    EXPECT_EQ(s2->getParent(), csg.get());
+}
+TEST(CSGTest, rayMissesCSG) {
+    auto csg = CSG::make(CSG_UNION, Sphere::make(), Cube::make());
+    Ray r = Ray(Point(0,2,-5), Vector(0,0,1));
+    Iset xs;
+    EXPECT_FALSE(csg->localIntersect(r, xs));
+    EXPECT_EQ(xs.size(), 0);
+}
+
+TEST(CSGTest, rayHitsCSG) {
+    auto s1 = Sphere::make();
+    auto s2 = Sphere::make(Matrix::translation(0,0,0.5));
+    auto csg = CSG::make(CSG_UNION, s1, s2);
+    Ray r = Ray(Point(0,0,-5), Vector(0,0,1));
+    // Existing entries in the list must be left alone by the CSG filter
+    auto other = Sphere::make();
+    Iset xs = { Intersection(10, other) };
+    EXPECT_TRUE(csg->localIntersect(r, xs));
+    EXPECT_EQ(xs.size(), 3);
+    auto it = xs.begin();
+    EXPECT_FLOAT_EQ(it->t, 4);
+    EXPECT_EQ(it->obj, s1.get());
+    ++it;
+    EXPECT_FLOAT_EQ(it->t, 6.5);
+    EXPECT_EQ(it->obj, s2.get());
+    ++it;
+    EXPECT_FLOAT_EQ(it->t, 10);
+    EXPECT_EQ(it->obj, other.get());
+}
+
+TEST(CSGTest, differenceFiltersIntersections) {
+    auto s1 = Sphere::make();
+    auto s2 = Cube::make(Matrix::translation(0,0,1));
+    auto csg = CSG::make(CSG_DIFFERENCE, s1, s2);
+    Ray r = Ray(Point(0,0,-5), Vector(0,0,1));
+    Iset xs;
+    EXPECT_TRUE(csg->localIntersect(r, xs));
+    // sphere entry at t=4, then the cube carves the sphere out from t=5 on
+    EXPECT_EQ(xs.size(), 2);
+    EXPECT_FLOAT_EQ(xs.begin()->t, 4);
+    EXPECT_EQ(xs.begin()->obj, s1.get());
+    EXPECT_FLOAT_EQ((++xs.begin())->t, 5);
+    EXPECT_EQ((++xs.begin())->obj, s2.get());
+}
@@ -0,0 +1,138 @@
+#include "gtest/gtest.h"
+#include "Denoiser.h"
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+// Adds samples to one pixel of fb, each color plus uniform noise of the given amplitude,
+// with a first hit of this albedo facing the camera at depth 5
+static void add_samples(Framebuffer &fb, size_t x, size_t y, const Color &color, const Color &albedo,
+                        double noise, std::mt19937 &rng, int count = 4)
+{
+    std::uniform_real_distribution<double> dist(-noise, noise);
+    for (int i = 0; i < count; i++) {
+        double n = dist(rng);
+        Color c(color.x() + n, color.y() + n, color.z() + n);
+        fb.add(x, y, c);
+        fb.addAov(x, y, 5.0, Vector(0, 0, -1), albedo, c);
+    }
+}
+
+static double rmse(const Framebuffer &fb, const Color &expected)
+{
+    double se = 0;
+    for (size_t y = 0; y < fb.height(); y++) {
+        for (size_t x = 0; x < fb.width(); x++) {
+            for (int i = 0; i < 3; i++) {
+                double d = fb.get(x, y).ptr()[i] - expected.ptr()[i];
+                se += d * d;
+            }
+        }
+    }
+    return std::sqrt(se / (fb.width() * fb.height() * 3));
+}
+
+TEST(DenoiserTest, needsAovs) {
+    Framebuffer in(4, 4), out(4, 4);
+    Denoiser denoiser;
+    EXPECT_THROW(denoiser.denoise(in, out), std::logic_error);
+    in.enableAovs(true);
+    Framebuffer small(2, 4);
+    EXPECT_THROW(denoiser.denoise(in, small), std::invalid_argument);
+}
+
+TEST(DenoiserTest, smoothsNoise) {
+    std::mt19937 rng(1);
+    Framebuffer in(16, 16);
+    in.enableAovs(true);
+    for (size_t y = 0; y < 16; y++) {
+        for (size_t x = 0; x < 16; x++) {
+            add_samples(in, x, y, Color(0.5, 0.5, 0.5), Color(0.8, 0.8, 0.8), 0.2, rng);
+        }
+    }
+    Framebuffer out(16, 16);
+    Denoiser().denoise(in, out, 2, 8);
+    EXPECT_LT(rmse(out, Color(0.5, 0.5, 0.5)), rmse(in, Color(0.5, 0.5, 0.5)) / 2);
+    EXPECT_EQ(out.samples(3, 7), 4);
+}
+
+TEST(DenoiserTest, keepsAlbedoEdges) {
+    std::mt19937 rng(2);
+    Framebuffer in(8, 8);
+    in.enableAovs(true);
+    for (size_t y = 0; y < 8; y++) {
+        for (size_t x = 0; x < 8; x++) {
+            if ( x < 4 ) {
+                add_samples(in, x, y, Color(0.8, 0, 0), Color(1, 0, 0), 0, rng);
+            } else {
+                add_samples(in, x, y, Color(0, 0, 0.8), Color(0, 0, 1), 0, rng);
+            }
+        }
+    }
+    Framebuffer out(8, 8);
+    Denoiser().denoise(in, out);
+    for (size_t y = 0; y < 8; y++) {
+        for (size_t x = 0; x < 8; x++) {
+            for (int i = 0; i < 3; i++) {
+                EXPECT_NEAR(out.get(x, y).ptr()[i], in.get(x, y).ptr()[i], 1e-6);
+            }
+        }
+    }
+}
+
+TEST(DenoiserTest, keepsLightingEdgesAboveTheNoise) {
+    // A shadow edge on one surface: nothing in the AOVs shows it, only the brightness
+    std::mt19937 rng(3);
+    Framebuffer in(8, 8);
+    in.enableAovs(true);
+    for (size_t y = 0; y < 8; y++) {
+        for (size_t x = 0; x < 8; x++) {
+            Color c = ( x < 4 ) ? Color(0.1, 0.1, 0.1) : Color(0.7, 0.7, 0.7);
+            add_samples(in, x, y, c, Color(0.8, 0.8, 0.8), 0.02, rng);
+        }
+    }
+    Framebuffer out(8, 8);
+    Denoiser().denoise(in, out);
+    for (size_t y = 0; y < 8; y++) {
+        EXPECT_NEAR(out.get(3, y).x(), 0.1, 0.02);
+        EXPECT_NEAR(out.get(4, y).x(), 0.7, 0.02);
+    }
+}
+
+TEST(DenoiserTest, keepsObjectsApartFromBackground) {
+    Framebuffer in(6, 1);
+    in.enableAovs(true);
+    for (size_t x = 0; x < 6; x++) {
+        // Missed samples leave the AOVs at zero
+        in.add(x, 0, ( x < 3 ) ? Color(0.2, 0.2, 0.2) : Color(0.4, 0.4, 0.4));
+        in.addAov(x, 0, 0, ( x < 3 ) ? Vector(0, 0, 0) : Vector(0, 1, 0), Color(0, 0, 0), in.get(x, 0));
+    }
+    Framebuffer out(6, 1);
+    Denoiser denoiser;
+    denoiser.setSigmaColor(0);
+    denoiser.denoise(in, out);
+    EXPECT_EQ(out.get(2, 0), Color(0.2, 0.2, 0.2));
+    EXPECT_EQ(out.get(3, 0), Color(0.4, 0.4, 0.4));
+}
+
+// The features are gathered by the tile workers too, and every pixel's are in place
+// before any is filtered, so the threads and tile size make no difference
+TEST(DenoiserTest, sameOnAnyThreads) {
+    std::mt19937 rng(4);
+    Framebuffer in(24, 20);
+    in.enableAovs(true);
+    for (size_t y = 0; y < 20; y++) {
+        for (size_t x = 0; x < 24; x++) {
+            Color c = ( x + y < 20 ) ? Color(0.2, 0.3, 0.4) : Color(0.9, 0.6, 0.3);
+            add_samples(in, x, y, c, Color(0.7, 0.7, 0.7), 0.3, rng);
+        }
+    }
+    Framebuffer one(24, 20), many(24, 20);
+    Denoiser().denoise(in, one, 1, 64);
+    Denoiser().denoise(in, many, 3, 5);
+    for (size_t y = 0; y < 20; y++) {
+        for (size_t x = 0; x < 24; x++) {
+            ASSERT_EQ(one.get(x, y), many.get(x, y)) << x << "," << y;
+        }
+    }
+}
@@ -0,0 +1,125 @@
+#include "gtest/gtest.h"
+#include "Framebuffer.h"
+#include "ToneMap.h"
+#include "Canvas.h"
+#include <stdexcept>
+
+TEST(FramebufferTest, startsBlack) {
+    Framebuffer fb(4, 3);
+    EXPECT_EQ(fb.width(), 4);
+    EXPECT_EQ(fb.height(), 3);
+    EXPECT_EQ(fb.get(3, 2), Color(0,0,0));
+    EXPECT_EQ(fb.samples(3, 2), 0);
+}
+
+TEST(FramebufferTest, keepsColorsAboveWhite) {
+    Framebuffer fb(2, 2);
+    fb.set(1, 0, Color(2.5, 0.5, 16.0));
+    EXPECT_EQ(fb.get(1, 0), Color(2.5, 0.5, 16.0));
+    EXPECT_EQ(fb.samples(1, 0), 1);
+    EXPECT_EQ(fb.get(0, 1), Color(0,0,0));
+}
+
+TEST(FramebufferTest, accumulatesMean) {
+    Framebuffer fb(2, 2);
+    fb.add(0, 1, Color(1, 0, 3));
+    fb.add(0, 1, Color(0, 0, 1));
+    EXPECT_EQ(fb.samples(0, 1), 2);
+    EXPECT_EQ(fb.get(0, 1), Color(0.5, 0, 2));
+    // set() starts over
+    fb.set(0, 1, Color(0.25, 0.25, 0.25));
+    EXPECT_EQ(fb.samples(0, 1), 1);
+    fb.clear();
+    EXPECT_EQ(fb.samples(0, 1), 0);
+    EXPECT_EQ(fb.get(0, 1), Color(0,0,0));
+}
+
+TEST(FramebufferTest, setKeepsSampleCount) {
+    Framebuffer fb(2, 2);
+    fb.set(1, 1, Color(0.5, 2, 0), 16);
+    EXPECT_EQ(fb.samples(1, 1), 16);
+    EXPECT_EQ(fb.get(1, 1), Color(0.5, 2, 0));
+}
+
+TEST(FramebufferTest, aovsAreAveraged) {
+    Framebuffer fb(3, 2);
+    EXPECT_FALSE(fb.hasAovs());
+    fb.enableAovs(true);
+    EXPECT_TRUE(fb.hasAovs());
+    EXPECT_EQ(fb.depth(2, 1), 0.0);
+    fb.addAov(2, 1, 3.0, Vector(0, 1, 0), Color(1, 0, 0), Color(0.2, 0.2, 0.2));
+    fb.addAov(2, 1, 5.0, Vector(1, 0, 0), Color(0, 0, 1), Color(0.6, 0.6, 0.6));
+    EXPECT_EQ(fb.depth(2, 1), 4.0);
+    EXPECT_EQ(fb.normal(2, 1), Vector(0.5, 0.5, 0));
+    EXPECT_EQ(fb.albedo(2, 1), Color(0.5, 0, 0.5));
+    // Luminances 0.2 and 0.6: sample variance 0.08, so the mean's is 0.04
+    EXPECT_NEAR(fb.variance(2, 1), 0.04, 1e-6);
+    EXPECT_EQ(fb.variance(1, 1), 0.0);
+    fb.clear();
+    EXPECT_TRUE(fb.hasAovs());
+    EXPECT_EQ(fb.albedo(2, 1), Color(0, 0, 0));
+    fb.enableAovs(false);
+    EXPECT_FALSE(fb.hasAovs());
+}
+
+TEST(ToneMapTest, defaultClamps) {
+    ToneMap tm;
+    EXPECT_EQ(tm.apply(Color(0.25, 1.5, -0.5)), Color(0.25, 1, 0));
+    unsigned char r, g, b;
+    tm.toBytes(Color(0.5, 1.5, 0.999), r, g, b);
+    // Rounded, not truncated
+    EXPECT_EQ(r, 128);
+    EXPECT_EQ(g, 255);
+    EXPECT_EQ(b, 255);
+}
+
+TEST(ToneMapTest, exposureInStops) {
+    ToneMap tm(ToneMapOperator::clamp, 1);
+    EXPECT_EQ(tm.apply(Color(0.25, 0.5, 0.75)), Color(0.5, 1, 1));
+    ToneMap dark(ToneMapOperator::clamp, -2);
+    EXPECT_EQ(dark.apply(Color(2, 1, 0)), Color(0.5, 0.25, 0));
+}
+
+TEST(ToneMapTest, reinhard) {
+    ToneMap tm(ToneMapOperator::reinhard);
+    Color c = tm.apply(Color(1, 3, 0));
+    EXPECT_DOUBLE_EQ(c.x(), 0.5);
+    EXPECT_DOUBLE_EQ(c.y(), 0.75);
+    EXPECT_DOUBLE_EQ(c.z(), 0);
+}
+
+TEST(ToneMapTest, acesStaysInRange) {
+    ToneMap tm(ToneMapOperator::aces);
+    double last = 0;
+    for (double v = 0.125; v < 1000; v *= 2) {
+        double m = tm.apply(Color(v, v, v)).x();
+        EXPECT_GE(m, last);
+        EXPECT_LE(m, 1.0);
+        last = m;
+    }
+    EXPECT_LT(tm.apply(Color(4, 4, 4)).x(), 1.0);
+}
+
+TEST(ToneMapTest, gamma) {
+    ToneMap tm(ToneMapOperator::clamp, 0, 2.0);
+    EXPECT_DOUBLE_EQ(tm.apply(Color(0.25, 1, 4)).x(), 0.5);
+}
+
+TEST(ToneMapTest, parseOperator) {
+    EXPECT_EQ(ToneMap::parseOperator("clamp"), ToneMapOperator::clamp);
+    EXPECT_EQ(ToneMap::parseOperator("reinhard"), ToneMapOperator::reinhard);
+    EXPECT_EQ(ToneMap::parseOperator("aces"), ToneMapOperator::aces);
+    EXPECT_THROW(ToneMap::parseOperator("filmic"), std::invalid_argument);
+}
+
+TEST(FramebufferTest, canvasShowsRegion) {
+    Framebuffer fb(4, 4);
+    Canvas canvas(4, 4);
+    fb.set(1, 1, Color(2, 0.5, 0));
+    fb.set(3, 3, Color(1, 1, 1));
+    canvas.put_framebuffer(fb, ToneMap(), 0, 0, 2, 2);
+    EXPECT_EQ(canvas.get_pixel(1, 1), Color(1, 128 / 255.0, 0));
+    // Outside the region is left alone
+    EXPECT_EQ(canvas.get_pixel(3, 3), Color(0, 0, 0));
+    EXPECT_THROW(canvas.put_framebuffer(fb, ToneMap(), 0, 0, 5, 4), std::range_error);
+}
@@ -5,8 +5,15 @@
 #include "Ray.h"
 #include "Sphere.h"
 #include "Group.h"
+#include "Plane.h"
+#include "Cube.h"
+#include "LinearBVH.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 
 TEST(GroupTest, intersectEmptyGroup) {
     auto g = Group::make();
@@ -34,11 +41,11 @@ TEST(GroupTest, intersectNonemptyGroup) {
     EXPECT_TRUE(hit);
     EXPECT_EQ(xs.size(), 4);
     auto it = xs.begin();
-    EXPECT_EQ(it->obj, s2);
-    EXPECT_EQ(it->obj->getParent(), g);
-    EXPECT_EQ((++it)->obj, s2);
-    EXPECT_EQ((++it)->obj, s1);
-    EXPECT_EQ((++it)->obj, s1);
+    EXPECT_EQ(it->obj, s2.get());
+    EXPECT_EQ(it->obj->getParent(), g.get());
+    EXPECT_EQ((++it)->obj, s2.get());
+    EXPECT_EQ((++it)->obj, s1.get());
+    EXPECT_EQ((++it)->obj, s1.get());
 }
 
 TEST(GroupTest, intersectTransformedGroup) {
@@ -53,6 +60,45 @@ TEST(GroupTest, intersectTransformedGroup) {
     EXPECT_EQ(xs.size(), 2);
 }
 
+TEST(GroupTest, intersectClosestMatchesHit) {
+    auto g = Group::make();
+    auto s1 = Sphere::make();
+    auto s2 = Sphere::make(Matrix::translation(0,0,-3));
+    auto s3 = Sphere::make(Matrix::translation(5,0,0));
+    g->addChild(s1);
+    g->addChild(s2);
+    g->addChild(s3);
+    g->divide(1);
+
+    for (auto r : { Ray(Point(0,0,-5), Vector(0,0,1)),
+                    Ray(Point(0,0,5), Vector(0,0,-1)),
+                    Ray(Point(0,0,-3), Vector(0,0,1)),
+                    Ray(Point(5,0,-5), Vector(0,0,1)),
+                    Ray(Point(0,3,-5), Vector(0,0,1)) }) {
+        Iset xs;
+        g->intersect(r, xs);
+        Intersection expected = hit(xs);
+        Intersection closest(std::numeric_limits<double>::infinity(), nullptr);
+        g->intersectClosest(r, closest);
+        if (expected.isEmpty()) {
+            EXPECT_TRUE(closest.isEmpty());
+        } else {
+            EXPECT_EQ(closest, expected);
+        }
+    }
+}
+
+TEST(GroupTest, intersectClosestRespectsMaxT) {
+    auto g = Group::make();
+    auto s = Sphere::make(Matrix::translation(0,0,10));
+    g->addChild(s);
+    Ray r = Ray(Point(0,0,-5), Vector(0,0,1));
+    Intersection best(5, nullptr); // pretend something else was already hit at t=5
+    EXPECT_FALSE(g->intersectClosest(r, best));
+    EXPECT_TRUE(best.isEmpty());
+    EXPECT_EQ(best.t, 5);
+}
+
 TEST(GroupTest, worldToObject) {
     auto g1 = Group::make();
     auto g2 = Group::make();
@@ -90,4 +136,372 @@ TEST(GroupTest, normalOnChildObject) {
     g2->addChild(s);
     Vector n = s->normalAt(Point(1.7321, 1.1547, -5.5774));
     EXPECT_EQ(n, Vector(0.285704, 0.428543, -0.857161));
-}
\ No newline at end of file
+}
+TEST(GroupTest, divideSAHPutsEveryShapeInALeaf) {
+    // Same layout as BoundingBoxTest.subdivideGroupPartitionsChildren, where divide()
+    // leaves the large sphere in the root
+    auto s1 = Sphere::make(Matrix::translation(-2,-2,0));
+    auto s2 = Sphere::make(Matrix::translation(-2,2,0));
+    auto s3 = Sphere::make(Matrix::scaling(4,4,4));
+    auto g = Group::make();
+    g->addChild(s1);
+    g->addChild(s2);
+    g->addChild(s3);
+
+    g->divideSAH(1);
+    BVHStats stats = g->bvhStats();
+    EXPECT_EQ(stats.primitives, 3);
+    EXPECT_EQ(stats.interiorPrimitives, 0);
+    EXPECT_EQ(stats.leaves, 3);
+    EXPECT_EQ(stats.maxLeafSize, 1);
+    EXPECT_EQ(stats.nodes, 5);
+    EXPECT_EQ(stats.depth, 3);
+    EXPECT_TRUE(g->includes(s1.get()) && g->includes(s2.get()) && g->includes(s3.get()));
+}
+
+TEST(GroupTest, divideSAHRespectsLeafSize) {
+    auto g = Group::make();
+    shapePtrVec spheres;
+    for (int i = 0; i < 10; i++) {
+        for (int j = 0; j < 10; j++) {
+            auto s = Sphere::make(Matrix::translation(i*3, j*3, (i+j) % 4));
+            spheres.push_back(s);
+            g->addChild(s);
+        }
+    }
+    BoundingBox before = g->bbox;
+
+    g->divideSAH(4);
+    BVHStats stats = g->bvhStats();
+    EXPECT_EQ(stats.primitives, 100);
+    EXPECT_EQ(stats.interiorPrimitives, 0);
+    EXPECT_LE(stats.maxLeafSize, 4);
+    EXPECT_GE(stats.leaves, 25);
+    EXPECT_EQ(g->bbox.min, before.min);
+    EXPECT_EQ(g->bbox.max, before.max);
+    for (auto s : spheres) {
+        EXPECT_TRUE(g->includes(s.get()));
+    }
+
+    // A SAH tree should be cheaper to trace than no tree at all
+    auto flat = Group::make(spheres);
+    EXPECT_LT(stats.sahCost, flat->bvhStats().sahCost);
+}
+
+TEST(GroupTest, divideSAHIntersectionsMatchFlatGroup) {
+    auto g = Group::make();
+    auto flat = Group::make();
+    for (int i = 0; i < 40; i++) {
+        Matrix4 M = Matrix::translation((i % 7) - 3, (i % 5) - 2, (i % 3) * 2) * Matrix::scaling(0.6, 0.6, 0.6);
+        g->addChild(Sphere::make(M));
+        flat->addChild(Sphere::make(M));
+    }
+    g->divideSAH(2);
+
+    for (auto r : { Ray(Point(0,0,-10), Vector(0,0,1)),
+                    Ray(Point(-3,-2,-10), Vector(0,0,1)),
+                    Ray(Point(-10,0.5,1), Vector(1,0,0)),
+                    Ray(Point(-10,-10,-10), normalize(Vector(1,1,1))) }) {
+        Iset xs, flat_xs;
+        g->intersect(r, xs);
+        flat->intersect(r, flat_xs);
+        ASSERT_EQ(xs.size(), flat_xs.size());
+        auto it = flat_xs.begin();
+        for (const auto &x : xs) {
+            EXPECT_FLOAT_EQ(x.t, it->t);
+            ++it;
+        }
+    }
+}
+
+TEST(GroupTest, divideSAHKeepsUnboundedShapesInRoot) {
+    auto g = Group::make();
+    auto p = Plane::make();
+    g->addChild(p);
+    for (int i = 0; i < 6; i++) {
+        g->addChild(Sphere::make(Matrix::translation(i*3, 1, 0)));
+    }
+    g->divideSAH(2);
+
+    auto children = g->getChildren();
+    EXPECT_EQ(children.size(), 3);
+    EXPECT_EQ(children[0], p);
+    BVHStats stats = g->bvhStats();
+    EXPECT_EQ(stats.interiorPrimitives, 1);
+    EXPECT_EQ(stats.primitives, 7);
+    EXPECT_TRUE(std::isfinite(stats.sahCost));
+}
+
+// Bins left empty between two clusters must not stop the split from going between them
+TEST(GroupTest, sahPartitionSkipsEmptyBins) {
+    std::vector<BVHBuildPrim> prims;
+    for (int i = 0; i < 6; i++) {
+        double x = ( i % 2 ) ? 10 + 0.5 * i : 0.5 * i;
+        BoundingBox box(Point(x - 0.1, -0.1, -0.1), Point(x + 0.1, 0.1, 0.1));
+        prims.push_back(BVHBuildPrim{ box, box.centroid(), (uint32_t)i });
+    }
+    BVHBuildPrimIter mid = sahPartition(prims.begin(), prims.end());
+    ASSERT_EQ(mid - prims.begin(), 3);
+    for (auto it = prims.begin(); it != prims.end(); ++it) {
+        EXPECT_EQ(it->index % 2, it < mid ? 0u : 1u);
+    }
+}
+
+// Builds the same scene twice: a few hundred small spheres, a plane, and a transformed
+// subgroup holding a cube
+static std::shared_ptr<Group> makeFlattenTestGroup()
+{
+    auto g = Group::make();
+    g->addChild(Plane::make(Matrix::translation(0,-2,0)));
+    for (int i = 0; i < 300; i++) {
+        double x = (i % 10) - 5;
+        double y = ((i / 10) % 6) - 3;
+        double z = (i / 60) * 1.5;
+        g->addChild(Sphere::make(Matrix::translation(x, y, z) * Matrix::scaling(0.3, 0.3, 0.3)));
+    }
+    auto sub = Group::make(Matrix::translation(0,0,-4) * Matrix::rotation_y(0.5));
+    sub->addChild(Cube::make());
+    g->addChild(sub);
+    return g;
+}
+
+TEST(GroupTest, flattenedBVHMatchesGroupHierarchy) {
+    auto g = makeFlattenTestGroup();
+    auto ref = makeFlattenTestGroup();
+    g->buildBVH(BVHMethod::sah, 2);
+    ref->divideSAH(2);
+    EXPECT_TRUE(g->isFlattened());
+    EXPECT_FALSE(ref->isFlattened());
+
+    std::vector<Ray> rays;
+    for (int i = 0; i < 200; i++) {
+        Point o(-8 + (i % 17), -4 + (i % 7), -10);
+        Vector d = normalize(Vector(0.05 * ((i % 5) - 2), 0.03 * ((i % 3) - 1), 1));
+        rays.push_back(Ray(o, d));
+        rays.push_back(Ray(Point(o.x(), o.y(), 12), -d));
+    }
+    rays.push_back(Ray(Point(0,0,0), Vector(1,0,0))); // starts inside the cloud of spheres
+
+    for (const auto &r : rays) {
+        Iset xs, ref_xs;
+        g->intersect(r, xs);
+        ref->intersect(r, ref_xs);
+        ASSERT_EQ(xs.size(), ref_xs.size());
+        auto it = ref_xs.begin();
+        for (const auto &x : xs) {
+            EXPECT_EQ(x.t, it->t);
+            ++it;
+        }
+
+        Intersection closest(std::numeric_limits<double>::infinity(), nullptr);
+        Intersection ref_closest(std::numeric_limits<double>::infinity(), nullptr);
+        EXPECT_EQ(g->intersectClosest(r, closest), ref->intersectClosest(r, ref_closest));
+        EXPECT_EQ(closest.t, ref_closest.t);
+
+        for (double max_t : { 1.0, 5.0, 50.0 }) {
+            EXPECT_EQ(g->intersectAny(r, max_t), ref->intersectAny(r, max_t));
+        }
+    }
+}
+
+TEST(GroupTest, addingChildDiscardsFlattenedBVH) {
+    auto g = Group::make();
+    auto sub = Group::make();
+    g->addChild(sub);
+    sub->addChild(Sphere::make());
+    g->flatten();
+    EXPECT_TRUE(g->isFlattened());
+
+    // The new sphere goes into an inlined subgroup, so g's node array is out of date
+    auto s = Sphere::make(Matrix::translation(5,0,0));
+    sub->addChild(s);
+    EXPECT_FALSE(g->isFlattened());
+
+    Intersection closest(std::numeric_limits<double>::infinity(), nullptr);
+    EXPECT_TRUE(g->intersectClosest(Ray(Point(5,0,-5), Vector(0,0,1)), closest));
+    EXPECT_EQ(closest.obj, s.get());
+}
+
+TEST(GroupTest, flattenEmptyGroup) {
+    auto g = Group::make();
+    g->flatten();
+    EXPECT_TRUE(g->isFlattened());
+    Iset xs;
+    EXPECT_FALSE(g->intersect(Ray(Point(0,0,-5), Vector(0,0,1)), xs));
+    EXPECT_TRUE(xs.empty());
+    EXPECT_FALSE(g->intersectAny(Ray(Point(0,0,-5), Vector(0,0,1)), 10));
+}
+
+TEST(GroupTest, wideBVHMatchesBinary) {
+    auto binary = makeFlattenTestGroup();
+    binary->buildBVH(BVHMethod::sah, 1, 2);
+    size_t binary_nodes = binary->bvhStats().nodes;
+
+    for (size_t width : { 4, 8 }) {
+        auto g = makeFlattenTestGroup();
+        g->buildBVH(BVHMethod::sah, 1, width);
+        EXPECT_EQ(g->getBVHWidth(), width);
+        EXPECT_LT(g->flattenedNodeCount(), binary->flattenedNodeCount());
+        EXPECT_EQ(g->bvhStats().nodes, binary_nodes);
+
+        for (int i = 0; i < 200; i++) {
+            Point o(-8 + (i % 17), -4 + (i % 7), -10);
+            Ray r(o, normalize(Vector(0.05 * ((i % 5) - 2), 0.03 * ((i % 3) - 1), 1)));
+
+            Iset xs, ref_xs;
+            g->intersect(r, xs);
+            binary->intersect(r, ref_xs);
+            ASSERT_EQ(xs.size(), ref_xs.size());
+
+            Intersection closest(std::numeric_limits<double>::infinity(), nullptr);
+            Intersection ref_closest(std::numeric_limits<double>::infinity(), nullptr);
+            EXPECT_EQ(g->intersectClosest(r, closest), binary->intersectClosest(r, ref_closest));
+            EXPECT_EQ(closest.t, ref_closest.t);
+
+            for (double max_t : { 1.0, 5.0, 50.0 }) {
+                EXPECT_EQ(g->intersectAny(r, max_t), binary->intersectAny(r, max_t));
+            }
+        }
+    }
+    EXPECT_THROW(binary->setBVHWidth(3), std::invalid_argument);
+}
+
+TEST(GroupTest, bvhCountersCountNodesAndBoxes) {
+    auto g = makeFlattenTestGroup();
+    g->buildBVH(BVHMethod::sah, 1, 4);
+    BVHCounters &counters = BVHCounters::current();
+    BVHCounters start = counters;
+    Intersection closest(std::numeric_limits<double>::infinity(), nullptr);
+    g->intersectClosest(Ray(Point(0,0,-10), Vector(0,0,1)), closest);
+    uint64_t nodes = counters.nodes - start.nodes;
+    uint64_t boxes = counters.boxes - start.boxes;
+    EXPECT_GT(nodes, 0u);
+    EXPECT_GE(boxes, nodes);
+    EXPECT_LE(boxes, 4 * nodes);
+}
+
+// Whichever of the two children lies lower on the split axis, the binary walks visit the
+// one the ray reaches first before the other
+TEST(GroupTest, linearBVHVisitsNearerChildFirst) {
+    const double inf = std::numeric_limits<double>::infinity();
+    BoundingBox low(Point(-3,-1,-1), Point(-1,1,1));
+    BoundingBox high(Point(1,-1,-1), Point(3,1,1));
+    BoundingBox all = low;
+    all.add(high);
+    for (bool second_lower : { false, true }) {
+        std::vector<LinearBVHNode> nodes { makeLinearBVHNode(all), makeLinearBVHNode(second_lower ? high : low),
+                                           makeLinearBVHNode(second_lower ? low : high) };
+        nodes[1].offset = 0;
+        nodes[1].count = 1;
+        nodes[2].offset = 1;
+        nodes[2].count = 1;
+        nodes[0].offset = 2;
+        nodes[0].axis = linearBVHSplitAxis(nodes[1], nodes[2]);
+        EXPECT_EQ(nodes[0].axis & LINEAR_BVH_AXIS_MASK, 0);
+        uint32_t low_leaf = second_lower ? 1 : 0;
+
+        for (double dir : { 1.0, -1.0 }) {
+            Ray r(Point(-10 * dir, 0, 0), Vector(dir, 0, 0));
+            uint32_t nearer = ( dir > 0 ) ? low_leaf : 1 - low_leaf;
+            std::vector<uint32_t> order;
+            traverseLinearBVH(nodes.data(), r, inf, false, [&](uint32_t first, uint32_t count) {
+                order.push_back(first);
+                return false;
+            });
+            ASSERT_EQ(order.size(), 2);
+            EXPECT_EQ(order[0], nearer);
+
+            RayPacket packet;
+            double max_t[PACKET_SIZE];
+            for (int lane = 0; lane < PACKET_SIZE; lane++) {
+                packet.set(lane, r);
+                max_t[lane] = inf;
+            }
+            order.clear();
+            traverseLinearBVHPacket(nodes.data(), packet, PACKET_ALL_LANES, max_t,
+                [&](uint32_t first, uint32_t count, PacketMask lanes) { order.push_back(first); },
+                [&](const Ray &ray, int lane, uint32_t first, uint32_t count) { order.push_back(first); });
+            ASSERT_EQ(order.size(), 2);
+            EXPECT_EQ(order[0], nearer);
+        }
+    }
+}
+
+// Boxes of varied sizes scattered over a few clusters
+static std::vector<BVHBuildPrim> makeBuildPrims(size_t n)
+{
+    std::vector<BVHBuildPrim> prims;
+    for (size_t i = 0; i < n; i++) {
+        double c = 10.0 * (i % 3);
+        Point p(c + fmod(i * 0.6180339, 4.0), fmod(i * 0.4142135, 3.0), c + fmod(i * 0.7320508, 5.0));
+        double r = 0.01 + 0.05 * (i % 7);
+        BoundingBox box(p - Vector(r, r, r), p + Vector(r, r, r));
+        prims.push_back(BVHBuildPrim{ box, box.centroid(), (uint32_t)i });
+    }
+    return prims;
+}
+
+// The tree must not depend on how many threads built it, and every prim must end up in
+// exactly one leaf, inside the bounds of every node above it
+TEST(GroupTest, parallelBuildMatchesSerial) {
+    for (BVHMethod method : { BVHMethod::sah, BVHMethod::lbvh }) {
+        std::vector<BVHBuildPrim> serial_prims = makeBuildPrims(5 * BVH_BUILD_PARALLEL_MIN_PRIMS);
+        std::vector<BVHBuildPrim> parallel_prims = serial_prims;
+        std::vector<LinearBVHNode> serial = buildBinaryBVH(serial_prims, 4, method, 1);
+        std::vector<LinearBVHNode> parallel = buildBinaryBVH(parallel_prims, 4, method, 8);
+
+        ASSERT_EQ(serial.size(), parallel.size());
+        EXPECT_EQ(std::memcmp(serial.data(), parallel.data(), serial.size() * sizeof(LinearBVHNode)), 0);
+        ASSERT_EQ(serial_prims.size(), parallel_prims.size());
+        for (size_t i = 0; i < serial_prims.size(); i++) {
+            EXPECT_EQ(serial_prims[i].index, parallel_prims[i].index);
+        }
+
+        std::vector<int> seen(serial_prims.size(), 0);
+        std::vector<uint32_t> path;
+        std::function<void(uint32_t)> walk = [&](uint32_t idx) {
+            const LinearBVHNode &n = serial[idx];
+            path.push_back(idx);
+            if ( n.count > 0 ) {
+                EXPECT_LE(n.count, 4);
+                for (uint32_t i = n.offset; i < n.offset + n.count; i++) {
+                    seen[serial_prims[i].index]++;
+                    for (uint32_t above : path) {
+                        for (int axis = 0; axis < 3; axis++) {
+                            EXPECT_LE(serial[above].min[axis], serial_prims[i].box.min[axis]);
+                            EXPECT_GE(serial[above].max[axis], serial_prims[i].box.max[axis]);
+                        }
+                    }
+                }
+            } else {
+                ASSERT_GT(n.offset, idx);
+                walk(idx + 1);
+                walk(n.offset);
+            }
+            path.pop_back();
+        };
+        walk(0);
+        EXPECT_EQ(std::count(seen.begin(), seen.end(), 1), (long)seen.size());
+    }
+}
+
+TEST(GroupTest, lbvhIntersectionsMatchFlatGroup) {
+    auto g = makeFlattenTestGroup();
+    auto flat = makeFlattenTestGroup();
+    g->buildBVH(BVHMethod::lbvh, 2);
+    EXPECT_TRUE(g->isFlattened());
+    EXPECT_GT(g->bvhStats().nodes, 100);
+
+    for (int i = 0; i < 200; i++) {
+        Point o(-8 + (i % 17), -4 + (i % 7), -10);
+        Ray r(o, normalize(Vector(0.05 * ((i % 5) - 2), 0.03 * ((i % 3) - 1), 1)));
+        Iset xs, flat_xs;
+        g->intersect(r, xs);
+        flat->intersect(r, flat_xs);
+        ASSERT_EQ(xs.size(), flat_xs.size());
+        Intersection closest(std::numeric_limits<double>::infinity(), nullptr);
+        Intersection flat_closest(std::numeric_limits<double>::infinity(), nullptr);
+        EXPECT_EQ(g->intersectClosest(r, closest), flat->intersectClosest(r, flat_closest));
+        EXPECT_EQ(closest.t, flat_closest.t);
+    }
+}
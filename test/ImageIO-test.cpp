@@ -0,0 +1,243 @@
+#include "gtest/gtest.h"
+#include "ImageIO.h"
+#include "Canvas.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <zlib.h>
+
+// A small image with a different value in every byte
+static std::vector<unsigned char> test_image(size_t width, size_t height)
+{
+    std::vector<unsigned char> rgb(width * height * 3);
+    for (size_t i = 0; i < rgb.size(); i++) {
+        rgb[i] = (unsigned char)(i * 37 + i / 7);
+    }
+    return rgb;
+}
+
+static std::string read_file(const std::string &filename)
+{
+    std::ifstream in(filename, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+TEST(ImageIOTest, pngRoundTrip) {
+    std::vector<unsigned char> rgb = test_image(13, 7);
+    save_image("imageio-test.png", rgb.data(), 13, 7);
+    EXPECT_EQ(read_file("imageio-test.png").compare(1, 3, "PNG"), 0);
+
+    std::vector<unsigned char> loaded;
+    size_t w, h;
+    load_image("imageio-test.png", loaded, w, h);
+    EXPECT_EQ(w, 13);
+    EXPECT_EQ(h, 7);
+    EXPECT_EQ(loaded, rgb);
+    std::remove("imageio-test.png");
+}
+
+TEST(ImageIOTest, ppmRoundTrip) {
+    std::vector<unsigned char> rgb = test_image(5, 4);
+    save_image("imageio-test.ppm", rgb.data(), 5, 4);
+    std::string file = read_file("imageio-test.ppm");
+    EXPECT_EQ(file.substr(0, 11), "P6\n5 4\n255\n");
+    EXPECT_EQ(file.size(), 11 + rgb.size());
+
+    std::vector<unsigned char> loaded;
+    size_t w, h;
+    load_image("imageio-test.ppm", loaded, w, h);
+    EXPECT_EQ(w, 5);
+    EXPECT_EQ(h, 4);
+    EXPECT_EQ(loaded, rgb);
+    std::remove("imageio-test.ppm");
+}
+
+TEST(ImageIOTest, pfmIsLinearAndBottomUp) {
+    Framebuffer fb(2, 2);
+    fb.set(0, 0, Color(4.5, 0.25, 0));  // top left
+    fb.set(1, 1, Color(0, 1, 100));     // bottom right
+    save_pfm("imageio-test.pfm", fb);
+    std::string file = read_file("imageio-test.pfm");
+    std::string header = "PF\n2 2\n-1.0\n";
+    ASSERT_EQ(file.size(), header.size() + 12 * sizeof(float));
+    EXPECT_EQ(file.substr(0, header.size()), header);
+
+    float px[12];
+    std::memcpy(px, file.data() + header.size(), sizeof(px));
+    // First row in the file is the bottom of the image
+    EXPECT_EQ(px[3], 0.0f);
+    EXPECT_EQ(px[4], 1.0f);
+    EXPECT_EQ(px[5], 100.0f);
+    EXPECT_EQ(px[6], 4.5f);
+    EXPECT_EQ(px[7], 0.25f);
+    std::remove("imageio-test.pfm");
+}
+
+TEST(ImageIOTest, supportedExtensions) {
+    EXPECT_TRUE(can_save_image("out.png"));
+    EXPECT_TRUE(can_save_image("out.PNG"));
+    EXPECT_TRUE(can_save_image("out.ppm"));
+    EXPECT_TRUE(can_save_image("out.pfm"));
+    EXPECT_FALSE(can_save_image("out.tiff"));
+    EXPECT_FALSE(can_save_image("out"));
+    unsigned char px[3] = { 0, 0, 0 };
+    EXPECT_THROW(save_image("out.tiff", px, 1, 1), std::invalid_argument);
+}
+
+TEST(ImageIOTest, loadErrors) {
+    std::vector<unsigned char> rgb;
+    size_t w, h;
+    EXPECT_THROW(load_image("no-such-image.png", rgb, w, h), std::runtime_error);
+    std::ofstream("imageio-test.ppm", std::ios::binary) << "P6\n4 4\n255\nshort";
+    EXPECT_THROW(load_image("imageio-test.ppm", rgb, w, h), std::runtime_error);
+    std::remove("imageio-test.ppm");
+}
+
+TEST(ImageIOTest, canvasFromFile) {
+    Canvas c(3, 2);
+    c.put_pixel(2, 1, 255, 128, 0);
+    c.save("imageio-test.png");
+    Canvas loaded("imageio-test.png");
+    EXPECT_EQ(loaded.get_width(), 3);
+    EXPECT_EQ(loaded.get_height(), 2);
+    EXPECT_EQ(loaded.get_pixel(2, 1), Color(1, 128 / 255.0, 0));
+    EXPECT_EQ(loaded.get_pixel(0, 0), Color(0, 0, 0));
+    std::remove("imageio-test.png");
+}
+
+// Reads the FLOAT channels of a scanline EXR written by save_exr(), undoing ZIP
+// compression the way OpenEXR does. Channels come back by name, rows top to bottom.
+static std::map<std::string, std::vector<float>> read_exr(const std::string &filename, int &compression)
+{
+    std::string file = read_file(filename);
+    const char *d = file.data();
+    auto i32 = [&](size_t pos) { int32_t v; std::memcpy(&v, d + pos, 4); return v; };
+    EXPECT_EQ(i32(0), 20000630);
+    EXPECT_EQ(i32(4), 2);
+
+    std::vector<std::string> channels;
+    int width = 0, height = 0;
+    size_t pos = 8;
+    while ( d[pos] ) {
+        std::string name(d + pos);
+        std::string type(d + pos + name.size() + 1);
+        size_t value = pos + name.size() + type.size() + 2 + 4;
+        int size = i32(value - 4);
+        if ( name == "channels" ) {
+            for (size_t c = value; d[c]; c += std::strlen(d + c) + 17) {
+                channels.push_back(d + c);
+                EXPECT_EQ(i32(c + std::strlen(d + c) + 1), 2); // FLOAT
+            }
+        } else if ( name == "compression" ) {
+            compression = d[value];
+        } else if ( name == "dataWindow" ) {
+            width = i32(value + 8) + 1;
+            height = i32(value + 12) + 1;
+        }
+        pos = value + size;
+    }
+    pos++;
+
+    std::map<std::string, std::vector<float>> ret;
+    for (auto &name : channels) {
+        ret[name].resize(width * height);
+    }
+    int lines = ( compression == 3 ) ? 16 : 1;
+    for (int block = 0; block < (height + lines - 1) / lines; block++) {
+        uint64_t offset;
+        std::memcpy(&offset, d + pos + 8 * block, 8);
+        int y0 = i32(offset);
+        int size = i32(offset + 4);
+        int n = std::min(lines, height - y0);
+        std::string raw(d + offset + 8, size);
+        size_t raw_size = (size_t)n * width * channels.size() * 4;
+        if ( raw.size() < raw_size ) {
+            std::string t(raw_size, '\0');
+            uLongf t_size = raw_size;
+            EXPECT_EQ(uncompress((Bytef*)&t[0], &t_size, (const Bytef*)raw.data(), raw.size()), Z_OK);
+            for (size_t i = 1; i < t.size(); i++) {
+                t[i] = (char)((unsigned char)t[i - 1] + (unsigned char)t[i] - 128);
+            }
+            size_t half = (t.size() + 1) / 2;
+            raw.resize(raw_size);
+            for (size_t i = 0; i < t.size(); i++) {
+                raw[i] = ( i % 2 ) ? t[half + i / 2] : t[i / 2];
+            }
+        }
+        const float *f = (const float*)raw.data();
+        for (int y = y0; y < y0 + n; y++) {
+            for (auto &name : channels) {
+                std::copy(f, f + width, &ret[name][y * width]);
+                f += width;
+            }
+        }
+    }
+    return ret;
+}
+
+static Framebuffer test_framebuffer()
+{
+    // Tall enough for two ZIP blocks, one of them short
+    Framebuffer fb(5, 21);
+    fb.enableAovs(true);
+    for (size_t y = 0; y < 21; y++) {
+        for (size_t x = 0; x < 5; x++) {
+            fb.set(x, y, Color(x * 0.5, y * 0.25, 7.5), 1 + x);
+            fb.addAov(x, y, 10.0 + y, Vector(0, 1, 0), Color(0.5, x * 0.1, 0), Color(0, 0, 0));
+        }
+    }
+    return fb;
+}
+
+TEST(ImageIOTest, exrChannels) {
+    Framebuffer fb = test_framebuffer();
+    for (ExrCompression c : { ExrCompression::none, ExrCompression::zip }) {
+        save_exr("imageio-test.exr", fb, c);
+        int compression = -1;
+        auto channels = read_exr("imageio-test.exr", compression);
+        EXPECT_EQ(compression, c == ExrCompression::zip ? 3 : 0);
+        std::vector<std::string> names;
+        for (auto &ch : channels) {
+            names.push_back(ch.first);
+        }
+        EXPECT_EQ(names, std::vector<std::string>({ "B", "G", "R", "Z", "albedo.B", "albedo.G", "albedo.R",
+                                                    "normal.X", "normal.Y", "normal.Z", "samples" }));
+        // Pixel (3, 18): linear color above white, the AOVs and the sample count
+        size_t i = 18 * 5 + 3;
+        EXPECT_FLOAT_EQ(channels["R"][i], 1.5f);
+        EXPECT_FLOAT_EQ(channels["G"][i], 4.5f);
+        EXPECT_FLOAT_EQ(channels["B"][i], 7.5f);
+        EXPECT_FLOAT_EQ(channels["Z"][i], 28.0f);
+        EXPECT_FLOAT_EQ(channels["normal.Y"][i], 1.0f);
+        EXPECT_FLOAT_EQ(channels["albedo.G"][i], 0.3f);
+        EXPECT_FLOAT_EQ(channels["samples"][i], 4.0f);
+    }
+    std::remove("imageio-test.exr");
+}
+
+TEST(ImageIOTest, exrWithoutAovs) {
+    Framebuffer fb(2, 1);
+    fb.set(1, 0, Color(0.25, 0.5, 100));
+    save_exr("imageio-test.exr", fb);
+    int compression = -1;
+    auto channels = read_exr("imageio-test.exr", compression);
+    EXPECT_EQ(channels.size(), 3);
+    EXPECT_FLOAT_EQ(channels["B"][1], 100.0f);
+    std::remove("imageio-test.exr");
+}
+
+TEST(ImageIOTest, pfmAovFiles) {
+    Framebuffer fb = test_framebuffer();
+    save_pfm("imageio-test.pfm", fb);
+    EXPECT_EQ(read_file("imageio-test.depth.pfm").substr(0, 3), "Pf\n");
+    EXPECT_EQ(read_file("imageio-test.samples.pfm").substr(0, 3), "Pf\n");
+    EXPECT_EQ(read_file("imageio-test.normal.pfm").substr(0, 3), "PF\n");
+    EXPECT_EQ(read_file("imageio-test.albedo.pfm").substr(0, 3), "PF\n");
+    for (auto name : { "imageio-test.pfm", "imageio-test.depth.pfm", "imageio-test.normal.pfm",
+                       "imageio-test.albedo.pfm", "imageio-test.samples.pfm" }) {
+        std::remove(name);
+    }
+}
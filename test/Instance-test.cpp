@@ -0,0 +1,202 @@
+#include "gtest/gtest.h"
+#include "Instance.h"
+#include "Group.h"
+#include "ObjParser.h"
+#include "SceneConfig.h"
+#include "World.h"
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <sstream>
+
+// A pyramid with smooth normals on its sides and a flat base, split into two groups
+static const char *pyramid_obj =
+R"EOF(
+    v 0 1 0
+    v -1 0 -1
+    v 1 0 -1
+    v 1 0 1
+    v -1 0 1
+    vn 0 0.7 -0.7
+    vn 0.7 0.7 0
+    vn 0 0.7 0.7
+    vn -0.7 0.7 0
+    vn 0 1 0
+    g Sides
+    f 1//5 2//1 3//1
+    f 1//5 3//2 4//2
+    f 1//5 4//3 5//3
+    f 1//5 5//4 2//4
+    g Base
+    f 2 4 3
+    f 2 5 4
+)EOF";
+
+static std::shared_ptr<Group> parsePyramid()
+{
+    std::istringstream iss(pyramid_obj);
+    return ObjParser(iss).obj;
+}
+
+static Matrix4 instanceTransform()
+{
+    return Matrix::translation(1, 0.5, 2) * Matrix::rotation_y(0.7) * Matrix::scaling(2, 1.5, 2);
+}
+
+static std::vector<Ray> makeRays()
+{
+    std::vector<Ray> rays;
+    for (int i = 0; i < 200; i++) {
+        Point o(-3 + 0.04 * i, 5, -3 + 0.03 * ((i * 7) % 200));
+        Vector d = normalize(Vector(0.1 * ((i % 5) - 2), -1, 0.08 * ((i % 3) - 1)));
+        rays.push_back(Ray(o, d));
+        rays.push_back(Ray(Point(o.x(), -3, o.z()), Vector(-d.x(), -d.y(), -d.z())));
+    }
+    return rays;
+}
+
+// An instance must behave exactly like its own copy of the geometry under a Group with
+// the instance's transform and material
+TEST(InstanceTest, matchesTransformedCopy) {
+    auto geometry = parsePyramid();
+    auto inst = Instance::make(geometry, instanceTransform());
+    inst->setMaterialColor(Color(0.2, 0.9, 0.4));
+
+    auto ref = Group::make(instanceTransform());
+    ref->addChild(parsePyramid());
+    ref->setMaterialColor(Color(0.2, 0.9, 0.4));
+
+    EXPECT_EQ(inst->parentBounds().min, ref->parentBounds().min);
+    EXPECT_EQ(inst->parentBounds().max, ref->parentBounds().max);
+
+    size_t hits = 0;
+    for (const auto &r : makeRays()) {
+        Iset xs, ref_xs;
+        inst->intersect(r, xs);
+        ref->intersect(r, ref_xs);
+        ASSERT_EQ(xs.size(), ref_xs.size());
+        auto it = ref_xs.begin();
+        for (const auto &x : xs) {
+            EXPECT_NEAR(x.t, it->t, 1e-12);
+            EXPECT_EQ(x.obj, inst.get());
+            EXPECT_TRUE(geometry->includes(x.inner));
+            ++it;
+        }
+
+        Intersection closest(std::numeric_limits<double>::infinity(), nullptr);
+        Intersection ref_closest(std::numeric_limits<double>::infinity(), nullptr);
+        bool hit = inst->intersectClosest(r, closest);
+        ASSERT_EQ(hit, ref->intersectClosest(r, ref_closest));
+        if ( hit ) {
+            hits++;
+            EXPECT_NEAR(closest.t, ref_closest.t, 1e-12);
+            Icomps comps = closest.prepComps(r);
+            Icomps ref_comps = ref_closest.prepComps(r);
+            EXPECT_EQ(comps.normalv, ref_comps.normalv);
+            EXPECT_EQ(comps.obj->getMaterial(), ref_comps.obj->getMaterial());
+        }
+
+        for (double max_t : { 1.0, 5.0, 50.0 }) {
+            EXPECT_EQ(inst->intersectAny(r, max_t), ref->intersectAny(r, max_t));
+        }
+    }
+    EXPECT_GT(hits, 50);
+}
+
+TEST(InstanceTest, packetsReportTheInstance) {
+    auto inst = Instance::make(parsePyramid(), instanceTransform());
+    RayPacket packet;
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        // Across the instance, which is centred on (1, 2), with the last ray beside it
+        double x = ( i == PACKET_SIZE - 1 ) ? 10 : 0.2 + 1.6 * i / PACKET_SIZE;
+        packet.set(i, Ray(Point(x, 5, 2.1), Vector(0, -1, 0)));
+    }
+    PacketHits hits;
+    PacketMask found = inst->intersectPacket(packet, packetLanes(PACKET_SIZE), hits);
+    EXPECT_EQ(found, packetLanes(PACKET_SIZE - 1));
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        Intersection expected(std::numeric_limits<double>::infinity(), nullptr);
+        ASSERT_EQ(inst->intersectClosest(packet.ray(i), expected), (bool)((found >> i) & 1));
+        if ( (found >> i) & 1 ) {
+            EXPECT_EQ(hits.hit[i].obj, inst.get());
+            EXPECT_EQ(hits.hit[i].inner, expected.inner);
+            EXPECT_NEAR(hits.t[i], expected.t, 1e-9);
+        }
+    }
+}
+
+// Each instance keeps its own material, transform and shadow flag over shared geometry
+TEST(InstanceTest, instancesShareGeometry) {
+    auto geometry = parsePyramid();
+    auto a = Instance::make(geometry);
+    auto b = Instance::make(geometry, Matrix::translation(5, 0, 0));
+    a->setMaterialColor(Color(1, 0, 0));
+    b->setMaterialColor(Color(0, 0, 1));
+    b->castsShadow(false);
+    EXPECT_EQ(geometry->getParent(), nullptr);
+
+    auto g = Group::make();
+    g->addChild(a);
+    g->addChild(b);
+    g->buildBVH(BVHMethod::sah, 1);
+
+    Ray ra(Point(0, 5, -0.2), Vector(0, -1, 0));
+    Ray rb(Point(5, 5, -0.2), Vector(0, -1, 0));
+    Intersection ha(std::numeric_limits<double>::infinity(), nullptr);
+    Intersection hb(std::numeric_limits<double>::infinity(), nullptr);
+    ASSERT_TRUE(g->intersectClosest(ra, ha));
+    ASSERT_TRUE(g->intersectClosest(rb, hb));
+    EXPECT_EQ(ha.obj, a.get());
+    EXPECT_EQ(hb.obj, b.get());
+    EXPECT_EQ(ha.inner, hb.inner);
+    EXPECT_NEAR(ha.t, hb.t, 1e-12);
+    EXPECT_EQ(ha.obj->getMaterial().getColor(), Color(1, 0, 0));
+    EXPECT_EQ(hb.obj->getMaterial().getColor(), Color(0, 0, 1));
+    EXPECT_EQ(ha.prepComps(ra).normalv, hb.prepComps(rb).normalv);
+
+    EXPECT_TRUE(g->intersectAny(ra, 10));
+    EXPECT_FALSE(g->intersectAny(rb, 10));
+}
+
+TEST(InstanceTest, sceneParsesEachObjOnce) {
+    const char *filename = "instance-test.obj";
+    {
+        std::ofstream f(filename);
+        f << pyramid_obj;
+    }
+    YAML::Node scene = YAML::Load(std::string(R"EOF(
+- add: obj
+  file: instance-test.obj
+  cache: false
+  material:
+    color: [ 1, 0, 0 ]
+- add: obj
+  file: instance-test.obj
+  cache: false
+  transform:
+    - [ translate, 5, 0, 0 ]
+  material:
+    color: [ 0, 0, 1 ]
+- add: obj
+  file: instance-test.obj
+  cache: false
+  bvh-width: 4
+  material:
+    color: [ 0, 1, 0 ]
+)EOF"));
+    SceneConfig config(scene);
+    std::remove(filename);
+
+    World world = config.getWorld();
+    auto &shapes = world.getShapes();
+    ASSERT_EQ(shapes.size(), 3);
+    auto a = std::dynamic_pointer_cast<Instance>(shapes[0]);
+    auto b = std::dynamic_pointer_cast<Instance>(shapes[1]);
+    auto c = std::dynamic_pointer_cast<Instance>(shapes[2]);
+    ASSERT_TRUE(a && b && c);
+    EXPECT_EQ(a->getGeometry(), b->getGeometry());
+    EXPECT_NE(a->getGeometry(), c->getGeometry()); // built differently
+    EXPECT_EQ(b->getTransform(), Matrix::translation(5, 0, 0));
+    EXPECT_EQ(b->getMaterial().getColor(), Color(0, 0, 1));
+}
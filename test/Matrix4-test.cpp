@@ -0,0 +1,66 @@
+#include "gtest/gtest.h"
+#include "Tuple.h"
+#include "Vector.h"
+#include "Point.h"
+#include "Matrix.h"
+#include "Matrix4.h"
+#include <math.h>
+
+
+TEST(Matrix4Test, convertToAndFromMatrix) {
+    Matrix A(4,4, {1,2,3,4,5,6,7,8,9,8,7,6,5,4,3,2});
+    Matrix4 B = A;
+    EXPECT_EQ(B(2,1), 8);
+    EXPECT_EQ(B, A);
+    Matrix C = B;
+    EXPECT_EQ(C, A);
+    EXPECT_ANY_THROW(Matrix4(Matrix(3,3)));
+}
+
+TEST(Matrix4Test, matrixMultiply) {
+    Matrix4 A({1,2,3,4,5,6,7,8,9,8,7,6,5,4,3,2});
+    Matrix4 B({-2,1,2,3,3,2,1,-1,4,3,6,5,1,2,7,8});
+    Matrix4 C({20,22,50,48,44,54,114,108,40,58,110,102,16,26,46,42});
+    EXPECT_EQ(A*B, C);
+}
+
+TEST(Matrix4Test, tupleMultiply) {
+    Matrix4 A({1,2,3,4,2,4,4,2,8,6,4,1,0,0,0,1});
+    EXPECT_EQ(A * Tuple(1,2,3,1), Tuple(18,24,33,1));
+    EXPECT_EQ(A * Point(1,2,3), Point(18,24,33));
+    // Vectors are unaffected by translation
+    EXPECT_EQ(A * Vector(1,2,3), Vector(14,22,32));
+}
+
+TEST(Matrix4Test, transpose) {
+    Matrix4 A({0,9,3,0,9,8,0,8,1,8,5,3,0,0,5,8});
+    Matrix4 B({0,9,1,0,9,8,8,0,3,0,5,5,0,8,3,8});
+    EXPECT_EQ(A.transpose(), B);
+    EXPECT_EQ(Matrix4::identity().transpose(), Matrix4::identity());
+}
+
+TEST(Matrix4Test, inverseMatchesMatrix) {
+    Matrix A(4,4, {-5,2,6,-8,1,-5,1,8,7,7,-6,-7,1,-3,7,4});
+    Matrix B(4,4, {9,3,0,9,-5,-2,-6,-3,-4,9,6,4,-7,6,6,2});
+    EXPECT_FLOAT_EQ(Matrix4(A).det(), A.det());
+    EXPECT_FLOAT_EQ(Matrix4(B).det(), B.det());
+    EXPECT_EQ(Matrix4(A).inverse(), A.inverse());
+    EXPECT_EQ(Matrix4(B).inverse(), B.inverse());
+
+    Matrix4 C = Matrix4(A) * Matrix4(B);
+    EXPECT_EQ(C * Matrix4(B).inverse(), Matrix4(A));
+    EXPECT_ANY_THROW(Matrix4::scaling(1,0,1).inverse());
+}
+
+TEST(Matrix4Test, transformsMatchMatrix) {
+    EXPECT_EQ(Matrix4::translation(5,-3,2), Matrix::translation(5,-3,2));
+    EXPECT_EQ(Matrix4::scaling(2,3,4), Matrix::scaling(2,3,4));
+    EXPECT_EQ(Matrix4::rotation_x(PI/4), Matrix::rotation_x(PI/4));
+    EXPECT_EQ(Matrix4::rotation_y(PI/4), Matrix::rotation_y(PI/4));
+    EXPECT_EQ(Matrix4::rotation_z(PI/4), Matrix::rotation_z(PI/4));
+    EXPECT_EQ(Matrix4::shearing(1,2,3,4,5,6), Matrix::shearing(1,2,3,4,5,6));
+
+    Point p(1,0,1);
+    Matrix4 T = Matrix4::identity().rotate_x(PI / 2).scale(5,5,5).translate(10,5,7);
+    EXPECT_EQ(T * p, Point(15,0,7));
+}
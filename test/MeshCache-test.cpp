@@ -0,0 +1,281 @@
+#include "gtest/gtest.h"
+#include "MeshCache.h"
+#include "ObjParser.h"
+#include "SceneConfig.h"
+#include "World.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A bumpy height field in three groups, one with smooth normals, with an empty group
+// between them
+static std::string heightFieldObj(int n)
+{
+    std::ostringstream obj;
+    for (int j = 0; j <= n; j++) {
+        for (int i = 0; i <= n; i++) {
+            double x = -2 + 4.0 * i / n;
+            double z = -2 + 4.0 * j / n;
+            obj << "v " << x << " " << 0.3 * sin(2*x) * cos(3*z) << " " << z << "\n";
+            obj << "vn " << -0.6 * cos(2*x) * cos(3*z) << " 1 " << 0.9 * sin(2*x) * sin(3*z) << "\n";
+        }
+    }
+    for (int j = 0; j < n; j++) {
+        if ( j == n / 3 ) {
+            obj << "g Smooth\n";
+        } else if ( j == 2 * n / 3 ) {
+            obj << "g Empty\ng Flat\n";
+        }
+        bool smooth = ( j >= n / 3 && j < 2 * n / 3 );
+        for (int i = 0; i < n; i++) {
+            int v00 = j * (n+1) + i + 1;
+            int v10 = v00 + 1;
+            int v01 = v00 + (n+1);
+            int v11 = v01 + 1;
+            if ( smooth ) {
+                obj << "f " << v00 << "//" << v00 << " " << v10 << "//" << v10 << " " << v11 << "//" << v11 << "\n";
+                obj << "f " << v00 << "//" << v00 << " " << v11 << "//" << v11 << " " << v01 << "//" << v01 << "\n";
+            } else {
+                obj << "f " << v00 << " " << v10 << " " << v11 << "\n";
+                obj << "f " << v00 << " " << v11 << " " << v01 << "\n";
+            }
+        }
+    }
+    return obj.str();
+}
+
+static void writeFile(const std::string &filename, const std::string &text)
+{
+    std::ofstream f(filename, std::ios::binary);
+    f << text;
+}
+
+static bool fileExists(const std::string &filename)
+{
+    return access(filename.c_str(), F_OK) == 0;
+}
+
+static void expectSameGeometry(const std::shared_ptr<Group> &cached, const std::shared_ptr<Group> &parsed)
+{
+    ASSERT_EQ(cached->getChildren().size(), parsed->getChildren().size());
+    EXPECT_EQ(cached->parentBounds().min, parsed->parentBounds().min);
+    EXPECT_EQ(cached->parentBounds().max, parsed->parentBounds().max);
+
+    size_t hits = 0;
+    for (int i = 0; i < 400; i++) {
+        Point o(-2.5 + 0.0125 * i, 3, -2.5 + 0.0125 * ((i * 7) % 400));
+        Ray r(o, normalize(Vector(0.1 * ((i % 5) - 2), -1, 0.07 * ((i % 3) - 1))));
+        Intersection a(std::numeric_limits<double>::infinity(), nullptr);
+        Intersection b(std::numeric_limits<double>::infinity(), nullptr);
+        bool hit = cached->intersectClosest(r, a);
+        ASSERT_EQ(hit, parsed->intersectClosest(r, b));
+        if ( hit ) {
+            hits++;
+            EXPECT_EQ(a.t, b.t);
+            EXPECT_EQ(a.face, b.face);
+            EXPECT_EQ(a.prepComps(r).normalv, b.prepComps(r).normalv);
+        }
+        Iset xs, ref_xs;
+        cached->intersect(r, xs);
+        parsed->intersect(r, ref_xs);
+        EXPECT_EQ(xs.size(), ref_xs.size());
+        EXPECT_EQ(cached->intersectAny(r, 2.5), parsed->intersectAny(r, 2.5));
+    }
+    EXPECT_GT(hits, 200);
+}
+
+// The meshes mapped from a cache must trace exactly like the ones it was written from,
+// for each precision and BVH width
+TEST(MeshCacheTest, cachedGeometryMatchesParsed) {
+    const std::string filename = "mesh-cache-test.obj";
+    writeFile(filename, heightFieldObj(30));
+    for (MeshPrecision precision : { MeshPrecision::double_precision, MeshPrecision::single_precision }) {
+        for (size_t width : { 2, 4, 8 }) {
+            MeshCache cache(filename, BVHMethod::sah, 4, precision, width);
+            std::remove(cache.path().c_str());
+            EXPECT_EQ(cache.load(), nullptr);
+
+            ObjParser parser(filename, BVHMethod::sah, 4, precision, width);
+            ASSERT_EQ(parser.meshes.size(), 3);
+            EXPECT_EQ(parser.group_count, 4);
+            ASSERT_TRUE(cache.save(parser));
+            auto cached = cache.load();
+            ASSERT_NE(cached, nullptr);
+            expectSameGeometry(cached, parser.obj);
+            std::remove(cache.path().c_str());
+        }
+    }
+    std::remove(filename.c_str());
+}
+
+TEST(MeshCacheTest, staleCachesAreNotLoaded) {
+    const std::string filename = "mesh-cache-stale.obj";
+    writeFile(filename, heightFieldObj(10));
+    MeshCache cache(filename);
+    ASSERT_TRUE(cache.save(ObjParser(filename)));
+    ASSERT_NE(cache.load(), nullptr);
+
+    // Other settings have caches of their own
+    MeshCache wider(filename, BVHMethod::sah, 4, DEFAULT_MESH_PRECISION, 8);
+    EXPECT_NE(wider.path(), cache.path());
+    EXPECT_EQ(wider.load(), nullptr);
+    MeshCache elsewhere(filename, BVHMethod::sah, 4, DEFAULT_MESH_PRECISION, DEFAULT_BVH_WIDTH, "mesh-cache-dir");
+    EXPECT_EQ(elsewhere.path().find("mesh-cache-dir/mesh-cache-stale.obj."), 0);
+    EXPECT_EQ(elsewhere.load(), nullptr);
+
+    // The same contents with a new time still load
+    writeFile(filename, heightFieldObj(10));
+    EXPECT_NE(cache.load(), nullptr);
+
+    // New contents of the same size don't
+    std::string changed = heightFieldObj(10);
+    changed[changed.find("v -2") + 3] = '3';
+    writeFile(filename, changed);
+    EXPECT_EQ(cache.load(), nullptr);
+
+    // Nor does a truncated cache
+    ASSERT_TRUE(cache.save(ObjParser(filename)));
+    ASSERT_NE(cache.load(), nullptr);
+    ASSERT_EQ(truncate(cache.path().c_str(), 1000), 0);
+    EXPECT_EQ(cache.load(), nullptr);
+
+    std::remove(cache.path().c_str());
+    std::remove(filename.c_str());
+}
+
+static std::string readFile(const std::string &filename)
+{
+    std::ifstream in(filename, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+// Loading leaves the cache as it is, even when the obj has only been touched, so that a
+// cache can be read from a read-only or shared directory
+TEST(MeshCacheTest, loadingDoesNotWriteTheCache) {
+    const std::string filename = "mesh-cache-readonly.obj";
+    writeFile(filename, heightFieldObj(10));
+    MeshCache cache(filename);
+    ASSERT_TRUE(cache.save(ObjParser(filename)));
+    std::string saved = readFile(cache.path());
+    ASSERT_EQ(chmod(cache.path().c_str(), 0444), 0);
+
+    writeFile(filename, heightFieldObj(10));
+    EXPECT_NE(cache.load(), nullptr);
+    EXPECT_NE(cache.load(), nullptr);
+    EXPECT_EQ(readFile(cache.path()), saved);
+
+    std::remove(cache.path().c_str());
+    std::remove(filename.c_str());
+}
+
+// Saving a cache removes the obj's caches with other settings, but not those of an obj
+// of the same name elsewhere
+TEST(MeshCacheTest, savingRemovesOtherCachesOfTheObj) {
+    const std::string filename = "mesh-cache-other.obj";
+    writeFile(filename, heightFieldObj(10));
+    mkdir("mesh-cache-other", 0777);
+    const std::string elsewhere = "mesh-cache-other/mesh-cache-other.obj";
+    writeFile(elsewhere, heightFieldObj(10));
+
+    MeshCache narrow(filename, BVHMethod::sah, 4, DEFAULT_MESH_PRECISION, 2, "mesh-cache-dir");
+    MeshCache wide(filename, BVHMethod::sah, 4, DEFAULT_MESH_PRECISION, 8, "mesh-cache-dir");
+    MeshCache other(elsewhere, BVHMethod::sah, 4, DEFAULT_MESH_PRECISION, 2, "mesh-cache-dir");
+    EXPECT_NE(narrow.path(), other.path());
+    ASSERT_TRUE(other.save(ObjParser(elsewhere, BVHMethod::sah, 4, DEFAULT_MESH_PRECISION, 2)));
+    ASSERT_TRUE(narrow.save(ObjParser(filename, BVHMethod::sah, 4, DEFAULT_MESH_PRECISION, 2)));
+    EXPECT_TRUE(fileExists(narrow.path()));
+    ASSERT_TRUE(wide.save(ObjParser(filename, BVHMethod::sah, 4, DEFAULT_MESH_PRECISION, 8)));
+    EXPECT_TRUE(fileExists(wide.path()));
+    EXPECT_FALSE(fileExists(narrow.path()));
+    EXPECT_TRUE(fileExists(other.path()));
+
+    std::remove(wide.path().c_str());
+    std::remove(other.path().c_str());
+    rmdir("mesh-cache-dir");
+    std::remove(elsewhere.c_str());
+    rmdir("mesh-cache-other");
+    std::remove(filename.c_str());
+}
+
+// Overwrites the uint32 at offset at within the first copy of the n bytes at record in the
+// file, as a bit flip or a partial write might
+static void corruptRecord(const std::string &filename, const void *record, size_t n, size_t at, uint32_t value)
+{
+    std::string data = readFile(filename);
+    size_t pos = data.find(std::string(static_cast<const char*>(record), n));
+    ASSERT_NE(pos, std::string::npos);
+    std::memcpy(&data[pos + at], &value, sizeof(value));
+    writeFile(filename, data);
+}
+
+// A damaged payload under an intact header is rejected, so the obj is parsed again
+// instead of a ray reading out of bounds
+TEST(MeshCacheTest, corruptCachesAreNotLoaded) {
+    const std::string filename = "mesh-cache-corrupt.obj";
+    writeFile(filename, heightFieldObj(10));
+    MeshCache cache(filename, BVHMethod::sah, 4, DEFAULT_MESH_PRECISION, 2);
+    ObjParser parser(filename, BVHMethod::sah, 4, DEFAULT_MESH_PRECISION, 2);
+    ASSERT_FALSE(parser.meshes.empty());
+    auto mesh = std::dynamic_pointer_cast<TriangleMesh>(parser.meshes[0].second);
+    ASSERT_TRUE(mesh);
+    ASSERT_GT(mesh->nodeCount(), 1);
+
+    // A vertex index past the vertex array
+    ASSERT_TRUE(cache.save(parser));
+    ASSERT_NE(cache.load(), nullptr);
+    corruptRecord(cache.path(), mesh->faceData(), sizeof(MeshFace), offsetof(MeshFace, v[1]), 1000000);
+    EXPECT_EQ(cache.load(), nullptr);
+
+    // A root whose second child is past the node array
+    ASSERT_TRUE(cache.save(parser));
+    ASSERT_NE(cache.load(), nullptr);
+    const LinearBVHNode *root = static_cast<const LinearBVHNode*>(mesh->bvh().data());
+    ASSERT_EQ(root->count, 0);
+    corruptRecord(cache.path(), root, sizeof(LinearBVHNode), offsetof(LinearBVHNode, offset), mesh->nodeCount() + 5);
+    EXPECT_EQ(cache.load(), nullptr);
+
+    std::remove(cache.path().c_str());
+    std::remove(filename.c_str());
+}
+
+TEST(MeshCacheTest, sceneWritesAndUsesCache) {
+    const std::string filename = "mesh-cache-scene.obj";
+    writeFile(filename, heightFieldObj(10));
+    MeshCache cache(filename, BVHMethod::sah, 4, DEFAULT_MESH_PRECISION, DEFAULT_BVH_WIDTH, "mesh-cache-dir");
+    std::remove(cache.path().c_str());
+
+    YAML::Node uncached = YAML::Load(std::string(R"EOF(
+- add: obj
+  file: mesh-cache-scene.obj
+  cache: false
+)EOF"));
+    SceneConfig(uncached).getWorld();
+    EXPECT_FALSE(fileExists(cache.path()));
+
+    YAML::Node scene = YAML::Load(std::string(R"EOF(
+- add: obj
+  file: mesh-cache-scene.obj
+  cache: mesh-cache-dir
+)EOF"));
+    World first = SceneConfig(scene).getWorld();
+    EXPECT_TRUE(fileExists(cache.path()));
+    World second = SceneConfig(scene).getWorld();
+    ASSERT_EQ(first.getShapes().size(), 1);
+    ASSERT_EQ(second.getShapes().size(), 1);
+    auto a = std::dynamic_pointer_cast<Instance>(first.getShapes()[0]);
+    auto b = std::dynamic_pointer_cast<Instance>(second.getShapes()[0]);
+    ASSERT_TRUE(a && b);
+    expectSameGeometry(b->getGeometry(), a->getGeometry());
+
+    std::remove(cache.path().c_str());
+    rmdir("mesh-cache-dir");
+    std::remove(filename.c_str());
+}
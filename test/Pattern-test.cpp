@@ -36,8 +36,8 @@ TEST(PatternTest, lightingWithPattern) {
     Vector eyev = Vector(0,0,-1);
     Vector normalv = Vector(0,0,-1);
     Light light = Light(Point(0,0,-10), Color::White);
-    Color c1 = m.lighting(s, light, Point(0.9,0,0), eyev, normalv, false);
-    Color c2 = m.lighting(s, light, Point(1.1,0,0), eyev, normalv, false);
+    Color c1 = m.lighting(s.get(), light, Point(0.9,0,0), eyev, normalv, false);
+    Color c2 = m.lighting(s.get(), light, Point(1.1,0,0), eyev, normalv, false);
     EXPECT_EQ(c1, Color::White);
     EXPECT_EQ(c2, Color::Black);
 
@@ -0,0 +1,57 @@
+#include "gtest/gtest.h"
+#include "PixelStats.h"
+
+TEST(PixelStatsTest, meanOfSamples) {
+    PixelStats p;
+    EXPECT_EQ(p.mean(), Color(0,0,0));
+    p.add(Color(0.2, 0.4, 2.0));
+    p.add(Color(0.4, 0.8, 4.0));
+    EXPECT_EQ(p.count(), 2);
+    // The mean isn't clamped: that is left to the output
+    Color m = p.mean();
+    EXPECT_DOUBLE_EQ(m.x(), 0.3);
+    EXPECT_DOUBLE_EQ(m.y(), 0.6);
+    EXPECT_DOUBLE_EQ(m.z(), 3.0);
+}
+
+TEST(PixelStatsTest, needsTwoSamples) {
+    PixelStats p;
+    EXPECT_FALSE(p.converged(1.0));
+    p.add(Color(0.5, 0.5, 0.5));
+    EXPECT_FALSE(p.converged(1.0));
+    p.add(Color(0.5, 0.5, 0.5));
+    EXPECT_TRUE(p.converged(0.001));
+}
+
+TEST(PixelStatsTest, convergesWithStandardError) {
+    // n samples alternating 0 and 1 have a sample variance of 0.25 * n/(n-1), so the
+    // standard error of their mean is 0.5/sqrt(n-1). That is at most 0.1 from n = 26.
+    PixelStats p;
+    for (int i = 0; i < 24; i++) {
+        p.add( (i % 2) ? Color(1,1,1) : Color(0,0,0) );
+    }
+    EXPECT_FALSE(p.converged(0.1));
+    p.add(Color(0,0,0));
+    p.add(Color(1,1,1));
+    EXPECT_TRUE(p.converged(0.1));
+}
+
+TEST(PixelStatsTest, anyChannelKeepsSampling) {
+    PixelStats p;
+    p.add(Color(0.5, 0.5, 0.0));
+    p.add(Color(0.5, 0.5, 1.0));
+    EXPECT_FALSE(p.converged(0.1));
+}
+
+TEST(PixelStatsTest, varianceAboveWhiteIsIgnored) {
+    // Both samples display as white
+    PixelStats p;
+    p.add(Color(1.5, 2.0, 1.0));
+    p.add(Color(4.0, 1.0, 9.0));
+    EXPECT_TRUE(p.converged(0.001));
+}
+
+TEST(PixelStatsTest, contrastAsDisplayed) {
+    EXPECT_DOUBLE_EQ(PixelStats::contrast(Color(0.2, 0.5, 0.5), Color(0.2, 0.1, 0.6)), 0.4);
+    EXPECT_DOUBLE_EQ(PixelStats::contrast(Color(3, 0, 0), Color(1, 0, 0)), 0.0);
+}
@@ -43,7 +43,7 @@ TEST(PlaneTest, intersectAbove) {
     EXPECT_TRUE(hit);
     EXPECT_EQ(iset.size(), 1);
     EXPECT_FLOAT_EQ(iset.begin()->t, 1);
-    EXPECT_EQ(iset.begin()->obj, p);
+    EXPECT_EQ(iset.begin()->obj, p.get());
 }
 
 TEST(PlaneTest, intersectBelow) {
@@ -54,5 +54,5 @@ TEST(PlaneTest, intersectBelow) {
     EXPECT_TRUE(hit);
     EXPECT_EQ(iset.size(), 1);
     EXPECT_FLOAT_EQ(iset.begin()->t, 1);
-    EXPECT_EQ(iset.begin()->obj, p);
+    EXPECT_EQ(iset.begin()->obj, p.get());
 }
\ No newline at end of file
@@ -0,0 +1,260 @@
+#include "gtest/gtest.h"
+#include "RayPacket.h"
+#include "Sphere.h"
+#include "Plane.h"
+#include "Cube.h"
+#include "Cylinder.h"
+#include "Triangle.h"
+#include "TriangleMesh.h"
+#include "Group.h"
+#include "World.h"
+#include "Renderer.h"
+#include "SceneConfig.h"
+#include "Sampler.h"
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+#include <unistd.h>
+
+#ifndef JRAY_SCENES_DIR
+#define JRAY_SCENES_DIR "../scenes"
+#endif
+
+// Rays from near origin towards the unit cube around the world origin. With spread 0
+// they all leave from origin, like a pinhole camera's.
+static std::vector<Ray> makeRays(std::mt19937 &rng, const Point &origin, double spread, size_t n)
+{
+    std::uniform_real_distribution<double> target(-1.5, 1.5);
+    std::uniform_real_distribution<double> jitter(-spread, spread);
+    std::vector<Ray> rays;
+    for (size_t i = 0; i < n; i++) {
+        Point o = origin + Vector(jitter(rng), jitter(rng), jitter(rng));
+        Point p(target(rng), target(rng), target(rng));
+        rays.push_back(Ray(o, normalize(p - o)));
+    }
+    return rays;
+}
+
+// Traces rays through shape both ways, PACKET_SIZE at a time, and checks that each
+// packet lane finds the same closest hit as its ray does on its own. Only triangles
+// report u and v.
+static void expectPacketsMatchRays(Shape &shape, const std::vector<Ray> &rays, bool uv = false)
+{
+    size_t hits_found = 0;
+    for (size_t first = 0; first < rays.size(); first += PACKET_SIZE) {
+        size_t n = std::min<size_t>(PACKET_SIZE, rays.size() - first);
+        RayPacket packet;
+        for (size_t i = 0; i < n; i++) {
+            packet.set(i, rays[first + i]);
+        }
+        PacketHits hits;
+        PacketMask found = shape.intersectPacket(packet, packetLanes(n), hits);
+        for (size_t i = 0; i < n; i++) {
+            Intersection expected(std::numeric_limits<double>::infinity(), nullptr);
+            bool hit = shape.intersectClosest(rays[first + i], expected);
+            ASSERT_EQ(hit, (found >> i) & 1) << "ray " << first + i;
+            if ( hit ) {
+                EXPECT_EQ(hits.hit[i].obj, expected.obj);
+                EXPECT_NEAR(hits.t[i], expected.t, 1e-9);
+                EXPECT_EQ(hits.hit[i].t, hits.t[i]);
+                if ( uv ) {
+                    EXPECT_NEAR(hits.hit[i].u, expected.u, 1e-9);
+                    EXPECT_NEAR(hits.hit[i].v, expected.v, 1e-9);
+                }
+                EXPECT_EQ(hits.hit[i].face, expected.face);
+                hits_found++;
+            } else {
+                EXPECT_TRUE(hits.hit[i].isEmpty());
+            }
+        }
+    }
+    // Make sure the test exercised both outcomes
+    EXPECT_GT(hits_found, 0);
+    EXPECT_LT(hits_found, rays.size());
+}
+
+TEST(RayPacketTest, transformMatchesRays) {
+    Matrix4 M = Matrix4::translation(1, -2, 3) * Matrix4::rotation_y(0.7) * Matrix4::scaling(2, 1, 0.5);
+    std::mt19937 rng(1);
+    std::vector<Ray> rays = makeRays(rng, Point(0, 0, -5), 1, PACKET_SIZE);
+    RayPacket packet;
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        packet.set(i, rays[i]);
+    }
+    RayPacket moved = packet.transform(M);
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        Ray expected = rays[i].transform(M);
+        Ray r = moved.ray(i);
+        EXPECT_EQ(r.origin, expected.origin);
+        EXPECT_EQ(r.dir, expected.dir);
+    }
+}
+
+TEST(RayPacketTest, laneMasks) {
+    EXPECT_EQ(packetLanes(0), 0u);
+    EXPECT_EQ(packetLanes(3), 7u);
+    EXPECT_EQ(packetLaneCount(PACKET_ALL_LANES), PACKET_SIZE);
+    EXPECT_EQ(packetFirstLane(12), 2);
+    std::vector<int> lanes;
+    forEachLane(0x29, [&](int lane) { lanes.push_back(lane); });
+    EXPECT_EQ(lanes, std::vector<int>({ 0, 3, 5 }));
+}
+
+TEST(RayPacketTest, primitivesMatchRays) {
+    std::vector<std::shared_ptr<Shape>> shapes = {
+        Sphere::make(Matrix4::scaling(1.2, 0.8, 1)),
+        Plane::make(Matrix4::rotation_x(0.3)),
+        Cube::make(Matrix4::rotation_z(0.5) * Matrix4::scaling(0.7, 0.7, 0.7)),
+        Triangle::make(Point(-1, -1, 0), Point(1, -1, 0.5), Point(0, 1.2, 0)),
+        Triangle::make(Point(-1, -1, 0), Point(1, -1, 0.5), Point(0, 1.2, 0),
+                       Vector(0, 0, -1), normalize(Vector(0.3, 0, -1)), normalize(Vector(0, 0.3, -1))),
+        // Cylinders have no kernel of their own and trace the lanes one by one
+        Cylinder::make(-1, 1, true),
+    };
+    std::mt19937 rng(2);
+    std::vector<Ray> rays = makeRays(rng, Point(0.3, 0.5, -4), 0.5, 10 * PACKET_SIZE);
+    for (size_t i = 0; i < shapes.size(); i++) {
+        bool triangle = ( i == 3 || i == 4 );
+        expectPacketsMatchRays(*shapes[i], rays, triangle);
+    }
+}
+
+TEST(RayPacketTest, onlyCloserHitsInMaskAreRecorded) {
+    auto s = Sphere::make();
+    RayPacket packet;
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        packet.set(i, Ray(Point(0, 0, -5), Vector(0, 0, 1)));
+    }
+    PacketHits hits;
+    hits.t[1] = 3.0; // a hit closer than the sphere's, at t = 4
+    PacketMask found = s->intersectPacket(packet, 0x3, hits);
+    EXPECT_EQ(found, 0x1u);
+    EXPECT_EQ(hits.t[0], 4.0);
+    EXPECT_EQ(hits.hit[0].obj, s.get());
+    EXPECT_EQ(hits.t[1], 3.0);
+    EXPECT_TRUE(hits.hit[2].isEmpty());
+}
+
+// A cloud of small spheres in a flattened BVH. Coherent packets stay together;
+// packets of rays from all over split into single rays as soon as they diverge.
+TEST(RayPacketTest, bvhMatchesRays) {
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> pos(-1.5, 1.5);
+    auto g = Group::make(Matrix4::rotation_y(0.2));
+    for (int i = 0; i < 300; i++) {
+        g->addChild(Sphere::make(Matrix4::translation(pos(rng), pos(rng), pos(rng)) * Matrix4::scaling(0.1, 0.1, 0.1)));
+    }
+    g->addChild(Plane::make(Matrix4::translation(0, -1.6, 0)));
+    g->buildBVH(BVHMethod::sah, 4);
+    ASSERT_TRUE(g->isFlattened());
+    expectPacketsMatchRays(*g, makeRays(rng, Point(0, 0, -5), 0, 40 * PACKET_SIZE));
+    expectPacketsMatchRays(*g, makeRays(rng, Point(0, 0, -5), 4, 40 * PACKET_SIZE));
+
+    // The same tree walked as a Group hierarchy
+    auto unflattened = Group::make();
+    unflattened->addChild(Sphere::make(Matrix4::translation(0.5, 0, 0)));
+    auto sub = Group::make(Matrix4::translation(-1, 0, 0));
+    sub->addChild(Cube::make(Matrix4::scaling(0.3, 0.3, 0.3)));
+    unflattened->addChild(sub);
+    ASSERT_FALSE(unflattened->isFlattened());
+    expectPacketsMatchRays(*unflattened, makeRays(rng, Point(0, 0, -5), 1, 20 * PACKET_SIZE));
+}
+
+// A bumpy height field seen from above, in double and single precision
+template <typename Mesh>
+static std::shared_ptr<Mesh> makeMesh(int n)
+{
+    std::vector<Point> points;
+    for (int j = 0; j <= n; j++) {
+        for (int i = 0; i <= n; i++) {
+            double x = -1.5 + 3.0 * i / n;
+            double z = -1.5 + 3.0 * j / n;
+            points.push_back(Point(x, 0.3 * sin(2*x) * cos(3*z), z));
+        }
+    }
+    std::vector<MeshFace> faces;
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            uint32_t a = j * (n + 1) + i, b = a + 1, c = a + n + 1, d = c + 1;
+            faces.push_back(MeshFace{ { a, b, d }, { Mesh::NO_NORMAL, 0, 0 } });
+            faces.push_back(MeshFace{ { a, d, c }, { Mesh::NO_NORMAL, 0, 0 } });
+        }
+    }
+    return Mesh::make(Mesh::makeVertices(points), std::make_shared<std::vector<Vector>>(), faces);
+}
+
+TEST(RayPacketTest, meshMatchesRays) {
+    std::mt19937 rng(4);
+    auto mesh = makeMesh<TriangleMesh>(24);
+    expectPacketsMatchRays(*mesh, makeRays(rng, Point(0.2, 4, -2), 0, 40 * PACKET_SIZE), true);
+    expectPacketsMatchRays(*mesh, makeRays(rng, Point(0.2, 4, -2), 3, 40 * PACKET_SIZE), true);
+    auto fmesh = makeMesh<FloatTriangleMesh>(24);
+    expectPacketsMatchRays(*fmesh, makeRays(rng, Point(0.2, 4, -2), 0, 40 * PACKET_SIZE), true);
+    expectPacketsMatchRays(*fmesh, makeRays(rng, Point(0.2, 4, -2), 3, 40 * PACKET_SIZE), true);
+}
+
+TEST(RayPacketTest, worldStartsOver) {
+    World w;
+    w.make_default();
+    RayPacket packet;
+    packet.set(0, Ray(Point(0, 0, -5), Vector(0, 0, 1)));
+    packet.set(1, Ray(Point(0, 5, -5), Vector(0, 0, 1)));
+    PacketHits hits;
+    hits.t[0] = 1; // left over from an earlier packet
+    EXPECT_EQ(w.intersectPacket(packet, 0x3, hits), 0x1u);
+    EXPECT_EQ(hits.t[0], 4.0);
+    Iset iset;
+    EXPECT_EQ(w.colorAtHit(packet.ray(0), hits.hit[0], iset), w.colorAt(packet.ray(0), iset));
+    EXPECT_EQ(w.colorAtHit(packet.ray(1), hits.hit[1], iset), Color(0, 0, 0));
+}
+
+// Renders reflect.yaml small, as progressive passes with a jittered area light, with
+// and without packets
+static Framebuffer renderReflect(bool packets)
+{
+    char cwd[4096];
+    EXPECT_NE(getcwd(cwd, sizeof(cwd)), nullptr);
+    EXPECT_EQ(chdir(JRAY_SCENES_DIR), 0);
+    YAML::Node scene = YAML::LoadFile("reflect.yaml");
+    EXPECT_EQ(chdir(cwd), 0);
+    for (auto node : scene) {
+        if ( node["add"] && node["add"].as<std::string>() == "camera" ) {
+            node["width"] = 64;
+            node["height"] = 32;
+            node["supersampling"] = 2;
+            node["progressive"] = true;
+            node["aovs"] = true;
+            node["packets"] = packets;
+        }
+        if ( node["add"] && node["add"].as<std::string>() == "light" ) {
+            node["uvec"] = YAML::Load("[1, 0, 0]");
+            node["vvec"] = YAML::Load("[0, 1, 0]");
+            node["usteps"] = 2;
+            node["vsteps"] = 2;
+            node["jitter"] = true;
+        }
+    }
+    // The jittered light draws its highlight points from this thread's Sampler
+    Sampler::current().setSeed(DEFAULT_SAMPLER_SEED);
+    SceneConfig config(scene);
+    Renderer renderer(2, config, 16);
+    renderer.render();
+    return renderer.getFramebuffer();
+}
+
+TEST(RayPacketTest, renderIsTheSameWithPackets) {
+    Framebuffer single = renderReflect(false);
+    Framebuffer packets = renderReflect(true);
+    for (size_t y = 0; y < single.height(); y++) {
+        for (size_t x = 0; x < single.width(); x++) {
+            Color a = single.get(x, y), b = packets.get(x, y);
+            for (int i = 0; i < 3; i++) {
+                ASSERT_NEAR(a.ptr()[i], b.ptr()[i], 1e-9) << x << "," << y;
+            }
+            ASSERT_EQ(single.samples(x, y), packets.samples(x, y));
+            ASSERT_NEAR(single.depth(x, y), packets.depth(x, y), 1e-9);
+        }
+    }
+}
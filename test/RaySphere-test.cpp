@@ -56,7 +56,7 @@ TEST(RaySphereTest, sphereBehindRay) {
     s->intersect(r,iset);
     EXPECT_FLOAT_EQ(iset.begin()->t, -6.0);
     EXPECT_FLOAT_EQ((++iset.begin())->t, -4.0);
-    EXPECT_EQ(s, iset.begin()->obj);
+    EXPECT_EQ(s.get(), iset.begin()->obj);
 }
 
 TEST(RaySphereTest, findHitPositiveT) {
@@ -93,6 +93,32 @@ TEST(RaySphereTest, findHitRandom) {
     EXPECT_EQ(hit(iset), i4);
 }
 
+TEST(RaySphereTest, isetIteratesInOrderOfT) {
+    auto s1 = Sphere::make();
+    auto s2 = Sphere::make();
+    Iset iset;
+    iset.insert(Intersection(5,s1));
+    iset.insert(Intersection(2,s1));
+    iset.insert(Intersection(2,s2)); // same t: must stay behind the first one inserted
+    iset.insert(Intersection(-1,s2));
+    EXPECT_FALSE(iset.isSorted());
+    EXPECT_EQ(hit(iset), Intersection(2,s1));
+    EXPECT_FALSE(iset.isSorted()); // hit() doesn't need to sort
+
+    std::vector<Intersection> expected = { Intersection(-1,s2), Intersection(2,s1),
+                                           Intersection(2,s2), Intersection(5,s1) };
+    size_t n = 0;
+    for (const auto &i : iset) {
+        EXPECT_EQ(i, expected[n++]);
+    }
+    EXPECT_EQ(n, 4);
+    EXPECT_TRUE(iset.isSorted());
+
+    iset.clear();
+    EXPECT_EQ(iset.size(), 0);
+    EXPECT_TRUE(hit(iset).isEmpty());
+}
+
 TEST(RaySphereTest, rayTranslate) {
     Ray r(Point(1,2,3), Vector(0,1,0) );
     Matrix M = Matrix::translation(3,4,5);
@@ -30,7 +30,7 @@ TEST(ReflectionTest, reflectNonReflective) {
     w.make_default();
     Ray r = Ray(Point(0,0,0), Vector(0,0,1));
     auto s = w.getShapes()[1];
-    s->getMaterial().setAmbient(1.0);
+    s->setMaterialAmbient(1.0);
     Intersection i(1, s);
 
     Icomps comps = i.prepComps(r);
@@ -0,0 +1,144 @@
+#include "gtest/gtest.h"
+#include "Renderer.h"
+#include "SceneConfig.h"
+#include "Sampler.h"
+#include <string>
+#include <unistd.h>
+
+#ifndef JRAY_SCENES_DIR
+#define JRAY_SCENES_DIR "../scenes"
+#endif
+
+// reflect.yaml, small, with two supersamples (eight when adaptive) and two focal blur
+// samples per pixel
+static YAML::Node loadReflect(bool progressive, double time_limit = 0, double adaptive_threshold = 0)
+{
+    char cwd[4096];
+    EXPECT_NE(getcwd(cwd, sizeof(cwd)), nullptr);
+    EXPECT_EQ(chdir(JRAY_SCENES_DIR), 0);
+    YAML::Node scene = YAML::LoadFile("reflect.yaml");
+    EXPECT_EQ(chdir(cwd), 0);
+    for (auto node : scene) {
+        if ( node["add"] && node["add"].as<std::string>() == "camera" ) {
+            node["width"] = 64;
+            node["height"] = 32;
+            node["supersampling"] = 2;
+            node["focal-samples"] = 2;
+            node["aperture"] = 0.05;
+            node["progressive"] = progressive;
+            if ( time_limit > 0 ) {
+                node["time-limit"] = time_limit;
+            }
+            if ( adaptive_threshold > 0 ) {
+                node["supersampling"] = 8;
+                node["adaptive-threshold"] = adaptive_threshold;
+                node["min-samples"] = 2;
+            }
+        }
+    }
+    return scene;
+}
+
+// Progressive passes take the same samples as a render in one pass, one pass per
+// supersample and focal sample, so the running means end up where the single pass does
+TEST(RendererTest, progressiveMatchesSinglePass) {
+    SceneConfig single_config(loadReflect(false));
+    Renderer single(2, single_config, 16);
+    single.render();
+    EXPECT_EQ(single.getPassesDone(), 0);
+
+    SceneConfig progressive_config(loadReflect(true));
+    Renderer progressive(2, progressive_config, 16);
+    size_t callbacks = 0;
+    progressive.setPassCallback([&](size_t passes) { EXPECT_EQ(passes, ++callbacks); });
+    progressive.render();
+    EXPECT_EQ(progressive.getPassesDone(), 4);
+    EXPECT_EQ(callbacks, 4);
+
+    const Framebuffer &a = single.getFramebuffer();
+    const Framebuffer &b = progressive.getFramebuffer();
+    for (size_t y = 0; y < a.height(); y++) {
+        for (size_t x = 0; x < a.width(); x++) {
+            Color ca = a.get(x, y), cb = b.get(x, y);
+            for (int i = 0; i < 3; i++) {
+                ASSERT_NEAR(ca.ptr()[i], cb.ptr()[i], 1e-6) << x << "," << y;
+            }
+            ASSERT_EQ(a.samples(x, y), 4);
+            ASSERT_EQ(b.samples(x, y), 4);
+        }
+    }
+}
+
+// A time limit that has run out before the passes start leaves the render with fewer
+TEST(RendererTest, progressiveStopsAtTimeLimit) {
+    SceneConfig config(loadReflect(true, 1e-9));
+    Renderer renderer(2, config, 16);
+    renderer.render();
+    EXPECT_LT(renderer.getPassesDone(), 4);
+}
+
+// Adaptive sampling compares each pixel with all four of its neighbors once they all have
+// their first samples, so where the tile borders fall makes no difference to which pixels
+// take every sample
+TEST(RendererTest, adaptiveSamplingDoesNotDependOnTiles) {
+    SceneConfig config(loadReflect(false, 0, 0.02));
+    Renderer one_tile(1, config, 64);
+    one_tile.render();
+    Renderer tiles(2, config, 8);
+    tiles.render();
+
+    const Framebuffer &a = one_tile.getFramebuffer();
+    const Framebuffer &b = tiles.getFramebuffer();
+    size_t stopped_early = 0, border_edges = 0;
+    for (size_t y = 0; y < a.height(); y++) {
+        for (size_t x = 0; x < a.width(); x++) {
+            ASSERT_EQ(a.samples(x, y), b.samples(x, y)) << x << "," << y;
+            Color ca = a.get(x, y), cb = b.get(x, y);
+            for (int i = 0; i < 3; i++) {
+                ASSERT_NEAR(ca.ptr()[i], cb.ptr()[i], 1e-6) << x << "," << y;
+            }
+            if ( a.samples(x, y) < 16 ) {
+                stopped_early++;
+            } else if ( x % 8 == 0 || y % 8 == 0 ) {
+                border_edges++;
+            }
+        }
+    }
+    EXPECT_GT(stopped_early, 0);
+    EXPECT_GT(border_edges, 0);
+}
+
+// With several samples per pixel, each sample of a row is traced as one packet, and
+// comes out the same as when its rays are traced one at a time
+TEST(RendererTest, packetsMatchSingleRaysWithSupersampling) {
+    SceneConfig single_config(loadReflect(false));
+    Renderer single(2, single_config, 16);
+    single.render();
+
+    YAML::Node scene = loadReflect(false);
+    for (auto node : scene) {
+        if ( node["add"] && node["add"].as<std::string>() == "camera" ) {
+            node["packets"] = true;
+        }
+    }
+    SceneConfig packet_config(scene);
+    Renderer packets(2, packet_config, 16);
+    packets.render();
+
+    const Framebuffer &a = single.getFramebuffer();
+    const Framebuffer &b = packets.getFramebuffer();
+    size_t traced = 0;
+    for (const auto &st : packets.getThreadStats()) {
+        traced += st.samples;
+    }
+    EXPECT_EQ(traced, a.width() * a.height() * 4);
+    for (size_t y = 0; y < a.height(); y++) {
+        for (size_t x = 0; x < a.width(); x++) {
+            Color ca = a.get(x, y), cb = b.get(x, y);
+            for (int i = 0; i < 3; i++) {
+                ASSERT_NEAR(ca.ptr()[i], cb.ptr()[i], 1e-6) << x << "," << y;
+            }
+            ASSERT_EQ(b.samples(x, y), 4);
+        }
+    }
+}
@@ -0,0 +1,129 @@
+#include "gtest/gtest.h"
+#include "Sampler.h"
+#include "Light.h"
+#include "Camera.h"
+#include <thread>
+#include <vector>
+
+TEST(SamplerTest, pcg32MatchesReference) {
+    // First outputs of the reference pcg32 demo, seeded with (42, 54)
+    Pcg32 rng(42u, 54u);
+    EXPECT_EQ(rng.next(), 0xa15c02b7u);
+    EXPECT_EQ(rng.next(), 0x7b47f409u);
+    EXPECT_EQ(rng.next(), 0xba1d3330u);
+    EXPECT_EQ(rng.next(), 0x83d2f293u);
+    EXPECT_EQ(rng.next(), 0xbfa4784bu);
+    EXPECT_EQ(rng.next(), 0xcbed606eu);
+}
+
+TEST(SamplerTest, radicalInverse) {
+    EXPECT_EQ(radicalInverse(0, 0), 0.0);
+    EXPECT_EQ(radicalInverse(0, 1), 0.5);
+    EXPECT_EQ(radicalInverse(0, 2), 0.25);
+    EXPECT_EQ(radicalInverse(0, 3), 0.75);
+    EXPECT_EQ(radicalInverse(0, 6), 0.375);
+    EXPECT_DOUBLE_EQ(radicalInverse(1, 1), 1.0/3);
+    EXPECT_DOUBLE_EQ(radicalInverse(1, 5), 2.0/3 + 1.0/9);
+    EXPECT_DOUBLE_EQ(radicalInverse(2, 7), 2.0/5 + 1.0/25);
+}
+
+TEST(SamplerTest, samplesAreReproducible) {
+    Sampler a(7), b(7);
+    a.startSample(12, 34, 5);
+    b.startSample(12, 34, 5);
+    for (int i = 0; i < 2 * SAMPLER_HALTON_DIMENSIONS; i++) {
+        double x = a.get1D();
+        EXPECT_EQ(x, b.get1D());
+        EXPECT_GE(x, 0.0);
+        EXPECT_LT(x, 1.0);
+    }
+}
+
+TEST(SamplerTest, pixelsAndSeedsDiffer) {
+    Sampler a(7), b(7), c(8);
+    a.startSample(12, 34, 0);
+    b.startSample(34, 12, 0);
+    c.startSample(12, 34, 0);
+    double xa = a.get1D();
+    EXPECT_NE(xa, b.get1D());
+    EXPECT_NE(xa, c.get1D());
+}
+
+TEST(SamplerTest, pixelSamplesAreStratified) {
+    // The first 2^k samples of a pixel put exactly one value in each interval of width
+    // 2^-k in the first dimension, and one in each of 3^k in the second
+    Sampler s;
+    std::vector<int> bins2(64, 0), bins3(27, 0);
+    for (int i = 0; i < 64; i++) {
+        s.startSample(3, 4, i);
+        double u, v;
+        s.get2D(u, v);
+        bins2[(int)(u * 64)]++;
+        if ( i < 27 ) {
+            bins3[(int)(v * 27)]++;
+        }
+    }
+    for (int n : bins2) {
+        EXPECT_EQ(n, 1);
+    }
+    for (int n : bins3) {
+        EXPECT_EQ(n, 1);
+    }
+}
+
+TEST(SamplerTest, currentIsPerThread) {
+    Sampler::current().setSeed(99);
+    uint64_t other_seed = 0;
+    std::thread t([&]() { other_seed = Sampler::current().getSeed(); });
+    t.join();
+    EXPECT_EQ(Sampler::current().getSeed(), 99);
+    EXPECT_EQ(other_seed, DEFAULT_SAMPLER_SEED);
+    Sampler::current().setSeed(DEFAULT_SAMPLER_SEED);
+}
+
+TEST(SamplerTest, jitteredLightPointFollowsSample) {
+    Light light(Point(0,0,0), Vector(2,0,0), 4, Vector(0,0,1), 2, Color(1,1,1), true);
+    Sampler &s = Sampler::current();
+    s.startSample(1, 2, 3);
+    Point p1 = light.pointAt(2,1);
+    s.startSample(1, 2, 3);
+    Point p2 = light.pointAt(2,1);
+    EXPECT_EQ(p1, p2);
+    // Stays within its cell
+    EXPECT_GE(p1.x(), 1.0);
+    EXPECT_LT(p1.x(), 1.5);
+    EXPECT_GE(p1.z(), 0.5);
+    EXPECT_LT(p1.z(), 1.0);
+}
+
+// The points that shading is computed from are fixed when the light is made, so they
+// can't depend on whatever sample the thread's Sampler was on at the time
+TEST(SamplerTest, jitteredLightShadingPointsAreFixed) {
+    Sampler &s = Sampler::current();
+    s.startSample(1, 2, 3);
+    Light a(Point(0,0,0), Vector(2,0,0), 4, Vector(0,0,1), 2, Color(1,1,1), true);
+    s.startSample(4, 5, 6);
+    s.get1D();
+    Light b(Point(0,0,0), Vector(2,0,0), 4, Vector(0,0,1), 2, Color(1,1,1), true);
+    ASSERT_EQ(a.samplePoints.size(), 8);
+    for (size_t i = 0; i < a.samplePoints.size(); i++) {
+        EXPECT_EQ(a.samplePoints[i], b.samplePoints[i]);
+    }
+    EXPECT_EQ(a.samplePoints[6], Point(1.25, 0, 0.75));
+}
+
+TEST(SamplerTest, lensPointFollowsSample) {
+    Camera c(201, 101, M_PI/2);
+    c.setAperture(0.1);
+    Sampler &s = Sampler::current();
+    s.startSample(100, 50, 1);
+    Ray r1 = c.ray_for_pixel(100, 50);
+    s.startSample(100, 50, 1);
+    Ray r2 = c.ray_for_pixel(100, 50);
+    s.startSample(100, 50, 2);
+    Ray r3 = c.ray_for_pixel(100, 50);
+    EXPECT_EQ(r1.origin, r2.origin);
+    EXPECT_NE(r1.origin, r3.origin);
+    EXPECT_LE(std::fabs(r1.origin.x()), 0.1);
+    EXPECT_LE(std::fabs(r1.origin.y()), 0.1);
+}
@@ -2,6 +2,7 @@
 #include "World.h"
 #include "Camera.h"
 #include "Sphere.h"
+#include "Group.h"
 #include "util.h"
 #include <iostream>
 #include <memory>
@@ -30,6 +31,24 @@ TEST(SceneTest, intersectWorld) {
     }
 }
 
+TEST(SceneTest, intersectWorldClosest) {
+    World w;
+    w.make_default();
+
+    Intersection i;
+    EXPECT_TRUE(w.intersectClosest(Ray(Point(0,0,-5), Vector(0,0,1)), i));
+    EXPECT_EQ(i.t, 4);
+    EXPECT_EQ(i.obj, w.getShapes()[0].get());
+
+    // From inside both spheres, the closest hit is the inner sphere's far side
+    EXPECT_TRUE(w.intersectClosest(Ray(Point(0,0,0), Vector(0,0,1)), i));
+    EXPECT_EQ(i.t, 0.5);
+    EXPECT_EQ(i.obj, w.getShapes()[1].get());
+
+    EXPECT_FALSE(w.intersectClosest(Ray(Point(0,0,-5), Vector(0,1,0)), i));
+    EXPECT_TRUE(i.isEmpty());
+}
+
 TEST(SceneTest, precomputeIntersection) {
     Ray r(Point(0,0,-5) , Vector(0,0,1) );
     auto s = Sphere::make();
@@ -102,6 +121,24 @@ TEST(SceneTest, colorAtRayHit) {
     EXPECT_EQ(c, Color(0.38066,0.47583,0.2855));
 }
 
+TEST(SceneTest, colorAtFillsFirstHit) {
+    World w;
+    w.make_default();
+    Ray r(Point(0,0,-5), Vector(0,0,1));
+    Iset iset;
+    SurfaceInfo surface;
+    Color c = w.colorAt(r, iset, REFLECTION_RECURSION_LIMIT, &surface);
+    EXPECT_EQ(c, Color(0.38066,0.47583,0.2855));
+    EXPECT_DOUBLE_EQ(surface.depth, 4.0);
+    EXPECT_EQ(surface.normal, Vector(0,0,-1));
+    EXPECT_EQ(surface.albedo, Color(0.8,1.0,0.6));
+
+    Ray miss(Point(0,0,-5), Vector(0,1,0));
+    w.colorAt(miss, iset, REFLECTION_RECURSION_LIMIT, &surface);
+    EXPECT_EQ(surface.depth, 0.0);
+    EXPECT_EQ(surface.normal, Vector(0,0,0));
+}
+
 TEST(SceneTest, colorAtRayHitInside) {
     World w;
     w.make_default();
@@ -233,7 +270,6 @@ TEST(SceneTest, isShadowedTestsOcclusionBetweenTwoPoints) {
     World w;
     w.make_default();
     Point lightpos = Point(-10, -10, -10);
-    Iset iset;
     std::vector<bool> expected_results = { false, true, false, false };
     int i = 0;
     for ( auto p : {
@@ -241,14 +277,39 @@ TEST(SceneTest, isShadowedTestsOcclusionBetweenTwoPoints) {
                     Point(10, 10, 10),
                     Point(-20, -20, -20),
                     Point(-5, -5, -5) }) {
-        EXPECT_EQ( w.isShadowed(p, iset, lightpos), expected_results[i++]);
-        iset.clear();
+        EXPECT_EQ( w.isShadowed(p, lightpos), expected_results[i++]);
     }
 
 
 }
 
 
+TEST(SceneTest, occludedStopsAtMaxT) {
+    World w;
+    auto s = Sphere::make();
+    s->setTransform(Matrix::translation(0,0,5));
+    w.addShape(s);
+    Ray r = Ray(Point(0,0,0), Vector(0,0,1));
+    EXPECT_TRUE(w.occluded(r, 10));
+    EXPECT_FALSE(w.occluded(r, 3));
+}
+
+TEST(SceneTest, occludedIgnoresShapesThatCastNoShadow) {
+    World w;
+    auto s = Sphere::make();
+    s->setTransform(Matrix::translation(0,0,5));
+    s->castsShadow(false);
+    auto g = Group::make();
+    auto s2 = Sphere::make();
+    s2->setTransform(Matrix::translation(0,0,-5));
+    g->addChild(s2);
+    g->castsShadow(false);
+    w.addShape(s);
+    w.addShape(g);
+    EXPECT_FALSE(w.occluded(Ray(Point(0,0,0), Vector(0,0,1)), 10));
+    EXPECT_FALSE(w.occluded(Ray(Point(0,0,0), Vector(0,0,-1)), 10));
+}
+
 TEST(SceneTest, shadeHitInShadow) {
     World w;
     w.addLight(Light(Point(0,0,-10), Color(1,1,1)));
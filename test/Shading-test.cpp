@@ -73,12 +73,12 @@ TEST(ShadingTest, phongReflection) {
     Vector normalv = Vector(0,0,-1);
     Light light = Light(Point(0,0,-10), Color(1,1,1));
     //EXPECT_EQ( m.lighting(obj, light, pos, eyev, normalv, false), Color(1.9,1.9,1.9));
-    EXPECT_EQ( m.lighting(obj, light, pos, eyev, normalv, 1.0), Color(1.9,1.9,1.9));
+    EXPECT_EQ( m.lighting(obj.get(), light, pos, eyev, normalv, 1.0), Color(1.9,1.9,1.9));
 
     // Eye is 45 degrees off normal. Specular value goes to zero
     eyev = Vector(0, sqrt(2)/2, -sqrt(2)/2);
     //EXPECT_EQ( m.lighting(obj, light, pos, eyev, normalv, false), Color(1,1,1));
-    EXPECT_EQ( m.lighting(obj, light, pos, eyev, normalv, 1.0), Color(1,1,1));
+    EXPECT_EQ( m.lighting(obj.get(), light, pos, eyev, normalv, 1.0), Color(1,1,1));
 
     // Move eye back to directly in front of surface,
     // but move light source up 10 units such that it is 45 degrees
@@ -86,19 +86,19 @@ TEST(ShadingTest, phongReflection) {
     eyev = Vector(0,0,-1);
     light = Light(Point(0,10,-10), Color(1,1,1));
     //EXPECT_EQ( m.lighting(obj, light, pos, eyev, normalv, false), Color(0.7364, 0.7364, 0.7364));
-    EXPECT_EQ( m.lighting(obj, light, pos, eyev, normalv, 1.0), Color(0.7364, 0.7364, 0.7364));
+    EXPECT_EQ( m.lighting(obj.get(), light, pos, eyev, normalv, 1.0), Color(0.7364, 0.7364, 0.7364));
 
     // Move eye directly in line with the reflection vector.
     // Specular component at full strength
     eyev = Vector(0, -sqrt(2)/2, -sqrt(2)/2);
     //EXPECT_EQ( m.lighting(obj, light, pos, eyev, normalv, false), Color(1.6364, 1.6364, 1.6364));
-    EXPECT_EQ( m.lighting(obj, light, pos, eyev, normalv, 1.0), Color(1.6364, 1.6364, 1.6364));
+    EXPECT_EQ( m.lighting(obj.get(), light, pos, eyev, normalv, 1.0), Color(1.6364, 1.6364, 1.6364));
 
     // Put light behind the surface entirely. Ambient is only remaining component
     eyev = Vector(0,0,-1);
     light = Light(Point(0,0,10), Color(1,1,1));
     //EXPECT_EQ( m.lighting(obj, light, pos, eyev, normalv, false), Color(0.1,0.1,0.1));
-    EXPECT_EQ( m.lighting(obj, light, pos, eyev, normalv, 1.0), Color(0.1,0.1,0.1));
+    EXPECT_EQ( m.lighting(obj.get(), light, pos, eyev, normalv, 1.0), Color(0.1,0.1,0.1));
 }
 
 TEST(ShadingTest, lightingInShadow) {
@@ -112,7 +112,7 @@ TEST(ShadingTest, lightingInShadow) {
     Light light = Light(Point(0,0,-10), Color(1,1,1));
     //bool in_shadow = true;
     double in_shadow = 0.0;
-    Color result = m.lighting(obj, light, pos, eyev, normalv, in_shadow);
+    Color result = m.lighting(obj.get(), light, pos, eyev, normalv, in_shadow);
     EXPECT_EQ(result, Color(0.1,0.1,0.1));
 }
 
@@ -130,9 +130,9 @@ TEST(ShadingTest, lightingUsesLightIntensityToAttenuateColor) {
     Vector eyev = Vector(0,0,-1);
     Vector normalv = Vector(0,0,-1);
 
-    Color result10 = m.lighting(s, w.getLights()[0], pt, eyev, normalv, 1.0);
-    Color result05 = m.lighting(s, w.getLights()[0], pt, eyev, normalv, 0.5);
-    Color result00 = m.lighting(s, w.getLights()[0], pt, eyev, normalv, 0.0);
+    Color result10 = m.lighting(s.get(), w.getLights()[0], pt, eyev, normalv, 1.0);
+    Color result05 = m.lighting(s.get(), w.getLights()[0], pt, eyev, normalv, 0.5);
+    Color result00 = m.lighting(s.get(), w.getLights()[0], pt, eyev, normalv, 0.0);
     EXPECT_EQ(result10, Color(1,1,1));
     EXPECT_EQ(result05, Color(0.55,0.55,0.55));
     EXPECT_EQ(result00, Color(0.1,0.1,0.1));
@@ -0,0 +1,77 @@
+#include "gtest/gtest.h"
+#include "Simd.h"
+
+// The kernels are checked against the straightforward scalar expressions, whichever
+// instruction set this build picked. Inputs are exactly representable so that the
+// results compare equal regardless of evaluation order.
+
+TEST(SimdTest, elementwise) {
+    double a[4] = {1, -2, 3.5, 1};
+    double b[4] = {0.5, 4, -2, 0};
+    double out[4];
+
+    simd_add4(a, b, out);
+    EXPECT_EQ(out[0], 1.5); EXPECT_EQ(out[1], 2); EXPECT_EQ(out[2], 1.5); EXPECT_EQ(out[3], 1);
+    simd_sub4(a, b, out);
+    EXPECT_EQ(out[0], 0.5); EXPECT_EQ(out[1], -6); EXPECT_EQ(out[2], 5.5); EXPECT_EQ(out[3], 1);
+    simd_mul4(a, b, out);
+    EXPECT_EQ(out[0], 0.5); EXPECT_EQ(out[1], -8); EXPECT_EQ(out[2], -7); EXPECT_EQ(out[3], 0);
+    simd_scale4(a, 2, out);
+    EXPECT_EQ(out[0], 2); EXPECT_EQ(out[1], -4); EXPECT_EQ(out[2], 7); EXPECT_EQ(out[3], 2);
+    simd_div4(b, a, out);
+    EXPECT_EQ(out[0], 0.5); EXPECT_EQ(out[1], -2); EXPECT_EQ(out[2], -2.0/3.5); EXPECT_EQ(out[3], 0);
+}
+
+TEST(SimdTest, dotAndCross) {
+    double a[4] = {1, 2, 3, 0};
+    double b[4] = {2, 3, 4, 0};
+    EXPECT_EQ(simd_dot4(a, b), 20);
+
+    double out[4] = {9, 9, 9, 9};
+    simd_cross3(a, b, out);
+    EXPECT_EQ(out[0], -1); EXPECT_EQ(out[1], 2); EXPECT_EQ(out[2], -1); EXPECT_EQ(out[3], 0);
+}
+
+TEST(SimdTest, outputMayAliasInput) {
+    double a[4] = {1, 2, 3, 1};
+    simd_add4(a, a, a);
+    EXPECT_EQ(a[0], 2); EXPECT_EQ(a[1], 4); EXPECT_EQ(a[2], 6); EXPECT_EQ(a[3], 2);
+
+    // Column-major identity with a translation of (5,6,7)
+    double m[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, 5,6,7,1};
+    double t[4] = {1, 2, 3, 1};
+    simd_mat4_mul_tuple(m, t, t);
+    EXPECT_EQ(t[0], 6); EXPECT_EQ(t[1], 8); EXPECT_EQ(t[2], 10); EXPECT_EQ(t[3], 1);
+}
+
+TEST(SimdTest, matrixTimesTuple) {
+    // Row-major {1,2,3,4, 2,4,4,2, 8,6,4,1, 0,0,0,1}, stored column-major
+    double m[16] = {1,2,8,0, 2,4,6,0, 3,4,4,0, 4,2,1,1};
+    double t[4] = {1, 2, 3, 1};
+    double out[4];
+    simd_mat4_mul_tuple(m, t, out);
+    EXPECT_EQ(out[0], 18); EXPECT_EQ(out[1], 24); EXPECT_EQ(out[2], 33); EXPECT_EQ(out[3], 1);
+
+    simd_mat4_mul_xyz(m, t, true, out);
+    EXPECT_EQ(out[0], 18); EXPECT_EQ(out[1], 24); EXPECT_EQ(out[2], 33);
+    simd_mat4_mul_xyz(m, t, false, out);
+    EXPECT_EQ(out[0], 14); EXPECT_EQ(out[1], 22); EXPECT_EQ(out[2], 32);
+}
+
+TEST(SimdTest, matrixTimesMatrix) {
+    double a[16], b[16], c[16];
+    for (int i = 0; i < 16; i++) {
+        a[i] = i + 1;
+        b[i] = (i % 5) - 2;
+    }
+    simd_mat4_mul(a, b, c);
+    for (int r = 0; r < 4; r++) {
+        for (int col = 0; col < 4; col++) {
+            double expected = 0;
+            for (int k = 0; k < 4; k++) {
+                expected += a[4*k + r] * b[4*col + k];
+            }
+            EXPECT_EQ(c[4*col + r], expected);
+        }
+    }
+}
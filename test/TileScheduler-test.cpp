@@ -0,0 +1,46 @@
+#include "gtest/gtest.h"
+#include "TileScheduler.h"
+#include <vector>
+
+TEST(TileSchedulerTest, tilesCoverImageExactlyOnce) {
+    size_t w = 70, h = 45;
+    TileScheduler sched(w, h, 16, 3);
+    EXPECT_EQ(sched.tileCount(), 5*3);
+
+    std::vector<int> covered(w*h, 0);
+    Tile t;
+    size_t count = 0;
+    while ( sched.next(0, t) ) {
+        for (size_t y = t.y0; y < t.y1; y++) {
+            for (size_t x = t.x0; x < t.x1; x++) {
+                covered[y*w + x]++;
+            }
+        }
+        count++;
+    }
+    EXPECT_EQ(count, sched.tileCount());
+    for (auto c : covered) {
+        EXPECT_EQ(c, 1);
+    }
+}
+
+TEST(TileSchedulerTest, threadStealsOnceOwnQueueIsEmpty) {
+    TileScheduler sched(64, 64, 32, 2); // 4 tiles, 2 per queue
+    Tile t;
+    bool stolen;
+    EXPECT_TRUE(sched.next(0, t, stolen));
+    EXPECT_FALSE(stolen);
+    EXPECT_TRUE(sched.next(0, t, stolen));
+    EXPECT_FALSE(stolen);
+    // Thread 0 has exhausted its own queue, so now it takes thread 1's last tile
+    EXPECT_TRUE(sched.next(0, t, stolen));
+    EXPECT_TRUE(stolen);
+    EXPECT_EQ(t.x0, 32);
+    EXPECT_EQ(t.y0, 32);
+    // Thread 1 still gets the front of its own queue
+    EXPECT_TRUE(sched.next(1, t, stolen));
+    EXPECT_FALSE(stolen);
+    EXPECT_EQ(t.x0, 0);
+    EXPECT_EQ(t.y0, 32);
+    EXPECT_FALSE(sched.next(1, t, stolen));
+}
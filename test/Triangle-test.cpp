@@ -2,8 +2,16 @@
 #include "Ray.h"
 #include "Triangle.h"
 #include "ObjParser.h"
+#include "TriangleMesh.h"
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <sstream>
+#include <string>
+
+#ifndef JRAY_SCENES_DIR
+#define JRAY_SCENES_DIR "../scenes"
+#endif
 
 TEST(TriangleTest, constructTriangle) {
     Point p1 = Point(0,1,0);
@@ -98,12 +106,14 @@ TEST(TriangleTest, objTriangleData) {
     )EOF";
     std::istringstream iss(testfile);
     ObjParser parser = ObjParser(iss);
-    EXPECT_EQ(std::static_pointer_cast<Triangle>(parser.obj->getChildren()[0])->p1, parser.vertices[0]);
-    EXPECT_EQ(std::static_pointer_cast<Triangle>(parser.obj->getChildren()[0])->p2, parser.vertices[1]);
-    EXPECT_EQ(std::static_pointer_cast<Triangle>(parser.obj->getChildren()[0])->p3, parser.vertices[2]);
-    EXPECT_EQ(std::static_pointer_cast<Triangle>(parser.obj->getChildren()[1])->p1, parser.vertices[0]);
-    EXPECT_EQ(std::static_pointer_cast<Triangle>(parser.obj->getChildren()[1])->p2, parser.vertices[2]);
-    EXPECT_EQ(std::static_pointer_cast<Triangle>(parser.obj->getChildren()[1])->p3, parser.vertices[3]);
+    ASSERT_EQ(parser.obj->getChildren().size(), 1);
+    auto mesh = std::static_pointer_cast<TriangleMesh>(parser.obj->getChildren()[0]);
+    EXPECT_EQ(mesh->corner(0, 0), parser.vertices[0]);
+    EXPECT_EQ(mesh->corner(0, 1), parser.vertices[1]);
+    EXPECT_EQ(mesh->corner(0, 2), parser.vertices[2]);
+    EXPECT_EQ(mesh->corner(1, 0), parser.vertices[0]);
+    EXPECT_EQ(mesh->corner(1, 1), parser.vertices[2]);
+    EXPECT_EQ(mesh->corner(1, 2), parser.vertices[3]);
 }
 
 TEST(TriangleTest, objPolygonData) {
@@ -118,13 +128,167 @@ TEST(TriangleTest, objPolygonData) {
     )EOF";
     std::istringstream iss(testfile);
     ObjParser parser = ObjParser(iss);
-    EXPECT_EQ(std::static_pointer_cast<Triangle>(parser.obj->getChildren()[0])->p1, parser.vertices[0]);
-    EXPECT_EQ(std::static_pointer_cast<Triangle>(parser.obj->getChildren()[0])->p2, parser.vertices[1]);
-    EXPECT_EQ(std::static_pointer_cast<Triangle>(parser.obj->getChildren()[0])->p3, parser.vertices[2]);
-    EXPECT_EQ(std::static_pointer_cast<Triangle>(parser.obj->getChildren()[1])->p1, parser.vertices[0]);
-    EXPECT_EQ(std::static_pointer_cast<Triangle>(parser.obj->getChildren()[1])->p2, parser.vertices[2]);
-    EXPECT_EQ(std::static_pointer_cast<Triangle>(parser.obj->getChildren()[1])->p3, parser.vertices[3]);
-    EXPECT_EQ(std::static_pointer_cast<Triangle>(parser.obj->getChildren()[2])->p1, parser.vertices[0]);
-    EXPECT_EQ(std::static_pointer_cast<Triangle>(parser.obj->getChildren()[2])->p2, parser.vertices[3]);
-    EXPECT_EQ(std::static_pointer_cast<Triangle>(parser.obj->getChildren()[2])->p3, parser.vertices[4]);
-}
\ No newline at end of file
+    ASSERT_EQ(parser.obj->getChildren().size(), 1);
+    auto mesh = std::static_pointer_cast<TriangleMesh>(parser.obj->getChildren()[0]);
+    EXPECT_EQ(mesh->corner(0, 0), parser.vertices[0]);
+    EXPECT_EQ(mesh->corner(0, 1), parser.vertices[1]);
+    EXPECT_EQ(mesh->corner(0, 2), parser.vertices[2]);
+    EXPECT_EQ(mesh->corner(1, 0), parser.vertices[0]);
+    EXPECT_EQ(mesh->corner(1, 1), parser.vertices[2]);
+    EXPECT_EQ(mesh->corner(1, 2), parser.vertices[3]);
+    EXPECT_EQ(mesh->corner(2, 0), parser.vertices[0]);
+    EXPECT_EQ(mesh->corner(2, 1), parser.vertices[3]);
+    EXPECT_EQ(mesh->corner(2, 2), parser.vertices[4]);
+}
+TEST(TriangleTest, objFaceFormats) {
+    std::string testfile =
+    "v -1 1 0\r\n"
+    "v -1 0 0\r\n"
+    "v 1 0 0\r\n"
+    "v 1 1 0\r\n"
+    "vt 0 0\n"
+    "vn 0 0 1\n"
+    "vn 0 0.1 1\n"
+    "vn 0.1 0 1\n"
+    "f 1/1 2/1 3/1\n"
+    "f 1//1 3//2 4//3\n"
+    "f 1/1/3 2/1/2 3/1/1\n"
+    "f -4//-3 -2//-2 -1//-1\n"
+    "f 1 2 9\n"            // a corner that doesn't exist leaves too few
+    "f 1//1 2//7 4//3\n"   // one normal that doesn't exist drops them all
+    "f\t1  2\t4 # comment\n"
+    "f 1 2";                 // no newline at the end
+    std::istringstream iss(testfile);
+    ObjParser parser = ObjParser(iss);
+    ASSERT_EQ(parser.vertices.size(), 4);
+    ASSERT_EQ(parser.normals.size(), 3);
+    ASSERT_EQ(parser.obj->getChildren().size(), 1);
+    auto mesh = std::static_pointer_cast<TriangleMesh>(parser.obj->getChildren()[0]);
+    ASSERT_EQ(mesh->faceCount(), 6);
+
+    auto faceAt = [&](uint32_t v0, uint32_t v1, uint32_t v2) -> const MeshFace* {
+        for (size_t i = 0; i < mesh->faceCount(); i++) {
+            const MeshFace &f = mesh->face(i);
+            if ( f.v[0] == v0 && f.v[1] == v1 && f.v[2] == v2 ) {
+                return &f;
+            }
+        }
+        return nullptr;
+    };
+    const MeshFace *f = faceAt(0, 1, 2);
+    ASSERT_TRUE(f);
+    EXPECT_EQ(f->n[0], TriangleMesh::NO_NORMAL);
+    f = faceAt(0, 2, 3);
+    ASSERT_TRUE(f);
+    EXPECT_EQ(f->n[0], 0);
+    EXPECT_EQ(f->n[1], 1);
+    EXPECT_EQ(f->n[2], 2);
+    f = faceAt(0, 1, 3);
+    ASSERT_TRUE(f);
+    EXPECT_EQ(f->n[0], TriangleMesh::NO_NORMAL);
+    // v/t/n and negative indices both find their normals
+    size_t smooth = 0;
+    for (size_t i = 0; i < mesh->faceCount(); i++) {
+        smooth += ( mesh->face(i).n[0] != TriangleMesh::NO_NORMAL );
+    }
+    EXPECT_EQ(smooth, 3);
+}
+
+// Every vertex must come out exactly as a stream reads it
+TEST(TriangleTest, objNumbersMatchStream) {
+    std::string numbers[] = { "0", "-0.5", "+2.25", "1e3", "-1.5E-4", "0.000123456789", ".75", "5.",
+                              "3.14159265358979323846", "123456789012345678901234", "1e-30", "2.5e+25" };
+    std::string testfile;
+    for (const auto &n : numbers) {
+        testfile += "v " + n + " " + n + " " + n + "\n";
+    }
+    std::istringstream iss(testfile);
+    ObjParser parser = ObjParser(iss);
+    ASSERT_EQ(parser.vertices.size(), sizeof(numbers) / sizeof(numbers[0]));
+    for (size_t i = 0; i < parser.vertices.size(); i++) {
+        std::istringstream ref(numbers[i]);
+        double expected;
+        ref >> expected;
+        EXPECT_EQ(parser.vertices[i].x(), expected) << numbers[i];
+        EXPECT_EQ(parser.vertices[i].z(), expected) << numbers[i];
+    }
+}
+
+TEST(TriangleTest, objFileMatchesStream) {
+    std::string filename = std::string(JRAY_SCENES_DIR) + "/dragon.obj";
+    ObjParser parser(filename);
+
+    std::ifstream file(filename);
+    std::string line;
+    size_t v = 0;
+    while ( std::getline(file, line) ) {
+        std::istringstream ls(line);
+        std::string cmd;
+        Point p;
+        if ( ls >> cmd && cmd == "v" && ls >> p ) {
+            ASSERT_LT(v, parser.vertices.size());
+            ASSERT_EQ(parser.vertices[v], p);
+            ASSERT_EQ(parser.vertices[v].x(), p.x());
+            v++;
+        }
+    }
+    EXPECT_EQ(v, parser.vertices.size());
+    EXPECT_GT(v, 10000);
+}
+
+// Negative indices that reach back into earlier chunks, and groups (some empty) that
+// straddle chunk boundaries, must come out as they do on one thread
+TEST(TriangleTest, objChunksMatchOneThread) {
+    std::ostringstream os;
+    for (int i = 0; i < 400; i++) {
+        os << "v " << i * 0.5 << " " << (i % 7) * 0.25 << " " << -i << "\n";
+        if ( i % 3 == 0 ) {
+            os << "vn 0 " << 1 + (i % 5) << " 1\n";
+        }
+        if ( i >= 3 && i % 2 == 0 ) {
+            os << "f -1//-1 -3//-2 " << i / 2 << "//1\n";
+        }
+        if ( i >= 3 && i % 5 == 0 ) {
+            os << "f " << i - 2 << " " << i << " -2 -30\n";
+        }
+        if ( i % 37 == 0 ) {
+            os << "g group" << i << "\n";
+        }
+        if ( i % 101 == 0 ) {
+            os << "g empty\n";
+        }
+    }
+    std::string text = os.str();
+
+    std::istringstream iss(text);
+    ObjParser ref(iss, BVHMethod::none, 4, MeshPrecision::double_precision, 2, 1);
+    for (size_t threads : { 2, 3, 7, 64 }) {
+        std::istringstream iss(text);
+        ObjParser parser(iss, BVHMethod::none, 4, MeshPrecision::double_precision, 2, threads);
+        ASSERT_EQ(parser.vertices.size(), ref.vertices.size());
+        ASSERT_EQ(parser.normals.size(), ref.normals.size());
+        for (size_t i = 0; i < ref.vertices.size(); i++) {
+            ASSERT_EQ(parser.vertices[i], ref.vertices[i]);
+        }
+        auto groups = parser.obj->getChildren();
+        auto ref_groups = ref.obj->getChildren();
+        ASSERT_EQ(groups.size(), ref_groups.size());
+        for (size_t g = 0; g < groups.size(); g++) {
+            auto meshes = std::static_pointer_cast<Group>(groups[g])->getChildren();
+            auto ref_meshes = std::static_pointer_cast<Group>(ref_groups[g])->getChildren();
+            ASSERT_EQ(meshes.size(), ref_meshes.size()) << "group " << g;
+            if ( meshes.empty() ) {
+                continue;
+            }
+            auto mesh = std::static_pointer_cast<TriangleMesh>(meshes[0]);
+            auto ref_mesh = std::static_pointer_cast<TriangleMesh>(ref_meshes[0]);
+            ASSERT_EQ(mesh->faceCount(), ref_mesh->faceCount());
+            for (size_t f = 0; f < mesh->faceCount(); f++) {
+                for (int c = 0; c < 3; c++) {
+                    EXPECT_EQ(mesh->face(f).v[c], ref_mesh->face(f).v[c]);
+                    EXPECT_EQ(mesh->face(f).n[c], ref_mesh->face(f).n[c]);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,373 @@
+#include "gtest/gtest.h"
+#include "Ray.h"
+#include "Triangle.h"
+#include "TriangleMesh.h"
+#include "Group.h"
+#include "ObjParser.h"
+#include "SceneConfig.h"
+#include "World.h"
+#include "Camera.h"
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <unistd.h>
+
+#ifndef JRAY_SCENES_DIR
+#define JRAY_SCENES_DIR "../scenes"
+#endif
+
+// A bumpy n x n height field, as a mesh and as a Group of the equivalent Triangles
+template <typename Mesh>
+struct MeshFixture {
+    std::shared_ptr<Mesh> mesh;
+    std::shared_ptr<Group> triangles;
+};
+
+template <typename Mesh = TriangleMesh>
+static MeshFixture<Mesh> makeHeightField(int n, bool smooth, const Vector &offset = Vector(0,0,0),
+                                         size_t bvh_width = DEFAULT_BVH_WIDTH,
+                                         BVHMethod bvh_method = BVHMethod::sah)
+{
+    auto vertices = std::make_shared<std::vector<Point>>();
+    auto normals = std::make_shared<std::vector<Vector>>();
+    for (int j = 0; j <= n; j++) {
+        for (int i = 0; i <= n; i++) {
+            double x = -2 + 4.0 * i / n;
+            double z = -2 + 4.0 * j / n;
+            vertices->push_back(Point(x, 0.3 * sin(2*x) * cos(3*z), z) + offset);
+            normals->push_back(normalize(Vector(-0.6 * cos(2*x) * cos(3*z), 1, 0.9 * sin(2*x) * sin(3*z))));
+        }
+    }
+
+    std::vector<TriangleMesh::Face> faces;
+    auto triangles = Group::make();
+    auto addFace = [&](uint32_t a, uint32_t b, uint32_t c) {
+        const auto &V = *vertices;
+        const auto &N = *normals;
+        TriangleMesh::Face f = { { a, b, c }, { a, b, c } };
+        if ( smooth ) {
+            triangles->addChild(Triangle::make(V[a], V[b], V[c], N[a], N[b], N[c]));
+        } else {
+            f.n[0] = TriangleMesh::NO_NORMAL;
+            triangles->addChild(Triangle::make(V[a], V[b], V[c]));
+        }
+        faces.push_back(f);
+    };
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            uint32_t v00 = j * (n+1) + i;
+            uint32_t v10 = v00 + 1;
+            uint32_t v01 = v00 + (n+1);
+            uint32_t v11 = v01 + 1;
+            addFace(v00, v10, v11);
+            addFace(v00, v11, v01);
+        }
+    }
+
+    MeshFixture<Mesh> fx;
+    fx.mesh = Mesh::make(vertices, normals, faces, 4, bvh_width, bvh_method);
+    fx.triangles = triangles;
+    return fx;
+}
+
+static std::vector<Ray> makeTestRays(const Vector &offset = Vector(0,0,0))
+{
+    std::vector<Ray> rays;
+    for (int i = 0; i < 300; i++) {
+        Point o = Point(-2.5 + 0.017 * i, 3, -2.5 + 0.013 * ((i * 7) % 300)) + offset;
+        Vector d = normalize(Vector(0.1 * ((i % 5) - 2), -1, 0.07 * ((i % 3) - 1)));
+        rays.push_back(Ray(o, d));
+        rays.push_back(Ray(Point(o.x(), -3, o.z()), Vector(-d.x(), -d.y(), -d.z())));
+    }
+    rays.push_back(Ray(Point(-5, 0, 0.3) + offset, Vector(1, 0, 0))); // grazes along the surface
+    rays.push_back(Ray(Point(0, 5, 0) + offset, Vector(1, 0, 0)));    // misses the bounds entirely
+    return rays;
+}
+
+static void expectMeshMatchesTriangles(bool smooth)
+{
+    MeshFixture<TriangleMesh> fx = makeHeightField(24, smooth);
+    EXPECT_EQ(fx.mesh->faceCount(), 24 * 24 * 2);
+
+    for (const auto &r : makeTestRays()) {
+        Iset xs, ref_xs;
+        fx.mesh->intersect(r, xs);
+        fx.triangles->intersect(r, ref_xs);
+        ASSERT_EQ(xs.size(), ref_xs.size());
+        auto it = ref_xs.begin();
+        for (const auto &x : xs) {
+            EXPECT_NEAR(x.t, it->t, 1e-12);
+            EXPECT_EQ(x.obj, fx.mesh.get());
+            ++it;
+        }
+
+        Intersection closest(std::numeric_limits<double>::infinity(), nullptr);
+        Intersection ref_closest(std::numeric_limits<double>::infinity(), nullptr);
+        bool hit = fx.mesh->intersectClosest(r, closest);
+        ASSERT_EQ(hit, fx.triangles->intersectClosest(r, ref_closest));
+        if ( hit ) {
+            EXPECT_NEAR(closest.t, ref_closest.t, 1e-12);
+            EXPECT_NEAR(closest.u, ref_closest.u, 1e-12);
+            EXPECT_NEAR(closest.v, ref_closest.v, 1e-12);
+            Icomps comps = closest.prepComps(r);
+            Icomps ref_comps = ref_closest.prepComps(r);
+            EXPECT_EQ(comps.normalv, ref_comps.normalv);
+        }
+
+        for (double max_t : { 1.0, 3.0, 50.0 }) {
+            EXPECT_EQ(fx.mesh->intersectAny(r, max_t), fx.triangles->intersectAny(r, max_t));
+        }
+    }
+}
+
+TEST(TriangleMeshTest, flatMeshMatchesTriangles) {
+    expectMeshMatchesTriangles(false);
+}
+
+TEST(TriangleMeshTest, smoothMeshMatchesTriangles) {
+    expectMeshMatchesTriangles(true);
+}
+
+TEST(TriangleMeshTest, wideBVHMatchesBinary) {
+    auto binary = makeHeightField(24, true, Vector(0,0,0), 2).mesh;
+    EXPECT_EQ(binary->bvhWidth(), 2u);
+    for (size_t width : { 4, 8 }) {
+        auto wide = makeHeightField(24, true, Vector(0,0,0), width).mesh;
+        EXPECT_EQ(wide->bvhWidth(), width);
+        EXPECT_LT(wide->nodeCount(), binary->nodeCount());
+        for (const auto &r : makeTestRays()) {
+            Intersection closest(std::numeric_limits<double>::infinity(), nullptr);
+            Intersection ref_closest(std::numeric_limits<double>::infinity(), nullptr);
+            ASSERT_EQ(wide->intersectClosest(r, closest), binary->intersectClosest(r, ref_closest));
+            EXPECT_EQ(closest.t, ref_closest.t);
+            for (double max_t : { 1.0, 3.0, 50.0 }) {
+                EXPECT_EQ(wide->intersectAny(r, max_t), binary->intersectAny(r, max_t));
+            }
+        }
+    }
+}
+
+// A Morton-ordered tree is laid out differently but must find the same hits
+TEST(TriangleMeshTest, lbvhMatchesSAH) {
+    for (size_t width : { 2, 4 }) {
+        auto sah = makeHeightField(24, true, Vector(0,0,0), width).mesh;
+        auto lbvh = makeHeightField(24, true, Vector(0,0,0), width, BVHMethod::lbvh).mesh;
+        EXPECT_EQ(lbvh->faceCount(), sah->faceCount());
+        for (const auto &r : makeTestRays()) {
+            Iset xs, ref_xs;
+            lbvh->intersect(r, xs);
+            sah->intersect(r, ref_xs);
+            EXPECT_EQ(xs.size(), ref_xs.size());
+            Intersection closest(std::numeric_limits<double>::infinity(), nullptr);
+            Intersection ref_closest(std::numeric_limits<double>::infinity(), nullptr);
+            ASSERT_EQ(lbvh->intersectClosest(r, closest), sah->intersectClosest(r, ref_closest));
+            EXPECT_EQ(closest.t, ref_closest.t);
+            for (double max_t : { 1.0, 3.0, 50.0 }) {
+                EXPECT_EQ(lbvh->intersectAny(r, max_t), sah->intersectAny(r, max_t));
+            }
+        }
+    }
+}
+
+TEST(TriangleMeshTest, smoothNormalUsesUV) {
+    auto vertices = std::make_shared<std::vector<Point>>(std::vector<Point>{
+        Point(0,1,0), Point(-1,0,0), Point(1,0,0) });
+    auto normals = std::make_shared<std::vector<Vector>>(std::vector<Vector>{
+        Vector(0,1,0), Vector(-1,0,0), Vector(1,0,0) });
+    auto mesh = TriangleMesh::make(vertices, normals, { { { 0, 1, 2 }, { 0, 1, 2 } } });
+
+    Intersection i(1, 0.45, 0.25, 0, mesh.get());
+    Vector n = mesh->normalAt(Point(0,0,0), &i);
+    EXPECT_EQ(n, Vector(-0.5547, 0.83205, 0));
+}
+
+TEST(TriangleMeshTest, emptyMesh) {
+    auto mesh = TriangleMesh::make(std::make_shared<std::vector<Point>>(),
+                                   std::make_shared<std::vector<Vector>>(), {});
+    Ray r(Point(0,0,-5), Vector(0,0,1));
+    Iset xs;
+    Intersection closest(std::numeric_limits<double>::infinity(), nullptr);
+    EXPECT_FALSE(mesh->intersect(r, xs));
+    EXPECT_FALSE(mesh->intersectClosest(r, closest));
+    EXPECT_FALSE(mesh->intersectAny(r, 10));
+    EXPECT_TRUE(mesh->bounds().isEmpty());
+}
+
+TEST(TriangleMeshTest, objGroupsBecomeMeshes) {
+    std::string testfile =
+    R"EOF(
+        v -1 1 0
+        v -1 0 0
+        v 1 0 0
+        v 1 1 0
+        vn 0 0 1
+        vn 0 0.1 1
+        vn 0.1 0 1
+        f 1 2 3
+        g FirstGroup
+        f 1//1 2//2 3//3
+        g SecondGroup
+        f 1 3 4
+        f 1 2 4
+    )EOF";
+    std::istringstream iss(testfile);
+    ObjParser parser = ObjParser(iss);
+    auto children = parser.obj->getChildren();
+    ASSERT_EQ(children.size(), 3);
+
+    auto root_mesh = std::dynamic_pointer_cast<TriangleMesh>(children[2]);
+    ASSERT_TRUE(root_mesh);
+    EXPECT_EQ(root_mesh->faceCount(), 1);
+    EXPECT_EQ(root_mesh->face(0).n[0], TriangleMesh::NO_NORMAL);
+
+    auto g1 = std::dynamic_pointer_cast<Group>(children[0]);
+    ASSERT_TRUE(g1);
+    ASSERT_EQ(g1->getChildren().size(), 1);
+    auto m1 = std::static_pointer_cast<TriangleMesh>(g1->getChildren()[0]);
+    EXPECT_EQ(m1->faceCount(), 1);
+    EXPECT_EQ(m1->face(0).n[0], 0);
+    EXPECT_EQ(m1->face(0).n[2], 2);
+
+    auto g2 = std::dynamic_pointer_cast<Group>(children[1]);
+    ASSERT_TRUE(g2);
+    auto m2 = std::static_pointer_cast<TriangleMesh>(g2->getChildren()[0]);
+    EXPECT_EQ(m2->faceCount(), 2);
+    EXPECT_EQ(m2->corner(1, 2), parser.vertices[3]);
+}
+
+// Far from the origin, a single precision Moller-Trumbore test is off by more than EPSILON
+TEST(TriangleMeshTest, floatMeshMatchesDoubleFarFromOrigin) {
+    Vector offset(1000, 500, -2000);
+    auto dbl = makeHeightField<TriangleMesh>(24, false, offset);
+    auto flt = makeHeightField<FloatTriangleMesh>(24, false, offset);
+
+    size_t hits = 0;
+    for (const auto &r : makeTestRays(offset)) {
+        Intersection closest(std::numeric_limits<double>::infinity(), nullptr);
+        Intersection ref_closest(std::numeric_limits<double>::infinity(), nullptr);
+        bool hit = flt.mesh->intersectClosest(r, closest);
+        ASSERT_EQ(hit, dbl.mesh->intersectClosest(r, ref_closest));
+        if ( !hit ) {
+            continue;
+        }
+        hits++;
+        // Rounding the vertices to float moves them by up to 6e-5 out here
+        EXPECT_NEAR(closest.t, ref_closest.t, 3e-4);
+
+        // The over point must be on the ray's side of the face that was hit, or shading
+        // would shadow the surface with itself
+        Icomps comps = closest.prepComps(r);
+        Point p1 = flt.mesh->corner(closest.face, 0);
+        const Vector &n = comps.normalv;
+        EXPECT_GT(dot(comps.over_point - p1, n), EPSILON / 2);
+        EXPECT_LT(dot(comps.under_point - p1, n), -EPSILON / 2);
+        EXPECT_FALSE(flt.mesh->intersectAny(Ray(comps.over_point, n), 1e-3));
+    }
+    EXPECT_GT(hits, 100);
+}
+
+// A ray leaving the surface from just above it, far closer than the single precision
+// error out here, must not find the face it leaves: hits are only accepted once their
+// refined t is in range
+TEST(TriangleMeshTest, floatMeshRaysDoNotHitTheFaceTheyLeave) {
+    Vector offset(1000, 500, -2000);
+    auto flt = makeHeightField<FloatTriangleMesh>(24, false, offset);
+
+    size_t hits = 0;
+    for (const auto &r : makeTestRays(offset)) {
+        Intersection closest(std::numeric_limits<double>::infinity(), nullptr);
+        if ( !flt.mesh->intersectClosest(r, closest) ) {
+            continue;
+        }
+        hits++;
+        Icomps comps = closest.prepComps(r);
+        Ray leaving(comps.point + comps.normalv * 1e-10, comps.normalv);
+        EXPECT_FALSE(flt.mesh->intersectAny(leaving, 1e-3));
+        Intersection again(std::numeric_limits<double>::infinity(), nullptr);
+        if ( flt.mesh->intersectClosest(leaving, again) ) {
+            EXPECT_GT(again.t, 1e-3);
+        }
+        Intersection bounded(1e-3, nullptr);
+        EXPECT_FALSE(flt.mesh->intersectClosest(leaving, bounded));
+    }
+    EXPECT_GT(hits, 100);
+}
+
+// Renders scenes/scene.yaml at 160x90, with the dragon's vertices in the given precision.
+// The car model isn't distributed with jray, so objs whose file is missing are left out,
+// and the area light isn't jittered so that the two renders see the same shadow rays.
+static std::vector<Color> renderScene(const std::string &precision, size_t &mesh_pixels)
+{
+    char cwd[4096];
+    EXPECT_TRUE(getcwd(cwd, sizeof(cwd)) != nullptr);
+    EXPECT_EQ(chdir(JRAY_SCENES_DIR), 0);
+
+    YAML::Node scene;
+    for (auto node : YAML::LoadFile("scene.yaml")) {
+        std::string add = node["add"] ? node["add"].as<std::string>() : "";
+        std::string define = node["define"] ? node["define"].as<std::string>() : "";
+        if ( add == "obj" && !std::ifstream(node["file"].as<std::string>()) ) {
+            continue;
+        }
+        if ( add == "camera" ) {
+            node["width"] = 160;
+            node["height"] = 90;
+        }
+        if ( add == "light" ) {
+            node["jitter"] = false;
+        }
+        if ( define == "dragon" ) {
+            node["value"]["mesh-precision"] = precision;
+            node["value"]["cache"] = false; // nothing is written to the source tree
+        }
+        if ( add == "obj" ) {
+            node["cache"] = false;
+        }
+        scene.push_back(node);
+    }
+    SceneConfig config(scene);
+    EXPECT_EQ(chdir(cwd), 0);
+
+    World world = config.getWorld();
+    Camera camera = config.getCamera();
+    std::vector<Color> image;
+    Iset iset;
+    mesh_pixels = 0;
+    for (size_t y = 0; y < camera.vsize; y++) {
+        for (size_t x = 0; x < camera.hsize; x++) {
+            Ray r = camera.ray_for_pixel(x, y);
+            image.push_back(world.colorAt(r, iset));
+            Intersection hit;
+            if ( world.intersectClosest(r, hit) && dynamic_cast<const FloatTriangleMesh*>(hit.inner) ) {
+                mesh_pixels++;
+            }
+        }
+    }
+    return image;
+}
+
+TEST(TriangleMeshTest, floatSceneMatchesDoubleReference) {
+    size_t mesh_pixels, ref_mesh_pixels;
+    std::vector<Color> image = renderScene("single", mesh_pixels);
+    std::vector<Color> ref = renderScene("double", ref_mesh_pixels);
+    ASSERT_EQ(image.size(), ref.size());
+    EXPECT_GT(mesh_pixels, image.size() / 50); // the dragon is in view
+    EXPECT_EQ(ref_mesh_pixels, 0);
+
+    size_t differing = 0;
+    double total_diff = 0;
+    for (size_t i = 0; i < image.size(); i++) {
+        int diff = std::max({ std::abs(image[i].r() - ref[i].r()),
+                              std::abs(image[i].g() - ref[i].g()),
+                              std::abs(image[i].b() - ref[i].b()) });
+        if ( diff > 1 ) {
+            differing++;
+        }
+        total_diff += diff;
+    }
+    EXPECT_LE(differing, image.size() / 200);
+    EXPECT_LT(total_diff / image.size(), 0.1);
+}